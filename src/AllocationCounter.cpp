@@ -0,0 +1,38 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "AllocationCounter.h"
+
+#ifdef SHADOWS_COUNT_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+
+namespace {
+    /* Other threads load and simulate while the GL thread draws, only the
+       calling thread's allocations are interesting */
+    thread_local std::size_t allocationCount = 0;
+}
+
+void* operator new(std::size_t size) {
+    ++allocationCount;
+    if(void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+std::size_t AllocationCounter::count() { return allocationCount; }
+#else
+std::size_t AllocationCounter::count() { return 0; }
+#endif
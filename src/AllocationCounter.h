@@ -0,0 +1,36 @@
+#if !defined(ALLOCATIONCOUNTER_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define ALLOCATIONCOUNTER_H
+
+#include <cstddef>
+
+#include "configure.h"
+
+/**
+Counts heap allocations made through operator new, per thread. Only built
+in with SHADOWS_COUNT_ALLOCATIONS, which replaces the global operator new,
+otherwise @ref isEnabled() is false and the count stays at zero. Work a
+frame hands to a pool is in @ref ThreadPool::allocationCount(), add that
+to cover the whole frame.
+*/
+class AllocationCounter {
+public:
+    static constexpr bool isEnabled() {
+        #ifdef SHADOWS_COUNT_ALLOCATIONS
+        return true;
+        #else
+        return false;
+        #endif
+    }
+
+    /* Allocations made by the calling thread so far */
+    static std::size_t count();
+};
+
+#endif
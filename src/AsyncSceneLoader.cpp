@@ -0,0 +1,424 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "AsyncSceneLoader.h"
+
+#include <Corrade/Utility/Debug.h>
+#include <Corrade/Utility/Directory.h>
+#include <Magnum/Buffer.h>
+#include <Magnum/ImageView.h>
+#include <Magnum/PixelFormat.h>
+#include <Magnum/Texture.h>
+#include <Magnum/TextureFormat.h>
+#include <Magnum/Trade/MeshData3D.h>
+#include <Magnum/Trade/TextureData.h>
+#include <Magnum/Shaders/Phong.h>
+#include <Magnum/Math/Functions.h>
+
+#include "ShadowCasterShader.h"
+#include "TraceRecorder.h"
+
+#pragma warning (push)
+#pragma warning (disable : 4127)
+#include <Magnum/MeshTools/Interleave.h>
+#pragma warning (pop)
+#include <Magnum/MeshTools/CompressIndices.h>
+
+AsyncSceneLoader::AsyncSceneLoader(ViewerResourceManager& resourceManager, std::unique_ptr<Trade::AbstractImporter> importer, std::string sceneFilename, TextureCache& textureCache, ThreadPool& pool, const MeshOptimizer& meshOptimizer, const std::size_t uploadBudget):
+_resourceManager(resourceManager),
+_importer{std::move(importer)},
+_sceneFilename{std::move(sceneFilename)},
+_sceneHash{0},
+_meshOptimizer{meshOptimizer},
+_uploadBudget{uploadBudget},
+_textureCache(textureCache),
+_pool(pool),
+_cancelled{false},
+_remaining{0},
+_pendingJobs{0},
+_budget{nullptr},
+_uploadedTextureCount{0},
+_uploadedMeshCount{0}
+{}
+
+AsyncSceneLoader::AsyncSceneLoader(ViewerResourceManager& resourceManager, CompiledScene scene, TextureCache& textureCache, ThreadPool& pool, const std::size_t uploadBudget):
+_resourceManager(resourceManager),
+_sceneHash{0},
+_compiledScene{std::move(scene)},
+_uploadBudget{uploadBudget},
+_textureCache(textureCache),
+_pool(pool),
+_cancelled{false},
+_remaining{0},
+_pendingJobs{0},
+_budget{nullptr},
+_uploadedTextureCount{0},
+_uploadedMeshCount{0}
+{}
+
+AsyncSceneLoader::~AsyncSceneLoader() {
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        _cancelled = true;
+    }
+    _requestCondition.notify_all();
+    if(_thread.joinable()) _thread.join();
+    _pool.wait(_pendingJobs);
+}
+
+void AsyncSceneLoader::start() {
+    if(_compiledScene) {
+        _remaining = _compiledScene.textures().size() + _compiledScene.meshes().size();
+        _thread = std::thread{&AsyncSceneLoader::decodeCompiled, this};
+        return;
+    }
+
+    _remaining = _importer->textureCount() + _importer->mesh3DCount();
+    _thread = std::thread{&AsyncSceneLoader::decode, this};
+}
+
+void AsyncSceneLoader::request(const ResidentType type, const UnsignedInt id) {
+    ++_remaining;
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        _requests.emplace_back(type, id);
+    }
+    _requestCondition.notify_one();
+}
+
+void AsyncSceneLoader::skip() {
+    --_remaining;
+}
+
+void AsyncSceneLoader::serveRequests() {
+    for(;;) {
+        std::pair<ResidentType, UnsignedInt> request;
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _requestCondition.wait(lock, [this]{ return _cancelled || !_requests.empty(); });
+            if(_cancelled) return;
+            request = _requests.front();
+            _requests.pop_front();
+        }
+
+        if(_compiledScene) {
+            if(request.first == ResidentType::Texture) decodeCompiledTexture(request.second);
+            else decodeCompiledMesh(request.second);
+        } else {
+            if(request.first == ResidentType::Texture) decodeTexture(request.second);
+            else decodeMesh(request.second);
+        }
+    }
+}
+
+void AsyncSceneLoader::decode() {
+    PROFILE_THREAD_NAME("scene loader");
+
+    /* Hashing the scene file is a lot cheaper than decoding the images it
+       references */
+    _sceneHash = TextureCache::hash(Utility::Directory::read(_sceneFilename));
+
+    /* Textures first, they are usually the bigger part of the upload and
+       meshes show up with the fallback material in the meantime anyway */
+    {
+        PROFILE_ZONE("AsyncSceneLoader textures");
+        for(UnsignedInt i = 0; i != _importer->textureCount() && !_cancelled; ++i)
+            decodeTexture(i);
+    }
+    {
+        PROFILE_ZONE("AsyncSceneLoader meshes");
+        for(UnsignedInt i = 0; i != _importer->mesh3DCount() && !_cancelled; ++i)
+            decodeMesh(i);
+    }
+
+    serveRequests();
+}
+
+void AsyncSceneLoader::decodeTexture(const UnsignedInt id) {
+    PROFILE_ZONE("AsyncSceneLoader::decodeTexture");
+    std::optional<Trade::TextureData> textureData = _importer->texture(id);
+    if(!textureData || textureData->type() != Trade::TextureData::Type::Texture2D) {
+        Warning{} << "Cannot load texture" << id << Debug::nospace << ", skipping";
+        return skip();
+    }
+
+    std::shared_ptr<PendingTexture> texture{new PendingTexture};
+    texture->id = id;
+    texture->minificationFilter = textureData->minificationFilter();
+    texture->magnificationFilter = textureData->magnificationFilter();
+    texture->mipmapFilter = textureData->mipmapFilter();
+    texture->wrapping = textureData->wrapping().xy();
+
+    const UnsignedInt image = textureData->image();
+    const std::string name = _importer->image2DName(image);
+    const UnsignedLong key = TextureCache::imageKey(_sceneHash, image, name,
+        TextureCache::imageFile(Utility::Directory::path(_sceneFilename), name));
+
+    if((texture->cooked = _textureCache.open(key))) {
+        std::unique_lock<std::mutex> lock{_mutex};
+        _textures.emplace_back(new PendingTexture{std::move(*texture)});
+        return;
+    }
+
+    /* Another texture with the same image is being cooked, wait for that */
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        auto found = _cooking.find(key);
+        if(found != _cooking.end()) {
+            found->second.push_back(std::move(texture));
+            return;
+        }
+        _cooking.emplace(key, std::vector<std::shared_ptr<PendingTexture>>{});
+    }
+
+    /* Textures are decoded only on this thread, so nothing waits for the
+       image yet if it fails */
+    std::optional<Trade::ImageData2D> imageData = _importer->image2D(image);
+    if(!imageData || !TextureCache::isSupported(*imageData)) {
+        Warning{} << "Cannot load texture image" << image << Debug::nospace << ", skipping";
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _cooking.erase(key);
+        }
+        return skip();
+    }
+
+    /* Mip generation and compression run on the pool */
+    std::shared_ptr<Trade::ImageData2D> data = std::make_shared<Trade::ImageData2D>(std::move(*imageData));
+    _pool.submit(_pendingJobs, [this, key, texture, data]{
+        if(_cancelled) return;
+
+        PROFILE_ZONE("cook texture");
+        texture->cooked = _textureCache.cook(key, *data);
+
+        std::vector<std::shared_ptr<PendingTexture>> waiting;
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            waiting = std::move(_cooking[key]);
+            _cooking.erase(key);
+        }
+
+        /* The others map the same cache file, only if it couldn't be
+           written they need their own copy */
+        for(const std::shared_ptr<PendingTexture>& other: waiting)
+            if(!(other->cooked = _textureCache.open(key)))
+                other->cooked = _textureCache.cook(key, *data);
+
+        std::unique_lock<std::mutex> lock{_mutex};
+        _textures.emplace_back(new PendingTexture{std::move(*texture)});
+        for(const std::shared_ptr<PendingTexture>& other: waiting)
+            _textures.emplace_back(new PendingTexture{std::move(*other)});
+    });
+}
+
+void AsyncSceneLoader::decodeMesh(const UnsignedInt id) {
+    PROFILE_ZONE("AsyncSceneLoader::decodeMesh");
+    std::optional<Trade::MeshData3D> meshData = _importer->mesh3D(id);
+    if(!meshData || !meshData->hasNormals() || meshData->primitive() != MeshPrimitive::Triangles) {
+        Warning{} << "Cannot load mesh" << id << Debug::nospace << ", skipping";
+        return skip();
+    }
+
+    /* Interleaving and index compression don't need the importer, do them
+       on the pool so the decoding thread can continue with the next mesh.
+       The pool job has to be copyable, so pass the data through a shared
+       pointer. */
+    std::shared_ptr<Trade::MeshData3D> data = std::make_shared<Trade::MeshData3D>(std::move(*meshData));
+    const std::string name = _importer->mesh3DName(id);
+    _pool.submit(_pendingJobs, [this, id, data, name]{
+        if(_cancelled) return;
+
+        PROFILE_ZONE("process mesh");
+        _meshOptimizer.optimize(*data, name);
+
+        std::unique_ptr<PendingMesh> mesh{new PendingMesh};
+        mesh->id = id;
+        mesh->primitive = data->primitive();
+        mesh->textureCoordinates = data->hasTextureCoords2D();
+        mesh->vertexStorage = mesh->textureCoordinates ?
+            MeshTools::interleave(data->positions(0), data->normals(0), data->textureCoords2D(0)) :
+            MeshTools::interleave(data->positions(0), data->normals(0));
+        mesh->vertexData = mesh->vertexStorage;
+        mesh->positionStorage = MeshTools::interleave(data->positions(0));
+        mesh->positionData = mesh->positionStorage;
+
+        Float maxMagnitudeSquared = 0.0f;
+        for(const Vector3& position: data->positions(0))
+            maxMagnitudeSquared = Math::max(maxMagnitudeSquared, position.dot());
+        mesh->radius = std::sqrt(maxMagnitudeSquared);
+
+        mesh->indexed = data->isIndexed();
+        if(mesh->indexed) {
+            mesh->count = data->indices().size();
+            std::tie(mesh->indexStorage, mesh->indexType, mesh->indexStart, mesh->indexEnd) = MeshTools::compressIndices(data->indices());
+            mesh->indexData = mesh->indexStorage;
+            mesh->lods = MeshSimplifier::lodChain(data->indices(), data->positions(0), mesh->radius);
+        } else mesh->count = data->positions(0).size();
+
+        std::unique_lock<std::mutex> lock{_mutex};
+        _meshes.push_back(std::move(mesh));
+    });
+}
+
+void AsyncSceneLoader::decodeCompiled() {
+    PROFILE_THREAD_NAME("scene loader");
+
+    for(UnsignedInt i = 0; i != _compiledScene.textures().size() && !_cancelled; ++i)
+        decodeCompiledTexture(i);
+    for(UnsignedInt i = 0; i != _compiledScene.meshes().size() && !_cancelled; ++i)
+        decodeCompiledMesh(i);
+
+    serveRequests();
+}
+
+void AsyncSceneLoader::decodeCompiledTexture(const UnsignedInt id) {
+    const CompiledSceneTexture& record = _compiledScene.textures()[id];
+    std::unique_ptr<PendingTexture> texture{new PendingTexture};
+    if(!record.valid || !(texture->cooked = _textureCache.open(record.key))) {
+        Warning{} << "Texture" << id << "is not in the texture cache, skipping";
+        return skip();
+    }
+
+    texture->id = id;
+    texture->minificationFilter = Sampler::Filter(record.minificationFilter);
+    texture->magnificationFilter = Sampler::Filter(record.magnificationFilter);
+    texture->mipmapFilter = Sampler::Mipmap(record.mipmapFilter);
+    texture->wrapping = {Sampler::Wrapping(record.wrapping[0]), Sampler::Wrapping(record.wrapping[1])};
+
+    std::unique_lock<std::mutex> lock{_mutex};
+    _textures.push_back(std::move(texture));
+}
+
+void AsyncSceneLoader::decodeCompiledMesh(const UnsignedInt id) {
+    const CompiledSceneMesh& record = _compiledScene.meshes()[id];
+    if(!record.valid) return skip();
+
+    /* Mesh data are used directly from the mapped file */
+    std::unique_ptr<PendingMesh> mesh{new PendingMesh};
+    mesh->id = id;
+    mesh->primitive = MeshPrimitive::Triangles;
+    mesh->textureCoordinates = record.textureCoordinates;
+    mesh->vertexData = _compiledScene.vertexData(record);
+    mesh->positionData = _compiledScene.positionData(record);
+    mesh->count = record.count;
+    mesh->radius = record.radius;
+    mesh->indexed = record.indexTypeSize != 0;
+    if(mesh->indexed) {
+        mesh->indexData = _compiledScene.indexData(record);
+        mesh->indexType = record.indexTypeSize == 1 ? Mesh::IndexType::UnsignedByte :
+            record.indexTypeSize == 2 ? Mesh::IndexType::UnsignedShort : Mesh::IndexType::UnsignedInt;
+        mesh->indexStart = record.indexStart;
+        mesh->indexEnd = record.indexEnd;
+        mesh->lods = _compiledScene.lods(record);
+    }
+
+    std::unique_lock<std::mutex> lock{_mutex};
+    _meshes.push_back(std::move(mesh));
+}
+
+std::size_t AsyncSceneLoader::processUploads() {
+    PROFILE_ZONE("AsyncSceneLoader::processUploads");
+    std::size_t uploaded = 0;
+
+    while(uploaded < _uploadBudget || !uploaded) {
+        std::unique_ptr<PendingTexture> texture;
+        std::unique_ptr<PendingMesh> mesh;
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            if(!_textures.empty()) {
+                texture = std::move(_textures.front());
+                _textures.pop_front();
+            } else if(!_meshes.empty()) {
+                mesh = std::move(_meshes.front());
+                _meshes.pop_front();
+            } else break;
+        }
+
+        if(texture) uploaded += uploadTexture(*texture);
+        else uploaded += uploadMesh(*mesh);
+
+        --_remaining;
+    }
+
+    return uploaded;
+}
+
+std::size_t AsyncSceneLoader::uploadTexture(PendingTexture& pending) {
+    const CookedTexture& cooked = pending.cooked;
+    const Int levelCount = cooked.levels().size();
+
+    auto texture = new Texture2D;
+    texture->setMagnificationFilter(pending.magnificationFilter)
+        .setMinificationFilter(pending.minificationFilter, pending.mipmapFilter)
+        .setWrapping(pending.wrapping);
+
+    /* All levels are cooked already, no generateMipmap() */
+    if(cooked.compression() == TextureCompression::Bc1) {
+        texture->setStorage(levelCount, TextureFormat::CompressedRGBS3tcDxt1, cooked.size());
+        for(Int level = 0; level != levelCount; ++level)
+            texture->setCompressedSubImage(level, {}, CompressedImageView2D{CompressedPixelFormat::RGBS3tcDxt1, cooked.levels()[level].size, cooked.data(level)});
+    } else {
+        texture->setStorage(levelCount, TextureFormat::RGB8, cooked.size());
+        for(Int level = 0; level != levelCount; ++level)
+            texture->setSubImage(level, {}, ImageView2D{PixelStorage{}.setAlignment(1), PixelFormat::RGB, PixelType::UnsignedByte, cooked.levels()[level].size, cooked.data(level)});
+    }
+
+    /* Mutable, so a budget can evict it again */
+    _resourceManager.set(ResourceKey{pending.id}, texture, ResourceDataState::Mutable, ResourcePolicy::Manual);
+    ++_uploadedTextureCount;
+
+    const std::size_t size = cooked.dataSize();
+    if(_budget) _budget->add(ResidentType::Texture, pending.id, size);
+    return size;
+}
+
+std::size_t AsyncSceneLoader::uploadMesh(PendingMesh& pending) {
+    auto vertexBuffer = new Buffer;
+    vertexBuffer->setData(pending.vertexData, BufferUsage::StaticDraw);
+    auto positionBuffer = new Buffer;
+    positionBuffer->setData(pending.positionData, BufferUsage::StaticDraw);
+
+    auto mesh = new Mesh;
+    mesh->setPrimitive(pending.primitive)
+        .setCount(pending.count);
+    if(pending.textureCoordinates)
+        mesh->addVertexBuffer(*vertexBuffer, 0, Shaders::Phong::Position{}, Shaders::Phong::Normal{}, Shaders::Phong::TextureCoordinates{});
+    else
+        mesh->addVertexBuffer(*vertexBuffer, 0, Shaders::Phong::Position{}, Shaders::Phong::Normal{});
+
+    /* Position-only mesh for the shadow passes, sharing the index buffer */
+    auto shadowMesh = new Mesh;
+    shadowMesh->setPrimitive(pending.primitive)
+        .setCount(pending.count)
+        .addVertexBuffer(*positionBuffer, 0, ShadowCasterShader::Position{});
+
+    if(pending.indexed) {
+        auto indexBuffer = new Buffer;
+        indexBuffer->setData(pending.indexData, BufferUsage::StaticDraw);
+        mesh->setIndexBuffer(*indexBuffer, 0, pending.indexType, pending.indexStart, pending.indexEnd);
+        shadowMesh->setIndexBuffer(*indexBuffer, 0, pending.indexType, pending.indexStart, pending.indexEnd);
+        _resourceManager.set(std::to_string(pending.id) + "-indices", indexBuffer, ResourceDataState::Mutable, ResourcePolicy::Manual);
+    }
+
+    _resourceManager.set(ResourceKey{pending.id}, mesh, ResourceDataState::Mutable, ResourcePolicy::Manual);
+    _resourceManager.set(std::to_string(pending.id) + "-shadow", shadowMesh, ResourceDataState::Mutable, ResourcePolicy::Manual);
+
+    /* Simplified levels of the shadow mesh */
+    auto shadowLods = new ShadowCasterLods;
+    shadowLods->setData(*positionBuffer, pending.lods);
+    shadowLods->radius = pending.radius;
+    _resourceManager.set(std::to_string(pending.id) + "-shadow-lods", shadowLods, ResourceDataState::Mutable, ResourcePolicy::Manual);
+    _resourceManager.set(std::to_string(pending.id) + "-vertices", vertexBuffer, ResourceDataState::Mutable, ResourcePolicy::Manual);
+    _resourceManager.set(std::to_string(pending.id) + "-positions", positionBuffer, ResourceDataState::Mutable, ResourcePolicy::Manual);
+    ++_uploadedMeshCount;
+
+    std::size_t size = pending.vertexData.size() + pending.indexData.size() + pending.positionData.size();
+    for(const MeshLod& lod: pending.lods)
+        size += lod.indices.size()*sizeof(UnsignedInt);
+    if(_budget) _budget->add(ResidentType::Mesh, pending.id, size);
+    return size;
+}
@@ -0,0 +1,202 @@
+#if !defined(ASYNCSCENELOADER_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define ASYNCSCENELOADER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <Corrade/Containers/Array.h>
+#include <Magnum/AbstractResourceLoader.h>
+#include <Magnum/Array.h>
+#include <Magnum/Mesh.h>
+#include <Magnum/Sampler.h>
+#include <Magnum/Trade/AbstractImporter.h>
+#include <Magnum/Trade/ImageData.h>
+
+#include "CompiledScene.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ResourceBudget.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+#include "Types.h"
+
+/**
+Loads scene textures and meshes in the background.
+
+Textures go through a @ref TextureCache. On a cache hit the cooked mip
+chain is uploaded straight from the mapped cache file and the source image
+isn't decoded at all.
+
+Importer calls happen on a dedicated decoding thread (the plugin manager is
+not thread-safe, so the importer can't be shared or duplicated across
+workers), CPU-side processing of the decoded data runs on a thread pool and
+the finished data are queued for upload. The GL thread calls
+@ref processUploads() once per frame, which uploads at most the configured
+number of bytes and puts the result into the resource manager. Until then,
+objects referencing the data draw with the resource manager fallbacks.
+
+Everything scene-structure related (materials, object hierarchy) should be
+read from the importer before calling @ref start(), as the importer is owned
+by the decoding thread afterwards.
+
+A @ref CompiledScene needs no decoding at all, mesh data are uploaded
+straight from the mapped file and textures come from the cache.
+
+After everything is loaded, the decoding thread stays around and serves
+@ref request() calls for data evicted by a @ref ResourceBudget.
+*/
+class AsyncSceneLoader {
+public:
+    /**
+     * @param sceneFilename     File the importer has opened, its contents
+     *      are used to key the texture cache
+     * @param textureCache      Cache of cooked textures, its compression
+     *      has to be supported by the GL context
+     * @param pool              Pool for CPU-side processing, better one
+     *      the frame doesn't wait on
+     * @param meshOptimizer     Applied to every mesh before upload
+     */
+    explicit AsyncSceneLoader(ViewerResourceManager& resourceManager, std::unique_ptr<Trade::AbstractImporter> importer, std::string sceneFilename, TextureCache& textureCache, ThreadPool& pool, const MeshOptimizer& meshOptimizer, std::size_t uploadBudget = 4*1024*1024);
+
+    /* Load a compiled scene, its textures have to be in @p textureCache */
+    explicit AsyncSceneLoader(ViewerResourceManager& resourceManager, CompiledScene scene, TextureCache& textureCache, ThreadPool& pool, std::size_t uploadBudget = 4*1024*1024);
+    ~AsyncSceneLoader();
+
+    AsyncSceneLoader(const AsyncSceneLoader&) = delete;
+    AsyncSceneLoader& operator=(const AsyncSceneLoader&) = delete;
+
+    /* Start decoding all textures and meshes of the opened file */
+    void start();
+
+    /* Budget the sizes of uploaded data are reported to, can be null */
+    void setResourceBudget(ResourceBudget* budget) { _budget = budget; }
+
+    /**
+     * Load a texture or mesh again, for example after it was evicted. Can
+     * be called any time after @ref start(), the data go through the same
+     * upload path as the initial load.
+     */
+    void request(ResidentType type, UnsignedInt id);
+
+    /* Bytes uploaded per processUploads() call. At least one item is
+       uploaded per call even if it's larger. */
+    void setUploadBudget(std::size_t bytes) { _uploadBudget = bytes; }
+
+    /**
+     * Upload data that finished decoding, has to be called from the GL
+     * thread. Returns number of bytes uploaded.
+     */
+    std::size_t processUploads();
+
+    /* True once everything requested so far was either uploaded or
+       skipped */
+    bool isFinished() const { return _remaining == 0; }
+
+    UnsignedInt uploadedTextureCount() const { return _uploadedTextureCount; }
+    UnsignedInt uploadedMeshCount() const { return _uploadedMeshCount; }
+
+private:
+    struct PendingTexture {
+        UnsignedInt id;
+        Sampler::Filter minificationFilter, magnificationFilter;
+        Sampler::Mipmap mipmapFilter;
+        Array2D<Sampler::Wrapping> wrapping;
+        CookedTexture cooked;
+    };
+
+    struct PendingMesh {
+        UnsignedInt id;
+        MeshPrimitive primitive;
+        /* Views either on the storage here or on the compiled scene */
+        Containers::Array<char> vertexStorage, indexStorage, positionStorage;
+        Containers::ArrayView<const char> vertexData, indexData, positionData;
+        std::vector<MeshLod> lods;
+        Mesh::IndexType indexType;
+        UnsignedInt indexStart, indexEnd, count;
+        /* Bounding sphere radius for the shadow casters */
+        Float radius;
+        bool indexed, textureCoordinates;
+    };
+
+    void decode();
+    void decodeTexture(UnsignedInt id);
+    void decodeMesh(UnsignedInt id);
+    void decodeCompiled();
+    void decodeCompiledTexture(UnsignedInt id);
+    void decodeCompiledMesh(UnsignedInt id);
+    void serveRequests();
+    void skip();
+
+    /* Return uploaded size in bytes */
+    std::size_t uploadTexture(PendingTexture& texture);
+    std::size_t uploadMesh(PendingMesh& mesh);
+
+    ViewerResourceManager& _resourceManager;
+    std::unique_ptr<Trade::AbstractImporter> _importer;
+    std::string _sceneFilename;
+    UnsignedLong _sceneHash;
+    CompiledScene _compiledScene;
+    MeshOptimizer _meshOptimizer;
+    std::size_t _uploadBudget;
+
+    TextureCache& _textureCache;
+    ThreadPool& _pool;
+    std::thread _thread;
+    std::atomic<bool> _cancelled;
+    std::atomic<std::size_t> _remaining;
+    /* Jobs of this loader on the pool, which may be shared */
+    std::atomic<std::size_t> _pendingJobs;
+
+    std::mutex _mutex;
+    std::deque<std::unique_ptr<PendingTexture>> _textures;
+    /* Textures waiting for an image another texture is cooking, by cache
+       key, so every image gets cooked once */
+    std::unordered_map<UnsignedLong, std::vector<std::shared_ptr<PendingTexture>>> _cooking;
+    std::deque<std::unique_ptr<PendingMesh>> _meshes;
+    std::condition_variable _requestCondition;
+    std::deque<std::pair<ResidentType, UnsignedInt>> _requests;
+
+    ResourceBudget* _budget;
+
+    UnsignedInt _uploadedTextureCount, _uploadedMeshCount;
+};
+
+/**
+Resource manager loader that brings evicted textures or meshes back through
+an @ref AsyncSceneLoader. The objects draw with the fallback in the
+meantime. Keys the budget doesn't know yet are still on their way from the
+initial load and are left alone.
+*/
+template<class T> class SceneResourceLoader: public AbstractResourceLoader<T> {
+public:
+    explicit SceneResourceLoader(const ResourceBudget& budget, AsyncSceneLoader& sceneLoader, ResidentType type): _budget(budget), _sceneLoader(sceneLoader), _type{type} {}
+
+private:
+    void doLoad(ResourceKey key) override {
+        std::optional<UnsignedInt> id = _budget.id(_type, key);
+        if(!id) return;
+
+        this->set(key, nullptr, ResourceDataState::Loading, ResourcePolicy::Manual);
+        _sceneLoader.request(_type, *id);
+    }
+
+    const ResourceBudget& _budget;
+    AsyncSceneLoader& _sceneLoader;
+    ResidentType _type;
+};
+
+#endif
@@ -0,0 +1,281 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "ClusteredLights.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <Corrade/Containers/ArrayView.h>
+#include <Magnum/BufferTextureFormat.h>
+#include <Magnum/Math/Functions.h>
+
+#include "ThreadPool.h"
+#include "TraceRecorder.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CLUSTEREDLIGHTS_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef CLUSTEREDLIGHTS_SSE2
+namespace {
+
+/* Floor of four values known to fit into an int, SSE2 has only truncation */
+__m128i floorToInt(const __m128 value) {
+    const __m128i truncated = _mm_cvttps_epi32(value);
+    /* All bits set is -1 */
+    return _mm_add_epi32(truncated, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(truncated), value)));
+}
+
+}
+#endif
+
+ClusteredLights::ClusteredLights(const Vector3ui& gridSize):
+_tileScale{1.0f},
+_lightIndexCount{0},
+_droppedCount{0},
+_maxClusterLightCount{0}
+{
+    setGridSize(gridSize);
+
+    _lightTexture.setBuffer(BufferTextureFormat::RGBA32F, _lightBuffer);
+    _clusterTexture.setBuffer(BufferTextureFormat::RG32UI, _clusterBuffer);
+    _lightIndexTexture.setBuffer(BufferTextureFormat::R32UI, _lightIndexBuffer);
+}
+
+void ClusteredLights::setGridSize(const Vector3ui& gridSize) {
+    _gridSize = Math::max(gridSize, Vector3ui{1});
+    _slices.resize(_gridSize.z());
+    _clusters.assign(_gridSize.product(), {});
+}
+
+void ClusteredLights::update(const SceneGraph::Camera3D& camera, ThreadPool* const pool) {
+    PROFILE_ZONE("ClusteredLights::update");
+
+    _projection = camera.projectionMatrix();
+    const Matrix4 cameraMatrix = camera.cameraMatrix();
+
+    /* Near and far plane back from the perspective projection */
+    const Float near = _projection[3][2]/(_projection[2][2] - 1.0f);
+    const Float far = _projection[3][2]/(_projection[2][2] + 1.0f);
+    const Float logDepthRange = std::log(far/near);
+    const Int sliceCount = _gridSize.z();
+
+    _tileScale = Vector2{_gridSize.xy()}/Vector2{Math::max(camera.viewport(), Vector2i{1})};
+    _depthSliceScaleBias = {sliceCount/logDepthRange, -sliceCount*std::log(near)/logDepthRange};
+    for(Int k = 0; k != sliceCount; ++k) {
+        _slices[k].near = near*std::pow(far/near, Float(k)/sliceCount);
+        _slices[k].far = near*std::pow(far/near, Float(k + 1)/sliceCount);
+    }
+
+    /* View space positions and the GPU copy in one pass, the slice ranges
+       in a second one that only touches the flat arrays */
+    const std::size_t count = _lights.size();
+    _viewX.resize(count);
+    _viewY.resize(count);
+    _depth.resize(count);
+    _radius.resize(count);
+    _firstSlice.resize(count);
+    _lastSlice.resize(count);
+    _lightData.resize(2*count);
+    for(std::size_t i = 0; i != count; ++i) {
+        const PointLight& light = _lights[i];
+        const Vector3 position = cameraMatrix.transformPoint(light.position);
+        _viewX[i] = position.x();
+        _viewY[i] = position.y();
+        _depth[i] = -position.z();
+        _radius[i] = light.radius;
+        _lightData[2*i] = {light.position, light.radius};
+        _lightData[2*i + 1] = {light.color, 0.0f};
+    }
+    for(std::size_t i = 0; i != count; ++i) {
+        const Float nearest = Math::max(_depth[i] - _radius[i], near);
+        const Float farthest = Math::min(_depth[i] + _radius[i], far);
+        /* Entirely in front of the near or behind the far plane gives an
+           empty range */
+        _firstSlice[i] = Math::min(Int(std::log(nearest)*_depthSliceScaleBias.x() + _depthSliceScaleBias.y()), sliceCount);
+        _lastSlice[i] = farthest < near ? -1 : Math::min(Int(std::log(farthest)*_depthSliceScaleBias.x() + _depthSliceScaleBias.y()), sliceCount - 1);
+    }
+
+    if(pool) pool->parallelFor(sliceCount, [this](const std::size_t begin, const std::size_t end) {
+        PROFILE_ZONE("ClusteredLights::binSlice");
+        for(std::size_t k = begin; k != end; ++k) binSlice(k);
+    });
+    else for(Int k = 0; k != sliceCount; ++k) binSlice(k);
+
+    /* Slice-local offsets to global ones. The index list can't outgrow the
+       largest buffer texture, clusters past it lose their lights. */
+    const std::size_t maxIndexCount = BufferTexture::maxSize();
+    const UnsignedInt clustersPerSlice = _gridSize.x()*_gridSize.y();
+    _lightIndexCount = 0;
+    _droppedCount = 0;
+    _maxClusterLightCount = 0;
+    for(Int k = 0; k != sliceCount; ++k) {
+        const Slice& slice = _slices[k];
+        for(UnsignedInt i = k*clustersPerSlice, end = i + clustersPerSlice; i != end; ++i) {
+            Vector2ui& cluster = _clusters[i];
+            cluster.x() += UnsignedInt(_lightIndexCount);
+            if(cluster.x() + cluster.y() > maxIndexCount) {
+                const UnsignedInt kept = cluster.x() < maxIndexCount ? maxIndexCount - cluster.x() : 0;
+                _droppedCount += cluster.y() - kept;
+                cluster.y() = kept;
+            }
+        }
+        _lightIndexCount += slice.indices.size();
+        _droppedCount += slice.dropped;
+        _maxClusterLightCount = Math::max(_maxClusterLightCount, slice.maxCount);
+    }
+
+    PROFILE_ZONE("ClusteredLights upload");
+    _lightBuffer.setData(_lightData, BufferUsage::StreamDraw);
+    _clusterBuffer.setData(_clusters, BufferUsage::StreamDraw);
+    const std::size_t uploadedIndexCount = Math::min(_lightIndexCount, maxIndexCount);
+    _lightIndexBuffer.setData({nullptr, uploadedIndexCount*sizeof(UnsignedInt)}, BufferUsage::StreamDraw);
+    std::size_t offset = 0;
+    for(const Slice& slice: _slices) {
+        if(offset >= uploadedIndexCount) break;
+        const std::size_t size = Math::min(slice.indices.size(), uploadedIndexCount - offset);
+        if(size) _lightIndexBuffer.setSubData(offset*sizeof(UnsignedInt),
+            Containers::ArrayView<const UnsignedInt>{slice.indices.data(), size});
+        offset += size;
+    }
+}
+
+void ClusteredLights::binSlice(const UnsignedInt k) {
+    Slice& slice = _slices[k];
+    slice.lights.clear();
+    slice.rects.clear();
+    slice.dropped = 0;
+    slice.maxCount = 0;
+
+    const Vector2i tiles{_gridSize.xy()};
+    const Float p00 = _projection[0][0], p11 = _projection[1][1];
+    const Float p20 = _projection[2][0], p21 = _projection[2][1];
+
+    /* Screen rectangle of every light reaching into the slice, from the
+       biggest cross-section of its sphere within the slice depth range.
+       Four lights at a time with SSE2, the same operations in the same
+       order as the loop after, so both give the same rectangles. */
+    const std::size_t count = _lights.size();
+    std::size_t light = 0;
+    #ifdef CLUSTEREDLIGHTS_SSE2
+    const __m128i slice4 = _mm_set1_epi32(Int(k));
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 near4 = _mm_set1_ps(slice.near), far4 = _mm_set1_ps(slice.far);
+    const __m128 p00v = _mm_set1_ps(p00), p11v = _mm_set1_ps(p11);
+    const __m128 p20v = _mm_set1_ps(p20), p21v = _mm_set1_ps(p21);
+    const __m128 tilesX = _mm_set1_ps(Float(tiles.x())), tilesY = _mm_set1_ps(Float(tiles.y()));
+    const __m128 lastTileX = _mm_set1_ps(Float(tiles.x() - 1)), lastTileY = _mm_set1_ps(Float(tiles.y() - 1));
+    const __m128 minusOne = _mm_set1_ps(-1.0f);
+    for(; light + 4 <= count; light += 4) {
+        /* Most lights don't reach into most slices */
+        const __m128i firstSlice = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_firstSlice.data() + light));
+        const __m128i lastSlice = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_lastSlice.data() + light));
+        const __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(firstSlice, slice4), _mm_cmpgt_epi32(slice4, lastSlice));
+        if(_mm_movemask_epi8(outside) == 0xffff) continue;
+
+        /* At most one of the two is nonzero */
+        const __m128 depth = _mm_loadu_ps(_depth.data() + light);
+        const __m128 radius = _mm_loadu_ps(_radius.data() + light);
+        const __m128 d = _mm_add_ps(_mm_max_ps(_mm_sub_ps(near4, depth), zero), _mm_max_ps(_mm_sub_ps(depth, far4), zero));
+        const __m128 r = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_mul_ps(radius, radius), _mm_mul_ps(d, d)), zero));
+        const __m128 d0 = _mm_max_ps(near4, _mm_sub_ps(depth, radius));
+        const __m128 d1 = _mm_min_ps(far4, _mm_add_ps(depth, radius));
+
+        const __m128 viewX = _mm_loadu_ps(_viewX.data() + light);
+        const __m128 viewY = _mm_loadu_ps(_viewY.data() + light);
+        const __m128 x0 = _mm_sub_ps(viewX, r), x1 = _mm_add_ps(viewX, r);
+        const __m128 y0 = _mm_sub_ps(viewY, r), y1 = _mm_add_ps(viewY, r);
+        const __m128 minX = _mm_sub_ps(_mm_mul_ps(p00v, _mm_min_ps(_mm_div_ps(x0, d0), _mm_div_ps(x0, d1))), p20v);
+        const __m128 minY = _mm_sub_ps(_mm_mul_ps(p11v, _mm_min_ps(_mm_div_ps(y0, d0), _mm_div_ps(y0, d1))), p21v);
+        const __m128 maxX = _mm_sub_ps(_mm_mul_ps(p00v, _mm_max_ps(_mm_div_ps(x1, d0), _mm_div_ps(x1, d1))), p20v);
+        const __m128 maxY = _mm_sub_ps(_mm_mul_ps(p11v, _mm_max_ps(_mm_div_ps(y1, d0), _mm_div_ps(y1, d1))), p21v);
+
+        /* Clamped before the floor instead of after, which gives the same
+           tiles and keeps the conversion in range. A first tile past the
+           grid or a last one before it still makes an empty rectangle. */
+        const __m128 tileMinX = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(minX, half), half), tilesX);
+        const __m128 tileMinY = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(minY, half), half), tilesY);
+        const __m128 tileMaxX = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(maxX, half), half), tilesX);
+        const __m128 tileMaxY = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(maxY, half), half), tilesY);
+        const __m128i firstX = floorToInt(_mm_min_ps(_mm_max_ps(tileMinX, zero), tilesX));
+        const __m128i firstY = floorToInt(_mm_min_ps(_mm_max_ps(tileMinY, zero), tilesY));
+        const __m128i lastX = floorToInt(_mm_max_ps(_mm_min_ps(tileMaxX, lastTileX), minusOne));
+        const __m128i lastY = floorToInt(_mm_max_ps(_mm_min_ps(tileMaxY, lastTileY), minusOne));
+
+        const __m128i empty = _mm_or_si128(_mm_cmpgt_epi32(firstX, lastX), _mm_cmpgt_epi32(firstY, lastY));
+        const Int binned = _mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(outside, empty))) ^ 0xf;
+        if(!binned) continue;
+
+        Int rects[4][4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rects[0]), firstX);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rects[1]), firstY);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rects[2]), lastX);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rects[3]), lastY);
+        for(Int lane = 0; lane != 4; ++lane) {
+            if(!(binned & (1 << lane))) continue;
+            slice.lights.push_back(light + lane);
+            slice.rects.push_back({rects[0][lane], rects[1][lane], rects[2][lane], rects[3][lane]});
+        }
+    }
+    #endif
+
+    for(; light != count; ++light) {
+        if(Int(k) < _firstSlice[light] || Int(k) > _lastSlice[light]) continue;
+
+        const Float depth = _depth[light], radius = _radius[light];
+        const Float d = depth < slice.near ? slice.near - depth :
+                        depth > slice.far ? depth - slice.far : 0.0f;
+        const Float r = std::sqrt(Math::max(radius*radius - d*d, 0.0f));
+        const Float d0 = Math::max(slice.near, depth - radius);
+        const Float d1 = Math::min(slice.far, depth + radius);
+
+        const Float x0 = _viewX[light] - r, x1 = _viewX[light] + r;
+        const Float y0 = _viewY[light] - r, y1 = _viewY[light] + r;
+        const Vector2 min{p00*Math::min(x0/d0, x0/d1) - p20, p11*Math::min(y0/d0, y0/d1) - p21};
+        const Vector2 max{p00*Math::max(x1/d0, x1/d1) - p20, p11*Math::max(y1/d0, y1/d1) - p21};
+
+        const Vector2i first = Math::max(Vector2i{Math::floor((min*0.5f + Vector2{0.5f})*Vector2{tiles})}, Vector2i{0});
+        const Vector2i last = Math::min(Vector2i{Math::floor((max*0.5f + Vector2{0.5f})*Vector2{tiles})}, tiles - Vector2i{1});
+        if(first.x() > last.x() || first.y() > last.y()) continue;
+
+        slice.lights.push_back(light);
+        slice.rects.push_back({first.x(), first.y(), last.x(), last.y()});
+    }
+
+    /* Count, offsets, then fill, which keeps the lights of a cluster
+       together and sorted */
+    Vector2ui* const clusters = _clusters.data() + k*tiles.product();
+    std::fill(clusters, clusters + tiles.product(), Vector2ui{});
+    for(const Vector4i& rect: slice.rects)
+        for(Int y = rect.y(); y <= rect.w(); ++y)
+            for(Int x = rect.x(); x <= rect.z(); ++x)
+                ++clusters[y*tiles.x() + x].y();
+
+    UnsignedInt offset = 0;
+    for(Int i = 0; i != tiles.product(); ++i) {
+        const UnsignedInt kept = Math::min(clusters[i].y(), UnsignedInt(MaxLightsPerCluster));
+        slice.dropped += clusters[i].y() - kept;
+        slice.maxCount = Math::max(slice.maxCount, kept);
+        clusters[i] = {offset, 0};
+        offset += kept;
+    }
+
+    slice.indices.resize(offset);
+    for(std::size_t j = 0; j != slice.lights.size(); ++j) {
+        const Vector4i& rect = slice.rects[j];
+        for(Int y = rect.y(); y <= rect.w(); ++y) {
+            for(Int x = rect.x(); x <= rect.z(); ++x) {
+                Vector2ui& cluster = clusters[y*tiles.x() + x];
+                if(cluster.y() == MaxLightsPerCluster) continue;
+                slice.indices[cluster.x() + cluster.y()++] = slice.lights[j];
+            }
+        }
+    }
+}
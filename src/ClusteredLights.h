@@ -0,0 +1,122 @@
+#if !defined(CLUSTEREDLIGHTS_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define CLUSTEREDLIGHTS_H
+
+#include <cstddef>
+#include <vector>
+
+#include <Magnum/Buffer.h>
+#include <Magnum/BufferTexture.h>
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Color.h>
+#include <Magnum/Math/Matrix4.h>
+#include <Magnum/SceneGraph/Camera.h>
+
+using namespace Magnum;
+
+class ThreadPool;
+
+struct PointLight {
+    Vector3 position;
+    Float radius;
+    Color3 color;
+};
+
+/**
+Assigns point lights to a froxel grid of the camera frustum: tiles in screen
+space and exponentially spaced depth slices. Receivers find their cluster
+from gl_FragCoord and only light with the lights listed in it.
+
+@ref update() puts the lights in view space in one flat pass over separate
+coordinate arrays, then bins every depth slice on its own, in parallel on
+the thread pool. The screen rectangles of the lights in a slice are
+projected four lights at a time with SSE2 where it's available. Each slice
+writes only its own clusters and index list, so there's no synchronization
+between them.
+
+The results are in three buffer textures (GL 3.3 has no storage buffers):
+the lights as two RGBA32F texels each (world position and radius, color),
+an RG32UI offset and count per cluster and an R32UI list of light indices.
+*/
+class ClusteredLights {
+public:
+    /* Lights of one cluster above this are dropped, it bounds the shader
+       loop */
+    enum: UnsignedInt { MaxLightsPerCluster = 128 };
+
+    explicit ClusteredLights(const Vector3ui& gridSize = {16, 9, 24});
+
+    ClusteredLights(const ClusteredLights&) = delete;
+    ClusteredLights& operator=(const ClusteredLights&) = delete;
+
+    /* Tiles horizontally, vertically and depth slices */
+    Vector3ui gridSize() const { return _gridSize; }
+    void setGridSize(const Vector3ui& gridSize);
+
+    std::vector<PointLight>& lights() { return _lights; }
+    const std::vector<PointLight>& lights() const { return _lights; }
+
+    /**
+     * Bin the lights for @p camera, which has to have a perspective
+     * projection and a viewport. Without @p pool everything runs on the
+     * calling thread. Uploads the results, call from the GL thread.
+     */
+    void update(const SceneGraph::Camera3D& camera, ThreadPool* pool);
+
+    BufferTexture& lightTexture() { return _lightTexture; }
+    BufferTexture& clusterTexture() { return _clusterTexture; }
+    BufferTexture& lightIndexTexture() { return _lightIndexTexture; }
+
+    /* Turns gl_FragCoord.xy into a tile */
+    Vector2 tileScale() const { return _tileScale; }
+    /* Turns log of view depth into a slice as log(depth)*x + y */
+    Vector2 depthSliceScaleBias() const { return _depthSliceScaleBias; }
+
+    /* Statistics of the last update() */
+    std::size_t lightIndexCount() const { return _lightIndexCount; }
+    std::size_t droppedCount() const { return _droppedCount; }
+    UnsignedInt maxClusterLightCount() const { return _maxClusterLightCount; }
+
+private:
+    void binSlice(UnsignedInt slice);
+
+    Vector3ui _gridSize;
+    std::vector<PointLight> _lights;
+
+    /* View space bounds of every light, filled in update() */
+    std::vector<Float> _viewX, _viewY, _depth, _radius;
+    std::vector<Int> _firstSlice, _lastSlice;
+
+    /* Per slice state, written by one thread each */
+    struct Slice {
+        Float near, far;
+        std::vector<UnsignedInt> lights;
+        /* Tile rectangle of every light in lights */
+        std::vector<Vector4i> rects;
+        std::vector<UnsignedInt> indices;
+        std::size_t dropped;
+        UnsignedInt maxCount;
+    };
+    std::vector<Slice> _slices;
+
+    Matrix4 _projection;
+    Vector2 _tileScale, _depthSliceScaleBias;
+
+    /* Offset and count of every cluster */
+    std::vector<Vector2ui> _clusters;
+    std::vector<Vector4> _lightData;
+
+    Buffer _lightBuffer, _clusterBuffer, _lightIndexBuffer;
+    BufferTexture _lightTexture, _clusterTexture, _lightIndexTexture;
+
+    std::size_t _lightIndexCount, _droppedCount;
+    UnsignedInt _maxClusterLightCount;
+};
+
+#endif
@@ -0,0 +1,446 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "CompiledScene.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <Corrade/Utility/Debug.h>
+#include <Magnum/Mesh.h>
+#include <Magnum/Sampler.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/Trade/AbstractImporter.h>
+#include <Magnum/Trade/ImageData.h>
+#include <Magnum/Trade/MeshData3D.h>
+#include <Magnum/Trade/MeshObjectData3D.h>
+#include <Magnum/Trade/PhongMaterialData.h>
+#include <Magnum/Trade/SceneData.h>
+#include <Magnum/Trade/TextureData.h>
+
+#pragma warning (push)
+#pragma warning (disable : 4127)
+#include <Magnum/MeshTools/Interleave.h>
+#pragma warning (pop)
+#include <Magnum/MeshTools/CompressIndices.h>
+
+#include "TextureCache.h"
+
+namespace {
+
+struct CompiledSceneHeader {
+    char magic[4];
+    UnsignedInt version;
+    UnsignedLong sourceSize;
+    Long sourceModificationTime;
+    UnsignedLong sourceHash;
+    UnsignedLong nodeOffset, materialOffset, textureOffset, meshOffset;
+    UnsignedInt nodeCount, materialCount, textureCount, meshCount;
+    UnsignedInt meshOptimizations, reserved;
+};
+
+/* Records are mapped as they are, a compiler padding them differently
+   would read garbage */
+static_assert(sizeof(CompiledSceneHeader) == 88, "unexpected header padding");
+static_assert(sizeof(CompiledSceneNode) == 80, "unexpected node padding");
+static_assert(sizeof(CompiledSceneMaterial) == 64, "unexpected material padding");
+static_assert(sizeof(CompiledSceneTexture) == 64, "unexpected texture padding");
+static_assert(sizeof(CompiledSceneMesh) == 88 + 8*MeshSimplifier::MaxLevels, "unexpected mesh padding");
+
+constexpr const char CompiledSceneMagic[4]{'M', 'S', 'C', 'N'};
+constexpr const UnsignedInt CompiledSceneVersion = 5;
+
+/* Records are aligned for the matrices in them, vertex and index data for
+   the most demanding buffer offset alignment drivers report */
+constexpr const std::size_t RecordAlignment = 16;
+constexpr const std::size_t BlobAlignment = 256;
+
+std::size_t alignUp(const std::size_t value, const std::size_t alignment) {
+    return (value + alignment - 1)/alignment*alignment;
+}
+
+bool sourceStamp(const std::string& file, UnsignedLong& size, Long& modificationTime) {
+    struct stat st;
+    if(stat(file.data(), &st) != 0) return false;
+    size = UnsignedLong(st.st_size);
+    modificationTime = Long(st.st_mtime);
+    return true;
+}
+
+void addNode(Trade::AbstractImporter& importer, std::vector<CompiledSceneNode>& nodes, const Int parent, const UnsignedInt id) {
+    std::unique_ptr<Trade::ObjectData3D> objectData = importer.object3D(id);
+    if(!objectData) {
+        Error{} << "Cannot import object" << id << Debug::nospace << ", skipping";
+        return;
+    }
+
+    CompiledSceneNode node{parent, -1, -1, 0, objectData->transformation()};
+    if(objectData->instanceType() == Trade::ObjectInstanceType3D::Mesh) {
+        node.mesh = objectData->instance();
+        node.material = static_cast<Trade::MeshObjectData3D*>(objectData.get())->material();
+    }
+
+    nodes.push_back(node);
+    const Int index = nodes.size() - 1;
+    for(UnsignedInt child: objectData->children())
+        addNode(importer, nodes, index, child);
+}
+
+/* Whether @p size bytes at @p offset are inside a file of @p fileSize,
+   without overflowing on garbage offsets */
+bool inFile(const UnsignedLong offset, const UnsignedLong size, const std::size_t fileSize) {
+    return offset <= fileSize && size <= fileSize - offset;
+}
+
+template<class T> bool recordsInFile(const UnsignedLong offset, const UnsignedInt count, const std::size_t fileSize) {
+    return offset % alignof(T) == 0 && inFile(offset, UnsignedLong(count)*sizeof(T), fileSize);
+}
+
+template<class T> Containers::ArrayView<const T> records(const Containers::ArrayView<const char> data, const UnsignedLong offset, const UnsignedInt count) {
+    return {reinterpret_cast<const T*>(data.data() + offset), count};
+}
+
+/* Only this header field, the rest of the file stays as it is */
+bool writeModificationTime(const std::string& file, const Long modificationTime) {
+    std::FILE* const f = std::fopen(file.data(), "r+b");
+    if(!f) return false;
+    const bool written = std::fseek(f, offsetof(CompiledSceneHeader, sourceModificationTime), SEEK_SET) == 0 &&
+        std::fwrite(&modificationTime, sizeof(modificationTime), 1, f) == 1;
+    return std::fclose(f) == 0 && written;
+}
+
+template<class T> void appendRecords(Containers::Array<char>& file, const std::size_t offset, const std::vector<T>& records) {
+    if(!records.empty())
+        std::memcpy(file.data() + offset, records.data(), records.size()*sizeof(T));
+}
+
+}
+
+bool CompiledScene::compile(Trade::AbstractImporter& importer, TextureCache& textureCache, const MeshOptimizer& meshOptimizer, const std::string& sourceFile, const std::string& outputFile) {
+    CompiledSceneHeader header{};
+    std::memcpy(header.magic, CompiledSceneMagic, 4);
+    header.version = CompiledSceneVersion;
+    header.meshOptimizations = UnsignedInt(meshOptimizer.optimizations());
+    if(!sourceStamp(sourceFile, header.sourceSize, header.sourceModificationTime)) {
+        Error{} << "Cannot stat" << sourceFile;
+        return false;
+    }
+    header.sourceHash = TextureCache::hash(Utility::Directory::read(sourceFile));
+
+    /* Flat node hierarchy. If the format has no scene support, display just
+       the first mesh with the default material. */
+    std::vector<CompiledSceneNode> nodes;
+    if(importer.defaultScene() != -1) {
+        std::optional<Trade::SceneData> sceneData = importer.scene(importer.defaultScene());
+        if(!sceneData) {
+            Error{} << "Cannot load scene" << importer.defaultScene();
+            return false;
+        }
+        for(UnsignedInt objectId: sceneData->children3D())
+            addNode(importer, nodes, -1, objectId);
+    } else if(importer.mesh3DCount())
+        nodes.push_back({-1, 0, -1, 0, Matrix4{}});
+
+    std::vector<CompiledSceneMaterial> materials(importer.materialCount());
+    for(UnsignedInt i = 0; i != importer.materialCount(); ++i) {
+        CompiledSceneMaterial& material = materials[i];
+        material = {};
+        material.diffuseTexture = -1;
+
+        std::unique_ptr<Trade::AbstractMaterialData> materialData = importer.material(i);
+        if(!materialData || materialData->type() != Trade::MaterialType::Phong) {
+            Warning{} << "Cannot load material" << i << Debug::nospace << ", skipping";
+            continue;
+        }
+
+        auto& phong = static_cast<Trade::PhongMaterialData&>(*materialData);
+        material.flags = CompiledSceneMaterial::Valid;
+        material.shininess = phong.shininess();
+        if(!phong.flags()) {
+            material.ambientColor = phong.ambientColor();
+            material.diffuseColor = phong.diffuseColor();
+            material.specularColor = phong.specularColor();
+        } else if(phong.flags() == Trade::PhongMaterialData::Flag::DiffuseTexture) {
+            material.flags |= CompiledSceneMaterial::DiffuseTexture;
+            material.ambientColor = phong.ambientColor();
+            material.specularColor = phong.specularColor();
+            material.diffuseTexture = phong.diffuseTexture();
+        } else {
+            Warning{} << "Texture combination of material" << i << importer.materialName(i) << "is not supported, using default material instead";
+            material.flags |= CompiledSceneMaterial::Unsupported;
+        }
+    }
+
+    /* Textures are only referenced, the cooked data live in the texture
+       cache */
+    const std::string directory = Utility::Directory::path(sourceFile);
+    std::vector<CompiledSceneTexture> textures(importer.textureCount());
+    std::string fileNames;
+    for(UnsignedInt i = 0; i != importer.textureCount(); ++i) {
+        CompiledSceneTexture& texture = textures[i];
+        texture = {};
+
+        std::optional<Trade::TextureData> textureData = importer.texture(i);
+        if(!textureData || textureData->type() != Trade::TextureData::Type::Texture2D) {
+            Warning{} << "Cannot load texture" << i << Debug::nospace << ", skipping";
+            continue;
+        }
+
+        const UnsignedInt image = textureData->image();
+        const std::string name = importer.image2DName(image);
+        const std::string file = TextureCache::imageFile(directory, name);
+        texture.key = TextureCache::imageKey(header.sourceHash, image, name, file);
+        if(!file.empty() && sourceStamp(file, texture.sourceSize, texture.sourceModificationTime)) {
+            /* Relative to the file name blob until the layout is known */
+            texture.fileNameOffset = fileNames.size();
+            texture.fileNameSize = name.size();
+            fileNames += name;
+        }
+        if(!textureCache.open(texture.key)) {
+            std::optional<Trade::ImageData2D> imageData = importer.image2D(image);
+            if(!imageData || !TextureCache::isSupported(*imageData) || !textureCache.cook(texture.key, *imageData)) {
+                Warning{} << "Cannot load texture image" << image << Debug::nospace << ", skipping";
+                continue;
+            }
+        }
+
+        texture.minificationFilter = UnsignedInt(textureData->minificationFilter());
+        texture.magnificationFilter = UnsignedInt(textureData->magnificationFilter());
+        texture.mipmapFilter = UnsignedInt(textureData->mipmapFilter());
+        texture.wrapping[0] = UnsignedInt(textureData->wrapping()[0]);
+        texture.wrapping[1] = UnsignedInt(textureData->wrapping()[1]);
+        texture.valid = 1;
+    }
+
+    std::vector<CompiledSceneMesh> meshes(importer.mesh3DCount());
+    std::vector<Containers::Array<char>> vertexData(importer.mesh3DCount()), indexData(importer.mesh3DCount()), positionData(importer.mesh3DCount());
+    std::vector<std::vector<UnsignedInt>> lodIndices(importer.mesh3DCount());
+    for(UnsignedInt i = 0; i != importer.mesh3DCount(); ++i) {
+        CompiledSceneMesh& mesh = meshes[i];
+        mesh = {};
+
+        std::optional<Trade::MeshData3D> meshData = importer.mesh3D(i);
+        if(!meshData || !meshData->hasNormals() || meshData->primitive() != MeshPrimitive::Triangles) {
+            Warning{} << "Cannot load mesh" << i << Debug::nospace << ", skipping";
+            continue;
+        }
+
+        meshOptimizer.optimize(*meshData, importer.mesh3DName(i));
+
+        mesh.textureCoordinates = meshData->hasTextureCoords2D();
+        vertexData[i] = mesh.textureCoordinates ?
+            MeshTools::interleave(meshData->positions(0), meshData->normals(0), meshData->textureCoords2D(0)) :
+            MeshTools::interleave(meshData->positions(0), meshData->normals(0));
+        positionData[i] = MeshTools::interleave(meshData->positions(0));
+
+        if(meshData->isIndexed()) {
+            Mesh::IndexType indexType;
+            mesh.count = meshData->indices().size();
+            std::tie(indexData[i], indexType, mesh.indexStart, mesh.indexEnd) = MeshTools::compressIndices(meshData->indices());
+            mesh.indexTypeSize = Mesh::indexSize(indexType);
+        } else mesh.count = meshData->positions(0).size();
+
+        Float maxMagnitudeSquared = 0.0f;
+        for(const Vector3& position: meshData->positions(0))
+            maxMagnitudeSquared = Math::max(maxMagnitudeSquared, position.dot());
+        mesh.radius = std::sqrt(maxMagnitudeSquared);
+
+        if(meshData->isIndexed()) {
+            const std::vector<MeshLod> lods = MeshSimplifier::lodChain(meshData->indices(), meshData->positions(0), mesh.radius);
+            mesh.lodCount = lods.size();
+            for(std::size_t j = 0; j != lods.size(); ++j) {
+                mesh.lodIndexCounts[j] = lods[j].indices.size();
+                mesh.lodErrors[j] = lods[j].error;
+                lodIndices[i].insert(lodIndices[i].end(), lods[j].indices.begin(), lods[j].indices.end());
+            }
+        }
+        mesh.valid = 1;
+    }
+
+    /* Lay out the file */
+    std::size_t offset = alignUp(sizeof(CompiledSceneHeader), RecordAlignment);
+    header.nodeOffset = offset;
+    header.nodeCount = nodes.size();
+    offset = alignUp(offset + nodes.size()*sizeof(CompiledSceneNode), RecordAlignment);
+    header.materialOffset = offset;
+    header.materialCount = materials.size();
+    offset = alignUp(offset + materials.size()*sizeof(CompiledSceneMaterial), RecordAlignment);
+    header.textureOffset = offset;
+    header.textureCount = textures.size();
+    offset = alignUp(offset + textures.size()*sizeof(CompiledSceneTexture), RecordAlignment);
+    header.meshOffset = offset;
+    header.meshCount = meshes.size();
+    offset += meshes.size()*sizeof(CompiledSceneMesh);
+    for(std::size_t i = 0; i != meshes.size(); ++i) {
+        offset = alignUp(offset, BlobAlignment);
+        meshes[i].vertexOffset = offset;
+        meshes[i].vertexSize = vertexData[i].size();
+        offset = alignUp(offset + vertexData[i].size(), BlobAlignment);
+        meshes[i].indexOffset = offset;
+        meshes[i].indexSize = indexData[i].size();
+        offset = alignUp(offset + indexData[i].size(), BlobAlignment);
+        meshes[i].positionOffset = offset;
+        meshes[i].positionSize = positionData[i].size();
+        offset = alignUp(offset + positionData[i].size(), BlobAlignment);
+        meshes[i].lodOffset = offset;
+        offset += lodIndices[i].size()*sizeof(UnsignedInt);
+    }
+    const std::size_t fileNameOffset = offset;
+    offset += fileNames.size();
+    for(CompiledSceneTexture& texture: textures)
+        if(texture.fileNameSize) texture.fileNameOffset += fileNameOffset;
+
+    Containers::Array<char> file{Containers::ValueInit, offset};
+    std::memcpy(file.data(), &header, sizeof(header));
+    appendRecords(file, header.nodeOffset, nodes);
+    appendRecords(file, header.materialOffset, materials);
+    appendRecords(file, header.textureOffset, textures);
+    appendRecords(file, header.meshOffset, meshes);
+    for(std::size_t i = 0; i != meshes.size(); ++i) {
+        if(!vertexData[i].empty())
+            std::memcpy(file.data() + meshes[i].vertexOffset, vertexData[i].data(), vertexData[i].size());
+        if(!indexData[i].empty())
+            std::memcpy(file.data() + meshes[i].indexOffset, indexData[i].data(), indexData[i].size());
+        if(!positionData[i].empty())
+            std::memcpy(file.data() + meshes[i].positionOffset, positionData[i].data(), positionData[i].size());
+        if(!lodIndices[i].empty())
+            std::memcpy(file.data() + meshes[i].lodOffset, lodIndices[i].data(), lodIndices[i].size()*sizeof(UnsignedInt));
+    }
+    if(!fileNames.empty())
+        std::memcpy(file.data() + fileNameOffset, fileNames.data(), fileNames.size());
+
+    if(!Utility::Directory::write(outputFile, file)) {
+        Error{} << "Cannot write compiled scene" << outputFile;
+        return false;
+    }
+
+    Debug{} << "Compiled" << sourceFile << "into" << outputFile << Debug::nospace << "," << nodes.size() << "nodes," << meshes.size() << "meshes," << file.size() << "bytes";
+    return true;
+}
+
+CompiledScene CompiledScene::open(const std::string& sourceFile, const std::string& compiledFile, const MeshOptimizations meshOptimizations) {
+    CompiledScene scene;
+    if(!Utility::Directory::fileExists(compiledFile)) return scene;
+
+    UnsignedLong sourceSize;
+    Long sourceModificationTime;
+    if(!sourceStamp(sourceFile, sourceSize, sourceModificationTime)) return scene;
+
+    Containers::Array<const char, Utility::Directory::MapDeleter> data = Utility::Directory::mapRead(compiledFile);
+    CompiledSceneHeader header;
+    if(data.size() < sizeof(header)) return scene;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if(std::memcmp(header.magic, CompiledSceneMagic, 4) != 0 || header.version != CompiledSceneVersion ||
+       header.meshOptimizations != UnsignedInt(meshOptimizations))
+        return scene;
+
+    /* Size changed, definitely stale. Only the time changed, check the
+       contents before throwing the cache away. */
+    if(header.sourceSize != sourceSize) return scene;
+    if(header.sourceModificationTime != sourceModificationTime &&
+       header.sourceHash != TextureCache::hash(Utility::Directory::read(sourceFile)))
+        return scene;
+
+    /* Everything below is used without further checks, a truncated or
+       corrupted file has to be rejected here */
+    if(!recordsInFile<CompiledSceneNode>(header.nodeOffset, header.nodeCount, data.size()) ||
+       !recordsInFile<CompiledSceneMaterial>(header.materialOffset, header.materialCount, data.size()) ||
+       !recordsInFile<CompiledSceneTexture>(header.textureOffset, header.textureCount, data.size()) ||
+       !recordsInFile<CompiledSceneMesh>(header.meshOffset, header.meshCount, data.size()))
+        return scene;
+
+    const Containers::ArrayView<const CompiledSceneNode> nodes = records<CompiledSceneNode>(data, header.nodeOffset, header.nodeCount);
+    const Containers::ArrayView<const CompiledSceneMaterial> materials = records<CompiledSceneMaterial>(data, header.materialOffset, header.materialCount);
+    const Containers::ArrayView<const CompiledSceneTexture> textures = records<CompiledSceneTexture>(data, header.textureOffset, header.textureCount);
+    const Containers::ArrayView<const CompiledSceneMesh> meshes = records<CompiledSceneMesh>(data, header.meshOffset, header.meshCount);
+
+    /* The hierarchy is built in a single pass, parents have to come first */
+    for(std::size_t i = 0; i != nodes.size(); ++i) {
+        const CompiledSceneNode& node = nodes[i];
+        if(node.parent < -1 || node.parent >= Int(i) ||
+           node.mesh < -1 || node.mesh >= Int(meshes.size()) ||
+           node.material < -1 || node.material >= Int(materials.size()))
+            return scene;
+    }
+    for(const CompiledSceneMaterial& material: materials)
+        if((material.flags & CompiledSceneMaterial::DiffuseTexture) &&
+           (material.diffuseTexture < 0 || material.diffuseTexture >= Int(textures.size())))
+            return scene;
+    for(const CompiledSceneMesh& mesh: meshes) {
+        if(mesh.lodCount > MeshSimplifier::MaxLevels) return scene;
+        UnsignedLong lodIndexCount = 0;
+        for(UnsignedInt i = 0; i != mesh.lodCount; ++i)
+            lodIndexCount += mesh.lodIndexCounts[i];
+        if(!inFile(mesh.vertexOffset, mesh.vertexSize, data.size()) ||
+           !inFile(mesh.indexOffset, mesh.indexSize, data.size()) ||
+           !inFile(mesh.positionOffset, mesh.positionSize, data.size()) ||
+           mesh.lodOffset % sizeof(UnsignedInt) ||
+           !inFile(mesh.lodOffset, lodIndexCount*sizeof(UnsignedInt), data.size()))
+            return scene;
+    }
+
+    /* An edited texture has to be cooked again, under a different key */
+    const std::string directory = Utility::Directory::path(sourceFile);
+    for(const CompiledSceneTexture& texture: textures) {
+        if(!texture.fileNameSize) continue;
+        if(!inFile(texture.fileNameOffset, texture.fileNameSize, data.size())) return scene;
+
+        UnsignedLong size;
+        Long modificationTime;
+        const std::string file = Utility::Directory::join(directory, std::string(data.data() + texture.fileNameOffset, texture.fileNameSize));
+        if(!sourceStamp(file, size, modificationTime) || size != texture.sourceSize || modificationTime != texture.sourceModificationTime)
+            return scene;
+    }
+
+    /* Same contents under a new time, store it so the source doesn't get
+       hashed on every open. Some systems can't write a mapped file, so it's
+       unmapped for that and mapped again. */
+    if(header.sourceModificationTime != sourceModificationTime) {
+        const std::size_t size = data.size();
+        {
+            Containers::Array<const char, Utility::Directory::MapDeleter> unmapped = std::move(data);
+        }
+        if(!writeModificationTime(compiledFile, sourceModificationTime))
+            Warning{} << "Cannot update the source modification time in" << compiledFile;
+        data = Utility::Directory::mapRead(compiledFile);
+        if(data.size() != size) return scene;
+    }
+
+    scene._nodes = records<CompiledSceneNode>(data, header.nodeOffset, header.nodeCount);
+    scene._materials = records<CompiledSceneMaterial>(data, header.materialOffset, header.materialCount);
+    scene._textures = records<CompiledSceneTexture>(data, header.textureOffset, header.textureCount);
+    scene._meshes = records<CompiledSceneMesh>(data, header.meshOffset, header.meshCount);
+    scene._data = std::move(data);
+    return scene;
+}
+
+Containers::ArrayView<const char> CompiledScene::vertexData(const CompiledSceneMesh& mesh) const {
+    return {_data.data() + mesh.vertexOffset, std::size_t(mesh.vertexSize)};
+}
+
+Containers::ArrayView<const char> CompiledScene::indexData(const CompiledSceneMesh& mesh) const {
+    return {_data.data() + mesh.indexOffset, std::size_t(mesh.indexSize)};
+}
+
+Containers::ArrayView<const char> CompiledScene::positionData(const CompiledSceneMesh& mesh) const {
+    return {_data.data() + mesh.positionOffset, std::size_t(mesh.positionSize)};
+}
+
+std::vector<MeshLod> CompiledScene::lods(const CompiledSceneMesh& mesh) const {
+    std::vector<MeshLod> lods(mesh.lodCount);
+    const UnsignedInt* indices = reinterpret_cast<const UnsignedInt*>(_data.data() + mesh.lodOffset);
+    for(UnsignedInt i = 0; i != mesh.lodCount; ++i) {
+        lods[i].indices.assign(indices, indices + mesh.lodIndexCounts[i]);
+        lods[i].error = mesh.lodErrors[i];
+        indices += mesh.lodIndexCounts[i];
+    }
+    return lods;
+}
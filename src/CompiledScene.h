@@ -0,0 +1,150 @@
+#if !defined(COMPILEDSCENE_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define COMPILEDSCENE_H
+
+#include <string>
+#include <vector>
+
+#include <Corrade/Containers/Array.h>
+#include <Corrade/Containers/ArrayView.h>
+#include <Corrade/Utility/Directory.h>
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Color.h>
+#include <Magnum/Math/Matrix4.h>
+#include <Magnum/Trade/Trade.h>
+
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+
+using namespace Magnum;
+
+class TextureCache;
+
+/* All records are plain data read straight from the mapped file, keep them
+   free of padding surprises */
+
+struct CompiledSceneNode {
+    /* Index of the parent node, always lower than the node's own index, -1
+       for nodes directly under the scene root */
+    Int parent;
+    /* Mesh and material index, -1 if none */
+    Int mesh;
+    Int material;
+    Int reserved;
+    Matrix4 transformation;
+};
+
+struct CompiledSceneMaterial {
+    enum: UnsignedInt {
+        Valid = 1 << 0,
+        DiffuseTexture = 1 << 1,
+        /* Texture combination that isn't supported, draw with the default
+           material */
+        Unsupported = 1 << 2
+    };
+
+    Color4 ambientColor, diffuseColor, specularColor;
+    Float shininess;
+    Int diffuseTexture;
+    UnsignedInt flags;
+    Int reserved;
+};
+
+struct CompiledSceneTexture {
+    /* TextureCache key of the cooked image */
+    UnsignedLong key;
+    UnsignedInt minificationFilter, magnificationFilter, mipmapFilter;
+    UnsignedInt wrapping[2];
+    UnsignedInt valid;
+    /* Stamp of the external image file, @ref CompiledScene::open() checks
+       it like the one of the scene file. The file name, relative to the
+       scene file, is at given offset in the file, its size is 0 for
+       embedded images. */
+    UnsignedLong sourceSize;
+    Long sourceModificationTime;
+    UnsignedLong fileNameOffset;
+    UnsignedInt fileNameSize;
+    UnsignedInt reserved;
+};
+
+struct CompiledSceneMesh {
+    /* Offsets are relative to the start of the file and aligned for direct
+       upload */
+    UnsignedLong vertexOffset, vertexSize, indexOffset, indexSize;
+    /* Tightly packed positions for the shadow passes */
+    UnsignedLong positionOffset, positionSize;
+    UnsignedInt count, indexStart, indexEnd;
+    /* 0 for non-indexed meshes, otherwise index size in bytes */
+    UnsignedInt indexTypeSize;
+    UnsignedInt textureCoordinates;
+    UnsignedInt valid;
+    Float radius;
+    /* Simplified shadow caster levels, their indices are 32-bit, one level
+       after another */
+    UnsignedInt lodCount;
+    UnsignedLong lodOffset;
+    UnsignedInt lodIndexCounts[MeshSimplifier::MaxLevels];
+    Float lodErrors[MeshSimplifier::MaxLevels];
+};
+
+/**
+Scene compiled from any importer-supported file into a single binary that
+is memory-mapped and used in place: a flat node array in depth-first order
+with parent indices, material and texture records and interleaved vertex and
+compressed index data ready for upload, plus a position-only copy of the
+vertices for shadow casters. Loading it does no parsing and no
+per-node allocation.
+
+The source file size, modification time and contents hash are stored in the
+header. @ref open() rejects the cache if the size changed, or if the
+modification time changed and the contents hash doesn't match anymore. If
+the contents still match, the new time is written to the header. The
+size and modification time of every external image file is stored as well,
+any change in those makes the scene stale too.
+*/
+class CompiledScene {
+public:
+    /**
+     * Compile @p sourceFile opened in @p importer into @p outputFile.
+     * Textures are cooked into @p textureCache on the way so the compiled
+     * scene can be loaded without the importer, meshes go through
+     * @p meshOptimizer. Returns false if the file couldn't be written.
+     */
+    static bool compile(Trade::AbstractImporter& importer, TextureCache& textureCache, const MeshOptimizer& meshOptimizer, const std::string& sourceFile, const std::string& outputFile);
+
+    /* Map a compiled scene, returns empty scene if it's missing, stale,
+       corrupted or was compiled with different mesh optimizations */
+    static CompiledScene open(const std::string& sourceFile, const std::string& compiledFile, MeshOptimizations meshOptimizations);
+
+    explicit CompiledScene() = default;
+
+    explicit operator bool() const { return !!_data; }
+
+    Containers::ArrayView<const CompiledSceneNode> nodes() const { return _nodes; }
+    Containers::ArrayView<const CompiledSceneMaterial> materials() const { return _materials; }
+    Containers::ArrayView<const CompiledSceneTexture> textures() const { return _textures; }
+    Containers::ArrayView<const CompiledSceneMesh> meshes() const { return _meshes; }
+
+    /* Vertex and index data of given mesh */
+    Containers::ArrayView<const char> vertexData(const CompiledSceneMesh& mesh) const;
+    Containers::ArrayView<const char> indexData(const CompiledSceneMesh& mesh) const;
+    Containers::ArrayView<const char> positionData(const CompiledSceneMesh& mesh) const;
+
+    /* Shadow caster levels of given mesh */
+    std::vector<MeshLod> lods(const CompiledSceneMesh& mesh) const;
+
+private:
+    Containers::Array<const char, Utility::Directory::MapDeleter> _data;
+    Containers::ArrayView<const CompiledSceneNode> _nodes;
+    Containers::ArrayView<const CompiledSceneMaterial> _materials;
+    Containers::ArrayView<const CompiledSceneTexture> _textures;
+    Containers::ArrayView<const CompiledSceneMesh> _meshes;
+};
+
+#endif
@@ -30,31 +30,160 @@
 
 #include "DebugLines.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
 #include <Magnum/SceneGraph/Camera.h>
 #include <Magnum/Renderer.h>
 
 #include "ShadowLight.h"
 
 namespace Magnum {
-DebugLines::DebugLines(): _mesh{MeshPrimitive::Lines} {
-    _mesh.addVertexBuffer(_buffer, 0,
+
+namespace {
+    enum: std::size_t {
+        InitialLineCapacity = 4096,
+        InitialShapeCapacity = 1024,
+        BoxVertexCount = 12*2,
+        SphereSegments = 24,
+        SphereVertexCount = 3*SphereSegments*2
+    };
+
+    /* Line list of a [-1, 1] box followed by a unit sphere drawn as three
+       great circles */
+    std::vector<Vector3> shapeVertices() {
+        std::vector<Vector3> vertices;
+        vertices.reserve(BoxVertexCount + SphereVertexCount);
+
+        for(std::size_t axis = 0; axis != 3; ++axis) {
+            for(const Float a: {-1.0f, 1.0f}) for(const Float b: {-1.0f, 1.0f}) {
+                Vector3 p0, p1;
+                p0[axis] = -1.0f;
+                p1[axis] = 1.0f;
+                p0[(axis + 1) % 3] = p1[(axis + 1) % 3] = a;
+                p0[(axis + 2) % 3] = p1[(axis + 2) % 3] = b;
+                vertices.push_back(p0);
+                vertices.push_back(p1);
+            }
+        }
+
+        for(std::size_t axis = 0; axis != 3; ++axis) {
+            for(std::size_t i = 0; i != SphereSegments; ++i) for(const std::size_t j: {i, i + 1}) {
+                const Float angle = 2.0f*Constants::pi()*j/SphereSegments;
+                Vector3 p;
+                p[(axis + 1) % 3] = std::cos(angle);
+                p[(axis + 2) % 3] = std::sin(angle);
+                vertices.push_back(p);
+            }
+        }
+
+        return vertices;
+    }
+}
+
+DebugLines::DebugLines():
+    _lines{sizeof(Point), InitialLineCapacity},
+    _boxes{sizeof(Shape), InitialShapeCapacity},
+    _spheres{sizeof(Shape), InitialShapeCapacity},
+    _lineMesh{NoCreate}, _boxMesh{NoCreate}, _sphereMesh{NoCreate}
+{
+    _shapeVertices.setData(shapeVertices(), BufferUsage::StaticDraw);
+    setupMeshes();
+}
+
+void DebugLines::setupMeshes() {
+    /* The streaming buffers are recreated when they grow, the meshes have to
+       follow */
+    _lineMesh = Mesh{MeshPrimitive::Lines};
+    _lineMesh.addVertexBuffer(_lines.buffer.buffer(), 0,
         Shaders::VertexColor3D::Position{},
         Shaders::VertexColor3D::Color{Shaders::VertexColor3D::Color::Components::Three});
+
+    _boxMesh = Mesh{MeshPrimitive::Lines};
+    _boxMesh.setCount(BoxVertexCount)
+        .addVertexBuffer(_shapeVertices, 0, DebugShapeShader::Position{})
+        .addVertexBufferInstanced(_boxes.buffer.buffer(), 1, 0,
+            DebugShapeShader::InstanceCenter{},
+            DebugShapeShader::InstanceHalfSize{},
+            DebugShapeShader::InstanceColor{});
+
+    _sphereMesh = Mesh{MeshPrimitive::Lines};
+    _sphereMesh.setCount(SphereVertexCount)
+        .addVertexBuffer(_shapeVertices, BoxVertexCount*sizeof(Vector3), DebugShapeShader::Position{})
+        .addVertexBufferInstanced(_spheres.buffer.buffer(), 1, 0,
+            DebugShapeShader::InstanceCenter{},
+            DebugShapeShader::InstanceHalfSize{},
+            DebugShapeShader::InstanceColor{});
+}
+
+void DebugLines::map(Stream& stream) {
+    const Containers::ArrayView<char> region = stream.buffer.map();
+    stream.data = region.data();
+    stream.capacity = region.size()/stream.stride;
+    stream.count = 0;
+}
+
+void DebugLines::reserve(Stream& stream, const std::size_t count) {
+    /* Growing is rare, copying out what's already written is fine */
+    const std::size_t writtenCount = stream.count;
+    Containers::Array<char> written(writtenCount*stream.stride);
+    if(writtenCount) std::memcpy(written.data(), stream.data, written.size());
+
+    if(stream.buffer.reserve(std::max(count, 2*stream.capacity)*stream.stride))
+        setupMeshes();
+    map(stream);
+
+    if(writtenCount) std::memcpy(stream.data, written.data(), written.size());
+    stream.count = writtenCount;
+}
+
+void DebugLines::addShapes(Stream& stream, const Containers::ArrayView<const Shape> shapes) {
+    if(stream.count + shapes.size() > stream.capacity) reserve(stream, stream.count + shapes.size());
+    std::memcpy(stream.data + stream.count*stream.stride, shapes.data(), shapes.size()*sizeof(Shape));
+    stream.count += shapes.size();
 }
 
 void DebugLines::reset() {
-    _lines.clear();
-    _buffer.invalidateData();
+    map(_lines);
+    map(_boxes);
+    map(_spheres);
 }
 
 void DebugLines::draw(const Matrix4& transformationProjectionMatrix) {
-    if(!_lines.empty()) {
-        Renderer::disable(Renderer::Feature::DepthTest);
-        _buffer.setData(_lines, BufferUsage::StreamDraw);
-        _mesh.setCount(_lines.size());
+    for(Stream* stream: {&_lines, &_boxes, &_spheres})
+        stream->buffer.unmap(stream->count*stream->stride);
+
+    Renderer::disable(Renderer::Feature::DepthTest);
+
+    if(_lines.count) {
+        _lineMesh.setBaseVertex(_lines.buffer.offset()/_lines.stride)
+            .setCount(_lines.count);
         _shader.setTransformationProjectionMatrix(transformationProjectionMatrix);
-        _mesh.draw(_shader);
-        Renderer::enable(Renderer::Feature::DepthTest);
+        _lineMesh.draw(_shader);
+    }
+
+    if(_boxes.count || _spheres.count)
+        _shapeShader.setTransformationProjectionMatrix(transformationProjectionMatrix);
+    if(_boxes.count) {
+        _boxMesh.setInstanceCount(_boxes.count)
+            .setBaseInstance(_boxes.buffer.offset()/_boxes.stride);
+        _boxMesh.draw(_shapeShader);
+    }
+    if(_spheres.count) {
+        _sphereMesh.setInstanceCount(_spheres.count)
+            .setBaseInstance(_spheres.buffer.offset()/_spheres.stride);
+        _sphereMesh.draw(_shapeShader);
+    }
+
+    Renderer::enable(Renderer::Feature::DepthTest);
+
+    /* Nothing can be added until the next reset() maps new regions */
+    for(Stream* stream: {&_lines, &_boxes, &_spheres}) {
+        stream->buffer.fence();
+        stream->data = nullptr;
+        stream->count = stream->capacity = 0;
     }
 }
 
@@ -63,6 +192,9 @@ void DebugLines::addFrustum(const Matrix4& imvp, const Color3& col) {
 }
 
 void DebugLines::addFrustum(const Matrix4& imvp, const Color3& col, const Float z0, const Float z1) {
+    /* 16 lines, make room for all of them at once */
+    if(_lines.count + 32 > _lines.capacity) reserve(_lines, _lines.count + 32);
+
     auto worldPointsToCover = ShadowLight::frustumCorners(imvp, z0, z1);
 
     auto nearMid = (worldPointsToCover[0] +
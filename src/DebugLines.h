@@ -30,12 +30,25 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <Corrade/Containers/ArrayView.h>
 #include <Magnum/Buffer.h>
 #include <Magnum/Mesh.h>
 #include <Magnum/SceneGraph/SceneGraph.h>
 #include <Magnum/Shaders/VertexColor.h>
 
+#include "DebugShapeShader.h"
+#include "StreamingBuffer.h"
+
 namespace Magnum {
+
+/**
+@brief Lines, boxes and spheres drawn for one frame
+
+Everything is written straight into persistently mapped streaming buffers,
+boxes and spheres are instances of a static unit shape, so each kind is a
+single draw no matter how many there are. Call @ref reset() before adding
+anything in a frame and @ref draw() once after.
+*/
 class DebugLines {
     public:
         struct Point {
@@ -43,29 +56,75 @@ class DebugLines {
             Color3 color;
         };
 
+        /** @brief Instance of a box or a sphere */
+        struct Shape {
+            Vector3 center;
+            Vector3 halfSize;
+            Color3 color;
+        };
+
         explicit DebugLines();
 
         void reset();
 
         void addLine(const Point& p0, const Point& p1) {
-            _lines.push_back(p0);
-            _lines.push_back(p1);
+            if(_lines.count + 2 > _lines.capacity) reserve(_lines, _lines.count + 2);
+            Point* const points = reinterpret_cast<Point*>(_lines.data) + _lines.count;
+            points[0] = p0;
+            points[1] = p1;
+            _lines.count += 2;
         }
 
         void addLine(const Vector3& p0, const Vector3& p1, const Color3& col) {
             addLine({p0, col}, {p1, col});
         }
 
+        /** @brief Axis-aligned box */
+        void addBox(const Vector3& center, const Vector3& halfSize, const Color3& color) {
+            addShape(_boxes, {center, halfSize, color});
+        }
+
+        void addSphere(const Vector3& center, Float radius, const Color3& color) {
+            addShape(_spheres, {center, Vector3{radius}, color});
+        }
+
+        /** @brief Add many boxes at once */
+        void addBoxes(Containers::ArrayView<const Shape> boxes) { addShapes(_boxes, boxes); }
+
+        /** @brief Add many spheres, the half-size is the radius along every axis */
+        void addSpheres(Containers::ArrayView<const Shape> spheres) { addShapes(_spheres, spheres); }
+
         void addFrustum(const Matrix4& imvp, const Color3& col);
         void addFrustum(const Matrix4& imvp, const Color3& col, Float z0, Float z1);
 
         void draw(const Matrix4& transformationProjectionMatrix);
 
     protected:
-        std::vector<Point> _lines;
-        Buffer _buffer;
-        Mesh _mesh;
+        struct Stream {
+            explicit Stream(std::size_t stride, std::size_t capacity): buffer{stride*capacity}, stride{stride} {}
+
+            StreamingBuffer buffer;
+            std::size_t stride;
+            /* Mapped region of the current frame */
+            char* data{};
+            std::size_t count{}, capacity{};
+        };
+
+        void addShape(Stream& stream, const Shape& shape) {
+            if(stream.count + 1 > stream.capacity) reserve(stream, stream.count + 1);
+            reinterpret_cast<Shape*>(stream.data)[stream.count++] = shape;
+        }
+        void addShapes(Stream& stream, Containers::ArrayView<const Shape> shapes);
+        void map(Stream& stream);
+        /* Make room for @p count items, keeps what was written already */
+        void reserve(Stream& stream, std::size_t count);
+        void setupMeshes();
+
+        Stream _lines, _boxes, _spheres;
+        Buffer _shapeVertices;
+        Mesh _lineMesh, _boxMesh, _sphereMesh;
         Shaders::VertexColor3D _shader;
+        DebugShapeShader _shapeShader;
 };
 
 }
@@ -0,0 +1,71 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DebugShapeShader.h"
+
+#include <Corrade/Utility/Resource.h>
+#include <Magnum/Context.h>
+#include <Magnum/Shader.h>
+#include <Magnum/Version.h>
+#include <Magnum/Math/Matrix4.h>
+
+namespace Magnum {
+
+DebugShapeShader::DebugShapeShader() {
+    MAGNUM_ASSERT_VERSION_SUPPORTED(Version::GL330);
+
+    const Utility::Resource rs{"shadow-data"};
+
+    Shader vert{Version::GL330, Shader::Type::Vertex};
+    Shader frag{Version::GL330, Shader::Type::Fragment};
+
+    vert.addSource(rs.get("DebugShape.vert"));
+    frag.addSource(rs.get("DebugShape.frag"));
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(Shader::compile({vert, frag}));
+
+    attachShaders({vert, frag});
+
+    bindAttributeLocation(Position::Location, "position");
+    bindAttributeLocation(InstanceCenter::Location, "instanceCenter");
+    bindAttributeLocation(InstanceHalfSize::Location, "instanceHalfSize");
+    bindAttributeLocation(InstanceColor::Location, "instanceColor");
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(link());
+
+    _transformationProjectionMatrixUniform = uniformLocation("transformationProjectionMatrix");
+}
+
+DebugShapeShader& DebugShapeShader::setTransformationProjectionMatrix(const Matrix4& matrix) {
+    setUniform(_transformationProjectionMatrixUniform, matrix);
+    return *this;
+}
+
+}
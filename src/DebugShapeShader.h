@@ -0,0 +1,69 @@
+#ifndef Magnum_Examples_DebugShapeShader_h
+#define Magnum_Examples_DebugShapeShader_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Magnum/AbstractShaderProgram.h>
+#include <Magnum/Shaders/Generic.h>
+
+namespace Magnum {
+
+/**
+@brief Instanced wireframe of a unit shape
+
+Every instance moves the shape to its center, scales it by its half-size and
+colors it, so any number of boxes or spheres is one draw.
+*/
+class DebugShapeShader: public AbstractShaderProgram {
+    public:
+        /** @brief Unit shape vertex position, per vertex */
+        typedef Shaders::Generic3D::Position Position;
+
+        /** @brief Instance center, per instance */
+        typedef Attribute<1, Vector3> InstanceCenter;
+
+        /** @brief Instance half-size, per instance */
+        typedef Attribute<2, Vector3> InstanceHalfSize;
+
+        /** @brief Instance color, per instance */
+        typedef Attribute<3, Vector3> InstanceColor;
+
+        explicit DebugShapeShader();
+
+        /** @brief Set world -> clip space matrix */
+        DebugShapeShader& setTransformationProjectionMatrix(const Matrix4& matrix);
+
+    private:
+        Int _transformationProjectionMatrixUniform;
+};
+
+}
+
+#endif
@@ -0,0 +1,99 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "DrawCommands.h"
+
+#include <algorithm>
+
+#include "ShadowCasterShader.h"
+#include "ShadowReceiverShader.h"
+#include "TraceRecorder.h"
+
+namespace {
+
+UnsignedLong sortKey(const AbstractShaderProgram& shader, const Mesh& mesh) {
+    return UnsignedLong(shader.id()) << 32 | mesh.id();
+}
+
+}
+
+void DrawCommandBuffer::clear() {
+    _packets.clear();
+    _casterUniforms.clear();
+    _receiverUniforms.clear();
+}
+
+void DrawCommandBuffer::recordCaster(ShadowCasterShader& shader, Mesh& mesh, const Matrix4& transformationProjectionMatrix) {
+    _packets.push_back({sortKey(shader, mesh), &shader, &mesh,
+        UnsignedInt(_casterUniforms.size()), DrawPacket::Type::Caster});
+    _casterUniforms.push_back({transformationProjectionMatrix});
+}
+
+void DrawCommandBuffer::recordReceiver(ShadowReceiverShader& shader, Mesh& mesh, const ReceiverUniforms& uniforms) {
+    _packets.push_back({sortKey(shader, mesh), &shader, &mesh,
+        UnsignedInt(_receiverUniforms.size()), DrawPacket::Type::Receiver});
+    _receiverUniforms.push_back(uniforms);
+}
+
+void DrawCommandBuffer::submit(const std::size_t i) const {
+    const DrawPacket& packet = _packets[i];
+    switch(packet.type) {
+        case DrawPacket::Type::Caster: {
+            auto& shader = static_cast<ShadowCasterShader&>(*packet.shader);
+            shader.setTransformationMatrix(_casterUniforms[packet.uniformOffset].transformationProjectionMatrix);
+            packet.mesh->draw(shader);
+        } break;
+
+        case DrawPacket::Type::Receiver: {
+            auto& shader = static_cast<ShadowReceiverShader&>(*packet.shader);
+            const ReceiverUniforms& uniforms = _receiverUniforms[packet.uniformOffset];
+            shader.setTransformationProjectionMatrix(uniforms.transformationProjectionMatrix)
+                .setModelMatrix(uniforms.modelMatrix)
+                .setAmbientColor(uniforms.ambientColor)
+                .setDiffuseColor(uniforms.diffuseColor)
+                .setSpecularColor(uniforms.specularColor)
+                .setShininess(uniforms.shininess);
+            packet.mesh->draw(shader);
+        } break;
+    }
+}
+
+DrawCommands::DrawCommands(const std::size_t bufferCount): _buffers(bufferCount) {}
+
+void DrawCommands::setBufferCount(const std::size_t count) {
+    _buffers.resize(count);
+}
+
+void DrawCommands::clear() {
+    for(DrawCommandBuffer& buffer: _buffers) buffer.clear();
+}
+
+std::size_t DrawCommands::size() const {
+    std::size_t size = 0;
+    for(const DrawCommandBuffer& buffer: _buffers) size += buffer.size();
+    return size;
+}
+
+void DrawCommands::replay() {
+    PROFILE_ZONE("DrawCommands::replay");
+
+    _order.clear();
+    for(std::size_t b = 0; b != _buffers.size(); ++b)
+        for(std::size_t i = 0; i != _buffers[b].size(); ++i)
+            _order.push_back({_buffers[b].packet(i).sortKey, UnsignedInt(b), UnsignedInt(i)});
+
+    /* Buffer and packet index last, which keeps the recording order for
+       equal keys without a stable sort and its temporary buffer */
+    std::sort(_order.begin(), _order.end(), [](const Entry& a, const Entry& b) {
+        if(a.key != b.key) return a.key < b.key;
+        if(a.buffer != b.buffer) return a.buffer < b.buffer;
+        return a.packet < b.packet;
+    });
+
+    for(const Entry& entry: _order)
+        _buffers[entry.buffer].submit(entry.packet);
+}
@@ -0,0 +1,111 @@
+#if !defined(DRAWCOMMANDS_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define DRAWCOMMANDS_H
+
+#include <cstddef>
+#include <vector>
+
+#include <Magnum/AbstractShaderProgram.h>
+#include <Magnum/Magnum.h>
+#include <Magnum/Mesh.h>
+#include <Magnum/Math/Color.h>
+#include <Magnum/Math/Matrix4.h>
+
+using namespace Magnum;
+
+namespace Magnum {
+class ShadowCasterShader;
+class ShadowReceiverShader;
+}
+
+/* One recorded draw. Its uniforms are in the buffer it was recorded into,
+   at uniformOffset in the array of its type. */
+struct DrawPacket {
+    enum class Type: UnsignedByte { Caster, Receiver };
+
+    /* Program in the upper half, vertex array in the lower one */
+    UnsignedLong sortKey;
+    AbstractShaderProgram* shader;
+    /* Vertex array and index range, the caster levels of detail are ranges
+       of one index buffer */
+    Mesh* mesh;
+    UnsignedInt uniformOffset;
+    Type type;
+};
+
+struct CasterUniforms {
+    Matrix4 transformationProjectionMatrix;
+};
+
+struct ReceiverUniforms {
+    Matrix4 transformationProjectionMatrix, modelMatrix;
+    Color3 ambientColor, diffuseColor, specularColor;
+    Float shininess;
+};
+
+/**
+Draws recorded by one thread. Recording only copies values and touches no GL
+state, so any thread can do it as long as no two record into the same buffer
+at once. The storage is kept by @ref clear(), after the first frames
+recording doesn't allocate.
+*/
+class DrawCommandBuffer {
+public:
+    void clear();
+
+    std::size_t size() const { return _packets.size(); }
+    const DrawPacket& packet(std::size_t i) const { return _packets[i]; }
+
+    void recordCaster(ShadowCasterShader& shader, Mesh& mesh, const Matrix4& transformationProjectionMatrix);
+    void recordReceiver(ShadowReceiverShader& shader, Mesh& mesh, const ReceiverUniforms& uniforms);
+
+    /* Set the uniforms of packet @p i and draw it, GL thread only */
+    void submit(std::size_t i) const;
+
+private:
+    std::vector<DrawPacket> _packets;
+    std::vector<CasterUniforms> _casterUniforms;
+    std::vector<ReceiverUniforms> _receiverUniforms;
+};
+
+/**
+Per-thread command buffers of one pass, replayed together on the GL thread.
+The draws are sorted by program and then vertex array, so each gets bound
+once. Draws with the same key stay in the order they were recorded in,
+buffer by buffer.
+*/
+class DrawCommands {
+public:
+    explicit DrawCommands(std::size_t bufferCount = 1);
+
+    /* Buffers that stay keep their storage */
+    void setBufferCount(std::size_t count);
+    std::size_t bufferCount() const { return _buffers.size(); }
+
+    DrawCommandBuffer& buffer(std::size_t i) { return _buffers[i]; }
+
+    void clear();
+
+    /* Draws in all buffers */
+    std::size_t size() const;
+
+    /* Sort and submit every buffer, GL thread only */
+    void replay();
+
+private:
+    struct Entry {
+        UnsignedLong key;
+        UnsignedInt buffer, packet;
+    };
+
+    std::vector<DrawCommandBuffer> _buffers;
+    std::vector<Entry> _order;
+};
+
+#endif
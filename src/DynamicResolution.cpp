@@ -0,0 +1,175 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "DynamicResolution.h"
+
+#include <cmath>
+
+#include <Magnum/DefaultFramebuffer.h>
+#include <Magnum/Renderer.h>
+#include <Magnum/RenderbufferFormat.h>
+#include <Magnum/TextureFormat.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/Math/Range.h>
+
+#include "TraceRecorder.h"
+
+namespace {
+    /* Grow only below this fraction of the target, in steps of this much
+       scale */
+    constexpr const Float GrowThreshold = 0.85f;
+    constexpr const Float GrowStep = 0.02f;
+
+    /* Frames between changes, enough for the profiler to read back a
+       frame drawn with the new scale */
+    constexpr const UnsignedInt Cooldown = FrameProfiler::FrameLatency + 1;
+
+    Int roundUp(const Int value, const Int multiple) {
+        return (value + multiple - 1)/multiple*multiple;
+    }
+}
+
+DynamicResolution::DynamicResolution(const Int sampleCount):
+_sampleCount{Math::max(sampleCount, 1)},
+_enabled{false},
+_targetGpuTime{15.0f},
+_minScale{0.5f},
+_maxScale{1.0f},
+_scale{1.0f},
+_sharpness{0.25f},
+_lastSample{0},
+_cooldown{0},
+_allocationCount{0},
+_color{NoCreate},
+_multisampleColor{NoCreate},
+_depth{NoCreate},
+_framebuffer{NoCreate},
+_resolveFramebuffer{NoCreate}
+{
+    _fullscreenTriangle.setPrimitive(MeshPrimitive::Triangles)
+        .setCount(3);
+}
+
+void DynamicResolution::setEnabled(const bool enabled) {
+    _enabled = enabled;
+    _scale = _maxScale;
+    _cooldown = 0;
+    if(_enabled) {
+        allocate();
+    } else {
+        _color = Texture2D{NoCreate};
+        _multisampleColor = Renderbuffer{NoCreate};
+        _depth = Renderbuffer{NoCreate};
+        _framebuffer = Framebuffer{NoCreate};
+        _resolveFramebuffer = Framebuffer{NoCreate};
+        _targetSize = {};
+    }
+    updateRenderSize();
+}
+
+void DynamicResolution::setScaleRange(const Float min, const Float max) {
+    _maxScale = Math::clamp(max, 0.1f, 1.0f);
+    _minScale = Math::clamp(min, 0.1f, _maxScale);
+    _scale = Math::clamp(_scale, _minScale, _maxScale);
+    if(_enabled) allocate();
+    updateRenderSize();
+}
+
+void DynamicResolution::setWindowSize(const Vector2i& size) {
+    _windowSize = size;
+    if(_enabled) allocate();
+    updateRenderSize();
+}
+
+void DynamicResolution::allocate() {
+    const Vector2i largest{Math::ceil(Vector2{_windowSize}*_maxScale)};
+    const Vector2i size{roundUp(Math::max(largest.x(), 1), BucketSize),
+                        roundUp(Math::max(largest.y(), 1), BucketSize)};
+    if(size == _targetSize) return;
+
+    PROFILE_ZONE("DynamicResolution::allocate");
+    _targetSize = size;
+    ++_allocationCount;
+
+    (_color = Texture2D{})
+        .setStorage(1, TextureFormat::RGBA8, size)
+        .setMinificationFilter(Sampler::Filter::Linear)
+        .setMagnificationFilter(Sampler::Filter::Linear)
+        .setWrapping(Sampler::Wrapping::ClampToEdge);
+
+    _depth = Renderbuffer{};
+    _framebuffer = Framebuffer{{{}, size}};
+    if(_sampleCount > 1) {
+        _multisampleColor = Renderbuffer{};
+        _multisampleColor.setStorageMultisample(_sampleCount, RenderbufferFormat::RGBA8, size);
+        _depth.setStorageMultisample(_sampleCount, RenderbufferFormat::DepthComponent24, size);
+        _framebuffer.attachRenderbuffer(Framebuffer::ColorAttachment{0}, _multisampleColor);
+        (_resolveFramebuffer = Framebuffer{{{}, size}})
+            .attachTexture(Framebuffer::ColorAttachment{0}, _color, 0);
+        CORRADE_INTERNAL_ASSERT(_resolveFramebuffer.checkStatus(FramebufferTarget::Draw) == Framebuffer::Status::Complete);
+    } else {
+        _depth.setStorage(RenderbufferFormat::DepthComponent24, size);
+        _framebuffer.attachTexture(Framebuffer::ColorAttachment{0}, _color, 0);
+    }
+    _framebuffer.attachRenderbuffer(Framebuffer::BufferAttachment::Depth, _depth);
+    CORRADE_INTERNAL_ASSERT(_framebuffer.checkStatus(FramebufferTarget::Draw) == Framebuffer::Status::Complete);
+}
+
+void DynamicResolution::updateRenderSize() {
+    if(!_enabled) {
+        _renderSize = _windowSize;
+        return;
+    }
+
+    const Vector2 scaled = Vector2{_windowSize}*_scale;
+    _renderSize = {Math::clamp(roundUp(Int(scaled.x()), SizeGranularity), SizeGranularity, _targetSize.x()),
+                   Math::clamp(roundUp(Int(scaled.y()), SizeGranularity), SizeGranularity, _targetSize.y())};
+    _framebuffer.setViewport({{}, _renderSize});
+}
+
+void DynamicResolution::update(const FrameProfiler& profiler) {
+    if(!_enabled || !profiler.hasGpuTimes()) return;
+
+    /* Nothing new read back since last time */
+    if(profiler.gpuWorkFrameCount() == _lastSample) return;
+    _lastSample = profiler.gpuWorkFrameCount();
+    if(_cooldown) {
+        --_cooldown;
+        return;
+    }
+
+    const Float time = profiler.lastGpuWorkTime();
+    if(time <= 0.0f) return;
+
+    Float scale = _scale;
+    if(time > _targetGpuTime)
+        scale = _scale*std::sqrt(_targetGpuTime/time);
+    else if(time < GrowThreshold*_targetGpuTime)
+        scale = Math::min(_scale + GrowStep, _scale*std::sqrt(_targetGpuTime/time));
+    scale = Math::clamp(scale, _minScale, _maxScale);
+
+    const Vector2i previousSize = _renderSize;
+    _scale = scale;
+    updateRenderSize();
+    if(_renderSize != previousSize) _cooldown = Cooldown;
+}
+
+void DynamicResolution::upscale() {
+    PROFILE_ZONE("DynamicResolution::upscale");
+
+    if(_sampleCount > 1)
+        Framebuffer::blit(_framebuffer, _resolveFramebuffer, {{}, _renderSize}, FramebufferBlit::Color);
+
+    /* At full size it's a straight copy, nothing to sharpen */
+    defaultFramebuffer.bind();
+    Renderer::disable(Renderer::Feature::DepthTest);
+    _shader.setSourceTexture(_color, _renderSize, _targetSize)
+        .setOutputSize(_windowSize)
+        .setSharpness(_renderSize == _windowSize ? 0.0f : _sharpness);
+    _fullscreenTriangle.draw(_shader);
+    Renderer::enable(Renderer::Feature::DepthTest);
+}
@@ -0,0 +1,113 @@
+#if !defined(DYNAMICRESOLUTION_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define DYNAMICRESOLUTION_H
+
+#include <cstddef>
+
+#include <Magnum/Framebuffer.h>
+#include <Magnum/Magnum.h>
+#include <Magnum/Mesh.h>
+#include <Magnum/Renderbuffer.h>
+#include <Magnum/Texture.h>
+#include <Magnum/Math/Vector2.h>
+
+#include "FrameProfiler.h"
+#include "UpscaleShader.h"
+
+using namespace Magnum;
+
+/**
+Renders the scene into an offscreen framebuffer smaller than the window and
+upscales it to the default framebuffer with @ref UpscaleShader, sharpening
+what the lower resolution blurs.
+
+The scale follows the GPU time of the frame from @ref FrameProfiler. Over
+the target it drops right away to where the time would fit, assuming the
+cost goes with the pixel count. Well under the target it grows in small
+steps. The results arrive a few frames late, so after every change it
+waits for them before changing again.
+
+The targets are allocated for the largest scale rounded up to a bucket of
+@ref BucketSize pixels and the scene is drawn into a part of them. Window
+resizes only reallocate when they cross a bucket, scale changes never do.
+*/
+class DynamicResolution {
+public:
+    enum: Int {
+        /* Render sizes are multiples of this */
+        SizeGranularity = 8,
+        BucketSize = 256
+    };
+
+    /* Offscreen targets with given MSAA sample count, resolved before the
+       upscale. Needs a GL context, nothing is allocated while disabled. */
+    explicit DynamicResolution(Int sampleCount = 1);
+
+    DynamicResolution(const DynamicResolution&) = delete;
+    DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+    bool isEnabled() const { return _enabled; }
+    /* Disabling frees the targets and goes back to full scale */
+    void setEnabled(bool enabled);
+
+    /* GPU milliseconds per frame to fit in, default is a bit under 60 FPS */
+    Float targetGpuTime() const { return _targetGpuTime; }
+    void setTargetGpuTime(Float milliseconds) { _targetGpuTime = milliseconds; }
+
+    /* Range of the scale of both sides, 0.5 to 1 by default */
+    void setScaleRange(Float min, Float max);
+    Float scale() const { return _scale; }
+
+    /* 0 is plain bilinear, 1 the strongest, 0.25 by default */
+    Float sharpness() const { return _sharpness; }
+    void setSharpness(Float sharpness) { _sharpness = sharpness; }
+
+    /* Call from the viewport event */
+    void setWindowSize(const Vector2i& size);
+
+    /* Size the scene is drawn at, the viewport of framebuffer() */
+    Vector2i renderSize() const { return _renderSize; }
+
+    /* Size of the allocated targets */
+    Vector2i targetSize() const { return _targetSize; }
+
+    /* Times the targets were allocated */
+    std::size_t allocationCount() const { return _allocationCount; }
+
+    /* Adjust the scale to the last GPU time read back, once per frame
+       before drawing. Does nothing without GPU times. */
+    void update(const FrameProfiler& profiler);
+
+    /* Where to draw the scene, valid only while enabled */
+    Framebuffer& framebuffer() { return _framebuffer; }
+
+    /* Resolve and upscale to the default framebuffer, which is bound
+       after */
+    void upscale();
+
+private:
+    void allocate();
+    void updateRenderSize();
+
+    Int _sampleCount;
+    bool _enabled;
+    Float _targetGpuTime, _minScale, _maxScale, _scale, _sharpness;
+    UnsignedLong _lastSample;
+    UnsignedInt _cooldown;
+    Vector2i _windowSize, _renderSize, _targetSize;
+    std::size_t _allocationCount;
+
+    Texture2D _color;
+    Renderbuffer _multisampleColor, _depth;
+    Framebuffer _framebuffer, _resolveFramebuffer;
+    UpscaleShader _shader;
+    Mesh _fullscreenTriangle;
+};
+
+#endif
@@ -0,0 +1,41 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "FrameArena.h"
+
+#include <algorithm>
+
+FrameArena::FrameArena(const std::size_t capacity): _block(capacity), _offset{0}, _overflowSize{0}, _peak{0} {}
+
+void* FrameArena::allocate(const std::size_t size, const std::size_t alignment) {
+    /* The block itself is aligned for any fundamental type */
+    const std::size_t offset = (_offset + alignment - 1) & ~(alignment - 1);
+    if(offset + size <= _block.size()) {
+        _offset = offset + size;
+        return _block + offset;
+    }
+
+    /* Doesn't fit, fall back to the heap until the next reset() */
+    _overflow.push_back(Containers::Array<char>(size + alignment));
+    _overflowSize += size + alignment;
+    const std::size_t address = reinterpret_cast<std::size_t>(_overflow.back().data());
+    return _overflow.back() + (((address + alignment - 1) & ~(alignment - 1)) - address);
+}
+
+void FrameArena::reset() {
+    _peak = std::max(_peak, used());
+
+    /* Grow to the whole last frame with some headroom, so the next one fits
+       without any heap allocation */
+    if(!_overflow.empty()) {
+        _block = Containers::Array<char>(std::max(_block.size()*2, used() + used()/2));
+        _overflow.clear();
+        _overflowSize = 0;
+    }
+
+    _offset = 0;
+}
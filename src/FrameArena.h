@@ -0,0 +1,63 @@
+#if !defined(FRAMEARENA_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define FRAMEARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include <Corrade/Containers/Array.h>
+#include <Corrade/Containers/ArrayView.h>
+
+using namespace Corrade;
+
+/**
+Linear allocator for data that lives for one frame. Allocating is a pointer
+bump, @ref reset() at the start of a frame throws everything away at once.
+
+When a frame needs more than the capacity, the rest comes from separate heap
+blocks and the next @ref reset() grows the arena to fit all of it, so only
+the first frames of a bigger scene allocate.
+*/
+class FrameArena {
+public:
+    enum: std::size_t { DefaultCapacity = 64*1024 };
+
+    explicit FrameArena(std::size_t capacity = DefaultCapacity);
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    /* Uninitialized memory for @p count values, valid until the next
+       reset(). Nothing is destructed, so only for trivial types. */
+    template<class T> Containers::ArrayView<T> allocate(std::size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena values are never destructed");
+        return {static_cast<T*>(allocate(count*sizeof(T), alignof(T))), count};
+    }
+
+    void* allocate(std::size_t size, std::size_t alignment);
+
+    /* Free everything allocated since the last reset */
+    void reset();
+
+    std::size_t capacity() const { return _block.size(); }
+    /* Bytes allocated since the last reset, including the overflow */
+    std::size_t used() const { return _offset + _overflowSize; }
+    /* Most bytes used in one frame */
+    std::size_t peak() const { return _peak; }
+
+private:
+    Containers::Array<char> _block;
+    std::size_t _offset;
+    std::vector<Containers::Array<char>> _overflow;
+    std::size_t _overflowSize, _peak;
+};
+
+#endif
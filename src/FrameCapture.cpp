@@ -0,0 +1,188 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "FrameCapture.h"
+
+#include <fstream>
+
+#include <Magnum/Buffer.h>
+#include <Magnum/Framebuffer.h>
+#include <Magnum/Math/Functions.h>
+
+#include "ShadowLight.h"
+#include "ThreadPool.h"
+#include "TraceRecorder.h"
+
+namespace {
+    constexpr const std::size_t FrameDigits = 6;
+
+    std::string frameNumber(const UnsignedLong frame) {
+        std::string number = std::to_string(frame);
+        if(number.size() < FrameDigits) number.insert(0, FrameDigits - number.size(), '0');
+        return number;
+    }
+}
+
+FrameCapture::FrameCapture(ThreadPool& pool, const std::size_t slotCount):
+_pool(pool),
+_slots{new Slot[slotCount]},
+_slotCount{slotCount},
+_nextSlot{0},
+_prefix{"frame-"},
+_shadowLight{nullptr},
+_capturedCount{0},
+_droppedCount{0},
+_writtenCount{0},
+_failedCount{0},
+_pendingWrites{0}
+{}
+
+FrameCapture::~FrameCapture() {
+    finish();
+}
+
+bool FrameCapture::capture(AbstractFramebuffer& framebuffer, const Range2Di& rectangle, const UnsignedLong frame) {
+    PROFILE_ZONE("FrameCapture::capture");
+
+    update();
+
+    /* The ring is full if the oldest slot is still in flight, the GPU or
+       the pool isn't keeping up */
+    Slot& slot = _slots[_nextSlot];
+    if(slot.state != State::Free) {
+        ++_droppedCount;
+        return false;
+    }
+
+    /* Orphans the previous storage, nothing on the CPU waits for it */
+    slot.size = rectangle.size();
+    framebuffer.read(rectangle, slot.color, BufferUsage::StreamRead);
+
+    slot.layerCount = _shadowLight ? _shadowLight->layerCount() : 0;
+    if(slot.layerCount) {
+        slot.layerSize = _shadowLight->shadowMapSize();
+        while(slot.layers.size() < slot.layerCount)
+            slot.layers.emplace_back(PixelFormat::DepthComponent, PixelType::Float);
+        slot.layerData.resize(slot.layerCount);
+        for(std::size_t layer = 0; layer != slot.layerCount; ++layer)
+            _shadowLight->layerFramebuffer(layer).read({{}, slot.layerSize}, slot.layers[layer], BufferUsage::StreamRead);
+    }
+
+    slot.frame = frame;
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.state = State::Reading;
+    _nextSlot = (_nextSlot + 1) % _slotCount;
+    ++_capturedCount;
+    return true;
+}
+
+void FrameCapture::update() {
+    for(std::size_t i = 0; i != _slotCount; ++i) {
+        Slot& slot = _slots[i];
+        if(slot.state == State::Reading) poll(slot, false);
+        else if(slot.state == State::Written) unmap(slot);
+    }
+}
+
+void FrameCapture::finish() {
+    PROFILE_ZONE("FrameCapture::finish");
+
+    for(std::size_t i = 0; i != _slotCount; ++i)
+        if(_slots[i].state == State::Reading) poll(_slots[i], true);
+    _pool.wait(_pendingWrites);
+    update();
+}
+
+void FrameCapture::poll(Slot& slot, const bool block) {
+    /* Flush so the fence is guaranteed to signal eventually */
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    for(;;) {
+        const GLenum status = glClientWaitSync(slot.fence, flags, block ? 1000000 : 0);
+        if(status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED || status == GL_WAIT_FAILED) break;
+        if(!block) return;
+        flags = 0;
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    slot.colorData = slot.color.buffer().map<char>(0, 4*slot.size.product(), Buffer::MapFlag::Read);
+    for(std::size_t layer = 0; layer != slot.layerCount; ++layer)
+        slot.layerData[layer] = slot.layers[layer].buffer().map<char>(0, sizeof(Float)*slot.layerSize.product(), Buffer::MapFlag::Read);
+
+    slot.state = State::Writing;
+    _pool.submit(_pendingWrites, [this, &slot]{ write(slot); });
+}
+
+void FrameCapture::unmap(Slot& slot) {
+    slot.color.buffer().unmap();
+    for(std::size_t layer = 0; layer != slot.layerCount; ++layer)
+        slot.layers[layer].buffer().unmap();
+    slot.colorData = nullptr;
+    slot.state = State::Free;
+}
+
+void FrameCapture::write(Slot& slot) {
+    PROFILE_ZONE("FrameCapture::write");
+
+    /* A buffer that failed to map is counted like a failed write */
+    const std::string name = _prefix + frameNumber(slot.frame);
+    bool written = slot.colorData && writePpm(name + ".ppm", slot.size, rgbFromRgba(slot.size, slot.colorData));
+    for(std::size_t layer = 0; layer != slot.layerCount; ++layer)
+        written = slot.layerData[layer] && writeDepthPgm(name + "-shadow" + std::to_string(layer) + ".pgm",
+            slot.layerSize, reinterpret_cast<const Float*>(slot.layerData[layer])) && written;
+
+    if(written) ++_writtenCount;
+    else ++_failedCount;
+    slot.state = State::Written;
+}
+
+std::string FrameCapture::rgbFromRgba(const Vector2i& size, const char* const rgba) {
+    std::string rgb(3*size.product(), '\0');
+    for(Int y = 0; y != size.y(); ++y) {
+        const char* const row = rgba + 4*size.x()*(size.y() - y - 1);
+        for(Int x = 0; x != size.x(); ++x)
+            for(Int c = 0; c != 3; ++c)
+                rgb[3*(y*size.x() + x) + c] = row[4*x + c];
+    }
+    return rgb;
+}
+
+bool FrameCapture::writePpm(const std::string& filename, const Vector2i& size, const std::string& rgb) {
+    std::ofstream file{filename, std::ios::binary};
+    file << "P6\n" << size.x() << " " << size.y() << "\n255\n";
+    file.write(rgb.data(), rgb.size());
+    return bool(file);
+}
+
+bool FrameCapture::readPpm(const std::string& filename, Vector2i& size, std::string& rgb) {
+    std::ifstream file{filename, std::ios::binary};
+    std::string magic;
+    Int max;
+    if(!(file >> magic >> size.x() >> size.y() >> max) || magic != "P6" || max != 255)
+        return false;
+    file.get();
+    rgb.resize(3*size.product());
+    return bool(file.read(&rgb[0], rgb.size()));
+}
+
+bool FrameCapture::writeDepthPgm(const std::string& filename, const Vector2i& size, const Float* const depth) {
+    /* Big endian, as PGM wants it */
+    std::string gray(2*size.product(), '\0');
+    for(Int y = 0; y != size.y(); ++y) {
+        const Float* const row = depth + size.x()*(size.y() - y - 1);
+        for(Int x = 0; x != size.x(); ++x) {
+            const UnsignedShort value = UnsignedShort(Math::clamp(row[x], 0.0f, 1.0f)*65535.0f + 0.5f);
+            gray[2*(y*size.x() + x)] = char(value >> 8);
+            gray[2*(y*size.x() + x) + 1] = char(value & 0xff);
+        }
+    }
+
+    std::ofstream file{filename, std::ios::binary};
+    file << "P5\n" << size.x() << " " << size.y() << "\n65535\n";
+    file.write(gray.data(), gray.size());
+    return bool(file);
+}
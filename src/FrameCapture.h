@@ -0,0 +1,138 @@
+#if !defined(FRAMECAPTURE_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define FRAMECAPTURE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Magnum/AbstractFramebuffer.h>
+#include <Magnum/BufferImage.h>
+#include <Magnum/Magnum.h>
+#include <Magnum/OpenGL.h>
+#include <Magnum/PixelFormat.h>
+#include <Magnum/Math/Range.h>
+
+using namespace Magnum;
+
+namespace Magnum {
+class ShadowLight;
+}
+
+class ThreadPool;
+
+/**
+Saves frames without stalling the GL thread. @ref capture() reads the
+framebuffer, and optionally every shadow map layer, into pixel pack buffers
+and puts a fence after them. Once the fence has signalled, @ref update()
+maps the buffers and a job on the thread pool encodes and writes the
+images. The buffers stay mapped until the job is done, so the pixels are
+never copied on the GL thread.
+
+The color goes to PREFIXnnnnnn.ppm, binary 8-bit RGB, the shadow map
+layers to PREFIXnnnnnn-shadowN.pgm, binary 16-bit grayscale of the depth.
+
+There's a fixed number of slots. Frames captured while all of them are
+still in flight are dropped and counted, rather than waited for.
+
+The pool should be one the frame doesn't wait on. A thread waiting for its
+own jobs doesn't pick up the writes, but they'd still keep the workers from
+the frame's jobs.
+*/
+class FrameCapture {
+public:
+    enum: std::size_t { DefaultSlotCount = 4 };
+
+    explicit FrameCapture(ThreadPool& pool, std::size_t slotCount = DefaultSlotCount);
+    /* Writes everything captured so far */
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    /* Start of the file names, including the directory */
+    void setPrefix(const std::string& prefix) { _prefix = prefix; }
+    const std::string& prefix() const { return _prefix; }
+
+    /* Capture the layers of @p light too, null for only the color */
+    void setShadowLight(ShadowLight* light) { _shadowLight = light; }
+
+    /**
+     * Queue the readback of @p rectangle of @p framebuffer as frame
+     * @p frame. Call once the frame is drawn, for the default framebuffer
+     * before the buffer swap. Returns false if the frame was dropped.
+     */
+    bool capture(AbstractFramebuffer& framebuffer, const Range2Di& rectangle, UnsignedLong frame);
+
+    /* Hand finished readbacks to the pool and release written slots, call
+       every frame. Never waits. */
+    void update();
+
+    /* Wait until everything captured is written */
+    void finish();
+
+    UnsignedLong capturedCount() const { return _capturedCount; }
+    UnsignedLong droppedCount() const { return _droppedCount; }
+    UnsignedLong writtenCount() const { return _writtenCount; }
+    UnsignedLong failedCount() const { return _failedCount; }
+
+    /* RGB rows top-down as in PPM, from RGBA8 rows bottom-up as read from
+       GL */
+    static std::string rgbFromRgba(const Vector2i& size, const char* rgba);
+    static bool writePpm(const std::string& filename, const Vector2i& size, const std::string& rgb);
+    /* Only the binary 8-bit flavor written above */
+    static bool readPpm(const std::string& filename, Vector2i& size, std::string& rgb);
+    /* 16-bit grayscale rows top-down from float rows bottom-up */
+    static bool writeDepthPgm(const std::string& filename, const Vector2i& size, const Float* depth);
+
+private:
+    enum class State: UnsignedByte {
+        Free,
+        /* Waiting for the fence */
+        Reading,
+        /* Mapped, the pool is writing it */
+        Writing,
+        /* Written, to be unmapped */
+        Written
+    };
+
+    struct Slot {
+        BufferImage2D color{PixelFormat::RGBA, PixelType::UnsignedByte};
+        std::vector<BufferImage2D> layers;
+        std::size_t layerCount{};
+        Vector2i size, layerSize;
+        UnsignedLong frame{};
+        GLsync fence{};
+        /* Valid while mapped */
+        const char* colorData{};
+        std::vector<const char*> layerData;
+        std::atomic<State> state{State::Free};
+    };
+
+    /* Map and hand a slot with a signalled fence to the pool, with
+       @p block waits for the fence */
+    void poll(Slot& slot, bool block);
+    void unmap(Slot& slot);
+    void write(Slot& slot);
+
+    ThreadPool& _pool;
+    std::unique_ptr<Slot[]> _slots;
+    std::size_t _slotCount, _nextSlot;
+    std::string _prefix;
+    ShadowLight* _shadowLight;
+
+    UnsignedLong _capturedCount, _droppedCount;
+    std::atomic<UnsignedLong> _writtenCount, _failedCount;
+    /* Slots the pool is writing */
+    std::atomic<std::size_t> _pendingWrites;
+};
+
+#endif
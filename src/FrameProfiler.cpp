@@ -0,0 +1,247 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "FrameProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <Corrade/Utility/Assert.h>
+#include <Magnum/Context.h>
+#include <Magnum/Extensions.h>
+
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+
+namespace {
+    bool hasPipelineStatistics() {
+        const std::vector<std::string> extensions = Context::current().extensionStrings();
+        return std::find(extensions.begin(), extensions.end(), "GL_ARB_pipeline_statistics_query") != extensions.end();
+    }
+}
+
+FrameProfiler::FrameProfiler():
+_gpuTimes{Context::current().isExtensionSupported<Extensions::GL::ARB::timer_query>()},
+_waitForResults{false},
+_issued{},
+_fragmentCounts{hasPipelineStatistics()},
+_countedSections{},
+_countingSection{FrameSection},
+_frame{0},
+_lastGpuWorkTime{0.0f},
+_gpuWorkFrameCount{0},
+_slot{0},
+_historySize{DefaultHistorySize},
+_cpuHistoryCount{0}
+{
+    if(_gpuTimes) {
+        _queries.reserve(FrameLatency*MaxSections*2);
+        for(std::size_t i = 0; i != FrameLatency*MaxSections*2; ++i)
+            _queries.emplace_back(TimeQuery::Target::Timestamp);
+    }
+    if(_fragmentCounts) {
+        _statisticsQueries.resize(FrameLatency*MaxSections);
+        glGenQueries(GLsizei(_statisticsQueries.size()), _statisticsQueries.data());
+    }
+
+    addSection("frame");
+}
+
+FrameProfiler::~FrameProfiler() {
+    if(_fragmentCounts)
+        glDeleteQueries(GLsizei(_statisticsQueries.size()), _statisticsQueries.data());
+}
+
+UnsignedInt FrameProfiler::addSection(std::string name) {
+    CORRADE_ASSERT(_sections.size() < MaxSections, "FrameProfiler::addSection(): too many sections", 0);
+
+    _sections.push_back(Section{std::move(name), {}, 0.0f, 0, 0,
+        std::vector<Float>(_historySize), std::vector<Float>(_historySize), 0, 0, 0, 0});
+    return _sections.size() - 1;
+}
+
+void FrameProfiler::setHistorySize(const std::size_t frames) {
+    CORRADE_ASSERT(frames, "FrameProfiler::setHistorySize(): the history can't be empty", );
+
+    _historySize = frames;
+    for(Section& section: _sections) {
+        section.cpuHistory.assign(_historySize, 0.0f);
+        section.gpuHistory.assign(_historySize, 0.0f);
+    }
+    reset();
+}
+
+void FrameProfiler::reset() {
+    _cpuHistoryCount = 0;
+    for(Section& section: _sections) {
+        section.gpuHistoryCount = 0;
+        section.fragmentTotal = 0;
+        section.fragmentFrames = 0;
+    }
+}
+
+void FrameProfiler::finish() {
+    if(!_gpuTimes && !_fragmentCounts) return;
+
+    /* Oldest frame first, the slots of the last FrameLatency frames haven't
+       been read back yet */
+    const bool wait = _waitForResults;
+    _waitForResults = true;
+    for(UnsignedLong frame = _frame > FrameLatency ? _frame - FrameLatency : 0; frame != _frame; ++frame) {
+        const UnsignedInt slot = frame % FrameLatency;
+        readBack(slot);
+        std::fill_n(_issued[slot], std::size_t(MaxSections), 0);
+        std::fill_n(_countedSections[slot], std::size_t(MaxSections), 0);
+    }
+    _waitForResults = wait;
+}
+
+void FrameProfiler::beginFrame() {
+    /* The queries of this slot were issued FrameLatency frames ago */
+    _slot = _frame % FrameLatency;
+    if((_gpuTimes || _fragmentCounts) && _frame >= FrameLatency) readBack(_slot);
+    std::fill_n(_issued[_slot], std::size_t(MaxSections), 0);
+    std::fill_n(_countedSections[_slot], std::size_t(MaxSections), 0);
+
+    for(Section& section: _sections) {
+        section.cpuTime = 0.0f;
+        section.drawCount = 0;
+    }
+
+    begin(FrameSection);
+}
+
+void FrameProfiler::endFrame() {
+    end(FrameSection);
+
+    for(Section& section: _sections) {
+        section.cpuHistory[_cpuHistoryCount % _historySize] = section.cpuTime;
+        section.lastDrawCount = section.drawCount;
+    }
+    ++_cpuHistoryCount;
+
+    ++_frame;
+}
+
+void FrameProfiler::begin(const UnsignedInt section) {
+    Section& s = _sections[section];
+    s.cpuBegin = std::chrono::steady_clock::now();
+
+    /* Only the first entry of a section in a frame is counted, a query
+       can't be resumed */
+    if(_fragmentCounts && section != FrameSection && _countingSection == FrameSection && !_countedSections[_slot][section]) {
+        glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, statisticsQuery(_slot, section));
+        _countedSections[_slot][section] = 1;
+        _countingSection = section;
+    }
+
+    if(!_gpuTimes || _issued[_slot][section]) return;
+    query(_slot, section, false).timestamp();
+    _issued[_slot][section] = 1;
+}
+
+void FrameProfiler::end(const UnsignedInt section, const UnsignedInt drawCount) {
+    Section& s = _sections[section];
+    s.cpuTime += std::chrono::duration<Float, std::milli>{std::chrono::steady_clock::now() - s.cpuBegin}.count();
+    s.drawCount += drawCount;
+
+    if(_countingSection == section && section != FrameSection) {
+        glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+        _countingSection = FrameSection;
+    }
+
+    if(_gpuTimes) query(_slot, section, true).timestamp();
+}
+
+void FrameProfiler::readBack(const UnsignedInt slot) {
+    if(_fragmentCounts) for(UnsignedInt i = 0; i != _sections.size(); ++i) {
+        if(!_countedSections[slot][i]) continue;
+
+        const GLuint id = statisticsQuery(slot, i);
+        GLuint available = GL_TRUE;
+        if(!_waitForResults) glGetQueryObjectuiv(id, GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available) continue;
+
+        GLuint64 count;
+        glGetQueryObjectui64v(id, GL_QUERY_RESULT, &count);
+        Section& section = _sections[i];
+        section.lastFragmentCount = count;
+        section.fragmentTotal += count;
+        ++section.fragmentFrames;
+    }
+
+    /* The frame end is the last query of the frame, if it's not there, the
+       others probably aren't either and nobody wants to wait. Getting the
+       result blocks otherwise. */
+    if(!_gpuTimes || !_issued[slot][FrameSection] || (!_waitForResults && !query(slot, FrameSection, true).resultAvailable()))
+        return;
+
+    Float workTime = 0.0f;
+    for(UnsignedInt i = 0; i != _sections.size(); ++i) {
+        if(!_issued[slot][i] || (!_waitForResults && !query(slot, i, true).resultAvailable())) continue;
+
+        const UnsignedLong begin = query(slot, i, false).result<UnsignedLong>();
+        const UnsignedLong end = query(slot, i, true).result<UnsignedLong>();
+        Section& section = _sections[i];
+        section.gpuHistory[section.gpuHistoryCount++ % _historySize] = (end - begin)/1.0e6f;
+        if(i != FrameSection) workTime += (end - begin)/1.0e6f;
+    }
+    _lastGpuWorkTime = workTime;
+    ++_gpuWorkFrameCount;
+}
+
+Float FrameProfiler::percentile(const std::vector<Float>& history, const std::size_t count, const Float percentile) {
+    const std::size_t size = std::min(count, history.size());
+    if(!size) return 0.0f;
+
+    std::vector<Float> sorted{history.begin(), history.begin() + size};
+    const std::size_t n = std::min(std::size_t(percentile*size), size - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + n, sorted.end());
+    return sorted[n];
+}
+
+Double FrameProfiler::fragmentsPerFrame(const UnsignedInt section) const {
+    const Section& s = _sections[section];
+    return s.fragmentFrames ? Double(s.fragmentTotal)/s.fragmentFrames : 0.0;
+}
+
+Float FrameProfiler::cpuPercentile(const UnsignedInt section, const Float p) const {
+    return percentile(_sections[section].cpuHistory, _cpuHistoryCount, p);
+}
+
+Float FrameProfiler::gpuPercentile(const UnsignedInt section, const Float p) const {
+    return percentile(_sections[section].gpuHistory, _sections[section].gpuHistoryCount, p);
+}
+
+std::vector<std::string> FrameProfiler::report() const {
+    std::vector<std::string> lines;
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-12s %17s %17s %6s%s", "ms", "cpu 50/95/99", "gpu 50/95/99", "draws",
+        _fragmentCounts ? "  Mfrag" : "");
+    lines.emplace_back(line);
+
+    for(UnsignedInt i = 0; i != _sections.size(); ++i) {
+        if(_gpuTimes)
+            std::snprintf(line, sizeof(line), "%-12s %5.2f %5.2f %5.2f %5.2f %5.2f %5.2f %6u", _sections[i].name.data(),
+                cpuPercentile(i, 0.5f), cpuPercentile(i, 0.95f), cpuPercentile(i, 0.99f),
+                gpuPercentile(i, 0.5f), gpuPercentile(i, 0.95f), gpuPercentile(i, 0.99f),
+                _sections[i].lastDrawCount);
+        else
+            std::snprintf(line, sizeof(line), "%-12s %5.2f %5.2f %5.2f %17s %6u", _sections[i].name.data(),
+                cpuPercentile(i, 0.5f), cpuPercentile(i, 0.95f), cpuPercentile(i, 0.99f), "-",
+                _sections[i].lastDrawCount);
+        if(_fragmentCounts && i != FrameSection) {
+            const std::size_t length = std::strlen(line);
+            std::snprintf(line + length, sizeof(line) - length, " %6.2f", _sections[i].lastFragmentCount/1.0e6);
+        }
+        lines.emplace_back(line);
+    }
+
+    return lines;
+}
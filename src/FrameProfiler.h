@@ -0,0 +1,153 @@
+#if !defined(FRAMEPROFILER_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define FRAMEPROFILER_H
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <Magnum/Magnum.h>
+#include <Magnum/OpenGL.h>
+#include <Magnum/TimeQuery.h>
+
+using namespace Magnum;
+
+/**
+CPU and GPU times of named frame sections. GPU times come from timestamp
+queries issued around every section, they are read back
+@ref FrameProfiler::FrameLatency frames later, so nothing ever waits for the
+GPU. If the results still aren't there by then, the frame is left out of the
+GPU history, unless @ref setWaitForResults() is enabled. The last
+@ref historySize() frames are kept for the percentiles.
+
+The whole frame between @ref beginFrame() and @ref endFrame() is always
+section zero.
+
+With ARB_pipeline_statistics_query, every other section also counts its
+fragment shader invocations. Such queries can't overlap, so a section begun
+while another one is counting isn't counted, the frame section never is.
+*/
+class FrameProfiler {
+public:
+    enum: UnsignedInt {
+        FrameLatency = 4,
+        DefaultHistorySize = 240,
+        MaxSections = 16,
+        FrameSection = 0
+    };
+
+    /* Needs a GL context, GPU times are left out if timer queries aren't
+       supported */
+    explicit FrameProfiler();
+
+    ~FrameProfiler();
+
+    FrameProfiler(const FrameProfiler&) = delete;
+    FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+    /* Register a section, returns its index for begin() and end() */
+    UnsignedInt addSection(std::string name);
+
+    /* Frames kept for the percentiles, clears the history */
+    std::size_t historySize() const { return _historySize; }
+    void setHistorySize(std::size_t frames);
+
+    /* Clear the history of all sections, e.g. after warm-up frames */
+    void reset();
+
+    /* Block on late GPU results instead of dropping the frame. Only for
+       benchmarks, it stalls the pipeline. */
+    void setWaitForResults(bool wait) { _waitForResults = wait; }
+
+    /* Wait for and read back the GPU times of all frames still in flight */
+    void finish();
+
+    void beginFrame();
+    void endFrame();
+
+    /**
+     * Time a section. If a section is entered more than once per frame,
+     * the CPU times add up and the GPU time spans from the first begin to
+     * the last end.
+     */
+    void begin(UnsignedInt section);
+    void end(UnsignedInt section, UnsignedInt drawCount = 0);
+
+    std::size_t sectionCount() const { return _sections.size(); }
+    const std::string& name(UnsignedInt section) const { return _sections[section].name; }
+    bool hasGpuTimes() const { return _gpuTimes; }
+    bool hasFragmentCounts() const { return _fragmentCounts; }
+
+    /* Draw calls in the section in the last frame */
+    UnsignedInt drawCount(UnsignedInt section) const { return _sections[section].lastDrawCount; }
+
+    /* Fragment shader invocations of the section in the last frame read
+       back and on average per frame since the last reset() */
+    UnsignedLong fragmentCount(UnsignedInt section) const { return _sections[section].lastFragmentCount; }
+    Double fragmentsPerFrame(UnsignedInt section) const;
+
+    /* GPU time of all sections but the frame in the last frame read back,
+       in milliseconds. Unlike the frame section it doesn't include waiting
+       for the swap. The count goes up with every frame read back. */
+    Float lastGpuWorkTime() const { return _lastGpuWorkTime; }
+    UnsignedLong gpuWorkFrameCount() const { return _gpuWorkFrameCount; }
+
+    /* Frames in the CPU and GPU history of a section */
+    std::size_t cpuFrameCount() const { return std::min(_cpuHistoryCount, _historySize); }
+    std::size_t gpuFrameCount(UnsignedInt section) const { return std::min(_sections[section].gpuHistoryCount, _historySize); }
+
+    /* Percentile of the history in milliseconds, @p percentile in 0 to 1 */
+    Float cpuPercentile(UnsignedInt section, Float percentile) const;
+    Float gpuPercentile(UnsignedInt section, Float percentile) const;
+
+    /* Section, CPU p50/p95/p99, GPU p50/p95/p99, draw count and millions
+       of fragments, one line per section */
+    std::vector<std::string> report() const;
+
+private:
+    struct Section {
+        std::string name;
+        std::chrono::steady_clock::time_point cpuBegin;
+        Float cpuTime;
+        UnsignedInt drawCount, lastDrawCount;
+        std::vector<Float> cpuHistory, gpuHistory;
+        std::size_t gpuHistoryCount;
+        UnsignedLong lastFragmentCount, fragmentTotal, fragmentFrames;
+    };
+
+    void readBack(UnsignedInt slot);
+    TimeQuery& query(UnsignedInt slot, UnsignedInt section, bool end) {
+        return _queries[(slot*MaxSections + section)*2 + end];
+    }
+    GLuint& statisticsQuery(UnsignedInt slot, UnsignedInt section) {
+        return _statisticsQueries[slot*MaxSections + section];
+    }
+    static Float percentile(const std::vector<Float>& history, std::size_t count, Float percentile);
+
+    std::vector<Section> _sections;
+    bool _gpuTimes;
+    bool _waitForResults;
+    std::vector<TimeQuery> _queries;
+    /* Sections with GPU queries issued, per frame slot */
+    UnsignedInt _issued[FrameLatency][MaxSections];
+    bool _fragmentCounts;
+    /* Raw GL, Magnum has no wrapper for pipeline statistics queries */
+    std::vector<GLuint> _statisticsQueries;
+    UnsignedInt _countedSections[FrameLatency][MaxSections];
+    /* Section with its statistics query running, FrameSection if none */
+    UnsignedInt _countingSection;
+    UnsignedLong _frame;
+    Float _lastGpuWorkTime;
+    UnsignedLong _gpuWorkFrameCount;
+    UnsignedInt _slot;
+    std::size_t _historySize, _cpuHistoryCount;
+};
+
+#endif
@@ -0,0 +1,492 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <unordered_map>
+
+#include <Corrade/Utility/Debug.h>
+#include <Corrade/Utility/String.h>
+#include <Magnum/Mesh.h>
+#include <Magnum/Math/Color.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/Math/Vector2.h>
+#include <Magnum/Trade/MeshData3D.h>
+
+namespace {
+
+/* Simulated FIFO post-transform cache. A vertex is in the cache if it was
+   transformed less than CacheSize misses ago, so no actual queue is
+   needed. */
+class FifoCache {
+public:
+    explicit FifoCache(std::size_t vertexCount): _timestamps(vertexCount, 0), _time{MeshOptimizer::CacheSize + 1} {}
+
+    /* Returns true on a miss */
+    bool access(UnsignedInt vertex) {
+        if(_time - _timestamps[vertex] > MeshOptimizer::CacheSize) {
+            _timestamps[vertex] = _time++;
+            return true;
+        }
+        return false;
+    }
+
+    void flush() { _time += MeshOptimizer::CacheSize + 1; }
+
+private:
+    std::vector<UnsignedInt> _timestamps;
+    UnsignedInt _time;
+};
+
+UnsignedInt vertexCount(const std::vector<UnsignedInt>& indices) {
+    UnsignedInt count = 0;
+    for(UnsignedInt index: indices) count = Math::max(count, index + 1);
+    return count;
+}
+
+/* All attributes of a mesh as raw arrays, for comparing whole vertices */
+class VertexAttributes {
+public:
+    explicit VertexAttributes(const Trade::MeshData3D& mesh) {
+        for(UnsignedInt i = 0; i != mesh.positionArrayCount(); ++i)
+            add(mesh.positions(i));
+        for(UnsignedInt i = 0; i != mesh.normalArrayCount(); ++i)
+            add(mesh.normals(i));
+        for(UnsignedInt i = 0; i != mesh.textureCoords2DArrayCount(); ++i)
+            add(mesh.textureCoords2D(i));
+        for(UnsignedInt i = 0; i != mesh.colorArrayCount(); ++i)
+            add(mesh.colors(i));
+    }
+
+    std::size_t hash(UnsignedInt vertex) const {
+        std::size_t hash = std::size_t(14695981039346656037ull);
+        for(const Attribute& attribute: _attributes) {
+            const char* data = attribute.data + vertex*attribute.size;
+            for(std::size_t i = 0; i != attribute.size; ++i)
+                hash = (hash ^ UnsignedByte(data[i]))*std::size_t(1099511628211ull);
+        }
+        return hash;
+    }
+
+    bool equal(UnsignedInt a, UnsignedInt b) const {
+        for(const Attribute& attribute: _attributes)
+            if(std::memcmp(attribute.data + a*attribute.size, attribute.data + b*attribute.size, attribute.size) != 0)
+                return false;
+        return true;
+    }
+
+private:
+    struct Attribute {
+        const char* data;
+        std::size_t size;
+    };
+
+    template<class T> void add(const std::vector<T>& array) {
+        _attributes.push_back({reinterpret_cast<const char*>(array.data()), sizeof(T)});
+    }
+
+    std::vector<Attribute> _attributes;
+};
+
+template<class T> void remapArray(std::vector<T>& array, const std::vector<UnsignedInt>& remap, const std::size_t count) {
+    std::vector<T> result(count);
+    for(std::size_t i = 0; i != array.size(); ++i)
+        if(remap[i] != ~UnsignedInt{}) result[remap[i]] = array[i];
+    array = std::move(result);
+}
+
+/* Move vertex i to remap[i], ~0 drops the vertex */
+void remapVertices(Trade::MeshData3D& mesh, const std::vector<UnsignedInt>& remap, const std::size_t count) {
+    for(UnsignedInt i = 0; i != mesh.positionArrayCount(); ++i)
+        remapArray(mesh.positions(i), remap, count);
+    for(UnsignedInt i = 0; i != mesh.normalArrayCount(); ++i)
+        remapArray(mesh.normals(i), remap, count);
+    for(UnsignedInt i = 0; i != mesh.textureCoords2DArrayCount(); ++i)
+        remapArray(mesh.textureCoords2D(i), remap, count);
+    for(UnsignedInt i = 0; i != mesh.colorArrayCount(); ++i)
+        remapArray(mesh.colors(i), remap, count);
+    for(UnsignedInt& index: mesh.indices())
+        index = remap[index];
+}
+
+void weld(Trade::MeshData3D& mesh) {
+    const VertexAttributes attributes{mesh};
+    const auto hash = [&attributes](UnsignedInt vertex) { return attributes.hash(vertex); };
+    const auto equal = [&attributes](UnsignedInt a, UnsignedInt b) { return attributes.equal(a, b); };
+    const std::size_t count = mesh.positions(0).size();
+    std::unordered_map<UnsignedInt, UnsignedInt, decltype(hash), decltype(equal)> unique{count, hash, equal};
+
+    std::vector<UnsignedInt> remap(count);
+    for(UnsignedInt i = 0; i != count; ++i)
+        remap[i] = unique.emplace(i, UnsignedInt(unique.size())).first->second;
+
+    if(unique.size() != count) remapVertices(mesh, remap, unique.size());
+}
+
+void optimizeVertexFetch(Trade::MeshData3D& mesh) {
+    std::vector<UnsignedInt> remap(mesh.positions(0).size(), ~UnsignedInt{});
+    UnsignedInt count = 0;
+    for(UnsignedInt index: mesh.indices())
+        if(remap[index] == ~UnsignedInt{}) remap[index] = count++;
+
+    remapVertices(mesh, remap, count);
+}
+
+/* Tom Forsyth's linear-speed vertex cache optimization: greedily emit the
+   triangle with the best score, where vertices score higher the more
+   recently they were used and the fewer triangles they have left */
+constexpr const std::size_t ScoringCacheSize = 32;
+
+Float vertexScore(const Int cachePosition, const UnsignedInt valence) {
+    if(!valence) return -1.0f;
+
+    Float score = 0.0f;
+    if(cachePosition < 0) {}
+    /* The last triangle's vertices get a fixed score so the next triangle
+       doesn't just reuse the same edge */
+    else if(cachePosition < 3) score = 0.75f;
+    else score = std::pow(1.0f - Float(cachePosition - 3)/(ScoringCacheSize - 3), 1.5f);
+
+    return score + 2.0f/std::sqrt(Float(valence));
+}
+
+void optimizeVertexCache(std::vector<UnsignedInt>& indices, const std::size_t vertexCount) {
+    const std::size_t triangleCount = indices.size()/3;
+    if(!triangleCount) return;
+
+    /* Triangles using each vertex. Emitted triangles are swapped to the end
+       of each list and valence is the count of the remaining ones. */
+    std::vector<UnsignedInt> valence(vertexCount, 0);
+    for(UnsignedInt index: indices) ++valence[index];
+    std::vector<UnsignedInt> adjacencyOffset(vertexCount + 1, 0);
+    for(std::size_t i = 0; i != vertexCount; ++i)
+        adjacencyOffset[i + 1] = adjacencyOffset[i] + valence[i];
+    std::vector<UnsignedInt> adjacency(indices.size());
+    {
+        std::vector<UnsignedInt> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for(std::size_t i = 0; i != indices.size(); ++i)
+            adjacency[fill[indices[i]]++] = i/3;
+    }
+
+    std::vector<Int> cachePosition(vertexCount, -1);
+    std::vector<Float> score(vertexCount);
+    for(std::size_t i = 0; i != vertexCount; ++i)
+        score[i] = vertexScore(-1, valence[i]);
+
+    std::vector<bool> emitted(triangleCount, false);
+    Int bestTriangle = 0;
+    Float bestScore = -1.0f;
+    for(std::size_t i = 0; i != triangleCount; ++i) {
+        const Float triangleScore = score[indices[i*3]] + score[indices[i*3 + 1]] + score[indices[i*3 + 2]];
+        if(triangleScore > bestScore) {
+            bestScore = triangleScore;
+            bestTriangle = i;
+        }
+    }
+
+    std::vector<UnsignedInt> result;
+    result.reserve(indices.size());
+    UnsignedInt cache[ScoringCacheSize + 3];
+    std::size_t cacheCount = 0;
+    std::size_t cursor = 0;
+    while(bestTriangle != -1) {
+        emitted[bestTriangle] = true;
+
+        /* Emitted vertices go to the front of the cache, the rest moves back
+           and possibly falls out */
+        UnsignedInt newCache[ScoringCacheSize + 3];
+        std::size_t newCacheCount = 0;
+        for(std::size_t i = 0; i != 3; ++i) {
+            const UnsignedInt vertex = indices[bestTriangle*3 + i];
+            result.push_back(vertex);
+            newCache[newCacheCount++] = vertex;
+
+            UnsignedInt* triangles = adjacency.data() + adjacencyOffset[vertex];
+            for(std::size_t j = 0; j != valence[vertex]; ++j) {
+                if(triangles[j] != UnsignedInt(bestTriangle)) continue;
+                std::swap(triangles[j], triangles[valence[vertex] - 1]);
+                break;
+            }
+            --valence[vertex];
+        }
+        for(std::size_t i = 0; i != cacheCount; ++i) {
+            const UnsignedInt vertex = cache[i];
+            if(vertex != newCache[0] && vertex != newCache[1] && vertex != newCache[2])
+                newCache[newCacheCount++] = vertex;
+        }
+
+        for(std::size_t i = 0; i != newCacheCount; ++i) {
+            const UnsignedInt vertex = newCache[i];
+            cachePosition[vertex] = i < ScoringCacheSize ? Int(i) : -1;
+            score[vertex] = vertexScore(cachePosition[vertex], valence[vertex]);
+        }
+        cacheCount = Math::min(newCacheCount, ScoringCacheSize);
+        std::copy(newCache, newCache + cacheCount, cache);
+
+        /* Only triangles touching the cache changed score */
+        bestTriangle = -1;
+        bestScore = -1.0f;
+        for(std::size_t i = 0; i != newCacheCount; ++i) {
+            const UnsignedInt vertex = newCache[i];
+            const UnsignedInt* triangles = adjacency.data() + adjacencyOffset[vertex];
+            for(std::size_t j = 0; j != valence[vertex]; ++j) {
+                const UnsignedInt triangle = triangles[j];
+                const Float triangleScore = score[indices[triangle*3]] + score[indices[triangle*3 + 1]] + score[indices[triangle*3 + 2]];
+                if(triangleScore > bestScore) {
+                    bestScore = triangleScore;
+                    bestTriangle = triangle;
+                }
+            }
+        }
+
+        /* Nothing adjacent left, continue with the next triangle in the
+           original order */
+        if(bestTriangle == -1) {
+            while(cursor != triangleCount && emitted[cursor]) ++cursor;
+            if(cursor != triangleCount) bestTriangle = cursor;
+        }
+    }
+
+    indices = std::move(result);
+}
+
+/* Sander et al., Fast Triangle Reordering for Vertex Locality and Reduced
+   Overdraw: split the cache-optimized order into clusters that can be
+   reordered without losing much cache efficiency, then draw clusters facing
+   outwards first */
+void optimizeOverdraw(std::vector<UnsignedInt>& indices, const std::vector<Vector3>& positions, const Float threshold = 1.05f) {
+    const std::size_t triangleCount = indices.size()/3;
+    if(!triangleCount) return;
+
+    /* Hard boundaries where the cache starts from scratch anyway */
+    std::vector<std::size_t> hardBoundaries;
+    {
+        FifoCache cache{positions.size()};
+        for(std::size_t i = 0; i != triangleCount; ++i) {
+            const bool a = cache.access(indices[i*3]);
+            const bool b = cache.access(indices[i*3 + 1]);
+            const bool c = cache.access(indices[i*3 + 2]);
+            if(i == 0 || (a && b && c)) hardBoundaries.push_back(i);
+        }
+        hardBoundaries.push_back(triangleCount);
+    }
+
+    /* Split further where the running ACMR is within the threshold of the
+       whole hard cluster */
+    std::vector<std::size_t> clusters;
+    FifoCache cache{positions.size()};
+    for(std::size_t h = 0; h + 1 < hardBoundaries.size(); ++h) {
+        const std::size_t begin = hardBoundaries[h], end = hardBoundaries[h + 1];
+
+        cache.flush();
+        std::size_t misses = 0;
+        for(std::size_t i = begin; i != end; ++i)
+            for(std::size_t j = 0; j != 3; ++j)
+                misses += cache.access(indices[i*3 + j]);
+        const Float clusterAcmr = Float(misses)/(end - begin);
+
+        cache.flush();
+        clusters.push_back(begin);
+        misses = 0;
+        std::size_t triangles = 0;
+        for(std::size_t i = begin; i != end; ++i) {
+            for(std::size_t j = 0; j != 3; ++j)
+                misses += cache.access(indices[i*3 + j]);
+            ++triangles;
+            if(i + 1 != end && Float(misses)/triangles <= clusterAcmr*threshold) {
+                clusters.push_back(i + 1);
+                cache.flush();
+                misses = triangles = 0;
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    /* Area-weighted centroid of the mesh and of each cluster */
+    Vector3 meshCentroid;
+    Float meshArea = 0.0f;
+    std::vector<std::pair<Float, std::size_t>> sortKeys;
+    sortKeys.reserve(clusters.size() - 1);
+    std::vector<Vector3> clusterCentroids(clusters.size() - 1), clusterNormals(clusters.size() - 1);
+    for(std::size_t c = 0; c + 1 < clusters.size(); ++c) {
+        Vector3 centroid, normal;
+        Float area = 0.0f;
+        for(std::size_t i = clusters[c]; i != clusters[c + 1]; ++i) {
+            const Vector3 a = positions[indices[i*3]];
+            const Vector3 b = positions[indices[i*3 + 1]];
+            const Vector3 cross = Math::cross(b - a, positions[indices[i*3 + 2]] - a);
+            const Float triangleArea = cross.length();
+            centroid += (a + b + positions[indices[i*3 + 2]])*(triangleArea/3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+        meshCentroid += centroid;
+        meshArea += area;
+        clusterCentroids[c] = area > 0.0f ? centroid/area : centroid;
+        clusterNormals[c] = normal.isZero() ? normal : normal.normalized();
+    }
+    if(meshArea > 0.0f) meshCentroid /= meshArea;
+
+    for(std::size_t c = 0; c + 1 < clusters.size(); ++c)
+        sortKeys.emplace_back(Math::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]), c);
+    std::stable_sort(sortKeys.begin(), sortKeys.end(), [](const std::pair<Float, std::size_t>& a, const std::pair<Float, std::size_t>& b) {
+        return a.first > b.first;
+    });
+
+    std::vector<UnsignedInt> result;
+    result.reserve(indices.size());
+    for(const auto& key: sortKeys)
+        result.insert(result.end(), indices.begin() + clusters[key.second]*3, indices.begin() + clusters[key.second + 1]*3);
+    indices = std::move(result);
+}
+
+/* Rasterize into a small depth buffer from one direction, counting
+   fragments passing the depth test. Back faces are culled like in the
+   renderer. */
+constexpr const Int OverdrawGridSize = 256;
+
+void rasterize(const std::vector<UnsignedInt>& indices, const std::vector<Vector3>& positions, const Vector3& min, const Float scale, const Vector3& u, const Vector3& v, const Vector3& direction, std::vector<Float>& depth, std::size_t& shaded) {
+    std::fill(depth.begin(), depth.end(), std::numeric_limits<Float>::infinity());
+
+    /* Projections on an axis pointing in the negative direction end up in
+       [-size, 0], shift them to the grid */
+    const Float offsetX = u.sum() < 0.0f ? OverdrawGridSize : 0.0f;
+    const Float offsetY = v.sum() < 0.0f ? OverdrawGridSize : 0.0f;
+
+    for(std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+        Vector3 p[3];
+        for(std::size_t j = 0; j != 3; ++j) {
+            const Vector3 position = (positions[indices[i + j]] - min)*scale;
+            p[j] = {Math::dot(position, u) + offsetX, Math::dot(position, v) + offsetY, -Math::dot(position, direction)};
+        }
+
+        const Float area = (p[1].x() - p[0].x())*(p[2].y() - p[0].y()) - (p[2].x() - p[0].x())*(p[1].y() - p[0].y());
+        if(area <= 0.0f) continue;
+
+        const Int minX = Math::max(0, Int(std::floor(std::min({p[0].x(), p[1].x(), p[2].x()}))));
+        const Int maxX = Math::min(OverdrawGridSize - 1, Int(std::ceil(std::max({p[0].x(), p[1].x(), p[2].x()}))));
+        const Int minY = Math::max(0, Int(std::floor(std::min({p[0].y(), p[1].y(), p[2].y()}))));
+        const Int maxY = Math::min(OverdrawGridSize - 1, Int(std::ceil(std::max({p[0].y(), p[1].y(), p[2].y()}))));
+        for(Int y = minY; y <= maxY; ++y) for(Int x = minX; x <= maxX; ++x) {
+            const Float px = x + 0.5f, py = y + 0.5f;
+            const Float w0 = (p[2].x() - p[1].x())*(py - p[1].y()) - (p[2].y() - p[1].y())*(px - p[1].x());
+            const Float w1 = (p[0].x() - p[2].x())*(py - p[2].y()) - (p[0].y() - p[2].y())*(px - p[2].x());
+            const Float w2 = (p[1].x() - p[0].x())*(py - p[0].y()) - (p[1].y() - p[0].y())*(px - p[0].x());
+            if(w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+
+            const Float z = (w0*p[0].z() + w1*p[1].z() + w2*p[2].z())/area;
+            Float& stored = depth[y*OverdrawGridSize + x];
+            if(z < stored) {
+                stored = z;
+                ++shaded;
+            }
+        }
+    }
+}
+
+}
+
+MeshOptimizations MeshOptimizer::parseOptimizations(const std::string& list) {
+    MeshOptimizations optimizations;
+    for(const std::string& item: Utility::String::splitWithoutEmptyParts(list, ',')) {
+        if(item == "all") optimizations |= MeshOptimization::Weld|MeshOptimization::VertexCache|MeshOptimization::Overdraw|MeshOptimization::VertexFetch;
+        else if(item == "none") {}
+        else if(item == "weld") optimizations |= MeshOptimization::Weld;
+        else if(item == "cache") optimizations |= MeshOptimization::VertexCache;
+        else if(item == "overdraw") optimizations |= MeshOptimization::Overdraw;
+        else if(item == "fetch") optimizations |= MeshOptimization::VertexFetch;
+        else Warning{} << "Unknown mesh optimization" << item << Debug::nospace << ", ignoring";
+    }
+    return optimizations;
+}
+
+MeshStatistics MeshOptimizer::analyze(const std::vector<UnsignedInt>& indices, const std::vector<Vector3>& positions) {
+    MeshStatistics statistics{};
+    statistics.triangleCount = indices.size()/3;
+    if(!statistics.triangleCount) return statistics;
+
+    std::vector<bool> used(positions.size(), false);
+    FifoCache cache{positions.size()};
+    std::size_t misses = 0;
+    for(UnsignedInt index: indices) {
+        misses += cache.access(index);
+        if(!used[index]) {
+            used[index] = true;
+            ++statistics.vertexCount;
+        }
+    }
+    statistics.acmr = Float(misses)/statistics.triangleCount;
+    statistics.atvr = Float(misses)/statistics.vertexCount;
+
+    Vector3 min{std::numeric_limits<Float>::max()}, max{-std::numeric_limits<Float>::max()};
+    for(const Vector3& position: positions) {
+        min = Math::min(min, position);
+        max = Math::max(max, position);
+    }
+    const Float extent = (max - min).max();
+    if(extent <= 0.0f) return statistics;
+
+    /* Six views along the axes, u x v always pointing towards the viewer */
+    const Vector3 views[][3]{
+        {Vector3::xAxis(), Vector3::yAxis(), Vector3::zAxis()},
+        {-Vector3::xAxis(), Vector3::yAxis(), -Vector3::zAxis()},
+        {-Vector3::zAxis(), Vector3::yAxis(), Vector3::xAxis()},
+        {Vector3::zAxis(), Vector3::yAxis(), -Vector3::xAxis()},
+        {Vector3::xAxis(), -Vector3::zAxis(), Vector3::yAxis()},
+        {Vector3::xAxis(), Vector3::zAxis(), -Vector3::yAxis()}};
+
+    std::vector<Float> depth(OverdrawGridSize*OverdrawGridSize);
+    std::size_t shaded = 0, covered = 0;
+    for(const auto& view: views) {
+        rasterize(indices, positions, min, OverdrawGridSize/extent, view[0], view[1], view[2], depth, shaded);
+        for(Float value: depth) covered += value != std::numeric_limits<Float>::infinity();
+    }
+    statistics.overdraw = covered ? Float(shaded)/covered : 1.0f;
+    return statistics;
+}
+
+MeshOptimizer::MeshOptimizer(const MeshOptimizations optimizations, const bool report): _optimizations{optimizations}, _report{report} {}
+
+void MeshOptimizer::optimize(Trade::MeshData3D& mesh, const std::string& name) const {
+    if(!mesh.isIndexed() || mesh.primitive() != MeshPrimitive::Triangles || !mesh.positionArrayCount())
+        return;
+
+    /* Catch out-of-range indices before they corrupt anything */
+    if(vertexCount(mesh.indices()) > mesh.positions(0).size()) {
+        Warning{} << "Mesh" << name << "has out-of-range indices, not optimizing";
+        return;
+    }
+
+    MeshStatistics before{};
+    if(_report) before = analyze(mesh.indices(), mesh.positions(0));
+
+    if(_optimizations & MeshOptimization::Weld)
+        weld(mesh);
+    if(_optimizations & MeshOptimization::VertexCache)
+        optimizeVertexCache(mesh.indices(), mesh.positions(0).size());
+    if(_optimizations & MeshOptimization::Overdraw)
+        optimizeOverdraw(mesh.indices(), mesh.positions(0));
+    if(_optimizations & MeshOptimization::VertexFetch)
+        optimizeVertexFetch(mesh);
+
+    if(!_report) return;
+
+    const MeshStatistics after = analyze(mesh.indices(), mesh.positions(0));
+    std::ostringstream out;
+    Debug{&out, Debug::Flag::NoNewlineAtTheEnd} << "Mesh" << name << Debug::nospace << ":"
+        << after.triangleCount << "triangles," << before.vertexCount << "->" << after.vertexCount << "vertices, ACMR"
+        << before.acmr << "->" << after.acmr << Debug::nospace << ", ATVR"
+        << before.atvr << "->" << after.atvr << Debug::nospace << ", overdraw"
+        << before.overdraw << "->" << after.overdraw;
+    /* Meshes are optimized on multiple threads, print each report at once */
+    Debug{} << out.str();
+}
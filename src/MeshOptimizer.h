@@ -0,0 +1,78 @@
+#if !defined(MESHOPTIMIZER_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define MESHOPTIMIZER_H
+
+#include <string>
+#include <vector>
+
+#include <Corrade/Containers/EnumSet.h>
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Vector3.h>
+#include <Magnum/Trade/Trade.h>
+
+using namespace Magnum;
+
+enum class MeshOptimization: UnsignedInt {
+    Weld = 1 << 0,          /**< Merge bitwise identical vertices */
+    VertexCache = 1 << 1,   /**< Order triangles for the post-transform cache */
+    Overdraw = 1 << 2,      /**< Order triangle clusters front to back, after VertexCache */
+    VertexFetch = 1 << 3    /**< Order vertices by first use, drop unused ones */
+};
+
+typedef Containers::EnumSet<MeshOptimization> MeshOptimizations;
+
+CORRADE_ENUMSET_OPERATORS(MeshOptimizations)
+
+struct MeshStatistics {
+    UnsignedInt vertexCount, triangleCount;
+    /* Transformed vertices per triangle and per vertex with a FIFO
+       post-transform cache of MeshOptimizer::CacheSize entries, 0.5 and 1.0
+       at best */
+    Float acmr, atvr;
+    /* Shaded fragments per covered pixel, averaged over six axis-aligned
+       views, 1.0 at best */
+    Float overdraw;
+};
+
+/**
+Reorders indexed triangle meshes before upload. All optimizations keep the
+rendered result the same, only the order of triangles and vertices changes
+and duplicate vertices are merged. Stateless, can be used from multiple
+threads at once.
+*/
+class MeshOptimizer {
+public:
+    /* Cache size assumed when simulating the post-transform cache */
+    enum: UnsignedInt { CacheSize = 16 };
+
+    /* Parse a comma-separated list of weld, cache, overdraw, fetch, or
+       "all" or "none" */
+    static MeshOptimizations parseOptimizations(const std::string& list);
+
+    static MeshStatistics analyze(const std::vector<UnsignedInt>& indices, const std::vector<Vector3>& positions);
+
+    /**
+     * @param report    Print statistics of every mesh before and after the
+     *      optimization. Overdraw is measured by rasterizing the mesh on the
+     *      CPU, so this isn't free for large meshes.
+     */
+    explicit MeshOptimizer(MeshOptimizations optimizations = MeshOptimization::Weld|MeshOptimization::VertexCache|MeshOptimization::Overdraw|MeshOptimization::VertexFetch, bool report = false);
+
+    MeshOptimizations optimizations() const { return _optimizations; }
+
+    /* Optimize in place. Non-indexed meshes and other primitives than
+       triangles are left untouched. */
+    void optimize(Trade::MeshData3D& mesh, const std::string& name) const;
+
+private:
+    MeshOptimizations _optimizations;
+    bool _report;
+};
+
+#endif
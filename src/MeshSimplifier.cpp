@@ -0,0 +1,306 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "MeshSimplifier.h"
+
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+
+#include <Magnum/Math/Functions.h>
+
+namespace {
+
+/* Q(p) = pᵀAp + 2bᵀp + c, summed over planes weighted by w. Doubles, as
+   the terms cancel out a lot. */
+struct Quadric {
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c, w;
+
+    static Quadric fromPlane(const Vector3& normal, const Float distance, const Float weight) {
+        const double x = normal.x(), y = normal.y(), z = normal.z(), d = distance;
+        return {weight*x*x, weight*x*y, weight*x*z, weight*y*y, weight*y*z, weight*z*z,
+                weight*x*d, weight*y*d, weight*z*d, weight*d*d, weight};
+    }
+
+    Quadric& operator+=(const Quadric& other) {
+        a00 += other.a00; a01 += other.a01; a02 += other.a02;
+        a11 += other.a11; a12 += other.a12; a22 += other.a22;
+        b0 += other.b0; b1 += other.b1; b2 += other.b2;
+        c += other.c; w += other.w;
+        return *this;
+    }
+
+    Quadric operator+(const Quadric& other) const {
+        return Quadric{*this} += other;
+    }
+
+    /* Weighted mean squared distance to the planes */
+    double error(const Vector3& p) const {
+        const double x = p.x(), y = p.y(), z = p.z();
+        const double q = a00*x*x + 2.0*a01*x*y + 2.0*a02*x*z + a11*y*y + 2.0*a12*y*z + a22*z*z +
+            2.0*(b0*x + b1*y + b2*z) + c;
+        return w > 0.0 ? Math::max(q/w, 0.0) : 0.0;
+    }
+};
+
+/* Boundary edges are kept in place by planes perpendicular to their face */
+constexpr const Float BoundaryWeight = 10.0f;
+
+struct Collapse {
+    double cost;
+    UnsignedInt from, to;
+    UnsignedInt fromVersion, toVersion;
+
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+class Simplifier {
+public:
+    explicit Simplifier(const std::vector<UnsignedInt>& indices, const std::vector<Vector3>& positions);
+
+    std::size_t indexCount() const { return _liveTriangles*3; }
+
+    /* Collapse edges until at most targetIndexCount indices are left or
+       nothing can be collapsed anymore. Returns false in the latter case. */
+    bool simplify(std::size_t targetIndexCount);
+
+    /* Largest collapse error so far, in model units */
+    Float error() const { return Float(std::sqrt(_maxCost)); }
+
+    /* Current triangles, indexing the original vertices */
+    std::vector<UnsignedInt> indices() const;
+
+private:
+    bool contains(UnsignedInt triangle, UnsignedInt vertex) const {
+        return _indices[triangle*3] == vertex || _indices[triangle*3 + 1] == vertex || _indices[triangle*3 + 2] == vertex;
+    }
+
+    Vector3 normal(UnsignedInt triangle, UnsignedInt from, UnsignedInt to) const;
+    void pushEdge(UnsignedInt a, UnsignedInt b);
+    bool collapse(const Collapse& collapse);
+
+    /* Vertices welded by position, with one of the original indices for
+       each */
+    std::vector<Vector3> _positions;
+    std::vector<UnsignedInt> _original;
+    std::vector<Quadric> _quadrics;
+    std::vector<UnsignedInt> _versions;
+    std::vector<bool> _alive;
+    std::vector<std::vector<UnsignedInt>> _vertexTriangles;
+
+    std::vector<UnsignedInt> _indices;
+    std::vector<bool> _deadTriangles;
+    std::size_t _liveTriangles;
+
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> _collapses;
+    double _maxCost;
+};
+
+Simplifier::Simplifier(const std::vector<UnsignedInt>& indices, const std::vector<Vector3>& positions): _liveTriangles{0}, _maxCost{0.0} {
+    /* Weld by position only, normal and texture seams don't matter for
+       depth */
+    struct PositionHash {
+        std::size_t operator()(const Vector3& position) const {
+            std::size_t hash = std::size_t(14695981039346656037ull);
+            const char* data = reinterpret_cast<const char*>(&position);
+            for(std::size_t i = 0; i != sizeof(Vector3); ++i)
+                hash = (hash ^ UnsignedByte(data[i]))*std::size_t(1099511628211ull);
+            return hash;
+        }
+    };
+    struct PositionEqual {
+        bool operator()(const Vector3& a, const Vector3& b) const {
+            return std::memcmp(&a, &b, sizeof(Vector3)) == 0;
+        }
+    };
+    std::unordered_map<Vector3, UnsignedInt, PositionHash, PositionEqual> unique;
+    std::vector<UnsignedInt> remap(positions.size(), ~UnsignedInt{});
+    for(UnsignedInt index: indices) {
+        if(remap[index] != ~UnsignedInt{}) continue;
+        auto inserted = unique.emplace(positions[index], UnsignedInt(_positions.size()));
+        if(inserted.second) {
+            _positions.push_back(positions[index]);
+            _original.push_back(index);
+        }
+        remap[index] = inserted.first->second;
+    }
+
+    const std::size_t vertexCount = _positions.size();
+    _quadrics.assign(vertexCount, Quadric{});
+    _versions.assign(vertexCount, 0);
+    _alive.assign(vertexCount, true);
+    _vertexTriangles.resize(vertexCount);
+
+    /* Degenerate triangles would only get in the way */
+    _indices.reserve(indices.size());
+    for(std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const UnsignedInt a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+        if(a == b || b == c || c == a) continue;
+        _indices.push_back(a);
+        _indices.push_back(b);
+        _indices.push_back(c);
+    }
+    _liveTriangles = _indices.size()/3;
+    _deadTriangles.assign(_liveTriangles, false);
+
+    std::map<std::pair<UnsignedInt, UnsignedInt>, UnsignedInt> edgeUseCount;
+    for(UnsignedInt t = 0; t != _liveTriangles; ++t) {
+        const Vector3 cross = Math::cross(_positions[_indices[t*3 + 1]] - _positions[_indices[t*3]],
+                                          _positions[_indices[t*3 + 2]] - _positions[_indices[t*3]]);
+        const Float length = cross.length();
+        for(std::size_t i = 0; i != 3; ++i) {
+            const UnsignedInt vertex = _indices[t*3 + i];
+            _vertexTriangles[vertex].push_back(t);
+            const UnsignedInt next = _indices[t*3 + (i + 1)%3];
+            ++edgeUseCount[{Math::min(vertex, next), Math::max(vertex, next)}];
+        }
+        if(length == 0.0f) continue;
+
+        const Vector3 normal = cross/length;
+        const Quadric quadric = Quadric::fromPlane(normal, -Math::dot(normal, _positions[_indices[t*3]]), length*0.5f);
+        for(std::size_t i = 0; i != 3; ++i)
+            _quadrics[_indices[t*3 + i]] += quadric;
+    }
+
+    for(UnsignedInt t = 0; t != _liveTriangles; ++t) {
+        const Vector3 faceNormal = Math::cross(_positions[_indices[t*3 + 1]] - _positions[_indices[t*3]],
+                                               _positions[_indices[t*3 + 2]] - _positions[_indices[t*3]]);
+        for(std::size_t i = 0; i != 3; ++i) {
+            const UnsignedInt a = _indices[t*3 + i], b = _indices[t*3 + (i + 1)%3];
+            if(edgeUseCount[{Math::min(a, b), Math::max(a, b)}] != 1) continue;
+
+            const Vector3 edge = _positions[b] - _positions[a];
+            const Vector3 planeNormal = Math::cross(edge, faceNormal);
+            const Float length = planeNormal.length();
+            if(length == 0.0f) continue;
+
+            const Vector3 normal = planeNormal/length;
+            const Quadric quadric = Quadric::fromPlane(normal, -Math::dot(normal, _positions[a]), edge.dot()*BoundaryWeight);
+            _quadrics[a] += quadric;
+            _quadrics[b] += quadric;
+        }
+    }
+
+    for(UnsignedInt t = 0; t != _liveTriangles; ++t)
+        for(std::size_t i = 0; i != 3; ++i)
+            pushEdge(_indices[t*3 + i], _indices[t*3 + (i + 1)%3]);
+}
+
+void Simplifier::pushEdge(const UnsignedInt a, const UnsignedInt b) {
+    const Quadric quadric = _quadrics[a] + _quadrics[b];
+    const double toB = quadric.error(_positions[b]);
+    const double toA = quadric.error(_positions[a]);
+    if(toB <= toA) _collapses.push({toB, a, b, _versions[a], _versions[b]});
+    else _collapses.push({toA, b, a, _versions[b], _versions[a]});
+}
+
+Vector3 Simplifier::normal(const UnsignedInt triangle, const UnsignedInt from, const UnsignedInt to) const {
+    Vector3 p[3];
+    for(std::size_t i = 0; i != 3; ++i) {
+        const UnsignedInt vertex = _indices[triangle*3 + i];
+        p[i] = _positions[vertex == from ? to : vertex];
+    }
+    return Math::cross(p[1] - p[0], p[2] - p[0]);
+}
+
+bool Simplifier::collapse(const Collapse& collapse) {
+    const UnsignedInt from = collapse.from, to = collapse.to;
+
+    /* Reject collapses that would flip or degenerate any remaining
+       triangle */
+    for(UnsignedInt t: _vertexTriangles[from]) {
+        if(_deadTriangles[t] || contains(t, to)) continue;
+        if(Math::dot(normal(t, from, from), normal(t, from, to)) <= 0.0f)
+            return false;
+    }
+
+    for(UnsignedInt t: _vertexTriangles[from]) {
+        if(_deadTriangles[t]) continue;
+        if(contains(t, to)) {
+            _deadTriangles[t] = true;
+            --_liveTriangles;
+            continue;
+        }
+
+        for(std::size_t i = 0; i != 3; ++i)
+            if(_indices[t*3 + i] == from) _indices[t*3 + i] = to;
+        _vertexTriangles[to].push_back(t);
+    }
+
+    _alive[from] = false;
+    _vertexTriangles[from].clear();
+    _quadrics[to] += _quadrics[from];
+    ++_versions[to];
+    _maxCost = Math::max(_maxCost, collapse.cost);
+
+    /* Drop dead triangles from the list and queue the changed edges */
+    std::vector<UnsignedInt>& triangles = _vertexTriangles[to];
+    std::size_t out = 0;
+    for(UnsignedInt t: triangles) {
+        if(_deadTriangles[t]) continue;
+        triangles[out++] = t;
+        for(std::size_t i = 0; i != 3; ++i)
+            if(_indices[t*3 + i] != to) pushEdge(to, _indices[t*3 + i]);
+    }
+    triangles.resize(out);
+    return true;
+}
+
+bool Simplifier::simplify(const std::size_t targetIndexCount) {
+    while(indexCount() > targetIndexCount) {
+        if(_collapses.empty()) return false;
+
+        const Collapse top = _collapses.top();
+        _collapses.pop();
+        if(!_alive[top.from] || !_alive[top.to] ||
+           _versions[top.from] != top.fromVersion || _versions[top.to] != top.toVersion)
+            continue;
+
+        collapse(top);
+    }
+
+    return true;
+}
+
+std::vector<UnsignedInt> Simplifier::indices() const {
+    std::vector<UnsignedInt> result;
+    result.reserve(indexCount());
+    for(std::size_t t = 0; t != _deadTriangles.size(); ++t) {
+        if(_deadTriangles[t]) continue;
+        for(std::size_t i = 0; i != 3; ++i)
+            result.push_back(_original[_indices[t*3 + i]]);
+    }
+    return result;
+}
+
+}
+
+std::vector<MeshLod> MeshSimplifier::lodChain(const std::vector<UnsignedInt>& indices, const std::vector<Vector3>& positions, const Float radius, const Float ratio, const UnsignedInt levelCount) {
+    std::vector<MeshLod> lods;
+    if(indices.size() < 3 || radius <= 0.0f) return lods;
+
+    Simplifier simplifier{indices, positions};
+    std::size_t previousIndexCount = simplifier.indexCount();
+    for(UnsignedInt level = 0; level != levelCount; ++level) {
+        const std::size_t target = std::size_t(previousIndexCount/3*ratio)*3;
+        simplifier.simplify(target);
+
+        /* Not worth another level if it didn't get noticeably smaller */
+        if(simplifier.indexCount() > previousIndexCount*3/4 || !simplifier.indexCount())
+            break;
+
+        previousIndexCount = simplifier.indexCount();
+        lods.push_back({simplifier.indices(), simplifier.error()/radius});
+    }
+
+    return lods;
+}
@@ -0,0 +1,43 @@
+#if !defined(MESHSIMPLIFIER_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define MESHSIMPLIFIER_H
+
+#include <vector>
+
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Vector3.h>
+
+using namespace Magnum;
+
+struct MeshLod {
+    /* Indices into the original vertex data */
+    std::vector<UnsignedInt> indices;
+    /* Largest simplification error relative to the mesh radius */
+    Float error;
+};
+
+/**
+Quadric error metric edge-collapse simplification (Garland and Heckbert).
+Collapses only onto existing vertices, so the simplified levels can reuse
+the original vertex buffer with just another index buffer. Only positions
+are considered, which is all the shadow casters need.
+*/
+class MeshSimplifier {
+public:
+    enum: UnsignedInt { MaxLevels = 3 };
+
+    /**
+     * Generate up to @p levelCount progressively simplified levels, each
+     * with about @p ratio of the triangles of the previous one. Stops early
+     * once the mesh can't be simplified any further.
+     */
+    static std::vector<MeshLod> lodChain(const std::vector<UnsignedInt>& indices, const std::vector<Vector3>& positions, Float radius, Float ratio = 0.25f, UnsignedInt levelCount = MaxLevels);
+};
+
+#endif
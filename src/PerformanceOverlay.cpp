@@ -0,0 +1,59 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "PerformanceOverlay.h"
+
+#include <Magnum/Renderer.h>
+#include <Magnum/Math/Range.h>
+#include <Magnum/Ui/Anchor.h>
+
+namespace {
+    constexpr const std::size_t LineCount = FrameProfiler::MaxSections + 1;
+    constexpr const std::size_t LineCapacity = 64;
+    constexpr const Vector2 LineSize{480.0f, 18.0f};
+}
+
+PerformanceOverlay::Panel::Panel(Ui::UserInterface& ui):
+Ui::Plane{ui, {Ui::Snap::Top|Ui::Snap::Left, Range2D::fromSize({}, {LineSize.x(), LineSize.y()*LineCount})},
+    0, 0, LineCount*LineCapacity}
+{
+    for(std::size_t i = 0; i != LineCount; ++i) {
+        const Ui::Anchor anchor = i ?
+            Ui::Anchor{Ui::Snap::Bottom, *lines.back(), Range2D::fromSize({}, LineSize)} :
+            Ui::Anchor{Ui::Snap::Top|Ui::Snap::Left|Ui::Snap::Inside, Range2D::fromSize({}, LineSize)};
+        lines.emplace_back(new Ui::Label{*this, anchor, "", Text::Alignment::LineLeft, LineCapacity, Ui::Style::Default});
+    }
+}
+
+PerformanceOverlay::PerformanceOverlay(const Vector2i& windowSize):
+_ui{Vector2{windowSize}, windowSize},
+_panel{_ui},
+_frame{0},
+_visible{false}
+{}
+
+void PerformanceOverlay::draw(const FrameProfiler& profiler) {
+    if(!_visible) return;
+
+    if(_frame++ % RefreshInterval == 0) {
+        const std::vector<std::string> report = profiler.report();
+        for(std::size_t i = 0; i != _panel.lines.size(); ++i)
+            _panel.lines[i]->setText(i < report.size() ? report[i].substr(0, LineCapacity) : std::string{});
+    }
+
+    /* Premultiplied alpha, on top of everything */
+    Renderer::enable(Renderer::Feature::Blending);
+    Renderer::setBlendFunction(Renderer::BlendFunction::One, Renderer::BlendFunction::OneMinusSourceAlpha);
+    Renderer::disable(Renderer::Feature::DepthTest);
+    Renderer::disable(Renderer::Feature::FaceCulling);
+
+    _ui.draw();
+
+    Renderer::enable(Renderer::Feature::FaceCulling);
+    Renderer::enable(Renderer::Feature::DepthTest);
+    Renderer::disable(Renderer::Feature::Blending);
+}
@@ -0,0 +1,54 @@
+#if !defined(PERFORMANCEOVERLAY_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define PERFORMANCEOVERLAY_H
+
+#include <memory>
+#include <vector>
+
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Vector2.h>
+#include <Magnum/Ui/Label.h>
+#include <Magnum/Ui/Plane.h>
+#include <Magnum/Ui/UserInterface.h>
+
+#include "FrameProfiler.h"
+
+using namespace Magnum;
+
+/**
+Ui panel in the top left corner showing the @ref FrameProfiler report. The
+text is refreshed every few frames only, rebuilding it isn't free and the
+percentiles don't change that fast anyway.
+*/
+class PerformanceOverlay {
+public:
+    enum: UnsignedInt { RefreshInterval = 15 };
+
+    explicit PerformanceOverlay(const Vector2i& windowSize);
+
+    bool isVisible() const { return _visible; }
+    void toggle() { _visible = !_visible; }
+
+    /* Update the text if it's time and draw, does nothing when hidden */
+    void draw(const FrameProfiler& profiler);
+
+private:
+    struct Panel: Ui::Plane {
+        explicit Panel(Ui::UserInterface& ui);
+
+        std::vector<std::unique_ptr<Ui::Label>> lines;
+    };
+
+    Ui::UserInterface _ui;
+    Panel _panel;
+    UnsignedInt _frame;
+    bool _visible;
+};
+
+#endif
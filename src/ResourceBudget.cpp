@@ -0,0 +1,184 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "ResourceBudget.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <Corrade/Utility/Debug.h>
+#include <Magnum/AbstractResourceLoader.h>
+#include <Magnum/Buffer.h>
+#include <Magnum/Mesh.h>
+#include <Magnum/Texture.h>
+
+namespace {
+    constexpr const char* TypeNames[]{"texture", "mesh"};
+
+    Float megabytes(const std::size_t bytes) {
+        return bytes/(1024.0f*1024.0f);
+    }
+}
+
+ResourceBudget::ResourceBudget(ViewerResourceManager& resourceManager, const std::size_t budget):
+_resourceManager(resourceManager),
+_budget{budget}
+{}
+
+std::size_t ResourceBudget::residentBytes() const {
+    return _residentBytes[0] + _residentBytes[1];
+}
+
+std::size_t ResourceBudget::residentBytes(const ResidentType type, const UnsignedInt id) const {
+    auto found = _lookup[UnsignedInt(type)].find(ResourceKey{id});
+    if(found == _lookup[UnsignedInt(type)].end() || found->second->state != State::Resident)
+        return 0;
+    return found->second->bytes;
+}
+
+std::optional<UnsignedInt> ResourceBudget::id(const ResidentType type, const ResourceKey key) const {
+    auto found = _lookup[UnsignedInt(type)].find(key);
+    if(found == _lookup[UnsignedInt(type)].end()) return {};
+    return found->second->id;
+}
+
+void ResourceBudget::add(const ResidentType type, const UnsignedInt id, const std::size_t bytes) {
+    auto& lookup = _lookup[UnsignedInt(type)];
+    auto found = lookup.find(ResourceKey{id});
+
+    /* A fresh upload counts as a use, otherwise it could get evicted
+       before anything had the chance to draw it */
+    if(found == lookup.end()) {
+        _entries.push_front(Entry{type, id, 0, _frame, State::Evicted});
+        found = lookup.emplace(ResourceKey{id}, _entries.begin()).first;
+    } else _entries.splice(_entries.begin(), _entries, found->second);
+
+    Entry& entry = *found->second;
+    if(entry.state == State::Resident)
+        _residentBytes[UnsignedInt(type)] -= entry.bytes;
+    entry.bytes = bytes;
+    entry.lastUsedFrame = _frame;
+    entry.state = State::Resident;
+    _residentBytes[UnsignedInt(type)] += bytes;
+}
+
+void ResourceBudget::use(const ResidentType type, const ResourceKey key) {
+    auto found = _lookup[UnsignedInt(type)].find(key);
+
+    /* Not uploaded for the first time yet */
+    if(found == _lookup[UnsignedInt(type)].end()) return;
+
+    Entry& entry = *found->second;
+    if(entry.lastUsedFrame != _frame) {
+        entry.lastUsedFrame = _frame;
+        _entries.splice(_entries.begin(), _entries, found->second);
+    }
+
+    if(entry.state != State::Evicted) return;
+
+    /* The loader sets the resource to loading state, the objects keep
+       drawing with the fallback until it's uploaded again */
+    if(type == ResidentType::Texture) {
+        if(!_resourceManager.loader<Texture2D>()) return;
+        _resourceManager.loader<Texture2D>()->load(key);
+    } else {
+        if(!_resourceManager.loader<Mesh>()) return;
+        _resourceManager.loader<Mesh>()->load(key);
+    }
+
+    entry.state = State::Loading;
+    ++_reloadCount;
+}
+
+void ResourceBudget::update() {
+    ++_frame;
+    if(!_budget) return;
+
+    /* Walk from the least recently drawn end, everything drawn in the
+       previous frame or later is at the front */
+    for(auto it = _entries.end(); residentBytes() > _budget && it != _entries.begin(); ) {
+        Entry& entry = *--it;
+        if(entry.lastUsedFrame + 1 >= _frame) break;
+        if(entry.state == State::Resident) evict(entry);
+    }
+
+    if(residentBytes() > _budget) {
+        if(!_overBudgetWarned) {
+            Warning{} << "Resources drawn in the last frame take" << megabytes(residentBytes()) << "MB, over the budget of" << megabytes(_budget) << "MB";
+            _overBudgetWarned = true;
+        }
+    } else _overBudgetWarned = false;
+}
+
+void ResourceBudget::refresh() {
+    for(Entry& entry: _entries) {
+        if(entry.state != State::Resident) continue;
+
+        const ResourceKey key{entry.id};
+        const ResourceState state = entry.type == ResidentType::Texture ?
+            _resourceManager.state<Texture2D>(key) : _resourceManager.state<Mesh>(key);
+        if(state == ResourceState::Mutable || state == ResourceState::Final)
+            continue;
+
+        evict(entry);
+    }
+}
+
+void ResourceBudget::evict(Entry& entry) {
+    const ResourceKey key{entry.id};
+    if(entry.type == ResidentType::Texture) {
+        release<Texture2D>(key);
+    } else {
+        /* Meshes first, they reference the buffers */
+        const std::string prefix = std::to_string(entry.id);
+        release<Mesh>(key);
+        release<Mesh>(prefix + "-shadow");
+        release<ShadowCasterLods>(prefix + "-shadow-lods");
+        release<Buffer>(prefix + "-vertices");
+        release<Buffer>(prefix + "-positions");
+        release<Buffer>(prefix + "-indices");
+    }
+
+    _residentBytes[UnsignedInt(entry.type)] -= entry.bytes;
+    entry.state = State::Evicted;
+    ++_evictionCount;
+}
+
+template<class T> void ResourceBudget::release(const ResourceKey key) {
+    /* Unreferenced parts might have been freed by the manager already */
+    if(_resourceManager.state<T>(key) != ResourceState::Mutable) return;
+
+    _resourceManager.set<T>(key, nullptr, ResourceDataState::NotFound, ResourcePolicy::Manual);
+}
+
+void ResourceBudget::printReport() const {
+    {
+        Debug d;
+        d << "Resource memory:" << megabytes(residentBytes()) << "MB resident,";
+        if(_budget) d << megabytes(_budget) << "MB budget";
+        else d << "no budget";
+    }
+
+    UnsignedInt counts[2][3]{};
+    std::vector<const Entry*> resident;
+    for(const Entry& entry: _entries) {
+        ++counts[UnsignedInt(entry.type)][UnsignedInt(entry.state)];
+        if(entry.state == State::Resident) resident.push_back(&entry);
+    }
+
+    for(UnsignedInt type = 0; type != 2; ++type)
+        Debug{} << "   " << TypeNames[type] << Debug::nospace << "s:" << counts[type][UnsignedInt(State::Resident)] << "resident in" << megabytes(_residentBytes[type]) << "MB," << counts[type][UnsignedInt(State::Evicted)] << "evicted," << counts[type][UnsignedInt(State::Loading)] << "loading";
+    Debug{} << "   " << _evictionCount << "evictions," << _reloadCount << "reloads so far";
+
+    const std::size_t listed = std::min(resident.size(), std::size_t{16});
+    std::partial_sort(resident.begin(), resident.begin() + listed, resident.end(),
+        [](const Entry* a, const Entry* b) { return a->bytes > b->bytes; });
+    if(listed) Debug{} << "    largest resident:";
+    for(std::size_t i = 0; i != listed; ++i)
+        Debug{} << "     " << TypeNames[UnsignedInt(resident[i]->type)] << resident[i]->id << Debug::nospace << ":" << megabytes(resident[i]->bytes) << "MB, drawn" << _frame - resident[i]->lastUsedFrame << "frames ago";
+}
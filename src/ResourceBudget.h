@@ -0,0 +1,118 @@
+#if !defined(RESOURCEBUDGET_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define RESOURCEBUDGET_H
+
+#include <cstring>
+#include <list>
+#include <optional>
+#include <unordered_map>
+
+#include <Magnum/Magnum.h>
+#include <Magnum/ResourceManager.h>
+
+#include "Types.h"
+
+using namespace Magnum;
+
+enum class ResidentType: UnsignedInt {
+    Texture = 0,    /**< Texture2D with all its mips */
+    Mesh = 1        /**< Mesh together with its buffers, shadow mesh and LODs */
+};
+
+/**
+Accounts the memory of scene textures and meshes in the resource manager
+and keeps it under a budget. Drawables report what they draw every frame,
+once over the budget the least recently drawn data are evicted and the
+objects using them draw with the resource manager fallbacks. Drawing an
+evicted resource asks the resource manager loader for it again.
+
+Everything here has to be called from the GL thread.
+*/
+class ResourceBudget {
+public:
+    /* Zero @p budget is unlimited */
+    explicit ResourceBudget(ViewerResourceManager& resourceManager, std::size_t budget = 0);
+
+    void setBudget(std::size_t bytes) { _budget = bytes; }
+    std::size_t budget() const { return _budget; }
+
+    std::size_t residentBytes() const;
+    std::size_t residentBytes(ResidentType type) const { return _residentBytes[UnsignedInt(type)]; }
+
+    /* Bytes of given texture or mesh, zero if it's not resident */
+    std::size_t residentBytes(ResidentType type, UnsignedInt id) const;
+
+    UnsignedInt evictionCount() const { return _evictionCount; }
+    UnsignedInt reloadCount() const { return _reloadCount; }
+
+    /* Id of a texture or mesh the budget knows about, for the loaders */
+    std::optional<UnsignedInt> id(ResidentType type, ResourceKey key) const;
+
+    /* Account a freshly uploaded texture or mesh */
+    void add(ResidentType type, UnsignedInt id, std::size_t bytes);
+
+    /**
+     * Mark a texture or mesh as drawn in this frame. If it was evicted,
+     * it's requested from the resource manager loader again.
+     */
+    void use(ResidentType type, ResourceKey key);
+
+    /**
+     * Start a new frame and evict least recently drawn data until under
+     * the budget. Data drawn in the previous frame are never evicted, if
+     * that isn't enough, a warning is printed.
+     */
+    void update();
+
+    /**
+     * Stop accounting data the resource manager doesn't have anymore,
+     * such as after @ref ResourceManager::free(), and release the buffers
+     * of freed meshes.
+     */
+    void refresh();
+
+    /* Print the resident memory by type and the largest resources */
+    void printReport() const;
+
+private:
+    enum class State: UnsignedByte { Resident, Evicted, Loading };
+
+    struct Entry {
+        ResidentType type;
+        UnsignedInt id;
+        std::size_t bytes;
+        UnsignedInt lastUsedFrame;
+        State state;
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const ResourceKey& key) const {
+            std::size_t hash;
+            std::memcpy(&hash, key.byteArray(), sizeof(hash));
+            return hash;
+        }
+    };
+
+    void evict(Entry& entry);
+    template<class T> void release(ResourceKey key);
+
+    ViewerResourceManager& _resourceManager;
+    std::size_t _budget;
+    std::size_t _residentBytes[2]{};
+
+    /* Most recently drawn first */
+    std::list<Entry> _entries;
+    std::unordered_map<ResourceKey, std::list<Entry>::iterator, KeyHash> _lookup[2];
+
+    UnsignedInt _frame{0};
+    UnsignedInt _evictionCount{0}, _reloadCount{0};
+    bool _overBudgetWarned{false};
+};
+
+#endif
@@ -0,0 +1,76 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+uniform int radius;
+uniform float weights[MAX_RADIUS + 1];
+
+#ifdef FROM_DEPTH
+uniform highp sampler2DArray sourceTexture;
+uniform int layer;
+#define DIRECTION ivec2(1, 0)
+#else
+uniform highp sampler2D sourceTexture;
+#define DIRECTION ivec2(0, 1)
+#endif
+
+out highp vec4 moments;
+
+highp vec4 fetch(ivec2 coordinates, ivec2 size) {
+    coordinates = clamp(coordinates, ivec2(0), size - 1);
+
+    #ifdef FROM_DEPTH
+    highp float depth = texelFetch(sourceTexture, ivec3(coordinates, layer), 0).r;
+    #ifdef REVERSED_DEPTH
+    depth = 1.0 - depth;
+    #endif
+    #ifdef EXPONENTIAL
+    /* Warped from [-1, 1], positive and negative exponential with their
+       squares */
+    highp float warped = 2.0*depth - 1.0;
+    highp vec2 exponential = vec2(exp(EVSM_EXPONENTS.x*warped), -exp(-EVSM_EXPONENTS.y*warped));
+    return vec4(exponential.x, exponential.x*exponential.x,
+                exponential.y, exponential.y*exponential.y);
+    #else
+    return vec4(depth, depth*depth, 0.0, 0.0);
+    #endif
+    #else
+    return texelFetch(sourceTexture, coordinates, 0);
+    #endif
+}
+
+void main() {
+    ivec2 size = textureSize(sourceTexture, 0).xy;
+    ivec2 coordinates = ivec2(gl_FragCoord.xy);
+
+    moments = weights[0]*fetch(coordinates, size);
+    for(int i = 1; i <= radius; ++i)
+        moments += weights[i]*(fetch(coordinates - i*DIRECTION, size) +
+                               fetch(coordinates + i*DIRECTION, size));
+}
@@ -0,0 +1,102 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ShadowBlurShader.h"
+
+#include <string>
+
+#include <Corrade/Utility/Resource.h>
+#include <Magnum/Context.h>
+#include <Magnum/Shader.h>
+#include <Magnum/Texture.h>
+#include <Magnum/TextureArray.h>
+#include <Magnum/Version.h>
+
+namespace Magnum {
+
+ShadowBlurShader::ShadowBlurShader(const Flags flags): _flags{flags} {
+    MAGNUM_ASSERT_VERSION_SUPPORTED(Version::GL330);
+    CORRADE_ASSERT(!(flags & (Flag::Exponential|Flag::ReversedDepth)) || (flags & Flag::FromDepth),
+        "ShadowBlurShader: moments are made only in the pass from depth", );
+
+    const Utility::Resource rs{"shadow-data"};
+
+    Shader vert{Version::GL330, Shader::Type::Vertex};
+    Shader frag{Version::GL330, Shader::Type::Fragment};
+
+    std::string preamble = "#define MAX_RADIUS " + std::to_string(MaxRadius) + "\n";
+    if(flags & Flag::FromDepth) preamble += "#define FROM_DEPTH\n";
+    if(flags & Flag::ReversedDepth) preamble += "#define REVERSED_DEPTH\n";
+    if(flags & Flag::Exponential)
+        preamble += "#define EXPONENTIAL\n#define EVSM_EXPONENTS vec2(" +
+            std::to_string(EvsmPositiveExponent) + ", " + std::to_string(EvsmNegativeExponent) + ")\n";
+    vert.addSource(rs.get("ShadowBlur.vert"));
+    frag.addSource(preamble);
+    frag.addSource(rs.get("ShadowBlur.frag"));
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(Shader::compile({vert, frag}));
+
+    attachShaders({vert, frag});
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(link());
+
+    _radiusUniform = uniformLocation("radius");
+    _weightsUniform = uniformLocation("weights");
+    _layerUniform = flags & Flag::FromDepth ? uniformLocation("layer") : -1;
+
+    setUniform(uniformLocation("sourceTexture"), SourceTextureLayer);
+    const Float weights[]{1.0f};
+    setKernel(weights);
+}
+
+ShadowBlurShader& ShadowBlurShader::setKernel(const Containers::ArrayView<const Float> weights) {
+    CORRADE_ASSERT(weights.size() && weights.size() <= MaxRadius + 1,
+        "ShadowBlurShader::setKernel(): expected 1 to" << MaxRadius + 1 << "weights, got" << weights.size(), *this);
+    setUniform(_radiusUniform, Int(weights.size() - 1));
+    setUniform(_weightsUniform, weights);
+    return *this;
+}
+
+ShadowBlurShader& ShadowBlurShader::setDepthTexture(Texture2DArray& texture, const Int layer) {
+    CORRADE_ASSERT(_flags & Flag::FromDepth,
+        "ShadowBlurShader::setDepthTexture(): the shader was not created for the pass from depth", *this);
+    texture.bind(SourceTextureLayer);
+    setUniform(_layerUniform, layer);
+    return *this;
+}
+
+ShadowBlurShader& ShadowBlurShader::setMomentsTexture(Texture2D& texture) {
+    CORRADE_ASSERT(!(_flags & Flag::FromDepth),
+        "ShadowBlurShader::setMomentsTexture(): the shader was created for the pass from depth", *this);
+    texture.bind(SourceTextureLayer);
+    return *this;
+}
+
+}
@@ -0,0 +1,122 @@
+#ifndef Magnum_Examples_ShadowBlurShader_h
+#define Magnum_Examples_ShadowBlurShader_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Corrade/Containers/ArrayView.h>
+#include <Corrade/Containers/EnumSet.h>
+#include <Magnum/AbstractShaderProgram.h>
+
+namespace Magnum {
+
+/**
+@brief Warp exponents of exponential variance shadow maps
+
+Positive and negative. The square of the positive moment stays in 32-bit
+float range for exponents up to about 44.
+*/
+constexpr Float EvsmPositiveExponent = 40.0f;
+constexpr Float EvsmNegativeExponent = 5.0f;
+
+/**
+@brief Separable Gaussian blur of shadow map moments
+
+Draws a single full-viewport triangle without any vertex data. The
+horizontal pass reads one layer of the depth texture array and turns every
+tap into moments, the vertical pass blurs the result of it, so the moments
+are never stored unfiltered.
+*/
+class ShadowBlurShader: public AbstractShaderProgram {
+    public:
+        /** @brief Shader flag */
+        enum class Flag: UnsignedByte {
+            /**
+             * Horizontal pass from depth. Without it, vertical pass over
+             * moments.
+             */
+            FromDepth = 1 << 0,
+
+            /** Exponential moments, only with @ref Flag::FromDepth */
+            Exponential = 1 << 1,
+
+            /**
+             * Reversed depth, the moments are made from one minus it. Only
+             * with @ref Flag::FromDepth.
+             */
+            ReversedDepth = 1 << 2
+        };
+
+        /** @brief Shader flags */
+        typedef Containers::EnumSet<Flag> Flags;
+
+        /** @brief Largest kernel radius in texels */
+        enum: UnsignedInt { MaxRadius = 8 };
+
+        explicit ShadowBlurShader(Flags flags);
+
+        Flags flags() const { return _flags; }
+
+        /**
+         * @brief Set kernel weights
+         *
+         * The center tap first, then one weight for each distance up to the
+         * radius, at most @ref MaxRadius + 1 values.
+         */
+        ShadowBlurShader& setKernel(Containers::ArrayView<const Float> weights);
+
+        /**
+         * @brief Set depth texture array and layer to blur
+         *
+         * Only with @ref Flag::FromDepth. The texture can't have depth
+         * comparison enabled.
+         */
+        ShadowBlurShader& setDepthTexture(Texture2DArray& texture, Int layer);
+
+        /**
+         * @brief Set moments from the horizontal pass
+         *
+         * Only without @ref Flag::FromDepth.
+         */
+        ShadowBlurShader& setMomentsTexture(Texture2D& texture);
+
+    private:
+        enum: Int { SourceTextureLayer = 0 };
+
+        Flags _flags;
+        Int _radiusUniform,
+            _weightsUniform,
+            _layerUniform;
+};
+
+CORRADE_ENUMSET_OPERATORS(ShadowBlurShader::Flags)
+
+}
+
+#endif
@@ -32,6 +32,10 @@ uniform highp mat4 transformationMatrix;
 
 in highp vec4 position;
 
+/* The depth pre-pass draws with this shader and the receivers have to hit
+   the same depth exactly */
+invariant gl_Position;
+
 void main() {
-    gl_Position = transformationMatrix * position * 1000.0;
+    gl_Position = transformationMatrix * position;
 }
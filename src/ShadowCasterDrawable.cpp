@@ -30,16 +30,74 @@
 
 #include "ShadowCasterDrawable.h"
 
+#include <utility>
+
 #include <Magnum/SceneGraph/Camera.h>
 
+#include "DrawCommands.h"
 #include "ShadowCasterShader.h"
 
 namespace Magnum {
 ShadowCasterDrawable::ShadowCasterDrawable(SceneGraph::AbstractObject3D& parent, SceneGraph::DrawableGroup3D* drawables): Magnum::SceneGraph::Drawable3D{parent, drawables} {}
 
+void ShadowCasterLods::setData(Buffer& positionBuffer, const std::vector<MeshLod>& lods) {
+    std::size_t indexCount = 0;
+    for(const MeshLod& lod: lods) indexCount += lod.indices.size();
+
+    std::vector<UnsignedInt> indices;
+    indices.reserve(indexCount);
+    meshes.clear();
+    errors.clear();
+    for(const MeshLod& lod: lods) {
+        meshes.emplace_back();
+        meshes.back().setPrimitive(MeshPrimitive::Triangles)
+            .setCount(lod.indices.size())
+            .addVertexBuffer(positionBuffer, 0, ShadowCasterShader::Position{})
+            .setIndexBuffer(indexBuffer, indices.size()*sizeof(UnsignedInt), Mesh::IndexType::UnsignedInt);
+        errors.push_back(lod.error);
+        indices.insert(indices.end(), lod.indices.begin(), lod.indices.end());
+    }
+
+    indexBuffer.setData(indices, BufferUsage::StaticDraw);
+}
+
+void ShadowCasterDrawable::setMesh(Resource<Mesh> mesh, Resource<ShadowCasterLods> lods) {
+    _meshResource = std::move(mesh);
+    _lodsResource = std::move(lods);
+    _hasResources = true;
+    acquireResources();
+}
+
+void ShadowCasterDrawable::acquireResources() {
+    if(!_hasResources) return;
+
+    _mesh = _meshResource;
+    _lods = _lodsResource;
+    _radius = _lods ? _lods->radius : 0.0f;
+}
+
+UnsignedInt ShadowCasterDrawable::selectLod(const Float texelsPerUnit, const Float scale, const Float maxErrorTexels) const {
+    if(!_lods) return 0;
+
+    /* Errors only grow with the level */
+    const Float texelsPerRadius = _radius*scale*texelsPerUnit;
+    UnsignedInt lod = 0;
+    while(lod != _lods->errors.size() && _lods->errors[lod]*texelsPerRadius <= maxErrorTexels)
+        ++lod;
+    return lod;
+}
+
 void ShadowCasterDrawable::draw(const Matrix4& transformationMatrix, SceneGraph::Camera3D& shadowCamera) {
     _shader->setTransformationMatrix(shadowCamera.projectionMatrix()*transformationMatrix);
-    _mesh->draw(*_shader);
+    if(_lod) _lods->meshes[_lod - 1].draw(*_shader);
+    else if(_mesh) _mesh->draw(*_shader);
+}
+
+void ShadowCasterDrawable::record(DrawCommandBuffer& commands, const Matrix4& transformationMatrix, const Matrix4& projectionMatrix, const UnsignedInt lod) const {
+    /* The levels are shared by all drawables, but drawing doesn't change
+       them */
+    Mesh* const mesh = lod ? &const_cast<Mesh&>(_lods->meshes[lod - 1]) : _mesh;
+    if(mesh) commands.recordCaster(*_shader, *mesh, projectionMatrix*transformationMatrix);
 }
 
 }
@@ -30,35 +30,151 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <vector>
+
+#include <Magnum/Buffer.h>
 #include <Magnum/Mesh.h>
+#include <Magnum/Resource.h>
+#include <Magnum/Math/Functions.h>
 #include <Magnum/SceneGraph/Drawable.h>
 #include <Magnum/SceneGraph/Object.h>
 
+#include "MeshSimplifier.h"
+
+class DrawCommandBuffer;
+
 namespace Magnum {
 class ShadowCasterShader;
 
+/**
+@brief Simplified versions of a shadow caster mesh
+
+All levels share the caster's position buffer and have their indices in
+one buffer.
+*/
+struct ShadowCasterLods {
+    /**
+     * @brief Upload the levels
+     *
+     * @p lods are ordered from finest to coarsest, level zero is the full
+     * mesh and isn't included.
+     */
+    void setData(Buffer& positionBuffer, const std::vector<MeshLod>& lods);
+
+    Buffer indexBuffer;
+    std::vector<Mesh> meshes;
+    /** @brief Simplification error of each level relative to the radius */
+    std::vector<Float> errors;
+    /** @brief Bounding sphere radius of the full mesh */
+    Float radius{};
+};
+
 class ShadowCasterDrawable: public SceneGraph::Drawable3D {
     public:
         explicit ShadowCasterDrawable(SceneGraph::AbstractObject3D& parent, SceneGraph::DrawableGroup3D* drawables);
 
-        /** @brief Mesh to use for this drawable and its bounding sphere radius */
+        /**
+         * @brief Mesh to use for this drawable and its bounding sphere radius
+         *
+         * Only positions are used, the mesh should have them in a separate
+         * tightly packed buffer bound to @ref ShadowCasterShader::Position.
+         */
         void setMesh(Mesh& mesh, Float radius) {
             _mesh = &mesh;
             _radius = radius;
         }
 
+        /**
+         * @brief Mesh and levels from a resource manager
+         *
+         * For meshes that get loaded or evicted while the drawable exists.
+         * The radius is @ref ShadowCasterLods::radius, until the levels are
+         * loaded the drawable has zero radius and draws the fallback mesh,
+         * if any.
+         */
+        void setMesh(Resource<Mesh> mesh, Resource<ShadowCasterLods> lods);
+
+        /**
+         * @brief Pick up changes of the resources
+         *
+         * Call before culling, it's a no-op for drawables not using
+         * resources.
+         */
+        void acquireResources();
+
+        /**
+         * @brief Key the mesh is accounted under in a resource budget
+         *
+         * Only meaningful for drawables using resources, see
+         * @ref hasResources().
+         */
+        void setResidentKey(ResourceKey key) { _residentKey = key; }
+        ResourceKey residentKey() const { return _residentKey; }
+
+        /** @brief Whether the mesh comes from a resource manager */
+        bool hasResources() const { return _hasResources; }
+
         void setShader(ShadowCasterShader& shader) {
             _shader = &shader;
         }
 
+        /** @brief Simplified levels of the mesh */
+        void setLods(const ShadowCasterLods& lods) {
+            _lods = &lods;
+        }
+
         Float radius() const { return _radius; }
 
+        /** @brief Full mesh, null if there's none yet */
+        Mesh* mesh() const { return _mesh; }
+
+        /** @brief Simplified levels, null if there are none (yet) */
+        const ShadowCasterLods* lods() const { return _lods; }
+
+        /**
+         * @brief Coarsest level with error below given threshold
+         * @param texelsPerUnit     Shadow map texels per world unit
+         * @param scale             Scale of the object
+         * @param maxErrorTexels    Largest allowed error in texels
+         */
+        UnsignedInt selectLod(Float texelsPerUnit, Float scale, Float maxErrorTexels) const;
+
+        /** @brief Level used for the next draw, zero is the full mesh */
+        void setLod(UnsignedInt lod) {
+            _lod = lod;
+            _finestLod = Math::min(_finestLod, lod);
+        }
+
+        /**
+         * @brief Finest level drawn since last @ref resetFinestLod()
+         *
+         * Used for visualizing the levels.
+         */
+        UnsignedInt finestLod() const { return _finestLod; }
+
+        void resetFinestLod() { _finestLod = ~UnsignedInt{}; }
+
         void draw(const Matrix4& transformationMatrix, SceneGraph::Camera3D& shadowCamera) override;
 
+        /**
+         * @brief Record a draw with given level instead of drawing
+         *
+         * Same as @ref draw(), but it doesn't touch the drawable or GL, so
+         * it can be called from any thread. Records nothing if there's no
+         * mesh yet.
+         */
+        void record(DrawCommandBuffer& commands, const Matrix4& transformationMatrix, const Matrix4& projectionMatrix, UnsignedInt lod) const;
+
     private:
         Mesh* _mesh{};
         ShadowCasterShader* _shader{};
+        const ShadowCasterLods* _lods{};
         Float _radius;
+        Resource<Mesh> _meshResource;
+        Resource<ShadowCasterLods> _lodsResource;
+        ResourceKey _residentKey;
+        bool _hasResources{};
+        UnsignedInt _lod{}, _finestLod{~UnsignedInt{}};
 };
 
 }
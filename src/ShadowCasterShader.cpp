@@ -53,6 +53,8 @@ ShadowCasterShader::ShadowCasterShader() {
 
     attachShaders({vert, frag});
 
+    bindAttributeLocation(Position::Location, "position");
+
     CORRADE_INTERNAL_ASSERT_OUTPUT(link());
 
     _transformationMatrixUniform = uniformLocation("transformationMatrix");
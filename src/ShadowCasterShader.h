@@ -31,11 +31,15 @@
 */
 
 #include <Magnum/AbstractShaderProgram.h>
+#include <Magnum/Shaders/Generic.h>
 
 namespace Magnum {
 
 class ShadowCasterShader: public AbstractShaderProgram {
     public:
+        /** @brief Vertex position, meant to be in its own tightly packed buffer */
+        typedef Shaders::Generic3D::Position Position;
+
         explicit ShadowCasterShader();
 
         /**
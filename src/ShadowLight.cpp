@@ -31,8 +31,12 @@
 #include "ShadowLight.h"
 
 #include <algorithm>
+#include <cmath>
+#include <Magnum/Context.h>
 #include <Magnum/DefaultFramebuffer.h>
+#include <Magnum/Extensions.h>
 #include <Magnum/ImageView.h>
+#include <Magnum/OpenGL.h>
 #include <Magnum/PixelFormat.h>
 #include <Magnum/Renderer.h>
 #include <Magnum/TextureFormat.h>
@@ -41,204 +45,511 @@
 #include <Magnum/SceneGraph/Scene.h>
 
 #include "ShadowCasterDrawable.h"
+#include "ThreadPool.h"
+#include "TraceRecorder.h"
 #include "Types.h"
 
 namespace Magnum {
 
-ShadowLight::ShadowLight(SceneGraph::Object<SceneGraph::MatrixTransformation3D>& parent): SceneGraph::Camera3D{parent}, _object(parent), _shadowTexture{NoCreate} {
+namespace {
+
+/* Near at one and far at zero, either in the zero to one clip depth range
+   or in the default one */
+Matrix4 reversedOrthographicProjection(const Vector2& size, const Float near, const Float far, const bool zeroToOne) {
+    const Float zScale = zeroToOne ? 1.0f/(far - near) : 2.0f/(far - near);
+    const Float zOffset = zeroToOne ? far/(far - near) : (far + near)/(far - near);
+    return {{2.0f/size.x(), 0.0f, 0.0f, 0.0f},
+            {0.0f, 2.0f/size.y(), 0.0f, 0.0f},
+            {0.0f, 0.0f, zScale, 0.0f},
+            {0.0f, 0.0f, zOffset, 1.0f}};
+}
+
+/* Projecting world points normalized device coordinates means they range
+   -1 -> 1. Use this bias matrix so we go straight from world -> texture
+   space */
+constexpr const Matrix4 Bias{{0.5f, 0.0f, 0.0f, 0.0f},
+                             {0.0f, 0.5f, 0.0f, 0.0f},
+                             {0.0f, 0.0f, 0.5f, 0.0f},
+                             {0.5f, 0.5f, 0.5f, 1.0f}};
+
+/* Zero to one clip depth maps texture depth one to one */
+constexpr const Matrix4 ZeroToOneBias{{0.5f, 0.0f, 0.0f, 0.0f},
+                                      {0.0f, 0.5f, 0.0f, 0.0f},
+                                      {0.0f, 0.0f, 1.0f, 0.0f},
+                                      {0.5f, 0.5f, 0.0f, 1.0f}};
+
+/* FNV-1a, to tell whether a layer would be drawn the same as last time */
+void hashBytes(UnsignedLong& hash, const void* const data, const std::size_t size) {
+    const unsigned char* const bytes = static_cast<const unsigned char*>(data);
+    for(std::size_t i = 0; i != size; ++i)
+        hash = (hash ^ bytes[i])*1099511628211ull;
+}
+
+template<class T> void hashValue(UnsignedLong& hash, const T& value) {
+    hashBytes(hash, &value, sizeof(T));
+}
+
+}
+
+ShadowLight::ShadowLight(SceneGraph::Object<SceneGraph::MatrixTransformation3D>& parent): SceneGraph::Camera3D{parent}, _object(parent), _shadowTexture{NoCreate}, _momentsTexture{NoCreate}, _blurTexture{NoCreate}, _blurFramebuffer{NoCreate}, _clipControl{Context::current().isExtensionSupported<Extensions::GL::ARB::clip_control>()} {
     setAspectRatioPolicy(SceneGraph::AspectRatioPolicy::NotPreserved);
+    _fullscreenTriangle.setPrimitive(MeshPrimitive::Triangles)
+        .setCount(3);
+    setSoftness(0);
 }
 
 void ShadowLight::setupShadowmaps(Int numShadowLevels, const Vector2i& size) {
     _layers.clear();
+    for(std::int_fast32_t i = 0; i < numShadowLevels; ++i)
+        _layers.emplace_back(size);
+    _pendingLayers.reset(new std::atomic<std::size_t>[numShadowLevels]{});
+    setupTextures(size);
+}
+
+void ShadowLight::setFiltering(const Filtering filtering) {
+    _filtering = filtering;
+    if(!_layers.empty()) setupTextures(shadowMapSize());
+}
+
+void ShadowLight::setStableCascades(const bool stable) {
+    _stableCascades = stable;
+    invalidate();
+}
+
+void ShadowLight::invalidate() {
+    for(ShadowLayerData& layer: _layers) layer.valid = false;
+}
+
+void ShadowLight::setDepthFormat(const DepthFormat format) {
+    _depthFormat = format;
+    if(!_layers.empty()) setupTextures(shadowMapSize());
+}
+
+Float ShadowLight::depthBias() const {
+    switch(_depthFormat) {
+        case DepthFormat::Depth16: return 2.0f/65535.0f;
+        case DepthFormat::Depth24: return 2.0f/16777215.0f;
+        /* Spacing of floats just below one, where the near plane is */
+        case DepthFormat::Depth32F: return 2.0f/16777216.0f;
+    }
+
+    CORRADE_ASSERT_UNREACHABLE();
+}
+
+Vector2i ShadowLight::shadowMapSize() const {
+    return _layers.empty() ? Vector2i{} : _layers.front().shadowFramebuffer.viewport().size();
+}
 
+std::size_t ShadowLight::depthMemory() const {
+    /* 24 bits are padded to 32 */
+    const std::size_t texelSize = _depthFormat == DepthFormat::Depth16 ? 2 : 4;
+    return std::size_t(shadowMapSize().product())*_layers.size()*texelSize;
+}
+
+std::size_t ShadowLight::momentsMemory() const {
+    if(_filtering == Filtering::DepthCompare) return 0;
+
+    /* A third more for the mips, one more layer for the blur */
+    const std::size_t texelSize = _filtering == Filtering::Variance ? 8 : 16;
+    const std::size_t layerSize = std::size_t(shadowMapSize().product())*texelSize;
+    return layerSize*_layers.size()*4/3 + layerSize;
+}
+
+std::size_t ShadowLight::bytesWrittenPerFrame() const {
+    /* The blur writes every layer twice */
+    const std::size_t texelSize = _filtering == Filtering::Variance ? 8 : 16;
+    const std::size_t layerSize = std::size_t(shadowMapSize().product())*texelSize;
+    return depthMemory() + (_filtering == Filtering::DepthCompare ? 0 :
+        layerSize*_layers.size()*2 + layerSize*_layers.size()/3);
+}
+
+void ShadowLight::setSoftness(const UnsignedInt radius) {
+    _softness = Math::min(radius, UnsignedInt(ShadowBlurShader::MaxRadius));
+
+    /* Gaussian with sigma of half the radius, normalized over the whole
+       kernel */
+    _blurWeights.resize(_softness + 1);
+    Float sum = 0.0f;
+    for(UnsignedInt i = 0; i <= _softness; ++i) {
+        _blurWeights[i] = _softness ? std::exp(-2.0f*i*i/(_softness*_softness)) : 1.0f;
+        sum += i ? 2.0f*_blurWeights[i] : _blurWeights[i];
+    }
+    for(Float& weight: _blurWeights) weight /= sum;
+
+    if(_horizontalBlurShader) {
+        _horizontalBlurShader->setKernel({_blurWeights.data(), _blurWeights.size()});
+        _verticalBlurShader->setKernel({_blurWeights.data(), _blurWeights.size()});
+    }
+    invalidate();
+}
+
+void ShadowLight::setupTextures(const Vector2i& size) {
+    const Int numShadowLevels = Int(_layers.size());
+    invalidate();
+
+    TextureFormat depthFormat;
+    PixelType depthType;
+    switch(_depthFormat) {
+        case DepthFormat::Depth16:
+            depthFormat = TextureFormat::DepthComponent16;
+            depthType = PixelType::UnsignedShort;
+            break;
+        case DepthFormat::Depth24:
+            depthFormat = TextureFormat::DepthComponent24;
+            depthType = PixelType::UnsignedInt;
+            break;
+        case DepthFormat::Depth32F:
+            depthFormat = TextureFormat::DepthComponent32F;
+            depthType = PixelType::Float;
+            break;
+        default: CORRADE_ASSERT_UNREACHABLE();
+    }
+
+    /* The moments are made from the depth, which is then read as a plain
+       texture */
     (_shadowTexture = Texture2DArray{})
-        .setImage(0, TextureFormat::DepthComponent, ImageView3D{PixelFormat::DepthComponent, PixelType::Float, {size, numShadowLevels}, nullptr})
+        .setImage(0, depthFormat, ImageView3D{PixelFormat::DepthComponent, depthType, {size, numShadowLevels}, nullptr})
         .setMaxLevel(0)
-        .setCompareFunction(Sampler::CompareFunction::LessOrEqual)
-        .setCompareMode(Sampler::CompareMode::CompareRefToTexture)
         .setMinificationFilter(Sampler::Filter::Linear, Sampler::Mipmap::Base)
         .setMagnificationFilter(Sampler::Filter::Linear);
+    if(_filtering == Filtering::DepthCompare) {
+        _shadowTexture.setCompareFunction(reversedDepth() ?
+                Sampler::CompareFunction::GreaterOrEqual : Sampler::CompareFunction::LessOrEqual)
+            .setCompareMode(Sampler::CompareMode::CompareRefToTexture);
+        _momentsTexture = Texture2DArray{NoCreate};
+        _blurTexture = Texture2D{NoCreate};
+        _blurFramebuffer = Framebuffer{NoCreate};
+        _horizontalBlurShader = nullptr;
+        _verticalBlurShader = nullptr;
+
+    } else {
+        const TextureFormat format = _filtering == Filtering::Variance ?
+            TextureFormat::RG32F : TextureFormat::RGBA32F;
+        (_momentsTexture = Texture2DArray{})
+            .setStorage(Math::log2(size.max()) + 1, format, {size, numShadowLevels})
+            .setWrapping(Sampler::Wrapping::ClampToEdge)
+            .setMinificationFilter(Sampler::Filter::Linear, Sampler::Mipmap::Linear)
+            .setMagnificationFilter(Sampler::Filter::Linear)
+            .setMaxAnisotropy(Sampler::maxMaxAnisotropy());
+        (_blurTexture = Texture2D{})
+            .setStorage(1, format, size)
+            .setMinificationFilter(Sampler::Filter::Nearest, Sampler::Mipmap::Base)
+            .setMagnificationFilter(Sampler::Filter::Nearest);
+        (_blurFramebuffer = Framebuffer{{{}, size}})
+            .attachTexture(Framebuffer::ColorAttachment{0}, _blurTexture, 0);
+        CORRADE_INTERNAL_ASSERT(_blurFramebuffer.checkStatus(FramebufferTarget::Draw) == Framebuffer::Status::Complete);
+
+        ShadowBlurShader::Flags flags = ShadowBlurShader::Flag::FromDepth;
+        if(_filtering == Filtering::ExponentialVariance) flags |= ShadowBlurShader::Flag::Exponential;
+        if(reversedDepth()) flags |= ShadowBlurShader::Flag::ReversedDepth;
+        _horizontalBlurShader.reset(new ShadowBlurShader{flags});
+        _verticalBlurShader.reset(new ShadowBlurShader{ShadowBlurShader::Flags{}});
+        _horizontalBlurShader->setKernel({_blurWeights.data(), _blurWeights.size()});
+        _verticalBlurShader->setKernel({_blurWeights.data(), _blurWeights.size()});
+    }
 
     for(std::int_fast32_t i = 0; i < numShadowLevels; ++i) {
-        _layers.emplace_back(size);
-        Framebuffer& shadowFramebuffer = _layers.back().shadowFramebuffer;
-        shadowFramebuffer.attachTextureLayer(Framebuffer::BufferAttachment::Depth, _shadowTexture, 0, i)
+        ShadowLayerData& layer = _layers[i];
+        layer.shadowFramebuffer.attachTextureLayer(Framebuffer::BufferAttachment::Depth, _shadowTexture, 0, i)
             .mapForDraw(Framebuffer::DrawAttachment::None)
             .bind();
-        CORRADE_INTERNAL_ASSERT(shadowFramebuffer.checkStatus(FramebufferTarget::Draw) == Framebuffer::Status::Complete);
-    }
-}
+        CORRADE_INTERNAL_ASSERT(layer.shadowFramebuffer.checkStatus(FramebufferTarget::Draw) == Framebuffer::Status::Complete);
 
-ShadowLight::ShadowLayerData::ShadowLayerData(const Vector2i& size): shadowFramebuffer{{{}, size}} {}
+        if(_filtering == Filtering::DepthCompare) {
+            layer.momentsFramebuffer = Framebuffer{NoCreate};
+            continue;
+        }
 
-void ShadowLight::setTarget(const Vector3& lightDirection, const Vector3& screenDirection, SceneGraph::Camera3D& mainCamera) {
-    Matrix4 cameraMatrix = Matrix4::lookAt({}, -lightDirection, screenDirection);
-    const Matrix3x3 cameraRotationMatrix = cameraMatrix.rotation();
-    const Matrix3x3 inverseCameraRotationMatrix = cameraRotationMatrix.inverted();
+        (layer.momentsFramebuffer = Framebuffer{{{}, size}})
+            .attachTextureLayer(Framebuffer::ColorAttachment{0}, _momentsTexture, 0, i);
+        CORRADE_INTERNAL_ASSERT(layer.momentsFramebuffer.checkStatus(FramebufferTarget::Draw) == Framebuffer::Status::Complete);
+    }
 
-    for(std::size_t layerIndex = 0; layerIndex != _layers.size(); ++layerIndex) {
-        std::vector<Vector3> mainCameraFrustumCorners = layerFrustumCorners(mainCamera, Int(layerIndex));
-        ShadowLayerData& layer = _layers[layerIndex];
+    defaultFramebuffer.bind();
+}
 
-        /* Calculate the AABB in shadow-camera space */
-        Vector3 min{std::numeric_limits<Float>::max()}, max{std::numeric_limits<Float>::lowest()};
-        for(Vector3 worldPoint: mainCameraFrustumCorners) {
-            Vector3 cameraPoint = inverseCameraRotationMatrix*worldPoint;
-            min = Math::min(min, cameraPoint);
-            max = Math::max(max, cameraPoint);
-        }
+ShadowLight::ShadowLayerData::ShadowLayerData(const Vector2i& size): shadowFramebuffer{{{}, size}}, momentsFramebuffer{NoCreate} {}
 
-        /* Place the shadow camera at the mid-point of the camera box */
-        const Vector3 mid = (min + max)*0.5f;
-        const Vector3 cameraPosition = cameraRotationMatrix*mid;
+std::size_t ShadowLight::setTarget(const Vector3& lightDirection, const Vector3& screenDirection, SceneGraph::Camera3D& mainCamera) {
+    PROFILE_ZONE("ShadowLight::setTarget");
 
-        const Vector3 range = max - min;
-        /* Set up the initial extends of the shadow map's render volume. Note
-           we will adjust this later when we render. */
-        layer.orthographicSize = range.xy();
-        layer.orthographicNear = -0.5f*range.z();
-        layer.orthographicFar =  0.5f*range.z();
-        cameraMatrix.translation() = cameraPosition;
-        layer.shadowCameraMatrix = cameraMatrix;
+    const Matrix4 cameraMatrix = Matrix4::lookAt({}, -lightDirection, screenDirection);
+    const Matrix4 imvp = (mainCamera.projectionMatrix()*mainCamera.cameraMatrix()).inverted();
+    _volumes.resize(_cutPlanes.size());
+    if(_stableCascades && !_layers.empty())
+        ShadowMath::fitStableLayers(cameraMatrix, imvp, {_cutPlanes.data(), _cutPlanes.size()}, shadowMapSize(), {_volumes.data(), _volumes.size()});
+    else
+        ShadowMath::fitLayers(cameraMatrix, imvp, {_cutPlanes.data(), _cutPlanes.size()}, {_volumes.data(), _volumes.size()});
+
+    /* Layers past the split distances set up so far keep their volumes */
+    std::size_t changedCount = 0;
+    for(std::size_t layerIndex = 0; layerIndex != std::min(_layers.size(), _volumes.size()); ++layerIndex) {
+        ShadowLayerData& layer = _layers[layerIndex];
+        const ShadowMath::LayerVolume& volume = _volumes[layerIndex];
+        layer.changed = layer.orthographicSize != volume.orthographicSize ||
+            layer.orthographicNear != volume.orthographicNear ||
+            layer.orthographicFar != volume.orthographicFar ||
+            layer.shadowCameraMatrix != volume.cameraMatrix;
+        if(layer.changed) ++changedCount;
+        layer.orthographicSize = volume.orthographicSize;
+        layer.orthographicNear = volume.orthographicNear;
+        layer.orthographicFar = volume.orthographicFar;
+        layer.shadowCameraMatrix = volume.cameraMatrix;
     }
+
+    return changedCount;
 }
 
 Float ShadowLight::cutZ(const Int layer) const {
-    return _layers[layer].cutPlane;
+    return _cutPlanes[layer];
 }
 
 void ShadowLight::setupSplitDistances(const Float zNear, const Float zFar, const Float power) {
-    /* props http://stackoverflow.com/a/33465663 */
-    for(std::size_t i = 0; i != _layers.size(); ++i) {
-        const Float linearDepth = zNear + std::pow(Float(i + 1)/_layers.size(), power)*(zFar - zNear);
-        const Float nonLinearDepth = (zFar + zNear - 2.0f*zNear*zFar/linearDepth)/(zFar - zNear);
-        _layers[i].cutPlane = (nonLinearDepth + 1.0f)/2.0f;
-    }
+    _cutPlanes = ShadowMath::splitCutPlanes(_layers.size(), zNear, zFar, power);
 }
 
 Float ShadowLight::cutDistance(const Float zNear, const Float zFar, const Int layer) const {
-    const Float depthSample = 2.0f*_layers[layer].cutPlane - 1.0f;
+    const Float depthSample = 2.0f*_cutPlanes[layer] - 1.0f;
     const Float zLinear = 2.0f*zNear*zFar/(zFar + zNear - depthSample*(zFar - zNear));
     return zLinear;
 }
 
-std::vector<Vector3> ShadowLight::layerFrustumCorners(SceneGraph::Camera3D& mainCamera, const Int layer) {
-    const Float z0 = layer == 0 ? 0 : _layers[layer - 1].cutPlane;
-    const Float z1 = _layers[layer].cutPlane;
+std::array<Vector3, 8> ShadowLight::layerFrustumCorners(SceneGraph::Camera3D& mainCamera, const Int layer) {
+    const Float z0 = layer == 0 ? 0 : _cutPlanes[layer - 1];
+    const Float z1 = _cutPlanes[layer];
     return cameraFrustumCorners(mainCamera, z0, z1);
 }
 
-std::vector<Vector3> ShadowLight::cameraFrustumCorners(SceneGraph::Camera3D& mainCamera, const Float z0, const Float z1) {
-    const Matrix4 imvp = (mainCamera.projectionMatrix()*mainCamera.cameraMatrix()).inverted();
-    return frustumCorners(imvp, z0, z1);
-}
-
-std::vector<Vector3> ShadowLight::frustumCorners(const Matrix4& imvp, const Float z0, const Float z1) {
-    return {imvp.transformPoint({-1,-1, z0}),
-            imvp.transformPoint({ 1,-1, z0}),
-            imvp.transformPoint({-1, 1, z0}),
-            imvp.transformPoint({ 1, 1, z0}),
-            imvp.transformPoint({-1,-1, z1}),
-            imvp.transformPoint({ 1,-1, z1}),
-            imvp.transformPoint({-1, 1, z1}),
-            imvp.transformPoint({ 1, 1, z1})};
-}
-
-std::vector<Vector4> ShadowLight::calculateClipPlanes() {
-    const Matrix4 pm = projectionMatrix();
-    std::vector<Vector4> clipPlanes{
-        {pm[3][0] + pm[2][0], pm[3][1] + pm[2][1], pm[3][2] + pm[2][2], pm[3][3] + pm[2][3]},   /* near */
-        {pm[3][0] - pm[2][0], pm[3][1] - pm[2][1], pm[3][2] - pm[2][2], pm[3][3] - pm[2][3]},   /* far */
-        {pm[3][0] + pm[0][0], pm[3][1] + pm[0][1], pm[3][2] + pm[0][2], pm[3][3] + pm[0][3]},   /* left */
-        {pm[3][0] - pm[0][0], pm[3][1] - pm[0][1], pm[3][2] - pm[0][2], pm[3][3] - pm[0][3]},   /* right */
-        {pm[3][0] + pm[1][0], pm[3][1] + pm[1][1], pm[3][2] + pm[1][2], pm[3][3] + pm[1][3]},   /* bottom */
-        {pm[3][0] - pm[1][0], pm[3][1] - pm[1][1], pm[3][2] - pm[1][2], pm[3][3] - pm[1][3]}};  /* top */
-    for(Vector4& plane: clipPlanes)
-        plane *= plane.xyz().lengthInverted();
-    return clipPlanes;
-}
-
-void ShadowLight::render(SceneGraph::DrawableGroup3D& drawables) {
-    /* Compute transformations of all objects in the group relative to the camera */
-    std::vector<std::reference_wrapper<Object3D>> objects;
-    objects.reserve(drawables.size());
-    for(std::size_t i = 0; i != drawables.size(); ++i)
-        objects.push_back(static_cast<Object3D&>(drawables[i].object()));
-    std::vector<ShadowCasterDrawable*> filteredDrawables;
-
-    /* Projecting world points normalized device coordinates means they range
-       -1 -> 1. Use this bias matrix so we go straight from world -> texture
-       space */
-    constexpr const Matrix4 bias{{0.5f, 0.0f, 0.0f, 0.0f},
-                                 {0.0f, 0.5f, 0.0f, 0.0f},
-                                 {0.0f, 0.0f, 0.5f, 0.0f},
-                                 {0.5f, 0.5f, 0.5f, 1.0f}};
+std::array<Vector3, 8> ShadowLight::cameraFrustumCorners(SceneGraph::Camera3D& mainCamera, const Float z0, const Float z1) {
+    return ShadowMath::cameraFrustumCorners(mainCamera.projectionMatrix(), mainCamera.cameraMatrix(), z0, z1);
+}
+
+std::array<Vector3, 8> ShadowLight::frustumCorners(const Matrix4& imvp, const Float z0, const Float z1) {
+    return ShadowMath::frustumCorners(imvp, z0, z1);
+}
+
+std::array<Vector4, 6> ShadowLight::calculateClipPlanes() {
+    return ShadowMath::clipPlanes(projectionMatrix());
+}
+
+void ShadowLight::render(SceneGraph::DrawableGroup3D& drawables, FrameArena& arena, ThreadPool* const pool) {
+    PROFILE_ZONE("ShadowLight::render");
+
+    /* Absolute transformations of all objects in the group, made relative to
+       the camera of every layer in prepareLayer(). Everything temporary
+       comes from the frame arena, nothing here touches the heap once it's
+       big enough. The layers get separate slices, as they may be prepared
+       at the same time. */
+    const std::size_t count = drawables.size();
+    const std::size_t layerCount = _layers.size();
+    _frame.drawables = arena.allocate<ShadowCasterDrawable*>(count);
+    _frame.absoluteTransformations = arena.allocate<Matrix4>(count);
+    _frame.radii = arena.allocate<Float>(count);
+    _frame.transformations = arena.allocate<Matrix4>(count*layerCount);
+    _frame.visible = arena.allocate<UnsignedInt>(count*layerCount);
+    _frame.lods = arena.allocate<UnsignedInt>(count*layerCount);
+    for(std::size_t i = 0; i != count; ++i) {
+        auto& drawable = static_cast<ShadowCasterDrawable&>(drawables[i]);
+        drawable.acquireResources();
+        _frame.drawables[i] = &drawable;
+        _frame.absoluteTransformations[i] = drawable.object().absoluteTransformationMatrix();
+        _frame.radii[i] = drawable.radius();
+        drawable.resetFinestLod();
+    }
+    _lodDrawCounts.assign(layerCount*(MeshSimplifier::MaxLevels + 1), 0);
+
+    _frame.reversed = reversedDepth();
+    _frame.zeroToOne = _frame.reversed && _clipControl;
+
+    /* The lambda is small enough for std::function to not allocate */
+    if(pool) for(std::size_t layer = 0; layer != layerCount; ++layer)
+        pool->submit(_pendingLayers[layer], [this, layer]{ prepareLayer(layer); });
 
     Renderer::setDepthMask(true);
 
-    for(std::size_t layer = 0; layer != _layers.size(); ++layer) {
+    if(_frame.reversed) {
+        Renderer::setDepthFunction(Renderer::DepthFunction::Greater);
+        Renderer::setClearDepth(0.0f);
+        if(_frame.zeroToOne) glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+    }
+
+    /* Layer N is drawn while the ones after it are still being prepared */
+    for(std::size_t layer = 0; layer != layerCount; ++layer) {
+        if(pool) pool->wait(_pendingLayers[layer]);
+        else prepareLayer(layer);
+
+        const bool profiled = _profiler && layer < _profiledLayerCount;
+        if(profiled) _profiler->begin(_profilerSection + layer);
+
         ShadowLayerData& d = _layers[layer];
-        Float orthographicNear = d.orthographicNear;
-        const Float orthographicFar = d.orthographicFar;
-
-        /* Move this whole object to the right place to render each layer */
-        _object.setTransformation(d.shadowCameraMatrix)
-            .setClean();
-        setProjectionMatrix(Matrix4::orthographicProjection(d.orthographicSize, orthographicNear, orthographicFar));
-
-        const std::vector<Vector4> clipPlanes = calculateClipPlanes();
-        std::vector<Matrix4> transformations = _object.scene()->transformationMatrices(objects, cameraMatrix());
-
-        /* Rebuild the list of objects we will draw by clipping them with the
-           shadow camera's planes */
-        std::size_t transformationsOutIndex = 0;
-        filteredDrawables.clear();
-        for(std::size_t drawableIndex = 0; drawableIndex != drawables.size(); ++drawableIndex) {
-            auto& drawable = static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]);
-            const Matrix4 transform = transformations[drawableIndex];
-
-            /* If your centre is offset, inject it here */
-            const Vector4 localCentre{0.0f, 0.0f, 0.0f, 1.0f};
-            const Vector4 drawableCentre = transform*localCentre;
-
-            /* Start at 1, not 0 to skip out the near plane because we need to
-               include shadow casters traveling the direction the camera is
-               facing. */
-            for(std::size_t clipPlaneIndex = 1; clipPlaneIndex != clipPlanes.size(); ++clipPlaneIndex) {
-                const Float distance = Math::dot(clipPlanes[clipPlaneIndex], drawableCentre);
-
-                /* If the object is on the useless side of any one plane, we can skip it */
-                if(distance < -drawable.radius())
-                    goto next;
-            }
-
-            {
-                /* If this object extends in front of the near plane, extend
-                   the near plane. We negate the z because the negative z is
-                   forward away from the camera, but the near/far planes are
-                   measured forwards. */
-                const Float nearestPoint = -drawableCentre.z() - drawable.radius();
-                orthographicNear = Math::min(orthographicNear, nearestPoint);
-                filteredDrawables.push_back(&drawable);
-                transformations[transformationsOutIndex++] = transform;
-            }
-
-            next:;
+        if(!d.skipped) {
+            d.shadowFramebuffer.clear(FramebufferClear::Depth)
+                .bind();
+            PROFILE_ZONE("ShadowLight draw");
+            d.commands.replay();
         }
 
-        /* Recalculate the projection matrix with new near plane. */
-        const Matrix4 shadowCameraProjectionMatrix =
-            Matrix4::orthographicProjection(d.orthographicSize, orthographicNear, orthographicFar);
-        d.shadowMatrix = bias*shadowCameraProjectionMatrix*cameraMatrix();
-        setProjectionMatrix(shadowCameraProjectionMatrix);
+        /* Levels are tracked for the debug view and the resource budget, so
+           not on the pool. Casters of a kept layer count as drawn, they're
+           still in its shadow map. */
+        const UnsignedInt* const visible = _frame.visible.data() + layer*count;
+        const UnsignedInt* const lods = _frame.lods.data() + layer*count;
+        for(std::size_t i = 0; i != d.visibleCount; ++i) {
+            if(!d.skipped) ++_lodDrawCounts[layer*(MeshSimplifier::MaxLevels + 1) + lods[i]];
+            _frame.drawables[visible[i]]->setLod(lods[i]);
+        }
 
-        d.shadowFramebuffer.clear(FramebufferClear::Depth)
-            .bind();
+        if(profiled) _profiler->end(_profilerSection + layer, d.drawnCount);
+    }
+
+    if(_frame.reversed) {
+        Renderer::setDepthFunction(Renderer::DepthFunction::Less);
+        Renderer::setClearDepth(1.0f);
+        if(_frame.zeroToOne) glClipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
+    }
+
+    /* The object is left where the last layer is, the light direction is
+       taken from it */
+    if(layerCount) _object.setTransformation(_layers.back().shadowCameraMatrix)
+        .setClean();
+
+    defaultFramebuffer.bind();
+}
+
+void ShadowLight::prepareLayer(const std::size_t layer) {
+    PROFILE_ZONE("ShadowLight::prepareLayer");
+
+    ShadowLayerData& d = _layers[layer];
+    d.commands.clear();
+    d.drawnCount = 0;
+    d.visibleCount = 0;
+
+    const std::size_t count = _frame.drawables.size();
+    Containers::ArrayView<Matrix4> transformations = _frame.transformations.slice(layer*count, (layer + 1)*count);
+    Containers::ArrayView<UnsignedInt> visible = _frame.visible.slice(layer*count, (layer + 1)*count);
+    Containers::ArrayView<UnsignedInt> lods = _frame.lods.slice(layer*count, (layer + 1)*count);
+
+    Float orthographicNear = d.orthographicNear;
+    const Float orthographicFar = d.orthographicFar;
+
+    /* The layer camera is computed here instead of moving the object, which
+       would have to happen on the GL thread */
+    const std::array<Vector4, 6> clipPlanes = ShadowMath::clipPlanes(Matrix4::orthographicProjection(d.orthographicSize, orthographicNear, orthographicFar));
+    const Matrix4 layerCameraMatrix = d.shadowCameraMatrix.invertedRigid();
+    for(std::size_t i = 0; i != count; ++i)
+        transformations[i] = layerCameraMatrix*_frame.absoluteTransformations[i];
+
+    /* Rebuild the list of objects we will draw by clipping them with the
+       shadow camera's planes */
+    std::size_t transformationsOutIndex;
+    {
+        PROFILE_ZONE("ShadowLight cull");
+        transformationsOutIndex = ShadowMath::cullSpheres(clipPlanes, transformations, _frame.radii, visible, orthographicNear);
         for(std::size_t i = 0; i != transformationsOutIndex; ++i)
-            filteredDrawables[i]->draw(transformations[i], *this);
+            transformations[i] = transformations[visible[i]];
+    }
+    d.visibleCount = transformationsOutIndex;
+
+    /* With 16 bits the depth range is only what the casters span,
+       receivers in front of it are lit and the ones behind it
+       compare against the farthest caster */
+    Float depthNear = orthographicNear, depthFar = orthographicFar;
+    d.depthRange = {0.0f, 1.0f};
+    if(_depthFormat == DepthFormat::Depth16 && transformationsOutIndex) {
+        Float nearest = orthographicFar, farthest = orthographicNear;
+        for(std::size_t i = 0; i != transformationsOutIndex; ++i) {
+            const Matrix4& transformation = transformations[i];
+            const Float radius = _frame.radii[visible[i]]*std::sqrt(Math::max(transformation[0].xyz().dot(),
+                Math::max(transformation[1].xyz().dot(), transformation[2].xyz().dot())));
+            nearest = Math::min(nearest, -transformation.translation().z() - radius);
+            farthest = Math::max(farthest, -transformation.translation().z() + radius);
+        }
+        depthNear = Math::max(orthographicNear, nearest);
+        depthFar = Math::min(orthographicFar, farthest);
+        if(depthFar > depthNear)
+            d.depthRange = Vector2{orthographicNear - depthNear, orthographicFar - depthNear}/(depthFar - depthNear);
+        else {
+            depthNear = orthographicNear;
+            depthFar = orthographicFar;
+        }
+    }
+
+    /* Level of detail from how many texels a world unit covers in this
+       layer */
+    const Vector2 texelsPerUnit = Vector2{d.shadowFramebuffer.viewport().size()}/d.orthographicSize;
+    const Float lodTexelsPerUnit = Math::max(texelsPerUnit.x(), texelsPerUnit.y());
+    for(std::size_t i = 0; i != transformationsOutIndex; ++i) {
+        const Matrix4& transformation = transformations[i];
+        const Float scale = std::sqrt(Math::max(transformation[0].xyz().dot(),
+            Math::max(transformation[1].xyz().dot(), transformation[2].xyz().dot())));
+        lods[i] = _lodThreshold > 0.0f ?
+            _frame.drawables[visible[i]]->selectLod(lodTexelsPerUnit, scale, _lodThreshold) : 0;
+    }
+
+    /* With stable cascades the layer is kept if the shadow camera and
+       every caster, its mesh and level are the same as last time */
+    d.skipped = false;
+    if(_stableCascades) {
+        UnsignedLong hash = 14695981039346656037ull;
+        hashValue(hash, d.shadowCameraMatrix);
+        hashValue(hash, d.orthographicSize);
+        hashValue(hash, orthographicNear);
+        hashValue(hash, orthographicFar);
+        hashValue(hash, depthNear);
+        hashValue(hash, depthFar);
+        for(std::size_t i = 0; i != transformationsOutIndex; ++i) {
+            const ShadowCasterDrawable* const drawable = _frame.drawables[visible[i]];
+            const Mesh* const mesh = drawable->mesh();
+            const ShadowCasterLods* const lodMeshes = drawable->lods();
+            hashValue(hash, drawable);
+            hashValue(hash, mesh);
+            hashValue(hash, lodMeshes);
+            hashValue(hash, lods[i]);
+            hashValue(hash, transformations[i]);
+        }
+        d.skipped = d.valid && d.contentHash == hash;
+        d.contentHash = hash;
+    }
+    if(d.skipped) return;
+    d.valid = true;
+
+    /* Recalculate the projection matrix with new near plane. */
+    const Matrix4 shadowCameraProjectionMatrix = _frame.reversed ?
+        reversedOrthographicProjection(d.orthographicSize, depthNear, depthFar, _frame.zeroToOne) :
+        Matrix4::orthographicProjection(d.orthographicSize, depthNear, depthFar);
+    d.shadowMatrix = (_frame.zeroToOne ? ZeroToOneBias : Bias)*shadowCameraProjectionMatrix*layerCameraMatrix;
+
+    PROFILE_ZONE("ShadowLight record");
+    DrawCommandBuffer& commands = d.commands.buffer(0);
+    for(std::size_t i = 0; i != transformationsOutIndex; ++i)
+        _frame.drawables[visible[i]]->record(commands, transformations[i], shadowCameraProjectionMatrix, lods[i]);
+    d.drawnCount = transformationsOutIndex;
+}
+
+void ShadowLight::filter() {
+    if(_filtering == Filtering::DepthCompare) return;
+
+    PROFILE_ZONE("ShadowLight::filter");
+
+    /* Horizontally from the depth into the scratch texture, vertically from
+       there into the layer. Reused layers keep their moments. */
+    Renderer::disable(Renderer::Feature::DepthTest);
+    bool filtered = false;
+    for(std::size_t layer = 0; layer != _layers.size(); ++layer) {
+        if(_layers[layer].skipped) continue;
+        filtered = true;
+
+        _blurFramebuffer.bind();
+        _horizontalBlurShader->setDepthTexture(_shadowTexture, Int(layer));
+        _fullscreenTriangle.draw(*_horizontalBlurShader);
+
+        _layers[layer].momentsFramebuffer.bind();
+        _verticalBlurShader->setMomentsTexture(_blurTexture);
+        _fullscreenTriangle.draw(*_verticalBlurShader);
     }
+    Renderer::enable(Renderer::Feature::DepthTest);
 
+    if(filtered) _momentsTexture.generateMipmap();
     defaultFramebuffer.bind();
 }
 
@@ -30,22 +30,36 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include <Magnum/Framebuffer.h>
+#include <Magnum/Mesh.h>
 #include <Magnum/Resource.h>
+#include <Magnum/Texture.h>
 #include <Magnum/TextureArray.h>
 #include <Magnum/SceneGraph/Camera.h>
 #include <Magnum/SceneGraph/Drawable.h>
 #include <Magnum/SceneGraph/AbstractFeature.h>
 #include <Magnum/SceneGraph/SceneGraph.h>
 
-
+#include "DrawCommands.h"
+#include "FrameArena.h"
+#include "FrameProfiler.h"
+#include "MeshSimplifier.h"
+#include "ShadowBlurShader.h"
+#include "ShadowMath.h"
 #include "Types.h"
 //typedef SceneGraph::Object<SceneGraph::MatrixTransformation3D> Object3D;
 //typedef SceneGraph::Scene<SceneGraph::MatrixTransformation3D> Scene3D;
 
+class ThreadPool;
 
 namespace Magnum {
 
+class ShadowCasterDrawable;
+
 /**
 @brief A special camera used to render shadow maps
 
@@ -53,9 +67,48 @@ The object it's attached to should face the direction that the light travels.
 */
 class ShadowLight: public SceneGraph::Camera3D {
     public:
-        static std::vector<Vector3> cameraFrustumCorners(SceneGraph::Camera3D& mainCamera, Float z0 = -1.0f, Float z1 = 1.0f);
+        /** @brief How receivers filter the shadow maps */
+        enum class Filtering: UnsignedByte {
+            /** Hardware depth comparison, percentage-closer filtered */
+            DepthCompare,
+
+            /**
+             * Variance shadow maps, depth and its square in a blurred and
+             * mipmapped RG32F texture array
+             */
+            Variance,
+
+            /**
+             * Exponential variance shadow maps, two exponentially warped
+             * depths and their squares in RGBA32F. Less light bleeding
+             * than @ref Filtering::Variance.
+             */
+            ExponentialVariance
+        };
+
+        /** @brief Depth format of the shadow maps */
+        enum class DepthFormat: UnsignedByte {
+            /**
+             * 16-bit normalized. The depth range of every layer is fitted
+             * tightly around its casters, receivers outside of it clamp to
+             * the range.
+             */
+            Depth16,
+
+            /** 24-bit normalized */
+            Depth24,
+
+            /**
+             * 32-bit float with reversed depth, near at one and far at
+             * zero. With ARB_clip_control the clip depth goes from zero to
+             * one, without it the precision is the same as of 24 bits.
+             */
+            Depth32F
+        };
 
-        static std::vector<Vector3> frustumCorners(const Matrix4& imvp, Float z0, Float z1);
+        static std::array<Vector3, 8> cameraFrustumCorners(SceneGraph::Camera3D& mainCamera, Float z0 = -1.0f, Float z1 = 1.0f);
+
+        static std::array<Vector3, 8> frustumCorners(const Matrix4& imvp, Float z0, Float z1);
 
         explicit ShadowLight(SceneGraph::Object<SceneGraph::MatrixTransformation3D>& parent);
 
@@ -66,6 +119,72 @@ class ShadowLight: public SceneGraph::Camera3D {
          */
         void setupShadowmaps(Int numShadowLevels, const Vector2i& size);
 
+        /**
+         * @brief Set filtering
+         *
+         * Recreates the textures of the current layers if there are any.
+         * Default is @ref Filtering::DepthCompare.
+         */
+        void setFiltering(Filtering filtering);
+
+        Filtering filtering() const { return _filtering; }
+
+        /**
+         * @brief Set depth format
+         *
+         * Recreates the textures of the current layers if there are any.
+         * Default is @ref DepthFormat::Depth24.
+         */
+        void setDepthFormat(DepthFormat format);
+
+        DepthFormat depthFormat() const { return _depthFormat; }
+
+        /**
+         * @brief Whether the depth is reversed
+         *
+         * Receivers then have to compare with greater or equal and bias
+         * the other way, moments are made from one minus the depth.
+         */
+        bool reversedDepth() const { return _depthFormat == DepthFormat::Depth32F; }
+
+        /**
+         * @brief Bias of the depth format
+         *
+         * Two quantization steps of the format, to be added to the
+         * receiver bias.
+         */
+        Float depthBias() const;
+
+        /** @brief Size of every layer */
+        Vector2i shadowMapSize() const;
+
+        /** @brief Bytes of the depth texture */
+        std::size_t depthMemory() const;
+
+        /** @brief Bytes of the moment textures with mips and scratch space */
+        std::size_t momentsMemory() const;
+
+        /**
+         * @brief Bytes written to the shadow maps every frame
+         *
+         * Lower bound counting every texel of every pass once, depth clears
+         * not included.
+         */
+        std::size_t bytesWrittenPerFrame() const;
+
+        /**
+         * @brief Set softness
+         *
+         * Radius of the Gaussian blur of the moments in texels, at most
+         * @ref ShadowBlurShader::MaxRadius. The sigma is half the radius.
+         * Receivers using @ref Filtering::DepthCompare should use the same
+         * radius for their percentage-closer filtering to get matching
+         * softness. Default is zero, no blur.
+         */
+        void setSoftness(UnsignedInt radius);
+
+        UnsignedInt softness() const { return _softness; }
+
         /**
          * @brief Set up the distances we should cut the view frustum along
          *
@@ -85,16 +204,103 @@ class ShadowLight: public SceneGraph::Camera3D {
          *      splits (normally, the main camera that the shadows will be
          *      rendered to)
          *
-         * Should be called whenever your camera moves.
+         * Should be called whenever your camera moves. Returns the count of
+         * layers whose shadow camera changed, see @ref layerChanged().
+         */
+        std::size_t setTarget(const Vector3& lightDirection, const Vector3& screenDirection, SceneGraph::Camera3D& mainCamera);
+
+        /**
+         * @brief Set stable cascades
+         *
+         * Fits every layer with a bounding sphere snapped to whole texels
+         * using @ref ShadowMath::fitStableLayers() instead of a box around
+         * the frustum slice. It wastes some resolution, but the layers
+         * don't shimmer and keep their shadow camera while the main camera
+         * rotates or moves by less than a texel, so @ref render() can skip
+         * them if their casters didn't change either. Use a constant
+         * @p screenDirection in @ref setTarget() with it. Default is
+         * @cpp false @ce.
+         */
+        void setStableCascades(bool stable);
+
+        bool stableCascades() const { return _stableCascades; }
+
+        /**
+         * @brief Whether the shadow camera of a layer changed
+         *
+         * In the last @ref setTarget().
+         */
+        bool layerChanged(Int layer) const { return _layers[layer].changed; }
+
+        /**
+         * @brief Whether a layer was reused in the last @ref render()
+         *
+         * Only with @ref stableCascades(), if neither the shadow camera
+         * nor anything about the casters drawn in it changed.
+         */
+        bool layerSkipped(Int layer) const { return _layers[layer].skipped; }
+
+        /**
+         * @brief Render every layer again in the next @ref render()
+         *
+         * For changes @ref render() can't see, such as face culling.
          */
-        void setTarget(const Vector3& lightDirection, const Vector3& screenDirection, SceneGraph::Camera3D& mainCamera);
+        void invalidate();
 
         /**
          * @brief Render a group of shadow-casting drawables to the shadow maps
+         *
+         * Each caster is drawn with the coarsest level of detail whose
+         * simplification error projects to at most @ref lodThreshold()
+         * texels in given layer. All temporary data come from @p arena,
+         * which has to stay untouched until the end of the frame.
+         *
+         * Culling, level selection and the draw list of every layer are
+         * prepared on its own. With @p pool all layers are prepared on it
+         * at once while the calling thread draws them in order as they get
+         * ready, without it everything runs on the calling thread.
          */
-        void render(SceneGraph::DrawableGroup3D& drawables);
+        void render(SceneGraph::DrawableGroup3D& drawables, FrameArena& arena, ThreadPool* pool = nullptr);
 
-        std::vector<Vector3> layerFrustumCorners(SceneGraph::Camera3D& mainCamera, Int layer);
+        /**
+         * @brief Turn the rendered depth into filtered moments
+         *
+         * Blurs every layer and generates the mip levels. Call after
+         * @ref render(), does nothing with @ref Filtering::DepthCompare.
+         * Binds the default framebuffer at the end.
+         */
+        void filter();
+
+        /**
+         * @brief Set largest allowed caster simplification error in texels
+         *
+         * Zero always draws the full meshes. Default is one texel.
+         */
+        void setLodThreshold(Float texels) {
+            _lodThreshold = texels;
+            invalidate();
+        }
+
+        Float lodThreshold() const { return _lodThreshold; }
+
+        /** @brief Number of casters drawn with given level in given layer in the last @ref render() */
+        UnsignedInt lodDrawCount(Int layer, UnsignedInt lod) const {
+            return _lodDrawCounts[layer*(MeshSimplifier::MaxLevels + 1) + lod];
+        }
+
+        /**
+         * @brief Time every layer pass in @ref render()
+         *
+         * Layer @p i is timed in section @p firstSection + @p i, layers past
+         * @p layerCount aren't timed. Pass null to stop timing.
+         */
+        void setProfiler(FrameProfiler* profiler, UnsignedInt firstSection, std::size_t layerCount) {
+            _profiler = profiler;
+            _profilerSection = firstSection;
+            _profiledLayerCount = layerCount;
+        }
+
+        std::array<Vector3, 8> layerFrustumCorners(SceneGraph::Camera3D& mainCamera, Int layer);
 
         Float cutZ(Int layer) const;
 
@@ -106,26 +312,110 @@ class ShadowLight: public SceneGraph::Camera3D {
             return _layers[layer].shadowMatrix;
         }
 
-        std::vector<Vector4> calculateClipPlanes();
+        /**
+         * @brief Depth range of the layer's cascade in texture space
+         *
+         * Receivers between these use the layer. Zero to one except for
+         * @ref DepthFormat::Depth16, where the range of the depth texture
+         * is just the casters.
+         */
+        Vector2 layerDepthRange(Int layer) const {
+            return _layers[layer].depthRange;
+        }
+
+        /**
+         * @brief Framebuffer with the depth of a layer
+         *
+         * For reading the layer back, @ref render() binds it itself.
+         */
+        Framebuffer& layerFramebuffer(Int layer) {
+            return _layers[layer].shadowFramebuffer;
+        }
+
+        std::array<Vector4, 6> calculateClipPlanes();
 
+        /** @brief Depth of every layer */
         Texture2DArray& shadowTexture() { return _shadowTexture; }
 
+        /**
+         * @brief Moments of every layer
+         *
+         * Available only with filtering other than
+         * @ref Filtering::DepthCompare.
+         */
+        Texture2DArray& momentsTexture() { return _momentsTexture; }
+
+        /** @brief The texture receivers should sample for given filtering */
+        Texture2DArray& receiverTexture() {
+            return _filtering == Filtering::DepthCompare ? _shadowTexture : _momentsTexture;
+        }
+
     private:
+        void setupTextures(const Vector2i& size);
+        /* Cull, pick levels and record the casters of one layer, touches
+           nothing but the layer and its part of _frame */
+        void prepareLayer(std::size_t layer);
+
         Object3D& _object;
         Texture2DArray _shadowTexture;
+        Texture2DArray _momentsTexture;
+        /* Horizontally blurred moments of one layer */
+        Texture2D _blurTexture;
+        Framebuffer _blurFramebuffer;
+        std::unique_ptr<ShadowBlurShader> _horizontalBlurShader, _verticalBlurShader;
+        Mesh _fullscreenTriangle;
+        std::vector<Float> _blurWeights;
+        Filtering _filtering{Filtering::DepthCompare};
+        DepthFormat _depthFormat{DepthFormat::Depth24};
+        bool _clipControl;
+        bool _stableCascades{};
+        UnsignedInt _softness{};
 
         struct ShadowLayerData {
             Framebuffer shadowFramebuffer;
+            /* The layer of the moments texture, only without depth
+               comparison */
+            Framebuffer momentsFramebuffer;
             Matrix4 shadowCameraMatrix;
             Matrix4 shadowMatrix;
+            Vector2 depthRange{0.0f, 1.0f};
             Vector2 orthographicSize;
             Float orthographicNear, orthographicFar;
-            Float cutPlane;
+            /* Hash of what was drawn into the layer and whether it's still
+               there */
+            UnsignedLong contentHash{};
+            bool valid{}, changed{true}, skipped{};
+            /* Casters recorded by prepareLayer() and how many survived the
+               culling, which a kept layer still has in its shadow map */
+            DrawCommands commands;
+            std::size_t drawnCount{}, visibleCount{};
 
             explicit ShadowLayerData(const Vector2i& size);
         };
 
         std::vector<ShadowLayerData> _layers;
+        /* Layer preparations still running on the pool */
+        std::unique_ptr<std::atomic<std::size_t>[]> _pendingLayers;
+
+        /* Inputs of the layer preparation in render(), the per-layer
+           arrays have a slice of the caster count for every layer */
+        struct Frame {
+            Containers::ArrayView<ShadowCasterDrawable*> drawables;
+            Containers::ArrayView<Matrix4> absoluteTransformations;
+            Containers::ArrayView<Float> radii;
+            Containers::ArrayView<Matrix4> transformations;
+            Containers::ArrayView<UnsignedInt> visible, lods;
+            bool reversed, zeroToOne;
+        } _frame;
+        /* Depth buffer value at the end of every layer */
+        std::vector<Float> _cutPlanes;
+        /* Scratch space for setTarget(), one per layer */
+        std::vector<ShadowMath::LayerVolume> _volumes;
+        Float _lodThreshold{1.0f};
+        std::vector<UnsignedInt> _lodDrawCounts;
+        FrameProfiler* _profiler{};
+        UnsignedInt _profilerSection{};
+        std::size_t _profiledLayerCount{};
 };
 
 }
@@ -0,0 +1,195 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ShadowMath.h"
+
+#include <cmath>
+#include <limits>
+
+#include <Corrade/Utility/Assert.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/Math/Matrix3.h>
+
+namespace Magnum { namespace ShadowMath {
+
+std::array<Vector3, 8> frustumCorners(const Matrix4& imvp, const Float z0, const Float z1) {
+    return {{imvp.transformPoint({-1,-1, z0}),
+            imvp.transformPoint({ 1,-1, z0}),
+            imvp.transformPoint({-1, 1, z0}),
+            imvp.transformPoint({ 1, 1, z0}),
+            imvp.transformPoint({-1,-1, z1}),
+            imvp.transformPoint({ 1,-1, z1}),
+            imvp.transformPoint({-1, 1, z1}),
+            imvp.transformPoint({ 1, 1, z1})}};
+}
+
+std::array<Vector3, 8> cameraFrustumCorners(const Matrix4& projectionMatrix, const Matrix4& cameraMatrix, const Float z0, const Float z1) {
+    return frustumCorners((projectionMatrix*cameraMatrix).inverted(), z0, z1);
+}
+
+std::array<Vector4, 6> clipPlanes(const Matrix4& pm) {
+    std::array<Vector4, 6> planes{{
+        {pm[3][0] + pm[2][0], pm[3][1] + pm[2][1], pm[3][2] + pm[2][2], pm[3][3] + pm[2][3]},   /* near */
+        {pm[3][0] - pm[2][0], pm[3][1] - pm[2][1], pm[3][2] - pm[2][2], pm[3][3] - pm[2][3]},   /* far */
+        {pm[3][0] + pm[0][0], pm[3][1] + pm[0][1], pm[3][2] + pm[0][2], pm[3][3] + pm[0][3]},   /* left */
+        {pm[3][0] - pm[0][0], pm[3][1] - pm[0][1], pm[3][2] - pm[0][2], pm[3][3] - pm[0][3]},   /* right */
+        {pm[3][0] + pm[1][0], pm[3][1] + pm[1][1], pm[3][2] + pm[1][2], pm[3][3] + pm[1][3]},   /* bottom */
+        {pm[3][0] - pm[1][0], pm[3][1] - pm[1][1], pm[3][2] - pm[1][2], pm[3][3] - pm[1][3]}}}; /* top */
+    for(Vector4& plane: planes)
+        plane *= plane.xyz().lengthInverted();
+    return planes;
+}
+
+std::vector<Float> splitCutPlanes(const std::size_t layerCount, const Float zNear, const Float zFar, const Float power) {
+    /* props http://stackoverflow.com/a/33465663 */
+    std::vector<Float> cutPlanes(layerCount);
+    for(std::size_t i = 0; i != layerCount; ++i) {
+        const Float linearDepth = zNear + std::pow(Float(i + 1)/layerCount, power)*(zFar - zNear);
+        const Float nonLinearDepth = (zFar + zNear - 2.0f*zNear*zFar/linearDepth)/(zFar - zNear);
+        cutPlanes[i] = (nonLinearDepth + 1.0f)/2.0f;
+    }
+    return cutPlanes;
+}
+
+void fitLayers(const Matrix4& lightCameraMatrix, const Matrix4& imvp, const Containers::ArrayView<const Float> cutPlanes, const Containers::ArrayView<LayerVolume> volumes) {
+    CORRADE_ASSERT(volumes.size() == cutPlanes.size(),
+        "ShadowMath::fitLayers(): expected" << cutPlanes.size() << "volumes but got" << volumes.size(), );
+
+    const Matrix3x3 cameraRotationMatrix = lightCameraMatrix.rotation();
+    const Matrix3x3 inverseCameraRotationMatrix = cameraRotationMatrix.inverted();
+
+    for(std::size_t layerIndex = 0; layerIndex != cutPlanes.size(); ++layerIndex) {
+        const Float z0 = layerIndex == 0 ? 0 : cutPlanes[layerIndex - 1];
+        const std::array<Vector3, 8> mainCameraFrustumCorners = frustumCorners(imvp, z0, cutPlanes[layerIndex]);
+
+        /* Calculate the AABB in shadow-camera space */
+        Vector3 min{std::numeric_limits<Float>::max()}, max{std::numeric_limits<Float>::lowest()};
+        for(Vector3 worldPoint: mainCameraFrustumCorners) {
+            Vector3 cameraPoint = inverseCameraRotationMatrix*worldPoint;
+            min = Math::min(min, cameraPoint);
+            max = Math::max(max, cameraPoint);
+        }
+
+        /* Place the shadow camera at the mid-point of the camera box */
+        const Vector3 mid = (min + max)*0.5f;
+        const Vector3 range = max - min;
+
+        /* Set up the initial extends of the shadow map's render volume. Note
+           we will adjust this later when we render. */
+        LayerVolume& volume = volumes[layerIndex];
+        volume.orthographicSize = range.xy();
+        volume.orthographicNear = -0.5f*range.z();
+        volume.orthographicFar =  0.5f*range.z();
+        volume.cameraMatrix = lightCameraMatrix;
+        volume.cameraMatrix.translation() = cameraRotationMatrix*mid;
+    }
+}
+
+void fitStableLayers(const Matrix4& lightCameraMatrix, const Matrix4& imvp, const Containers::ArrayView<const Float> cutPlanes, const Vector2i& shadowMapSize, const Containers::ArrayView<LayerVolume> volumes) {
+    CORRADE_ASSERT(volumes.size() == cutPlanes.size(),
+        "ShadowMath::fitStableLayers(): expected" << cutPlanes.size() << "volumes but got" << volumes.size(), );
+    CORRADE_ASSERT(shadowMapSize.x() > 2 && shadowMapSize.y() > 2,
+        "ShadowMath::fitStableLayers(): shadow map size" << shadowMapSize << "too small", );
+
+    const Matrix3x3 cameraRotationMatrix = lightCameraMatrix.rotation();
+    const Matrix3x3 inverseCameraRotationMatrix = cameraRotationMatrix.inverted();
+
+    for(std::size_t layerIndex = 0; layerIndex != cutPlanes.size(); ++layerIndex) {
+        const Float z0 = layerIndex == 0 ? 0 : cutPlanes[layerIndex - 1];
+        const std::array<Vector3, 8> mainCameraFrustumCorners = frustumCorners(imvp, z0, cutPlanes[layerIndex]);
+
+        /* Sphere around the centroid of the slice, its radius depends only
+           on the slice shape. Rounded up to 1/16 of a unit so float noise
+           in the corners doesn't change it from frame to frame. */
+        Vector3 centre;
+        for(const Vector3& corner: mainCameraFrustumCorners) centre += corner;
+        centre /= 8.0f;
+        Float radius = 0.0f;
+        for(const Vector3& corner: mainCameraFrustumCorners)
+            radius = Math::max(radius, (corner - centre).length());
+        radius = std::ceil(radius*16.0f)/16.0f;
+
+        /* One texel of padding on every side, so the sphere stays inside
+           after the centre gets snapped */
+        const Vector2 texelSize = Vector2{2.0f*radius}/Vector2{shadowMapSize - Vector2i{2}};
+        const Vector3 lightCentre = inverseCameraRotationMatrix*centre;
+        const Vector3 snappedCentre{
+            std::floor(lightCentre.x()/texelSize.x())*texelSize.x(),
+            std::floor(lightCentre.y()/texelSize.y())*texelSize.y(),
+            std::floor(lightCentre.z()/texelSize.x())*texelSize.x()};
+
+        LayerVolume& volume = volumes[layerIndex];
+        volume.orthographicSize = texelSize*Vector2{shadowMapSize};
+        volume.orthographicNear = -radius - texelSize.x();
+        volume.orthographicFar = radius + texelSize.x();
+        volume.cameraMatrix = lightCameraMatrix;
+        volume.cameraMatrix.translation() = cameraRotationMatrix*snappedCentre;
+    }
+}
+
+std::size_t cullSpheres(const std::array<Vector4, 6>& clipPlanes, const Containers::ArrayView<const Matrix4> transformations, const Containers::ArrayView<const Float> radii, const Containers::ArrayView<UnsignedInt> visible, Float& orthographicNear) {
+    CORRADE_ASSERT(radii.size() == transformations.size() && visible.size() >= transformations.size(),
+        "ShadowMath::cullSpheres(): expected" << transformations.size() << "radii and visible indices but got" << radii.size() << "and" << visible.size(), 0);
+
+    std::size_t visibleCount = 0;
+    for(std::size_t i = 0; i != transformations.size(); ++i) {
+        /* If your centre is offset, inject it here */
+        const Vector4 localCentre{0.0f, 0.0f, 0.0f, 1.0f};
+        const Vector4 centre = transformations[i]*localCentre;
+        const Float radius = radii[i];
+
+        /* Start at 1, not 0 to skip out the near plane because we need to
+           include shadow casters traveling the direction the camera is
+           facing. */
+        for(std::size_t clipPlaneIndex = 1; clipPlaneIndex != clipPlanes.size(); ++clipPlaneIndex) {
+            const Float distance = Math::dot(clipPlanes[clipPlaneIndex], centre);
+
+            /* If the object is on the useless side of any one plane, we can skip it */
+            if(distance < -radius)
+                goto next;
+        }
+
+        {
+            /* If this object extends in front of the near plane, extend
+               the near plane. We negate the z because the negative z is
+               forward away from the camera, but the near/far planes are
+               measured forwards. */
+            const Float nearestPoint = -centre.z() - radius;
+            orthographicNear = Math::min(orthographicNear, nearestPoint);
+            visible[visibleCount++] = i;
+        }
+
+        next:;
+    }
+
+    return visibleCount;
+}
+
+}}
@@ -0,0 +1,121 @@
+#ifndef Magnum_Examples_ShadowMath_h
+#define Magnum_Examples_ShadowMath_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include <Corrade/Containers/ArrayView.h>
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Matrix4.h>
+#include <Magnum/Math/Vector4.h>
+
+namespace Magnum {
+
+/**
+@brief Shadow map math without any GL state
+
+Everything @ref ShadowLight computes on the CPU, split out so it can be
+benchmarked and tested without a GL context.
+*/
+namespace ShadowMath {
+
+/** @brief Shadow camera placement and extents of one layer */
+struct LayerVolume {
+    Matrix4 cameraMatrix;
+    Vector2 orthographicSize;
+    Float orthographicNear, orthographicFar;
+};
+
+/** @brief Eight corners of the part of a frustum between NDC depths @p z0 and @p z1 */
+std::array<Vector3, 8> frustumCorners(const Matrix4& imvp, Float z0, Float z1);
+
+/** @brief Frustum corners of a camera given its projection and camera matrix */
+std::array<Vector3, 8> cameraFrustumCorners(const Matrix4& projectionMatrix, const Matrix4& cameraMatrix, Float z0 = -1.0f, Float z1 = 1.0f);
+
+/**
+ * @brief Normalized near, far, left, right, bottom and top planes of a projection
+ *
+ * A point is inside a plane if its dot product with it is positive.
+ */
+std::array<Vector4, 6> clipPlanes(const Matrix4& projectionMatrix);
+
+/**
+ * @brief Depth buffer values of cascade ends distributed along a power series
+ *
+ * One value in the 0 to 1 range per layer.
+ */
+std::vector<Float> splitCutPlanes(std::size_t layerCount, Float zNear, Float zFar, Float power);
+
+/**
+ * @brief Fit a shadow camera around the frustum of every layer
+ * @param lightCameraMatrix Rotation of the shadow camera, see @ref ShadowLight::setTarget()
+ * @param imvp          Inverted projection and camera matrix of the main camera
+ * @param cutPlanes     Layer ends from @ref splitCutPlanes()
+ * @param[out] volumes  One per cut plane
+ */
+void fitLayers(const Matrix4& lightCameraMatrix, const Matrix4& imvp, Containers::ArrayView<const Float> cutPlanes, Containers::ArrayView<LayerVolume> volumes);
+
+/**
+ * @brief Fit a shadow camera around the bounding sphere of every layer
+ * @param lightCameraMatrix Rotation of the shadow camera, see @ref ShadowLight::setTarget()
+ * @param imvp          Inverted projection and camera matrix of the main camera
+ * @param cutPlanes     Layer ends from @ref splitCutPlanes()
+ * @param shadowMapSize Size of every layer in texels
+ * @param[out] volumes  One per cut plane
+ *
+ * Unlike @ref fitLayers() the extents only depend on the shape of the
+ * frustum slice, so they stay the same when the main camera rotates, and
+ * the camera position is snapped to whole texels in light space, so it
+ * only changes when the main camera moved by at least a texel. As long as
+ * @p lightCameraMatrix doesn't change either, the volumes are bit-exact
+ * between calls and the shadow map content can be reused.
+ */
+void fitStableLayers(const Matrix4& lightCameraMatrix, const Matrix4& imvp, Containers::ArrayView<const Float> cutPlanes, const Vector2i& shadowMapSize, Containers::ArrayView<LayerVolume> volumes);
+
+/**
+ * @brief Cull bounding spheres against shadow camera planes
+ * @param clipPlanes        Planes from @ref clipPlanes()
+ * @param transformations   Sphere transformations relative to the shadow
+ *      camera, the spheres are centered at the origin
+ * @param radii             Sphere radii
+ * @param[out] visible      Indices of spheres not completely outside of any
+ *      plane except the near one, which doesn't cull casters between the
+ *      light and the layer. Has to be as large as @p transformations.
+ * @param[in,out] orthographicNear  Extended to include all visible spheres
+ * @return Count of visible spheres
+ */
+std::size_t cullSpheres(const std::array<Vector4, 6>& clipPlanes, Containers::ArrayView<const Matrix4> transformations, Containers::ArrayView<const Float> radii, Containers::ArrayView<UnsignedInt> visible, Float& orthographicNear);
+
+}}
+
+#endif
@@ -29,24 +29,147 @@
 */
 
 uniform float shadowBias;
+#if defined(VARIANCE_SHADOW_MAP) || defined(EXPONENTIAL_VARIANCE_SHADOW_MAP)
+#define SHADOW_MOMENTS
+uniform highp sampler2DArray shadowmapTexture;
+#else
 uniform sampler2DArrayShadow shadowmapTexture;
+uniform int pcfRadius;
+#endif
 uniform highp vec3 lightDirection;
+uniform highp vec3 cameraPosition;
+
+/* Phong material, the diffuse color comes either from a uniform or from a
+   texture */
+uniform lowp vec3 ambientColor;
+#ifdef DIFFUSE_TEXTURE
+uniform lowp sampler2D diffuseTexture;
+in mediump vec2 interpolatedTextureCoordinates;
+#else
+uniform lowp vec3 diffuseColor;
+#endif
+uniform lowp vec3 specularColor;
+uniform mediump float shininess;
 
 in mediump vec3 transformedNormal;
+in highp vec3 worldPosition;
 in highp vec3 shadowCoords[NUM_SHADOW_MAP_LEVELS];
 uniform float shadowDepthSplits[NUM_SHADOW_MAP_LEVELS];
+/* Depths of the cascade of every layer, past zero and one with 16-bit
+   shadow maps fitted to the casters */
+uniform highp vec2 shadowDepthRanges[NUM_SHADOW_MAP_LEVELS];
+
+/* Point lights binned into a froxel grid, see ClusteredLights. Zero depth
+   slices means there are no lights. */
+uniform highp samplerBuffer lights;
+uniform highp usamplerBuffer clusters;
+uniform highp usamplerBuffer clusterLightIndices;
+uniform uvec3 clusterGridSize;
+uniform highp vec2 clusterTileScale;
+uniform highp vec2 clusterDepthSliceScaleBias;
+
+mediump vec3 pointLighting(mediump vec3 normal) {
+    mediump vec3 result = vec3(0.0);
+    if(clusterGridSize.z == 0u) return result;
+
+    /* gl_FragCoord.w is one over the view depth for a perspective
+       projection */
+    highp float depth = 1.0/gl_FragCoord.w;
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy*clusterTileScale),
+                          int(log(depth)*clusterDepthSliceScaleBias.x + clusterDepthSliceScaleBias.y));
+    cluster = clamp(cluster, ivec3(0), ivec3(clusterGridSize) - 1);
+    uvec2 range = texelFetch(clusters, (cluster.z*int(clusterGridSize.y) + cluster.y)*int(clusterGridSize.x) + cluster.x).xy;
+
+    for(uint i = 0u; i != range.y; ++i) {
+        int light = int(texelFetch(clusterLightIndices, int(range.x + i)).x);
+        highp vec4 positionRadius = texelFetch(lights, 2*light);
+        mediump vec3 lightColor = texelFetch(lights, 2*light + 1).rgb;
+
+        /* Inverse square falloff, windowed to reach zero at the radius */
+        highp vec3 toLight = positionRadius.xyz - worldPosition;
+        highp float distanceSquared = dot(toLight, toLight);
+        highp float ratio = distanceSquared/(positionRadius.w*positionRadius.w);
+        mediump float window = clamp(1.0 - ratio*ratio, 0.0, 1.0);
+        mediump float intensity = max(dot(normal, toLight*inversesqrt(distanceSquared)), 0.0);
+        result += lightColor*intensity*window*window/(distanceSquared + 1.0);
+    }
+
+    return result;
+}
+
+#ifdef SHADOW_MOMENTS
+/* Keeps flat receivers from shadowing themselves, in squared depth units */
+#define MIN_VARIANCE 0.00001
+/* Cuts off the lowest probabilities, which is where the light bleeds
+   through overlapping casters */
+#define LIGHT_BLEEDING_REDUCTION 0.2
+
+/* Chebyshev upper bound of the lit fraction */
+mediump float chebyshev(highp vec2 moments, highp float depth, highp float minVariance) {
+    if(depth <= moments.x) return 1.0;
+
+    highp float variance = max(moments.y - moments.x*moments.x, minVariance);
+    highp float difference = depth - moments.x;
+    mediump float upperBound = variance/(variance + difference*difference);
+    return clamp((upperBound - LIGHT_BLEEDING_REDUCTION)/(1.0 - LIGHT_BLEEDING_REDUCTION), 0.0, 1.0);
+}
+
+mediump float momentShadow(highp vec4 moments, highp float depth) {
+    #ifdef EXPONENTIAL_VARIANCE_SHADOW_MAP
+    /* Same warp as in ShadowBlur.frag, the minimum variance scales with its
+       derivative */
+    highp float warped = 2.0*depth - 1.0;
+    highp vec2 exponential = vec2(exp(EVSM_EXPONENTS.x*warped), -exp(-EVSM_EXPONENTS.y*warped));
+    highp vec2 minVariance = MIN_VARIANCE*4.0*EVSM_EXPONENTS*EVSM_EXPONENTS*exponential*exponential;
+    return min(chebyshev(moments.xy, exponential.x, minVariance.x),
+               chebyshev(moments.zw, exponential.y, minVariance.y));
+    #else
+    return chebyshev(moments.xy, depth, MIN_VARIANCE);
+    #endif
+}
+#else
+/* Gaussian weighted grid of bilinear comparisons, sigma of half the radius
+   like the blur of the moments */
+lowp float percentageCloser(highp vec4 coordinates) {
+    if(pcfRadius == 0) return texture(shadowmapTexture, coordinates);
+
+    highp vec2 texelSize = 1.0/vec2(textureSize(shadowmapTexture, 0).xy);
+    highp float falloff = -2.0/float(pcfRadius*pcfRadius);
+    mediump float lit = 0.0;
+    mediump float weightSum = 0.0;
+    for(int y = -pcfRadius; y <= pcfRadius; ++y) {
+        for(int x = -pcfRadius; x <= pcfRadius; ++x) {
+            mediump float weight = exp(float(x*x + y*y)*falloff);
+            lit += weight*texture(shadowmapTexture, vec4(coordinates.xy + vec2(x, y)*texelSize, coordinates.zw));
+            weightSum += weight;
+        }
+    }
+    return lit/weightSum;
+}
+#endif
 
 out lowp vec4 color;
 
 void main() {
-    /* You might want to source this from a texture or a vertex color */
-    vec3 albedo = vec3(0.5,0.5,0.5);
-
-    /* You might want to source this from a uniform */
-    vec3 ambient = vec3(0.5,0.5,0.5);
+    #ifdef DIFFUSE_TEXTURE
+    lowp vec3 albedo = texture(diffuseTexture, interpolatedTextureCoordinates).rgb;
+    #else
+    lowp vec3 albedo = diffuseColor;
+    #endif
 
     mediump vec3 normalizedTransformedNormal = normalize(transformedNormal);
 
+    #ifdef SHADOW_MOMENTS
+    /* Gradients for the mip level and anisotropy, taken here as the branches
+       below aren't uniform */
+    highp vec2 shadowCoordsDx[NUM_SHADOW_MAP_LEVELS];
+    highp vec2 shadowCoordsDy[NUM_SHADOW_MAP_LEVELS];
+    for(int i = 0; i < NUM_SHADOW_MAP_LEVELS; ++i) {
+        shadowCoordsDx[i] = dFdx(shadowCoords[i].xy);
+        shadowCoordsDy[i] = dFdy(shadowCoords[i].xy);
+    }
+    #endif
+
     float inverseShadow = 1.0;
 
     /* Is the normal of this face pointing towards the light? */
@@ -70,10 +193,23 @@ void main() {
                       shadowCoord.y >= 0 &&
                       shadowCoord.x <  1 &&
                       shadowCoord.y <  1 &&
-                      shadowCoord.z >= 0 &&
-                      shadowCoord.z <  1;
+                      shadowCoord.z >= shadowDepthRanges[shadowLevel].x &&
+                      shadowCoord.z <  shadowDepthRanges[shadowLevel].y;
             if(inRange) {
-                inverseShadow = texture(shadowmapTexture, vec4(shadowCoord.xy, shadowLevel, shadowCoord.z-shadowBias));
+                highp float depth = clamp(shadowCoord.z, 0.0, 1.0);
+                #ifdef SHADOW_MOMENTS
+                #ifdef REVERSED_DEPTH
+                /* The moments were made from one minus the depth */
+                depth = 1.0 - depth;
+                #endif
+                inverseShadow = momentShadow(textureGrad(shadowmapTexture, vec3(shadowCoord.xy, shadowLevel),
+                    shadowCoordsDx[shadowLevel], shadowCoordsDy[shadowLevel]), depth-shadowBias);
+                #elif defined(REVERSED_DEPTH)
+                /* Near is one, compared with greater or equal */
+                inverseShadow = percentageCloser(vec4(shadowCoord.xy, shadowLevel, depth+shadowBias));
+                #else
+                inverseShadow = percentageCloser(vec4(shadowCoord.xy, shadowLevel, depth-shadowBias));
+                #endif
                 break;
             }
         }
@@ -94,6 +230,14 @@ void main() {
         #endif
     }
 
-    color.rgb = ((ambient + vec3(intensity*inverseShadow))*albedo);
+    /* Specular highlight of the directional light, none in its shadow */
+    mediump float specular = 0.0;
+    if(intensity > 0.0) {
+        highp vec3 reflection = reflect(-lightDirection, normalizedTransformedNormal);
+        highp vec3 viewDirection = normalize(cameraPosition - worldPosition);
+        specular = pow(max(dot(reflection, viewDirection), 0.0), shininess)*inverseShadow;
+    }
+
+    color.rgb = ambientColor + albedo*(vec3(intensity*inverseShadow) + pointLighting(normalizedTransformedNormal)) + specularColor*specular;
     color.a = 1.0;
 }
@@ -35,14 +35,28 @@ uniform highp mat4 shadowmapMatrix[NUM_SHADOW_MAP_LEVELS];
 in highp vec4 position;
 in mediump vec3 normal;
 
+/* Has to match the depth pre-pass of ShadowCaster.vert exactly */
+invariant gl_Position;
+
+#ifdef DIFFUSE_TEXTURE
+in mediump vec2 textureCoordinates;
+out mediump vec2 interpolatedTextureCoordinates;
+#endif
+
 out mediump vec3 transformedNormal;
+out highp vec3 worldPosition;
 
 out highp vec3 shadowCoords[NUM_SHADOW_MAP_LEVELS];
 
 void main() {
     transformedNormal = mat3(modelMatrix)*normal;
 
+    #ifdef DIFFUSE_TEXTURE
+    interpolatedTextureCoordinates = textureCoordinates;
+    #endif
+
     vec4 worldPos4 = modelMatrix * position;
+    worldPosition = worldPos4.xyz;
     for(int i = 0; i < shadowmapMatrix.length(); i++) {
         shadowCoords[i] = (shadowmapMatrix[i]*worldPos4).xyz;
     }
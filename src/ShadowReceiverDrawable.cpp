@@ -32,6 +32,7 @@
 
 #include <Corrade/Containers/Array.h>
 
+#include "DrawCommands.h"
 #include "ShadowReceiverShader.h"
 #include "ShadowLight.h"
 
@@ -42,7 +43,16 @@ ShadowReceiverDrawable::ShadowReceiverDrawable(SceneGraph::AbstractObject3D &obj
 void ShadowReceiverDrawable::draw(const Matrix4& transformationMatrix, SceneGraph::Camera3D& camera) {
     _shader->setTransformationProjectionMatrix(camera.projectionMatrix()*transformationMatrix);
     _shader->setModelMatrix(object().transformationMatrix());
+    _shader->setAmbientColor(_ambientColor)
+        .setDiffuseColor(_diffuseColor)
+        .setSpecularColor(_specularColor)
+        .setShininess(_shininess);
 
     _mesh->draw(*_shader);
 }
+
+void ShadowReceiverDrawable::record(DrawCommandBuffer& commands, const Matrix4& transformationMatrix, const Matrix4& projectionMatrix) const {
+    commands.recordReceiver(*_shader, *_mesh, {projectionMatrix*transformationMatrix,
+        object().transformationMatrix(), _ambientColor, _diffuseColor, _specularColor, _shininess});
+}
 }
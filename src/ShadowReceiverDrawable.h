@@ -32,6 +32,9 @@
 
 #include <Magnum/SceneGraph/Drawable.h>
 #include <Magnum/Mesh.h>
+#include <Magnum/Math/Color.h>
+
+class DrawCommandBuffer;
 
 namespace Magnum {
 
@@ -45,13 +48,36 @@ class ShadowReceiverDrawable: public SceneGraph::Drawable3D {
 
         void draw(const Matrix4 &transformationMatrix, SceneGraph::Camera3D& camera) override;
 
+        /**
+         * @brief Record a draw instead of drawing
+         *
+         * Same as @ref draw(), but it doesn't touch GL, so it can be called
+         * from any thread.
+         */
+        void record(DrawCommandBuffer& commands, const Matrix4& transformationMatrix, const Matrix4& projectionMatrix) const;
+
         void setMesh(Mesh& mesh) { _mesh = &mesh; }
 
         void setShader(ShadowReceiverShader& shader) { _shader = &shader; }
 
+        /**
+         * @brief Set material colors
+         *
+         * The shader is shared with other objects, so they're set for every
+         * draw. Defaults give the plain grey look.
+         */
+        void setMaterial(const Color3& ambientColor, const Color3& diffuseColor, const Color3& specularColor, Float shininess) {
+            _ambientColor = ambientColor;
+            _diffuseColor = diffuseColor;
+            _specularColor = specularColor;
+            _shininess = shininess;
+        }
+
     private:
         Mesh* _mesh{};
         ShadowReceiverShader* _shader{};
+        Color3 _ambientColor{0.25f}, _diffuseColor{0.5f}, _specularColor{0.0f};
+        Float _shininess{80.0f};
 };
 
 }
@@ -30,17 +30,26 @@
 
 #include "ShadowReceiverShader.h"
 
+#include <vector>
+
 #include <Corrade/Utility/Resource.h>
+#include <Magnum/BufferTexture.h>
 #include <Magnum/Context.h>
 #include <Magnum/Shader.h>
+#include <Magnum/Texture.h>
 #include <Magnum/TextureArray.h>
 #include <Magnum/Version.h>
 #include <Magnum/Math/Matrix4.h>
 
+#include "ClusteredLights.h"
+#include "ShadowBlurShader.h"
+
 namespace Magnum {
 
-ShadowReceiverShader::ShadowReceiverShader(Int numShadowLevels) {
+ShadowReceiverShader::ShadowReceiverShader(Int numShadowLevels, const Flags flags): _flags{flags} {
     MAGNUM_ASSERT_VERSION_SUPPORTED(Version::GL330);
+    CORRADE_ASSERT(!(flags & Flag::VarianceShadows) || !(flags & Flag::ExponentialVarianceShadows),
+        "ShadowReceiverShader: variance and exponential variance shadows are mutually exclusive", );
 
     const Utility::Resource rs{"shadow-data"};
 
@@ -48,6 +57,12 @@ ShadowReceiverShader::ShadowReceiverShader(Int numShadowLevels) {
     Shader frag{Version::GL330, Shader::Type::Fragment};
 
     std::string preamble = "#define NUM_SHADOW_MAP_LEVELS " + std::to_string(numShadowLevels) + "\n";
+    if(flags & Flag::DiffuseTexture) preamble += "#define DIFFUSE_TEXTURE\n";
+    if(flags & Flag::ReversedDepth) preamble += "#define REVERSED_DEPTH\n";
+    if(flags & Flag::VarianceShadows) preamble += "#define VARIANCE_SHADOW_MAP\n";
+    if(flags & Flag::ExponentialVarianceShadows)
+        preamble += "#define EXPONENTIAL_VARIANCE_SHADOW_MAP\n#define EVSM_EXPONENTS vec2(" +
+            std::to_string(EvsmPositiveExponent) + ", " + std::to_string(EvsmNegativeExponent) + ")\n";
     vert.addSource(preamble);
     vert.addSource(rs.get("ShadowReceiver.vert"));
     frag.addSource(preamble);
@@ -57,6 +72,8 @@ ShadowReceiverShader::ShadowReceiverShader(Int numShadowLevels) {
 
     bindAttributeLocation(Position::Location, "position");
     bindAttributeLocation(Normal::Location, "normal");
+    if(flags & Flag::DiffuseTexture)
+        bindAttributeLocation(TextureCoordinates::Location, "textureCoordinates");
 
     attachShaders({vert, frag});
 
@@ -65,10 +82,35 @@ ShadowReceiverShader::ShadowReceiverShader(Int numShadowLevels) {
     _modelMatrixUniform = uniformLocation("modelMatrix");
     _transformationProjectionMatrixUniform = uniformLocation("transformationProjectionMatrix");
     _shadowmapMatrixUniform = uniformLocation("shadowmapMatrix");
+    _shadowDepthRangesUniform = uniformLocation("shadowDepthRanges");
     _lightDirectionUniform = uniformLocation("lightDirection");
     _shadowBiasUniform = uniformLocation("shadowBias");
+    _pcfRadiusUniform = flags & (Flag::VarianceShadows|Flag::ExponentialVarianceShadows) ? -1 : uniformLocation("pcfRadius");
+    _clusterGridSizeUniform = uniformLocation("clusterGridSize");
+    _clusterTileScaleUniform = uniformLocation("clusterTileScale");
+    _clusterDepthSliceScaleBiasUniform = uniformLocation("clusterDepthSliceScaleBias");
+    _cameraPositionUniform = uniformLocation("cameraPosition");
+    _ambientColorUniform = uniformLocation("ambientColor");
+    _diffuseColorUniform = flags & Flag::DiffuseTexture ? -1 : uniformLocation("diffuseColor");
+    _specularColorUniform = uniformLocation("specularColor");
+    _shininessUniform = uniformLocation("shininess");
 
     setUniform(uniformLocation("shadowmapTexture"), ShadowmapTextureLayer);
+    setUniform(uniformLocation("lights"), LightTextureLayer);
+    setUniform(uniformLocation("clusters"), ClusterTextureLayer);
+    setUniform(uniformLocation("clusterLightIndices"), LightIndexTextureLayer);
+    setUniform(_clusterGridSizeUniform, Vector3ui{});
+    setPcfRadius(0);
+    const std::vector<Vector2> depthRanges(numShadowLevels, Vector2{0.0f, 1.0f});
+    setShadowDepthRanges({depthRanges.data(), depthRanges.size()});
+
+    /* Same look as the grey receivers had before they got materials */
+    setAmbientColor(Color3{0.25f});
+    if(flags & Flag::DiffuseTexture)
+        setUniform(uniformLocation("diffuseTexture"), DiffuseTextureLayer);
+    else setDiffuseColor(Color3{0.5f});
+    setSpecularColor(Color3{0.0f});
+    setShininess(80.0f);
 }
 
 ShadowReceiverShader& ShadowReceiverShader::setTransformationProjectionMatrix(const Matrix4& matrix) {
@@ -86,6 +128,11 @@ ShadowReceiverShader& ShadowReceiverShader::setShadowmapMatrices(const Container
     return *this;
 }
 
+ShadowReceiverShader& ShadowReceiverShader::setShadowDepthRanges(const Containers::ArrayView<const Vector2> ranges) {
+    setUniform(_shadowDepthRangesUniform, ranges);
+    return *this;
+}
+
 ShadowReceiverShader& ShadowReceiverShader::setLightDirection(const Vector3& vector) {
     setUniform(_lightDirectionUniform, vector);
     return *this;
@@ -101,4 +148,53 @@ ShadowReceiverShader& ShadowReceiverShader::setShadowBias(const Float bias) {
     return *this;
 }
 
+ShadowReceiverShader& ShadowReceiverShader::setPcfRadius(const Int radius) {
+    setUniform(_pcfRadiusUniform, radius);
+    return *this;
+}
+
+ShadowReceiverShader& ShadowReceiverShader::setClusteredLights(ClusteredLights& lights) {
+    lights.lightTexture().bind(LightTextureLayer);
+    lights.clusterTexture().bind(ClusterTextureLayer);
+    lights.lightIndexTexture().bind(LightIndexTextureLayer);
+    setUniform(_clusterGridSizeUniform, lights.gridSize());
+    setUniform(_clusterTileScaleUniform, lights.tileScale());
+    setUniform(_clusterDepthSliceScaleBiasUniform, lights.depthSliceScaleBias());
+    return *this;
+}
+
+ShadowReceiverShader& ShadowReceiverShader::setCameraPosition(const Vector3& position) {
+    setUniform(_cameraPositionUniform, position);
+    return *this;
+}
+
+ShadowReceiverShader& ShadowReceiverShader::setAmbientColor(const Color3& color) {
+    setUniform(_ambientColorUniform, color);
+    return *this;
+}
+
+ShadowReceiverShader& ShadowReceiverShader::setDiffuseColor(const Color3& color) {
+    CORRADE_ASSERT(!(_flags & Flag::DiffuseTexture),
+        "ShadowReceiverShader::setDiffuseColor(): the shader was created with a diffuse texture", *this);
+    setUniform(_diffuseColorUniform, color);
+    return *this;
+}
+
+ShadowReceiverShader& ShadowReceiverShader::setDiffuseTexture(Texture2D& texture) {
+    CORRADE_ASSERT(_flags & Flag::DiffuseTexture,
+        "ShadowReceiverShader::setDiffuseTexture(): the shader was not created with a diffuse texture", *this);
+    texture.bind(DiffuseTextureLayer);
+    return *this;
+}
+
+ShadowReceiverShader& ShadowReceiverShader::setSpecularColor(const Color3& color) {
+    setUniform(_specularColorUniform, color);
+    return *this;
+}
+
+ShadowReceiverShader& ShadowReceiverShader::setShininess(const Float shininess) {
+    setUniform(_shininessUniform, shininess);
+    return *this;
+}
+
 }
@@ -30,18 +30,64 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <Corrade/Containers/EnumSet.h>
 #include <Magnum/AbstractShaderProgram.h>
+#include <Magnum/Math/Color.h>
 #include <Magnum/Shaders/Generic.h>
 
+class ClusteredLights;
+
 namespace Magnum {
 
-/** @brief Shader that can synthesize shadows on an object */
+/**
+@brief Shader that can synthesize shadows on an object
+
+Phong material lit by the shadowed directional light and by clustered point
+lights, all in a single pass. Permutations are picked with @ref Flags at
+compile time.
+*/
 class ShadowReceiverShader: public AbstractShaderProgram {
     public:
         typedef Shaders::Generic3D::Position Position;
         typedef Shaders::Generic3D::Normal Normal;
 
-        explicit ShadowReceiverShader(Int numShadowLevels);
+        /**
+         * @brief Texture coordinates
+         *
+         * Used only with @ref Flag::DiffuseTexture.
+         */
+        typedef Shaders::Generic3D::TextureCoordinates TextureCoordinates;
+
+        /** @brief Shader flag */
+        enum class Flag: UnsignedByte {
+            /** Diffuse color from a texture instead of a uniform */
+            DiffuseTexture = 1 << 0,
+
+            /**
+             * Shadows from a variance shadow map, see
+             * @ref ShadowLight::Filtering::Variance
+             */
+            VarianceShadows = 1 << 1,
+
+            /**
+             * Shadows from an exponential variance shadow map, see
+             * @ref ShadowLight::Filtering::ExponentialVariance
+             */
+            ExponentialVarianceShadows = 1 << 2,
+
+            /**
+             * Shadow maps with reversed depth, see
+             * @ref ShadowLight::reversedDepth()
+             */
+            ReversedDepth = 1 << 3
+        };
+
+        /** @brief Shader flags */
+        typedef Containers::EnumSet<Flag> Flags;
+
+        explicit ShadowReceiverShader(Int numShadowLevels, Flags flags = {});
+
+        Flags flags() const { return _flags; }
 
         /**
          * @brief Set transformation and projection matrix
@@ -66,12 +112,36 @@ class ShadowReceiverShader: public AbstractShaderProgram {
          */
         ShadowReceiverShader& setShadowmapMatrices(Containers::ArrayView<const Matrix4> matrices);
 
+        /**
+         * @brief Set depth range of every layer
+         *
+         * Shadow texture space depths a receiver has to be between to use
+         * the layer, see @ref ShadowLight::layerDepthRange(). Initially
+         * zero to one for all layers.
+         */
+        ShadowReceiverShader& setShadowDepthRanges(Containers::ArrayView<const Vector2> ranges);
+
         /** @brief Set world-space direction to the light source */
         ShadowReceiverShader& setLightDirection(const Vector3& vector3);
 
-        /** @brief Set shadow map texture array */
+        /**
+         * @brief Set shadow map texture array
+         *
+         * Depth with comparison enabled, or moments with
+         * @ref Flag::VarianceShadows or
+         * @ref Flag::ExponentialVarianceShadows.
+         */
         ShadowReceiverShader& setShadowmapTexture(Texture2DArray& texture);
 
+        /**
+         * @brief Set percentage-closer filtering radius
+         *
+         * In texels, the taps are weighted with a Gaussian with sigma of
+         * half the radius. Ignored with moments, those are blurred before.
+         * Initial value is zero, a single bilinear comparison.
+         */
+        ShadowReceiverShader& setPcfRadius(Int radius);
+
         /**
          * @brief Set thadow bias uniform
          *
@@ -79,16 +149,88 @@ class ShadowReceiverShader: public AbstractShaderProgram {
          */
         ShadowReceiverShader& setShadowBias(Float bias);
 
-    private:
-        enum: Int { ShadowmapTextureLayer = 0 };
+        /**
+         * @brief Set clustered point lights
+         *
+         * Textures and grid parameters from @ref ClusteredLights. Until this
+         * is called, only the directional light is used.
+         */
+        ShadowReceiverShader& setClusteredLights(ClusteredLights& lights);
+
+        /**
+         * @brief Set world-space camera position
+         *
+         * Used for the specular highlight.
+         */
+        ShadowReceiverShader& setCameraPosition(const Vector3& position);
+
+        /**
+         * @brief Set ambient color
+         *
+         * Added to the lit color regardless of lights and shadows. Initial
+         * value is @cpp Color3{0.25f} @ce.
+         */
+        ShadowReceiverShader& setAmbientColor(const Color3& color);
 
+        /**
+         * @brief Set diffuse color
+         *
+         * Not available with @ref Flag::DiffuseTexture. Initial value is
+         * @cpp Color3{0.5f} @ce.
+         */
+        ShadowReceiverShader& setDiffuseColor(const Color3& color);
+
+        /**
+         * @brief Set diffuse texture
+         *
+         * Only with @ref Flag::DiffuseTexture.
+         */
+        ShadowReceiverShader& setDiffuseTexture(Texture2D& texture);
+
+        /**
+         * @brief Set specular color
+         *
+         * Initial value is black, no highlight.
+         */
+        ShadowReceiverShader& setSpecularColor(const Color3& color);
+
+        /**
+         * @brief Set shininess
+         *
+         * The larger value, the harder surface. Initial value is
+         * @cpp 80.0f @ce.
+         */
+        ShadowReceiverShader& setShininess(Float shininess);
+
+    private:
+        enum: Int {
+            ShadowmapTextureLayer = 0,
+            LightTextureLayer = 1,
+            ClusterTextureLayer = 2,
+            LightIndexTextureLayer = 3,
+            DiffuseTextureLayer = 4
+        };
+
+        Flags _flags;
         Int _modelMatrixUniform,
             _transformationProjectionMatrixUniform,
             _shadowmapMatrixUniform,
+            _shadowDepthRangesUniform,
             _lightDirectionUniform,
-            _shadowBiasUniform;
+            _shadowBiasUniform,
+            _pcfRadiusUniform,
+            _clusterGridSizeUniform,
+            _clusterTileScaleUniform,
+            _clusterDepthSliceScaleBiasUniform,
+            _cameraPositionUniform,
+            _ambientColorUniform,
+            _diffuseColorUniform,
+            _specularColorUniform,
+            _shininessUniform;
 };
 
+CORRADE_ENUMSET_OPERATORS(ShadowReceiverShader::Flags)
+
 }
 
 #endif
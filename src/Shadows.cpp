@@ -7,6 +7,12 @@
 
 #include "Shadows.h"
 
+#include <Corrade/Utility/Assert.h>
+
+#include "ResourceBudget.h"
+#include "ThreadPool.h"
+#include "TraceRecorder.h"
+
 
 Shadows::Shadows(Scene3D *scene):
 _shadowLightObject{scene},
@@ -15,12 +21,26 @@ _shadowBias{0.003f},
 _layerSplitExponent{3.0f},
 _shadowMapSize{1024*2, 1024*2},
 _shadowMapFaceCullMode{1},
-_shadowStaticAlignment{false}
+_shadowStaticAlignment{false},
+_lodDebug{false},
+_depthPrePass{false},
+_profiler{nullptr},
+_filterSection{0},
+_depthPrePassSection{0},
+_receiverSection{0},
+_framebuffer{&defaultFramebuffer},
+_lights{nullptr},
+_resourceBudget{nullptr},
+_frame{0},
+_peakDrawableCount{0},
+_threadPool{nullptr},
+_pendingRecordings{0}
 {
 
     _shadowLight.setupShadowmaps(3, _shadowMapSize);
     _shadowReceiverShader.reset(new ShadowReceiverShader(_shadowLight.layerCount()));
-    _shadowReceiverShader->setShadowBias(_shadowBias);
+    _texturedReceiverShader.reset(new ShadowReceiverShader(_shadowLight.layerCount(), ShadowReceiverShader::Flag::DiffuseTexture));
+    updateShadowBias();
 
     _shadowLight.setupSplitDistances(MainCameraNear, MainCameraFar, _layerSplitExponent);
 
@@ -47,13 +67,100 @@ void Shadows::setShadowMapSize(const Vector2i& shadowMapSize) {
     }
 }
 
-void Shadows::recompileReceiverShader(const std::size_t numLayers) {
-    _shadowReceiverShader.reset(new ShadowReceiverShader(numLayers));
-    _shadowReceiverShader->setShadowBias(_shadowBias);
-    for(std::size_t i = 0; i != _shadowReceiverDrawables.size(); ++i) {
-        auto& drawable = static_cast<ShadowReceiverDrawable&>(_shadowReceiverDrawables[i]);
-        drawable.setShader(*_shadowReceiverShader);
+void Shadows::setShadowFiltering(const ShadowLight::Filtering filtering) {
+    _shadowLight.setFiltering(filtering);
+    recompileReceiverShader(_shadowLight.layerCount());
+    Debug() << "Shadow filtering:" << shadowFilteringName(filtering);
+}
+
+void Shadows::setShadowDepthFormat(const ShadowLight::DepthFormat format) {
+    _shadowLight.setDepthFormat(format);
+    recompileReceiverShader(_shadowLight.layerCount());
+    Debug() << "Shadow depth format:" << shadowDepthFormatName(format);
+}
+
+void Shadows::cycleShadowDepthFormat() {
+    setShadowDepthFormat(ShadowLight::DepthFormat((UnsignedByte(_shadowLight.depthFormat()) + 1) % 3));
+    printShadowMapReport();
+}
+
+void Shadows::printShadowMapReport() {
+    const Vector2i size = _shadowLight.shadowMapSize();
+    Debug() << "Shadow maps:" << _shadowLight.layerCount() << "layers of" << size.x() << "x" << size.y()
+        << shadowDepthFormatName(_shadowLight.depthFormat()) << "depth," << shadowFilteringName(_shadowLight.filtering()) << "filtering";
+    Debug() << "  depth" << _shadowLight.depthMemory()/1024.0f/1024.0f << "MB, moments"
+        << _shadowLight.momentsMemory()/1024.0f/1024.0f << "MB, at least"
+        << _shadowLight.bytesWrittenPerFrame()/1024.0f/1024.0f << "MB written per frame";
+}
+
+ShadowLight::DepthFormat Shadows::parseShadowDepthFormat(const std::string& name) {
+    if(name == "16") return ShadowLight::DepthFormat::Depth16;
+    if(name == "32f") return ShadowLight::DepthFormat::Depth32F;
+    if(name != "24")
+        Warning() << "Unknown shadow depth format" << name << Debug::nospace << ", using 24 bits";
+    return ShadowLight::DepthFormat::Depth24;
+}
+
+const char* Shadows::shadowDepthFormatName(const ShadowLight::DepthFormat format) {
+    switch(format) {
+        case ShadowLight::DepthFormat::Depth16: return "16";
+        case ShadowLight::DepthFormat::Depth24: return "24";
+        case ShadowLight::DepthFormat::Depth32F: return "32f";
+    }
+
+    CORRADE_ASSERT_UNREACHABLE();
+}
+
+void Shadows::cycleShadowFiltering() {
+    setShadowFiltering(ShadowLight::Filtering((UnsignedByte(_shadowLight.filtering()) + 1) % 3));
+}
+
+void Shadows::setShadowSoftness(const UnsignedInt texels) {
+    _shadowLight.setSoftness(texels);
+    Debug() << "Shadow softness" << _shadowLight.softness() << "texels";
+}
+
+ShadowLight::Filtering Shadows::parseShadowFiltering(const std::string& name) {
+    if(name == "vsm") return ShadowLight::Filtering::Variance;
+    if(name == "evsm") return ShadowLight::Filtering::ExponentialVariance;
+    if(name != "compare")
+        Warning() << "Unknown shadow filtering" << name << Debug::nospace << ", using depth comparison";
+    return ShadowLight::Filtering::DepthCompare;
+}
+
+const char* Shadows::shadowFilteringName(const ShadowLight::Filtering filtering) {
+    switch(filtering) {
+        case ShadowLight::Filtering::DepthCompare: return "compare";
+        case ShadowLight::Filtering::Variance: return "vsm";
+        case ShadowLight::Filtering::ExponentialVariance: return "evsm";
     }
+
+    CORRADE_ASSERT_UNREACHABLE();
+}
+
+void Shadows::recompileReceiverShader(const std::size_t numLayers) {
+    ShadowReceiverShader::Flags flags;
+    if(_shadowLight.filtering() == ShadowLight::Filtering::Variance)
+        flags |= ShadowReceiverShader::Flag::VarianceShadows;
+    else if(_shadowLight.filtering() == ShadowLight::Filtering::ExponentialVariance)
+        flags |= ShadowReceiverShader::Flag::ExponentialVarianceShadows;
+    if(_shadowLight.reversedDepth())
+        flags |= ShadowReceiverShader::Flag::ReversedDepth;
+
+    /* In place, objects keep references to the shaders */
+    *_shadowReceiverShader = ShadowReceiverShader{Int(numLayers), flags};
+    *_texturedReceiverShader = ShadowReceiverShader{Int(numLayers), flags|ShadowReceiverShader::Flag::DiffuseTexture};
+    updateShadowBias();
+}
+
+ShadowReceiverShader& Shadows::receiverShader(const ShadowReceiverShader::Flags flags) {
+    return flags & ShadowReceiverShader::Flag::DiffuseTexture ? *_texturedReceiverShader : *_shadowReceiverShader;
+}
+
+void Shadows::setLayerCount(const std::size_t layerCount) {
+    _shadowLight.setupShadowmaps(layerCount, _shadowMapSize);
+    recompileReceiverShader(layerCount);
+    _shadowLight.setupSplitDistances(MainCameraNear, MainCameraFar, _layerSplitExponent);
 }
 
 void Shadows::addDrawable(Object3D *object, Model &model, bool makeCaster, bool makeReceiver) {
@@ -61,27 +168,101 @@ void Shadows::addDrawable(Object3D *object, Model &model, bool makeCaster, bool
 if(makeCaster) {
         auto caster = new ShadowCasterDrawable(*object, &_shadowCasterDrawables);
         caster->setShader(_shadowCasterShader);
-        caster->setMesh(model.mesh, model.radius);
+        caster->setMesh(model.shadowMesh, model.radius);
+        caster->setLods(model.shadowLods);
     }
 
     if(makeReceiver) {
         auto receiver = new ShadowReceiverDrawable(*object, &_shadowReceiverDrawables);
         receiver->setShader(*_shadowReceiverShader);
         receiver->setMesh(model.mesh);
+
+        auto depth = new ShadowCasterDrawable(*object, &_depthDrawables);
+        depth->setShader(_shadowCasterShader);
+        depth->setMesh(model.shadowMesh, model.radius);
     }
 }
 
-void Shadows::setShadowLightTarget(SceneGraph::Camera3D *camera, const Vector3 transformation) {
-    const Vector3 screenDirection = _shadowStaticAlignment ? Vector3::zAxis() : transformation;
+void Shadows::addCaster(Object3D *object, const ResourceKey meshKey, Resource<Mesh> mesh, Resource<ShadowCasterLods> lods) {
+    auto depth = new ShadowCasterDrawable(*object, &_depthDrawables);
+    depth->setShader(_shadowCasterShader);
+    depth->setMesh(mesh, lods);
+    depth->setResidentKey(meshKey);
+
+    auto caster = new ShadowCasterDrawable(*object, &_shadowCasterDrawables);
+    caster->setShader(_shadowCasterShader);
+    caster->setMesh(std::move(mesh), std::move(lods));
+    caster->setResidentKey(meshKey);
+}
+
+void Shadows::setDepthPrePass(const bool enabled) {
+    _depthPrePass = enabled;
+    Debug() << "Depth pre-pass:" << (_depthPrePass ? "on" : "off");
+}
+
+void Shadows::endDepthPrePass() {
+    if(!_depthPrePass) return;
+
+    Renderer::setDepthFunction(Renderer::DepthFunction::Less);
+    Renderer::setDepthMask(true);
+}
+
+void Shadows::setThreadPool(ThreadPool* const pool) {
+    _threadPool = pool;
+    const std::size_t bufferCount = pool ? pool->threadCount() + 1 : 1;
+    _depthCommands.setBufferCount(bufferCount);
+    _receiverCommands.setBufferCount(bufferCount);
+}
+
+void Shadows::recordCameraPass(const std::size_t buffer) {
+    PROFILE_ZONE("Shadows::recordCameraPass");
+
+    /* Same transformations as camera->draw(), the pre-pass computes them
+       the same way as the receivers, so the depths come out bit-exact */
+    const std::size_t bufferCount = _receiverCommands.bufferCount();
+    if(_depthPrePass) {
+        DrawCommandBuffer& commands = _depthCommands.buffer(buffer);
+        const std::size_t count = _depthDrawables.size();
+        for(std::size_t i = count*buffer/bufferCount, end = count*(buffer + 1)/bufferCount; i != end; ++i) {
+            auto& drawable = static_cast<const ShadowCasterDrawable&>(_depthDrawables[i]);
+            drawable.record(commands, _recordCameraMatrix*drawable.object().absoluteTransformationMatrix(), _recordProjectionMatrix, 0);
+        }
+    }
+
+    DrawCommandBuffer& commands = _receiverCommands.buffer(buffer);
+    const std::size_t count = _shadowReceiverDrawables.size();
+    for(std::size_t i = count*buffer/bufferCount, end = count*(buffer + 1)/bufferCount; i != end; ++i) {
+        auto& drawable = static_cast<const ShadowReceiverDrawable&>(_shadowReceiverDrawables[i]);
+        drawable.record(commands, _recordCameraMatrix*drawable.object().absoluteTransformationMatrix(), _recordProjectionMatrix);
+    }
+}
+
+std::size_t Shadows::setShadowLightTarget(SceneGraph::Camera3D *camera, const Vector3 transformation) {
+    /* Stable cascades only stay put with a fixed orientation */
+    const Vector3 screenDirection = _shadowStaticAlignment || _shadowLight.stableCascades() ? Vector3::zAxis() : transformation;
     /* You only really need to do this when your camera moves */
-    _shadowLight.setTarget({3, 2, 3}, screenDirection, *camera);
-};
+    return _shadowLight.setTarget({3, 2, 3}, screenDirection, *camera);
+}
 
 ShadowLight* Shadows::getShadowLight() {
     return &_shadowLight;
 };
 
 void Shadows::draw(SceneGraph::Camera3D *camera, const Vector3 transformation) {
+    const std::size_t allocationCount = frameAllocationCount();
+    _frameArena.reset();
+
+    /* The camera pass doesn't depend on the shadow maps, so it's recorded
+       on the pool while the cascades are drawn. Resources are picked up
+       here, the resource manager isn't thread-safe. */
+    _recordCameraMatrix = camera->cameraMatrix();
+    _recordProjectionMatrix = camera->projectionMatrix();
+    _depthCommands.clear();
+    _receiverCommands.clear();
+    if(_depthPrePass) for(std::size_t i = 0; i != _depthDrawables.size(); ++i)
+        static_cast<ShadowCasterDrawable&>(_depthDrawables[i]).acquireResources();
+    if(_threadPool) for(std::size_t buffer = 0; buffer != _receiverCommands.bufferCount(); ++buffer)
+        _threadPool->submit(_pendingRecordings, [this, buffer]{ recordCameraPass(buffer); });
 
     /* You can use face culling, depending on your geometry. You might want to
        render only back faces for shadows. */
@@ -95,7 +276,15 @@ void Shadows::draw(SceneGraph::Camera3D *camera, const Vector3 transformation) {
     }
 
     /* Create the shadow map textures. */
-    _shadowLight.render(_shadowCasterDrawables);
+    _shadowLight.render(_shadowCasterDrawables, _frameArena, _threadPool);
+
+    /* The budget isn't thread-safe, so the casters the layers kept are
+       marked here and not while culling */
+    if(_resourceBudget) for(std::size_t i = 0; i != _shadowCasterDrawables.size(); ++i) {
+        auto& caster = static_cast<ShadowCasterDrawable&>(_shadowCasterDrawables[i]);
+        if(caster.hasResources() && caster.finestLod() <= MeshSimplifier::MaxLevels)
+            _resourceBudget->use(ResidentType::Mesh, caster.residentKey());
+    }
 
     switch(_shadowMapFaceCullMode) {
         case 0:
@@ -105,20 +294,92 @@ void Shadows::draw(SceneGraph::Camera3D *camera, const Vector3 transformation) {
             Renderer::setFaceCullingMode(Renderer::PolygonFacing::Back);
             break;
     }
-    Containers::Array<Matrix4> shadowMatrices{Containers::NoInit, _shadowLight.layerCount()};
-    for(std::size_t layerIndex = 0; layerIndex != _shadowLight.layerCount(); ++layerIndex)
+
+    /* Moments from the depth, blurred and mipmapped */
+    if(_shadowLight.filtering() != ShadowLight::Filtering::DepthCompare) {
+        if(_profiler) _profiler->begin(_filterSection);
+        _shadowLight.filter();
+        if(_profiler) _profiler->end(_filterSection, 2*_shadowLight.layerCount());
+    }
+    _framebuffer->bind();
+    const Containers::ArrayView<Matrix4> shadowMatrices = _frameArena.allocate<Matrix4>(_shadowLight.layerCount());
+    const Containers::ArrayView<Vector2> depthRanges = _frameArena.allocate<Vector2>(_shadowLight.layerCount());
+    for(std::size_t layerIndex = 0; layerIndex != _shadowLight.layerCount(); ++layerIndex) {
         shadowMatrices[layerIndex] = _shadowLight.layerMatrix(layerIndex);
+        depthRanges[layerIndex] = _shadowLight.layerDepthRange(layerIndex);
+    }
 
-    _shadowReceiverShader->setShadowmapMatrices(shadowMatrices)
-        .setShadowmapTexture(_shadowLight.shadowTexture())
-        .setLightDirection(_shadowLightObject.transformation().backward());
+    /* Both permutations, imported objects draw with the textured one after
+       this */
+    const Vector3 cameraPosition = camera->object().absoluteTransformationMatrix().translation();
+    for(ShadowReceiverShader* shader: {_shadowReceiverShader.get(), _texturedReceiverShader.get()}) {
+        shader->setShadowmapMatrices(shadowMatrices)
+            .setShadowDepthRanges(depthRanges)
+            .setShadowmapTexture(_shadowLight.receiverTexture())
+            .setPcfRadius(Int(_shadowLight.softness()))
+            .setLightDirection(_shadowLightObject.transformation().backward())
+            .setCameraPosition(cameraPosition);
+        if(_lights) shader->setClusteredLights(*_lights);
+    }
+
+    if(_threadPool) _threadPool->wait(_pendingRecordings);
+    else recordCameraPass(0);
 
-    camera->draw(_shadowReceiverDrawables);
+    /* The pre-pass isn't culled, every caster in it is drawn */
+    if(_depthPrePass && _resourceBudget) for(std::size_t i = 0; i != _depthDrawables.size(); ++i) {
+        auto& drawable = static_cast<ShadowCasterDrawable&>(_depthDrawables[i]);
+        if(drawable.hasResources()) _resourceBudget->use(ResidentType::Mesh, drawable.residentKey());
+    }
 
+    if(_depthPrePass) {
+        if(_profiler) _profiler->begin(_depthPrePassSection);
+        Renderer::setColorMask(false, false, false, false);
+        _depthCommands.replay();
+        Renderer::setColorMask(true, true, true, true);
+        Renderer::setDepthFunction(Renderer::DepthFunction::Equal);
+        Renderer::setDepthMask(false);
+        if(_profiler) _profiler->end(_depthPrePassSection, _depthCommands.size());
+    }
+
+    if(_profiler) _profiler->begin(_receiverSection);
+    _receiverCommands.replay();
+    if(_profiler) _profiler->end(_receiverSection, _receiverCommands.size());
+
+    #ifdef SHADOWS_COUNT_ALLOCATIONS
+    /* A scene growing past its largest size so far, like a streamed one,
+       warms up again */
+    const std::size_t drawableCount = _shadowCasterDrawables.size() + _shadowReceiverDrawables.size();
+    if(drawableCount > _peakDrawableCount) {
+        _peakDrawableCount = drawableCount;
+        _frame = 0;
+    }
+    ++_frame;
+    CORRADE_ASSERT(_frame <= AllocationWarmupFrames || frameAllocationCount() == allocationCount,
+        "Shadows::draw():" << frameAllocationCount() - allocationCount << "heap allocations in frame" << _frame, );
+    #endif
+    static_cast<void>(allocationCount);
+}
+
+std::size_t Shadows::frameAllocationCount() const {
+    return AllocationCounter::count() + (_threadPool ? _threadPool->allocationCount() : 0);
+}
+
+void Shadows::setProfiler(FrameProfiler& profiler) {
+    _profiler = &profiler;
+
+    const UnsignedInt firstSection = profiler.addSection("cascade 0");
+    for(std::size_t layer = 1; layer < _shadowLight.layerCount(); ++layer)
+        profiler.addSection("cascade " + std::to_string(layer));
+    _shadowLight.setProfiler(&profiler, firstSection, _shadowLight.layerCount());
+
+    _filterSection = profiler.addSection("shadow filter");
+    _depthPrePassSection = profiler.addSection("depth prepass");
+    _receiverSection = profiler.addSection("receivers");
 }
 
 void Shadows::changeCullMode(){
         _shadowMapFaceCullMode = (_shadowMapFaceCullMode + 1) % 3;
+        _shadowLight.invalidate();
         Debug() << "Face cull mode:"
                 << (_shadowMapFaceCullMode == 0 ? "no cull" : _shadowMapFaceCullMode == 1 ? "cull back" : "cull front");
 }
@@ -130,6 +391,49 @@ void Shadows::toggleStaticAlignment(){
 
 }
 
+void Shadows::setStableCascades(const bool enabled) {
+    _shadowLight.setStableCascades(enabled);
+    Debug() << "Stable cascades:" << (enabled ? "on" : "off");
+}
+
+void Shadows::setShadowLodThreshold(const Float texels) {
+    _shadowLight.setLodThreshold(texels);
+    Debug() << "Shadow caster LOD threshold" << texels << "texels";
+}
+
+void Shadows::toggleLodDebug() {
+    _lodDebug = !_lodDebug;
+    Debug() << "Shadow caster LOD debug:" << (_lodDebug ? "on" : "off");
+    if(!_lodDebug) return;
+
+    for(std::size_t layer = 0; layer != _shadowLight.layerCount(); ++layer) {
+        std::string buf;
+        for(UnsignedInt lod = 0; lod != MeshSimplifier::MaxLevels + 1; ++lod) {
+            if(lod) buf += ", ";
+            buf += std::to_string(_shadowLight.lodDrawCount(layer, lod));
+        }
+        Debug() << "  layer" << layer << "casters per LOD:" << buf;
+    }
+}
+
+void Shadows::addLodDebugLines(DebugLines& lines) {
+    /* Full detail green, going to red for the coarsest level */
+    const Color3 colors[]{{0.0f, 1.0f, 0.0f}, {1.0f, 1.0f, 0.0f}, {1.0f, 0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}};
+    static_assert(sizeof(colors)/sizeof(colors[0]) == MeshSimplifier::MaxLevels + 1, "");
+
+    /* Bounding sphere of every drawn caster, all of them in one instanced
+       draw */
+    for(std::size_t i = 0; i != _shadowCasterDrawables.size(); ++i) {
+        auto& caster = static_cast<ShadowCasterDrawable&>(_shadowCasterDrawables[i]);
+        if(caster.finestLod() > MeshSimplifier::MaxLevels) continue;
+
+        const Matrix4 transformation = caster.object().absoluteTransformationMatrix();
+        const Float scale = std::sqrt(Math::max(transformation[0].xyz().dot(),
+            Math::max(transformation[1].xyz().dot(), transformation[2].xyz().dot())));
+        lines.addSphere(transformation.translation(), caster.radius()*scale, colors[caster.finestLod()]);
+    }
+}
+
 void Shadows::increaseShadowBias(Float value) {
     setShadowSplitExponent(_layerSplitExponent *= value); 
 }
@@ -137,10 +441,18 @@ void Shadows::decreaseShadowBias(Float value) {
         setShadowSplitExponent(_layerSplitExponent /= value);
 }
 void Shadows::increaseShadowRecieverBias(Float value) {
-        _shadowReceiverShader->setShadowBias(_shadowBias *= value);
+        _shadowBias *= value;
+        updateShadowBias();
         Debug() << "Shadow bias" << _shadowBias;
 }
 void Shadows::decreaseShadowRecieverBias(Float value) {
-        _shadowReceiverShader->setShadowBias(_shadowBias /= value);
+        _shadowBias /= value;
+        updateShadowBias();
         Debug() << "Shadow bias" << _shadowBias;
 }
+
+void Shadows::updateShadowBias() {
+    const Float bias = _shadowBias + _shadowLight.depthBias();
+    _shadowReceiverShader->setShadowBias(bias);
+    _texturedReceiverShader->setShadowBias(bias);
+}
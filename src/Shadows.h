@@ -15,11 +15,19 @@
 #include <Magnum/SceneGraph/AbstractObject.h>
 #include <Magnum/SceneGraph/MatrixTransformation3D.h>
 #include <Magnum/SceneGraph/MatrixTransformation3D.h>
+#include <Magnum/DefaultFramebuffer.h>
 #include <Magnum/Renderer.h>
 #include <Corrade/Utility/Debug.h>
+#include <atomic>
 #include <memory>
+#include <string>
 
+#include "AllocationCounter.h"
+#include "ClusteredLights.h"
 #include "DebugLines.h"
+#include "DrawCommands.h"
+#include "FrameArena.h"
+#include "FrameProfiler.h"
 #include "ShadowCasterShader.h"
 #include "ShadowReceiverShader.h"
 #include "ShadowLight.h"
@@ -32,18 +40,103 @@ constexpr const float MainCameraFar = 100.0f * 2.f;
 
 using namespace Magnum;
 
+class ResourceBudget;
+class ThreadPool;
+
 class Shadows {
 public:
+    /* With SHADOWS_COUNT_ALLOCATIONS, draw() asserts that neither it nor
+       its jobs on the thread pool allocate after this many frames, counted again whenever there are
+       more drawables than ever before */
+    enum: UnsignedInt { AllocationWarmupFrames = 8 };
+
     explicit Shadows(Scene3D *scene);
 
     void recompileReceiverShader(std::size_t numLayers);
+    /* Cascade count, call before setProfiler() */
+    void setLayerCount(std::size_t layerCount);
     void setShadowMapSize(const Vector2i& shadowMapSize);
     void setShadowSplitExponent(float power);
+    /* Recreates the shadow maps and recompiles the receiver shaders */
+    void setShadowFiltering(ShadowLight::Filtering filtering);
+    ShadowLight::Filtering shadowFiltering() const { return _shadowLight.filtering(); }
+    /* Depth compare, variance, exponential variance and around */
+    void cycleShadowFiltering();
+    /* Blur radius of the moments or the PCF radius of the depth comparison,
+       in texels */
+    void setShadowSoftness(UnsignedInt texels);
+    UnsignedInt shadowSoftness() const { return _shadowLight.softness(); }
+    /* Recreates the shadow maps and recompiles the receiver shaders, the
+       bias grows by two steps of the format */
+    void setShadowDepthFormat(ShadowLight::DepthFormat format);
+    ShadowLight::DepthFormat shadowDepthFormat() const { return _shadowLight.depthFormat(); }
+    /* 16, 24, 32F and around */
+    void cycleShadowDepthFormat();
+    /* Shadow map memory and bytes written per frame */
+    void printShadowMapReport();
+    /* "16", "24" or "32f", unknown names warn and give Depth24 */
+    static ShadowLight::DepthFormat parseShadowDepthFormat(const std::string& name);
+    static const char* shadowDepthFormatName(ShadowLight::DepthFormat format);
+    /* "compare", "vsm" or "evsm", unknown names warn and give DepthCompare */
+    static ShadowLight::Filtering parseShadowFiltering(const std::string& name);
+    static const char* shadowFilteringName(ShadowLight::Filtering filtering);
     void addDrawable(Object3D *object, Model &model, bool makeCaster, bool makeReceiver);
+    /* Caster for a mesh the scene loader uploads, with the "<id>-shadow"
+       and "<id>-shadow-lods" resources. @p meshKey is the mesh in the
+       resource budget. */
+    void addCaster(Object3D *object, ResourceKey meshKey, Resource<Mesh> mesh, Resource<ShadowCasterLods> lods);
+    /* Casters that survive the culling of any cascade or go into the depth
+       pre-pass mark their mesh as used in @p budget, so it doesn't evict
+       meshes that only cast shadows */
+    void setResourceBudget(ResourceBudget* budget) { _resourceBudget = budget; }
+    /* Receiver shader permutation for objects that draw themselves. It
+       stays the same instance when the layer count changes and gets the
+       shadow and light uniforms in draw(), so use it only after that. */
+    ShadowReceiverShader& receiverShader(ShadowReceiverShader::Flags flags = {});
+    /* Resets the frame arena, nothing from it survives into the next frame */
     void draw(SceneGraph::Camera3D *camera, const Vector3 transformation);
+    FrameArena& frameArena() { return _frameArena; }
+    /* Where the receivers are drawn, the default framebuffer unless set */
+    void setFramebuffer(AbstractFramebuffer& framebuffer) { _framebuffer = &framebuffer; }
+    std::size_t casterCount() const { return _shadowCasterDrawables.size(); }
+    /**
+     * Draw the main camera's casters depth-only before the receivers, which
+     * then shade only the visible fragments with depth test Equal and
+     * depth writes off. Objects drawing themselves after draw() see that
+     * state too, as long as they're casters, and call
+     * @ref endDepthPrePass() after.
+     */
+    void setDepthPrePass(bool enabled);
+    bool depthPrePass() const { return _depthPrePass; }
+    /* Back to depth test Less with depth writes, no-op without the
+       pre-pass */
+    void endDepthPrePass();
+    /* Record the cascades and the camera pass on the pool while the GL
+       thread draws, everything stays on the GL thread without one */
+    void setThreadPool(ThreadPool* pool);
+    ThreadPool* threadPool() const { return _threadPool; }
+    /* Point lights the receivers are lit with in addition to the shadowed
+       directional light, binned by the caller before draw() */
+    void setLights(ClusteredLights* lights) { _lights = lights; }
+
+    /* Time every cascade pass, the moment filtering, the depth pre-pass and
+       the receiver pass in their own sections */
+    void setProfiler(FrameProfiler& profiler);
 
     void changeCullMode();
     void toggleStaticAlignment();
+    /* Texel-snapped bounding sphere cascades with static alignment, layers
+       whose shadow camera and casters didn't change aren't rendered again */
+    void setStableCascades(bool enabled);
+    bool stableCascades() const { return _shadowLight.stableCascades(); }
+    void setShadowLodThreshold(Float texels);
+    /* Show which caster level of detail was used, prints the per-layer
+       counts when enabled */
+    void toggleLodDebug();
+    bool lodDebug() const { return _lodDebug; }
+    /* Bounding sphere of every caster drawn in the last frame, colored by the
+       finest level it was drawn with */
+    void addLodDebugLines(DebugLines& lines);
     void setShadowBias(Float value);
     void increaseShadowBias(Float value);
     void decreaseShadowBias(Float value);
@@ -51,15 +144,29 @@ public:
     void decreaseShadowRecieverBias(Float value);
 
     ShadowLight* getShadowLight();
+    const ShadowLight* getShadowLight() const { return &_shadowLight; }
 
-    void setShadowLightTarget(SceneGraph::Camera3D *camera, const Vector3 transformation);
+    /* Returns the count of layers whose shadow camera changed */
+    std::size_t setShadowLightTarget(SceneGraph::Camera3D *camera, const Vector3 transformation);
 
 private:
+    /* Allocations of the calling thread and the pool workers so far */
+    std::size_t frameAllocationCount() const;
+    /* User bias plus the one of the depth format on both shaders */
+    void updateShadowBias();
+    /* Record one share of the depth pre-pass and the receivers into
+       command buffer @p buffer */
+    void recordCameraPass(std::size_t buffer);
+
 
     SceneGraph::DrawableGroup3D _shadowCasterDrawables;
     SceneGraph::DrawableGroup3D _shadowReceiverDrawables;
+    /* Full detail casters of the main camera depth pre-pass, every
+       receiver and every object drawing itself has one */
+    SceneGraph::DrawableGroup3D _depthDrawables;
     ShadowCasterShader _shadowCasterShader;
     std::unique_ptr<ShadowReceiverShader> _shadowReceiverShader;
+    std::unique_ptr<ShadowReceiverShader> _texturedReceiverShader;
 
     Object3D _shadowLightObject;
     ShadowLight _shadowLight;
@@ -69,6 +176,23 @@ private:
     Vector2i _shadowMapSize;
     Int _shadowMapFaceCullMode;
     bool _shadowStaticAlignment;
+    bool _lodDebug;
+    bool _depthPrePass;
+    FrameProfiler* _profiler;
+    UnsignedInt _filterSection, _depthPrePassSection, _receiverSection;
+    AbstractFramebuffer* _framebuffer;
+    ClusteredLights* _lights;
+    ResourceBudget* _resourceBudget;
+    FrameArena _frameArena;
+    UnsignedLong _frame;
+    std::size_t _peakDrawableCount;
+
+    ThreadPool* _threadPool;
+    /* One buffer per recording thread, _recordCameraMatrix and
+       _recordProjectionMatrix are what they're recorded with */
+    DrawCommands _depthCommands, _receiverCommands;
+    Matrix4 _recordCameraMatrix, _recordProjectionMatrix;
+    std::atomic<std::size_t> _pendingRecordings;
 };
 
 #endif
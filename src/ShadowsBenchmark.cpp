@@ -0,0 +1,469 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "ShadowsBenchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+#include <Corrade/Utility/Arguments.h>
+#include <Corrade/Utility/Debug.h>
+#include <Corrade/Utility/Directory.h>
+#include <Corrade/Utility/String.h>
+#include <Magnum/Context.h>
+#include <Magnum/Image.h>
+#include <Magnum/PixelFormat.h>
+#include <Magnum/Renderer.h>
+#include <Magnum/RenderbufferFormat.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/Primitives/Capsule.h>
+#include <Magnum/Primitives/Cube.h>
+#include <Magnum/Primitives/UVSphere.h>
+#include <Magnum/Trade/MeshData3D.h>
+
+#include "AllocationCounter.h"
+#include "MeshSimplifier.h"
+
+using namespace Math::Literals;
+
+namespace {
+    /* The default scene of ShadowsExample covers 100x100 units with 200
+       objects, bigger scenes keep its density */
+    constexpr const Float DefaultExtent = 100.0f;
+    constexpr const UnsignedInt DefaultObjectCount = 200;
+
+    constexpr const Float Percentiles[]{0.5f, 0.9f, 0.95f, 0.99f, 1.0f};
+    constexpr const char* PercentileNames[]{"p50", "p90", "p95", "p99", "max"};
+
+    /* Pixels with a channel differing by more than this from the reference
+       count as different, more than the fraction of them fails the run */
+    constexpr const Int PixelTolerance = 8;
+    constexpr const Float DifferingPixelFraction = 0.001f;
+}
+
+ShadowsBenchmark::ShadowsBenchmark(const Arguments& arguments):
+Platform::WindowlessApplication{arguments},
+_cameraObject{&_scene},
+_camera{_cameraObject},
+_shadows{&_scene},
+_backgroundPool{ThreadPool::backgroundThreadCount()},
+_framebuffer{{{}, Vector2i{1}}},
+_measuredFrames{0},
+_allocations{0},
+_lightBinningSection{0},
+_lightIndices{0},
+_droppedLights{0},
+_maxClusterLightCount{0},
+_differingPixels{0}
+{
+    Utility::Arguments args;
+    args.addOption("objects", std::to_string(DefaultObjectCount)).setHelp("objects", "number of shadow casting objects", "N")
+        .addOption("point-lights", "0").setHelp("point-lights", "number of point lights binned into clusters and lighting the receivers", "N")
+        .addOption("models", "cube,capsule,capsule-hi").setHelp("models", "comma-separated mix of cube, capsule, capsule-hi and sphere, picked uniformly", "LIST")
+        .addOption("cascades", "3").setHelp("cascades", "shadow cascade count", "N")
+        .addOption("shadow-map-size", "2048").setHelp("shadow-map-size", "shadow map resolution of every cascade", "N")
+        .addOption("size", "1280x720").setHelp("size", "framebuffer size", "WxH")
+        .addOption("frames", "600").setHelp("frames", "measured frames, the camera does one orbit over them", "N")
+        .addOption("warmup", "60").setHelp("warmup", "frames rendered before measuring, not part of the results", "N")
+        .addOption("seed", "1").setHelp("seed", "scene random seed", "N")
+        .addOption("mesh-optimizations", "all").setHelp("mesh-optimizations", "comma-separated list of weld, cache, overdraw and fetch, or all or none", "LIST")
+        .addOption("shadow-lod-threshold", "1").setHelp("shadow-lod-threshold", "largest shadow caster simplification error in shadow map texels, 0 disables caster LODs", "TEXELS")
+        .addOption("shadow-filter", "compare").setHelp("shadow-filter", "shadow map filtering, compare, vsm or evsm", "MODE")
+        .addOption("shadow-softness", "0").setHelp("shadow-softness", "shadow blur or PCF radius in shadow map texels, at most 8", "TEXELS")
+        .addOption("shadow-depth-format", "24").setHelp("shadow-depth-format", "shadow map depth format, 16, 24 or 32f", "FORMAT")
+        .addBooleanOption("depth-pre-pass").setHelp("depth-pre-pass", "draw the receivers depth-only first and shade them with depth test equal")
+        .addBooleanOption("stable-cascades").setHelp("stable-cascades", "texel-snapped bounding sphere cascades, unchanged ones aren't rendered again")
+        .addBooleanOption("serial-recording").setHelp("serial-recording", "record the cascade and camera draws on the GL thread instead of the thread pool")
+        .addOption("output", "").setHelp("output", "JSON file with the results, printed if empty", "FILE")
+        .addOption("image", "").setHelp("image", "save the last frame as a PPM image", "FILE")
+        .addOption("reference", "").setHelp("reference", "compare the last frame to this PPM image and fail if it differs", "FILE")
+        .addOption("capture", "").setHelp("capture", "save measured frames as PREFIXnnnnnn.ppm in the background, nothing if empty", "PREFIX")
+        .addOption("capture-interval", "1").setHelp("capture-interval", "capture every Nth measured frame", "N")
+        .addBooleanOption("capture-shadow-maps").setHelp("capture-shadow-maps", "capture the shadow map layers as 16-bit PGM too")
+        .setHelp("Renders a seeded scene along a scripted camera path without a "
+                 "window and reports frame times, draw counts and shadow caster "
+                 "culling statistics as JSON.")
+        .parse(arguments.argc, arguments.argv);
+
+    _seed = args.value<UnsignedInt>("seed");
+    _objectCount = args.value<UnsignedInt>("objects");
+    _pointLightCount = args.value<UnsignedInt>("point-lights");
+    _layerCount = Math::max(args.value<UnsignedInt>("cascades"), 1u);
+    _frameCount = Math::max(args.value<UnsignedInt>("frames"), 1u);
+    _warmupFrameCount = args.value<UnsignedInt>("warmup");
+    _shadowMapSize = Vector2i{args.value<Int>("shadow-map-size")};
+    _extent = DefaultExtent*std::sqrt(Float(Math::max(_objectCount, 1u))/DefaultObjectCount);
+    _output = args.value("output");
+    _image = args.value("image");
+    _reference = args.value("reference");
+    _captureInterval = Math::max(args.value<UnsignedInt>("capture-interval"), 1u);
+    _random.seed(_seed);
+
+    _size = Vector2i{1280, 720};
+    const std::vector<std::string> size = Utility::String::splitWithoutEmptyParts(args.value("size"), 'x');
+    if(size.size() == 2) _size = {std::stoi(size[0]), std::stoi(size[1])};
+    else Warning{} << "Invalid size" << args.value("size") << Debug::nospace << ", using" << _size;
+
+    _modelNames = Utility::String::splitWithoutEmptyParts(args.value("models"), ',');
+    if(_modelNames.empty()) _modelNames.push_back("cube");
+    _meshOptimizer = MeshOptimizer{MeshOptimizer::parseOptimizations(args.value("mesh-optimizations"))};
+
+    /* Offscreen target, a windowless context has no default framebuffer to
+       draw into */
+    _color.setStorage(RenderbufferFormat::RGBA8, _size);
+    _depth.setStorage(RenderbufferFormat::DepthComponent24, _size);
+    _framebuffer.setViewport({{}, _size})
+        .attachRenderbuffer(Framebuffer::ColorAttachment{0}, _color)
+        .attachRenderbuffer(Framebuffer::BufferAttachment::Depth, _depth);
+    CORRADE_INTERNAL_ASSERT(_framebuffer.checkStatus(FramebufferTarget::Draw) == Framebuffer::Status::Complete);
+
+    Renderer::enable(Renderer::Feature::DepthTest);
+    Renderer::enable(Renderer::Feature::FaceCulling);
+    Renderer::setClearColor({0.1f, 0.1f, 0.4f, 1.0f});
+
+    _shadows.setFramebuffer(_framebuffer);
+    _shadows.setShadowMapSize(_shadowMapSize);
+    _shadows.setLayerCount(_layerCount);
+    _shadows.setShadowLodThreshold(args.value<Float>("shadow-lod-threshold"));
+    _shadows.setProfiler(_profiler);
+    if(args.isSet("depth-pre-pass")) _shadows.setDepthPrePass(true);
+    if(args.isSet("stable-cascades")) _shadows.setStableCascades(true);
+    if(!args.isSet("serial-recording")) _shadows.setThreadPool(&_threadPool);
+    _shadows.setShadowFiltering(Shadows::parseShadowFiltering(args.value("shadow-filter")));
+    _shadows.setShadowSoftness(args.value<UnsignedInt>("shadow-softness"));
+    _shadows.setShadowDepthFormat(Shadows::parseShadowDepthFormat(args.value("shadow-depth-format")));
+    if(!args.value("capture").empty()) {
+        _capture.reset(new FrameCapture{_backgroundPool});
+        _capture->setPrefix(args.value("capture"));
+        if(args.isSet("capture-shadow-maps")) _capture->setShadowLight(_shadows.getShadowLight());
+    }
+    if(_pointLightCount) {
+        _lightBinningSection = _profiler.addSection("light binning");
+        _shadows.setLights(&_lights);
+    }
+
+    _camera.setProjectionMatrix(Matrix4::perspectiveProjection(35.0_degf,
+        Vector2{_size}.aspectRatio(), MainCameraNear, MainCameraFar))
+        .setViewport(_size);
+
+    populateScene();
+
+    _profiler.setHistorySize(_frameCount);
+    _profiler.setWaitForResults(true);
+    _sectionDraws.assign(_profiler.sectionCount(), 0);
+    _layerStatistics.assign(_layerCount, LayerStatistics{0, ~0u, 0, 0, 0,
+        std::vector<UnsignedLong>(MeshSimplifier::MaxLevels + 1)});
+}
+
+void ShadowsBenchmark::addModel(const std::string& name) {
+    Trade::MeshData3D meshData3D = [&name]() {
+        if(name == "cube") return Primitives::Cube::solid();
+        if(name == "capsule") return Primitives::Capsule3D::solid(1, 1, 4, 1.0f);
+        if(name == "capsule-hi") return Primitives::Capsule3D::solid(6, 1, 9, 1.0f);
+        if(name == "sphere") return Primitives::UVSphere::solid(16, 32);
+        Warning{} << "Unknown model" << name << Debug::nospace << ", using a cube";
+        return Primitives::Cube::solid();
+    }();
+    _meshOptimizer.optimize(meshData3D, name);
+
+    _models.emplace_back();
+    setupModel(_models.back(), meshData3D);
+}
+
+void ShadowsBenchmark::populateScene() {
+    /* Meshes reference their buffers, nothing can move after this */
+    _models.reserve(_modelNames.size() + 1);
+    addModel("cube");
+    for(const std::string& name: _modelNames) addModel(name);
+
+    auto ground = new Object3D{&_scene};
+    ground->setTransformation(Matrix4::scaling({_extent, 1.0f, _extent}));
+    _shadows.addDrawable(ground, _models[0], false, true);
+
+    /* Only the seeded generator decides the placement, never std::rand() */
+    std::uniform_int_distribution<std::size_t> model{1, _models.size() - 1};
+    std::uniform_real_distribution<Float> horizontal{-0.5f*_extent, 0.5f*_extent};
+    std::uniform_real_distribution<Float> vertical{0.0f, 5.0f};
+    for(UnsignedInt i = 0; i != _objectCount; ++i) {
+        Model& m = _models[model(_random)];
+        auto object = new Object3D{&_scene};
+        const Float x = horizontal(_random);
+        const Float y = vertical(_random);
+        const Float z = horizontal(_random);
+        object->setTransformation(Matrix4::translation({x, y, z}));
+        _shadows.addDrawable(object, m, true, true);
+    }
+
+    /* Lights after the objects, so their count doesn't change the object
+       placement of a seed */
+    std::uniform_real_distribution<Float> lightHeight{0.5f, 3.0f};
+    std::uniform_real_distribution<Float> lightRadius{3.0f, 8.0f};
+    std::uniform_real_distribution<Float> lightHue{0.0f, 360.0f};
+    _lights.lights().reserve(_pointLightCount);
+    for(UnsignedInt i = 0; i != _pointLightCount; ++i) {
+        const Float x = horizontal(_random);
+        const Float y = lightHeight(_random);
+        const Float z = horizontal(_random);
+        const Float radius = lightRadius(_random);
+        const Color3 color = Color3::fromHsv(Deg(lightHue(_random)), 0.75f, 1.0f)*4.0f;
+        _lights.lights().push_back({{x, y, z}, radius, color});
+    }
+}
+
+Matrix4 ShadowsBenchmark::cameraTransformation(const UnsignedInt frame, const UnsignedInt frameCount) const {
+    /* Orbit at a bobbing height, looking across the scene towards a point
+       that leads the camera, so the cascades see both the near and the far
+       end of the scene change every frame */
+    const Float angle = 2.0f*Constants::pi()*frame/frameCount;
+    const Float radius = 0.35f*_extent;
+    const Vector3 eye{radius*std::cos(angle), 4.0f + 2.0f*std::sin(2.0f*angle), radius*std::sin(angle)};
+    const Vector3 target{0.5f*radius*std::cos(angle + 2.0f), 0.0f, 0.5f*radius*std::sin(angle + 2.0f)};
+    return Matrix4::lookAt(eye, target, Vector3::yAxis());
+}
+
+void ShadowsBenchmark::drawFrame(const UnsignedInt frame, const UnsignedInt frameCount) {
+    /* The light binning and the shadow jobs run on the pool */
+    const std::size_t allocationCount = AllocationCounter::count() + _threadPool.allocationCount();
+    _profiler.beginFrame();
+
+    _cameraObject.setTransformation(cameraTransformation(frame, frameCount));
+    _shadows.setShadowLightTarget(&_camera, _cameraObject.transformation()[2].xyz());
+
+    if(_pointLightCount) {
+        _profiler.begin(_lightBinningSection);
+        _lights.update(_camera, &_threadPool);
+        _profiler.end(_lightBinningSection);
+    }
+
+    _framebuffer.clear(FramebufferClear::Color|FramebufferClear::Depth);
+    _shadows.draw(&_camera, _cameraObject.transformation()[2].xyz());
+    /* Or the next clear wouldn't touch the depth */
+    _shadows.endDepthPrePass();
+
+    /* There's no swap to pace the frames, don't let the driver queue up an
+       unbounded amount of them */
+    Renderer::flush();
+    _profiler.endFrame();
+
+    /* exec() clears it after the warm-up frames */
+    _allocations += AllocationCounter::count() + _threadPool.allocationCount() - allocationCount;
+}
+
+void ShadowsBenchmark::collectStatistics() {
+    ++_measuredFrames;
+    for(UnsignedInt i = 0; i != _profiler.sectionCount(); ++i)
+        _sectionDraws[i] += _profiler.drawCount(i);
+    _lightIndices += _lights.lightIndexCount();
+    _droppedLights += _lights.droppedCount();
+    _maxClusterLightCount = Math::max(_maxClusterLightCount, _lights.maxClusterLightCount());
+
+    ShadowLight& light = *_shadows.getShadowLight();
+    for(std::size_t layer = 0; layer != _layerStatistics.size(); ++layer) {
+        LayerStatistics& statistics = _layerStatistics[layer];
+        UnsignedInt drawn = 0;
+        for(UnsignedInt lod = 0; lod != MeshSimplifier::MaxLevels + 1; ++lod) {
+            const UnsignedInt count = light.lodDrawCount(layer, lod);
+            statistics.lods[lod] += count;
+            drawn += count;
+        }
+        statistics.drawn += drawn;
+        statistics.drawnMin = Math::min(statistics.drawnMin, drawn);
+        statistics.drawnMax = Math::max(statistics.drawnMax, drawn);
+        if(light.layerChanged(layer)) ++statistics.changed;
+        if(light.layerSkipped(layer)) ++statistics.skipped;
+    }
+}
+
+bool ShadowsBenchmark::checkImage() {
+    Image2D image = _framebuffer.read({{}, _size}, {PixelFormat::RGBA, PixelType::UnsignedByte});
+    const std::string rgb = FrameCapture::rgbFromRgba(_size, image.data());
+
+    if(!_image.empty()) {
+        if(FrameCapture::writePpm(_image, _size, rgb)) Debug{} << "Last frame saved to" << _image;
+        else Error{} << "Cannot write" << _image;
+    }
+
+    if(_reference.empty()) return true;
+
+    Vector2i referenceSize;
+    std::string reference;
+    if(!FrameCapture::readPpm(_reference, referenceSize, reference) || referenceSize != _size) {
+        Error{} << "Cannot compare to" << _reference << Debug::nospace << ", it's not a" << _size << "binary PPM";
+        _differingPixels = _size.product();
+        return false;
+    }
+
+    _differingPixels = 0;
+    for(std::size_t i = 0; i != rgb.size(); i += 3) {
+        for(std::size_t c = 0; c != 3; ++c) {
+            if(std::abs(Int(UnsignedByte(rgb[i + c])) - Int(UnsignedByte(reference[i + c]))) > PixelTolerance) {
+                ++_differingPixels;
+                break;
+            }
+        }
+    }
+
+    return _differingPixels <= DifferingPixelFraction*_size.product();
+}
+
+int ShadowsBenchmark::exec() {
+    Debug{} << "Benchmarking" << _objectCount << "objects," << _layerCount << "cascades of" << _shadowMapSize << "at" << _size << "on" << Context::current().rendererString();
+
+    /* Warm-up frames move along the start of the path, the driver compiles
+       and uploads lazily */
+    for(UnsignedInt frame = 0; frame != _warmupFrameCount; ++frame)
+        drawFrame(frame, _frameCount);
+    _profiler.finish();
+    _profiler.reset();
+    _allocations = 0;
+
+    /* Captures are queued after the profiled frame, the readback lands in
+       the next frame's GPU queue but outside of its timer queries */
+    for(UnsignedInt frame = 0; frame != _frameCount; ++frame) {
+        drawFrame(frame, _frameCount);
+        collectStatistics();
+        if(!_capture) continue;
+        if(frame % _captureInterval == 0)
+            _capture->capture(_framebuffer, {{}, _size}, frame);
+        else _capture->update();
+    }
+    _profiler.finish();
+    if(_capture) {
+        _capture->finish();
+        Debug{} << _capture->writtenCount() << "frames captured to" << _capture->prefix() << Debug::nospace << "*," << _capture->droppedCount() << "dropped";
+    }
+
+    const bool imageMatches = checkImage();
+    const std::string out = json();
+    if(_output.empty()) {
+        Debug{} << out;
+    } else if(!Utility::Directory::writeString(_output, out)) {
+        Error{} << "Cannot write" << _output;
+        return 1;
+    } else Debug{} << "Results written to" << _output;
+
+    if(!imageMatches) {
+        Error{} << _differingPixels << "of" << _size.product() << "pixels differ from" << _reference;
+        return 1;
+    }
+
+    return 0;
+}
+
+std::string ShadowsBenchmark::json() const {
+    std::ostringstream out;
+    out.precision(4);
+    out << std::fixed;
+
+    auto percentiles = [&out](auto&& percentile) {
+        out << "{";
+        for(std::size_t i = 0; i != sizeof(Percentiles)/sizeof(Percentiles[0]); ++i)
+            out << (i ? ", " : "") << "\"" << PercentileNames[i] << "\": " << percentile(Percentiles[i]);
+        out << "}";
+    };
+
+    out << "{\n  \"config\": {\"seed\": " << _seed
+        << ", \"objects\": " << _objectCount
+        << ", \"pointLights\": " << _pointLightCount
+        << ", \"depthPrePass\": " << (_shadows.depthPrePass() ? "true" : "false")
+        << ", \"shadowFilter\": \"" << Shadows::shadowFilteringName(_shadows.shadowFiltering()) << "\""
+        << ", \"shadowSoftness\": " << _shadows.shadowSoftness()
+        << ", \"stableCascades\": " << (_shadows.stableCascades() ? "true" : "false")
+        << ", \"threadedRecording\": " << (_shadows.threadPool() ? "true" : "false")
+        << ", \"shadowDepthFormat\": \"" << Shadows::shadowDepthFormatName(_shadows.shadowDepthFormat()) << "\""
+        << ", \"models\": [";
+    for(std::size_t i = 0; i != _modelNames.size(); ++i)
+        out << (i ? ", " : "") << "\"" << _modelNames[i] << "\"";
+    out << "], \"cascades\": " << _layerCount
+        << ", \"shadowMapSize\": [" << _shadowMapSize.x() << ", " << _shadowMapSize.y() << "]"
+        << ", \"size\": [" << _size.x() << ", " << _size.y() << "]"
+        << ", \"frames\": " << _frameCount
+        << ", \"warmupFrames\": " << _warmupFrameCount << "},\n";
+
+    out << "  \"renderer\": \"" << Context::current().rendererString() << "\",\n"
+        << "  \"version\": \"" << Context::current().versionString() << "\",\n"
+        << "  \"gpuTimes\": " << (_profiler.hasGpuTimes() ? "true" : "false") << ",\n"
+        << "  \"fragmentCounts\": " << (_profiler.hasFragmentCounts() ? "true" : "false") << ",\n";
+
+    /* Times in milliseconds */
+    out << "  \"sections\": [\n";
+    for(UnsignedInt i = 0; i != _profiler.sectionCount(); ++i) {
+        out << "    {\"name\": \"" << _profiler.name(i) << "\", \"cpu\": ";
+        percentiles([this, i](Float p) { return _profiler.cpuPercentile(i, p); });
+        if(_profiler.hasGpuTimes()) {
+            out << ", \"gpu\": ";
+            percentiles([this, i](Float p) { return _profiler.gpuPercentile(i, p); });
+            out << ", \"gpuFrames\": " << _profiler.gpuFrameCount(i);
+        }
+        out << ", \"drawsPerFrame\": " << Float(_sectionDraws[i])/_measuredFrames;
+        /* Fragment shader invocations, to compare runs with and without
+           the depth pre-pass */
+        if(_profiler.hasFragmentCounts() && i != FrameProfiler::FrameSection)
+            out << ", \"fragmentsPerFrame\": " << _profiler.fragmentsPerFrame(i);
+        out << "}"
+            << (i + 1 != _profiler.sectionCount() ? ",\n" : "\n");
+    }
+    out << "  ],\n";
+
+    UnsignedLong draws = 0;
+    for(UnsignedInt i = 0; i != _profiler.sectionCount(); ++i)
+        if(i != FrameProfiler::FrameSection) draws += _sectionDraws[i];
+    out << "  \"drawsPerFrame\": " << Float(draws)/_measuredFrames << ",\n";
+    if(AllocationCounter::isEnabled())
+        out << "  \"heapAllocationsPerFrame\": " << Float(_allocations)/_measuredFrames << ",\n";
+
+    if(_pointLightCount) {
+        const Vector3ui grid = _lights.gridSize();
+        out << "  \"lights\": {\"grid\": [" << grid.x() << ", " << grid.y() << ", " << grid.z() << "]"
+            << ", \"indicesPerFrame\": " << Float(_lightIndices)/_measuredFrames
+            << ", \"droppedPerFrame\": " << Float(_droppedLights)/_measuredFrames
+            << ", \"maxPerCluster\": " << _maxClusterLightCount << "},\n";
+    }
+
+    /* Bytes, the written ones are a lower bound without overdraw */
+    const ShadowLight& light = *_shadows.getShadowLight();
+    out << "  \"shadowMaps\": {\"depthBytes\": " << light.depthMemory()
+        << ", \"momentsBytes\": " << light.momentsMemory()
+        << ", \"bytesWrittenPerFrame\": " << light.bytesWrittenPerFrame() << "},\n";
+
+    if(!_reference.empty())
+        out << "  \"image\": {\"reference\": \"" << _reference << "\""
+            << ", \"differingPixels\": " << _differingPixels
+            << ", \"tolerance\": " << PixelTolerance << "},\n";
+
+    if(_capture)
+        out << "  \"capture\": {\"prefix\": \"" << _capture->prefix() << "\""
+            << ", \"interval\": " << _captureInterval
+            << ", \"captured\": " << _capture->capturedCount()
+            << ", \"dropped\": " << _capture->droppedCount()
+            << ", \"written\": " << _capture->writtenCount()
+            << ", \"failed\": " << _capture->failedCount() << "},\n";
+
+    const std::size_t casterCount = _shadows.casterCount();
+    out << "  \"culling\": {\"casters\": " << casterCount << ", \"cascades\": [\n";
+    for(std::size_t layer = 0; layer != _layerStatistics.size(); ++layer) {
+        const LayerStatistics& statistics = _layerStatistics[layer];
+        const Float drawnMean = Float(statistics.drawn)/_measuredFrames;
+        out << "    {\"drawnMean\": " << drawnMean
+            << ", \"drawnMin\": " << statistics.drawnMin
+            << ", \"drawnMax\": " << statistics.drawnMax
+            << ", \"culledMean\": " << casterCount - drawnMean
+            << ", \"changedFraction\": " << Float(statistics.changed)/_measuredFrames
+            << ", \"skippedFraction\": " << Float(statistics.skipped)/_measuredFrames
+            << ", \"lodsPerFrame\": [";
+        for(std::size_t lod = 0; lod != statistics.lods.size(); ++lod)
+            out << (lod ? ", " : "") << Float(statistics.lods[lod])/_measuredFrames;
+        out << "]}" << (layer + 1 != _layerStatistics.size() ? ",\n" : "\n");
+    }
+    out << "  ]}\n}\n";
+
+    return out.str();
+}
+
+MAGNUM_WINDOWLESSAPPLICATION_MAIN(ShadowsBenchmark)
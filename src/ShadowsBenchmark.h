@@ -0,0 +1,107 @@
+#if !defined(SHADOWSBENCHMARK_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define SHADOWSBENCHMARK_H
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Magnum/Framebuffer.h>
+#include <Magnum/Renderbuffer.h>
+#include <Magnum/Platform/WindowlessEglApplication.h>
+#include <Magnum/SceneGraph/Camera.h>
+#include <Magnum/SceneGraph/Drawable.h>
+#include <Magnum/SceneGraph/MatrixTransformation3D.h>
+#include <Magnum/SceneGraph/Scene.h>
+
+#include "ClusteredLights.h"
+#include "FrameCapture.h"
+#include "FrameProfiler.h"
+#include "MeshOptimizer.h"
+#include "Shadows.h"
+#include "ThreadPool.h"
+#include "Types.h"
+
+using namespace Magnum;
+
+/**
+Renders a seeded scene along a scripted camera path without a window and
+writes frame time percentiles, draw counts and shadow caster culling
+statistics as JSON. The same options and seed always give the same scene
+and the same camera path, so two runs differ only in how long they took.
+
+GPU times need ARB_timer_query, Mesa llvmpipe has it. The profiler waits for
+every timer result, so no frame is left out of the percentiles.
+*/
+class ShadowsBenchmark: public Platform::WindowlessApplication {
+public:
+    explicit ShadowsBenchmark(const Arguments& arguments);
+
+    int exec() override;
+
+private:
+    /* Per-layer caster culling totals over the measured frames */
+    struct LayerStatistics {
+        UnsignedLong drawn;
+        UnsignedInt drawnMin, drawnMax;
+        /* Frames the shadow camera moved in, frames it was reused in */
+        UnsignedLong changed, skipped;
+        std::vector<UnsignedLong> lods;
+    };
+
+    void addModel(const std::string& name);
+    void populateScene();
+    /* Camera at @p frame of the path, one full orbit over @p frameCount */
+    Matrix4 cameraTransformation(UnsignedInt frame, UnsignedInt frameCount) const;
+    void drawFrame(UnsignedInt frame, UnsignedInt frameCount);
+    void collectStatistics();
+    /* Saves the last frame and compares it to the reference, false if it
+       differs too much */
+    bool checkImage();
+    std::string json() const;
+
+    Scene3D _scene;
+    Object3D _cameraObject;
+    SceneGraph::Camera3D _camera;
+    Shadows _shadows;
+    FrameProfiler _profiler;
+    MeshOptimizer _meshOptimizer;
+    ThreadPool _threadPool;
+    /* Frame capture writes, so they don't take workers from the frame */
+    ThreadPool _backgroundPool;
+    ClusteredLights _lights;
+
+    Vector2i _size;
+    Renderbuffer _color, _depth;
+    Framebuffer _framebuffer;
+
+    std::vector<std::string> _modelNames;
+    std::vector<Model> _models;
+    std::mt19937 _random;
+
+    UnsignedInt _seed, _objectCount, _pointLightCount, _layerCount, _frameCount, _warmupFrameCount;
+    Vector2i _shadowMapSize;
+    Float _extent;
+    std::string _output, _image, _reference;
+    /* Declared after the thread pool, so it's gone before it */
+    std::unique_ptr<FrameCapture> _capture;
+    UnsignedInt _captureInterval;
+
+    UnsignedInt _measuredFrames;
+    UnsignedLong _allocations;
+    UnsignedInt _lightBinningSection;
+    UnsignedLong _lightIndices, _droppedLights;
+    UnsignedInt _maxClusterLightCount;
+    std::vector<UnsignedLong> _sectionDraws;
+    std::vector<LayerStatistics> _layerStatistics;
+    std::size_t _differingPixels;
+};
+
+#endif
@@ -2,7 +2,10 @@
 
 void ShadowsExample::globalViewportEvent(const Vector2i& size) {
     defaultFramebuffer.setViewport({{}, size});
-    _activeCamera->setViewport(size);
+    /* Reallocates the offscreen targets only if the size crossed a
+       bucket */
+    _dynamicResolution.setWindowSize(size);
+    _activeCamera->setViewport(_dynamicResolution.renderSize());
 }
 
 ShadowsExample::ShadowsExample(const Arguments& arguments):
@@ -16,22 +19,64 @@ _mainCamera{_mainCameraObject},
 _debugCameraObject{&_scene},
 _debugCamera{_debugCameraObject},
 _resource{"shadow-data"},
-_shadows{&_scene}
+_shadows{&_scene},
+_resourceBudget{_resourceManager},
+_backgroundPool{ThreadPool::backgroundThreadCount()},
+_dynamicResolution{8},
+_capture{_backgroundPool}
 {
+    _startTime = std::chrono::steady_clock::now();
+    PROFILE_THREAD_NAME("main");
+
     Utility::Arguments args;
     args.addArgument("file").setHelp("file", "file to load")
+        .addOption("texture-cache", "texture-cache").setHelp("texture-cache", "directory for cooked textures", "DIR")
+        .addOption("texture-compression", "bc1").setHelp("texture-compression", "compression of cooked textures, none or bc1", "FORMAT")
+        .addBooleanOption("cook-textures").setHelp("cook-textures", "cook all scene textures into the cache, compile the scene and exit")
+        .addOption("scene-cache", "").setHelp("scene-cache", "compiled scene file, the scene file with .mscn appended if empty", "FILE")
+        .addBooleanOption("no-scene-cache").setHelp("no-scene-cache", "always load the scene through the importer")
+        .addOption("mesh-optimizations", "all").setHelp("mesh-optimizations", "comma-separated list of weld, cache, overdraw and fetch, or all or none", "LIST")
+        .addOption("shadow-lod-threshold", "1").setHelp("shadow-lod-threshold", "largest shadow caster simplification error in shadow map texels, 0 disables caster LODs", "TEXELS")
+        .addBooleanOption("mesh-report").setHelp("mesh-report", "print vertex cache and overdraw statistics of every mesh")
+        .addOption("trace-first-frame", "").setHelp("trace-first-frame", "record a CPU trace starting with this frame, 0 includes the startup", "N")
+        .addOption("trace-frames", "60").setHelp("trace-frames", "number of frames in a trace", "N")
+        .addOption("trace-file", "trace.json").setHelp("trace-file", "where to write the trace, in Chrome trace format", "FILE")
+        .addOption("point-lights", "256").setHelp("point-lights", "number of moving point lights lighting the shadow receivers", "N")
+        .addOption("shadow-filter", "compare").setHelp("shadow-filter", "shadow map filtering, compare, vsm or evsm, B cycles them", "MODE")
+        .addOption("shadow-softness", "0").setHelp("shadow-softness", "shadow blur or PCF radius in shadow map texels, at most 8", "TEXELS")
+        .addOption("shadow-depth-format", "24").setHelp("shadow-depth-format", "shadow map depth format, 16, 24 or 32f, G cycles them", "FORMAT")
+        .addBooleanOption("depth-pre-pass").setHelp("depth-pre-pass", "draw the main camera depth-only first, Z toggles it")
+        .addBooleanOption("stable-cascades").setHelp("stable-cascades", "texel-snapped bounding sphere cascades, unchanged ones aren't rendered again, K toggles them")
+        .addOption("dynamic-resolution", "0").setHelp("dynamic-resolution", "draw the scene at a scale keeping the GPU frame time under this, 0 disables it, R toggles it", "MS")
+        .addOption("min-render-scale", "0.5").setHelp("min-render-scale", "smallest dynamic resolution scale of the window size", "SCALE")
+        .addOption("sharpness", "0.25").setHelp("sharpness", "sharpening of the dynamic resolution upscale, 0 to 1", "AMOUNT")
+        .addOption("capture", "").setHelp("capture", "save every frame as PREFIXnnnnnn.ppm in the background from the start, F toggles capturing, into frame- without this", "PREFIX")
+        .addBooleanOption("capture-shadow-maps").setHelp("capture-shadow-maps", "capture the shadow map layers as 16-bit PGM too")
+        .addOption("world", "").setHelp("world", "stream a chunked world from this directory instead of the fixed ground and objects, chunks missing there are generated", "DIR")
+        .addOption("world-size", "64").setHelp("world-size", "chunks along each side of a generated world", "N")
+        .addOption("chunk-size", "32").setHelp("chunk-size", "edge of a world chunk", "UNITS")
+        .addOption("chunk-objects", "40").setHelp("chunk-objects", "objects in a generated chunk besides its ground tile", "N")
+        .addOption("load-radius", "96").setHelp("load-radius", "chunks closer to the camera than this are loaded", "UNITS")
+        .addOption("unload-hysteresis", "16").setHelp("unload-hysteresis", "chunks are unloaded this much further than they're loaded", "UNITS")
+        .addOption("chunk-budget", "1").setHelp("chunk-budget", "time spent creating objects of loaded chunks every frame", "MS")
+        .addOption("sound-emitters", "0").setHelp("sound-emitters", "entities playing positional looping sounds, 0 doesn't open an audio device", "N")
+        .addOption("voices", "32").setHelp("voices", "OpenAL sources the loudest sound emitters are played on", "N")
+        .addOption("audio-max-distance", "50").setHelp("audio-max-distance", "sound emitters further than this are silent", "UNITS")
+        .addOption("memory-budget", "0").setHelp("memory-budget", "texture and mesh memory budget, least recently drawn data are evicted above it, 0 is unlimited", "MB")
         .setHelp("Loads and displays 3D scene file (such as OpenGEX or "
                  "COLLADA one) provided on command-line.")
         .parse(arguments.argc, arguments.argv);
+
+    _traceFrameCount = args.value<UnsignedInt>("trace-frames");
+    _traceFile = args.value("trace-file");
+    if(!args.value("trace-first-frame").empty())
+        TraceRecorder::capture(args.value<UnsignedLong>("trace-first-frame"), _traceFrameCount, _traceFile);
+
     // Corrade Resources
     //Debug{} << _resource.get("ShadowCaster.vert");
     
-    // Viewer :
-    /* - Phong Shader instances */
-    _resourceManager
-        .set("color", new Shaders::Phong)
-        .set("texture", new Shaders::Phong{Shaders::Phong::Flag::DiffuseTexture});
-
+    /* Imported objects use the shadow receiver shaders of _shadows, there
+       are no separate Phong shaders */
 
     /* Fallback material, texture and mesh in case the data are not present or
        cannot be loaded */
@@ -44,26 +89,101 @@ _shadows{&_scene}
         .setFallback(new Texture2D)
         .setFallback(new Mesh);
 
-    Debug{} << MAGNUM_PLUGINS_IMPORTER_DIR;
-    /* Load scene importer plugin */
-    PluginManager::Manager<Trade::AbstractImporter> manager{MAGNUM_PLUGINS_IMPORTER_DIR};
-    std::unique_ptr<Trade::AbstractImporter> importer = manager.loadAndInstantiate("AnySceneImporter");
-    if(!importer) std::exit(1);
+    TextureCompression textureCompression = TextureCompression::None;
+    if(args.value("texture-compression") == "bc1") {
+        if(Context::current().isExtensionSupported<Extensions::GL::EXT::texture_compression_s3tc>())
+            textureCompression = TextureCompression::Bc1;
+        else Warning{} << "BC1 texture compression is not supported, cooking uncompressed textures";
+    } else if(args.value("texture-compression") != "none")
+        Warning{} << "Unknown texture compression" << args.value("texture-compression") << Debug::nospace << ", cooking uncompressed textures";
+    _textureCache.reset(new TextureCache{args.value("texture-cache"), textureCompression, _backgroundPool});
+    _meshOptimizer = MeshOptimizer{MeshOptimizer::parseOptimizations(args.value("mesh-optimizations")), args.isSet("mesh-report")};
+    _shadows.setShadowLodThreshold(args.value<Float>("shadow-lod-threshold"));
+    if(args.isSet("depth-pre-pass")) _shadows.setDepthPrePass(true);
+    if(args.isSet("stable-cascades")) _shadows.setStableCascades(true);
+    _shadows.setThreadPool(&_threadPool);
+    _shadows.setShadowFiltering(Shadows::parseShadowFiltering(args.value("shadow-filter")));
+    _shadows.setShadowSoftness(args.value<UnsignedInt>("shadow-softness"));
+    _shadows.setShadowDepthFormat(Shadows::parseShadowDepthFormat(args.value("shadow-depth-format")));
+
+    _loadingSection = _profiler.addSection("loading");
+    _updateSection = _profiler.addSection("update");
+    _lightBinningSection = _profiler.addSection("light binning");
+    _shadows.setProfiler(_profiler);
+    _mainPassSection = _profiler.addSection("main pass");
+    _debugLinesSection = _profiler.addSection("debug lines");
+    _upscaleSection = _profiler.addSection("upscale");
+    _dynamicResolution.setWindowSize(defaultFramebuffer.viewport().size());
+    _dynamicResolution.setScaleRange(args.value<Float>("min-render-scale"), 1.0f);
+    _dynamicResolution.setSharpness(args.value<Float>("sharpness"));
+    if(args.value<Float>("dynamic-resolution") > 0.0f) {
+        _dynamicResolution.setTargetGpuTime(args.value<Float>("dynamic-resolution"));
+        _dynamicResolution.setEnabled(true);
+        _shadows.setFramebuffer(_dynamicResolution.framebuffer());
+    }
+    _resourceBudget.setBudget(args.value<UnsignedInt>("memory-budget")*std::size_t{1024*1024});
+    _shadows.setResourceBudget(&_resourceBudget);
+    if(!args.value("capture").empty()) {
+        _capture.setPrefix(args.value("capture"));
+        _capturing = true;
+    }
+    if(args.isSet("capture-shadow-maps")) _capture.setShadowLight(_shadows.getShadowLight());
 
     //std::string fileName = "scene2.blend";
     std::string fileName = "scene2.ogex";
     //auto fileName = args.value("file");
-    Debug{} << "Opening file" << fileName;
 
-    /* Load file */
-    if(!importer->openFile(fileName)){
-        Error{} << "Failed to open file" << fileName;
-        std::exit(4);
+    /* Use the compiled scene if it's up to date and all its textures are in
+       the cache with current compression, otherwise go through the
+       importer */
+    const bool useSceneCache = !args.isSet("no-scene-cache");
+    const std::string sceneCacheFile = args.value("scene-cache").empty() ? fileName + ".mscn" : args.value("scene-cache");
+    CompiledScene compiledScene;
+    if(useSceneCache && (compiledScene = CompiledScene::open(fileName, sceneCacheFile, _meshOptimizer.optimizations()))) {
+        for(const CompiledSceneTexture& texture: compiledScene.textures()) {
+            if(texture.valid && !_textureCache->open(texture.key)) {
+                compiledScene = CompiledScene{};
+                break;
+            }
+        }
+    }
+
+    Debug{} << MAGNUM_PLUGINS_IMPORTER_DIR;
+    /* Load scene importer plugin. The manager has to outlive the scene
+       loader, which keeps using the importer after the constructor exits. */
+    std::unique_ptr<Trade::AbstractImporter> importer;
+    if(!compiledScene) {
+        _importerManager.reset(new PluginManager::Manager<Trade::AbstractImporter>{MAGNUM_PLUGINS_IMPORTER_DIR});
+        importer = _importerManager->loadAndInstantiate("AnySceneImporter");
+        if(!importer) std::exit(1);
+
+        Debug{} << "Opening file" << fileName;
+
+        /* Load file */
+        if(!importer->openFile(fileName)){
+            Error{} << "Failed to open file" << fileName;
+            std::exit(4);
+        }
+        Debug{} << "Opened file" << fileName;
+
+        /* Compile the scene for next time. If that fails, continue with the
+           importer. */
+        if(useSceneCache) {
+            const auto compileStart = std::chrono::steady_clock::now();
+            if(CompiledScene::compile(*importer, *_textureCache, _meshOptimizer, fileName, sceneCacheFile))
+                compiledScene = CompiledScene::open(fileName, sceneCacheFile, _meshOptimizer.optimizations());
+            Debug{} << "Scene compiled in" << std::chrono::duration<Float, std::milli>{std::chrono::steady_clock::now() - compileStart}.count() << "ms";
+        }
+    }
+
+    if(compiledScene) {
+        importer = nullptr;
+        Debug{} << "Using compiled scene" << sceneCacheFile << "opened after" << std::chrono::duration<Float, std::milli>{std::chrono::steady_clock::now() - _startTime}.count() << "ms";
     }
-    Debug{} << "Opened file" << fileName;
 
     /* Load all materials */
-    for(UnsignedInt i = 0; i != importer->materialCount(); ++i) {
+    PROFILE_ZONE("ShadowsExample scene setup");
+    if(importer) for(UnsignedInt i = 0; i != importer->materialCount(); ++i) {
         Debug{} << "Importing material" << i << importer->materialName(i);
 
         std::unique_ptr<Trade::AbstractMaterialData> materialData = importer->material(i);
@@ -76,70 +196,6 @@ _shadows{&_scene}
         _resourceManager.set(ResourceKey{i}, static_cast<Trade::PhongMaterialData*>(materialData.release()));
     }
 
-    /* Load all textures */
-    for(UnsignedInt i = 0; i != importer->textureCount(); ++i) {
-        Debug{} << "Importing texture" << i << importer->textureName(i);
-
-        std::optional<Trade::TextureData> textureData = importer->texture(i);
-        if(!textureData || textureData->type() != Trade::TextureData::Type::Texture2D) {
-            Warning{} << "Cannot load texture, skipping";
-            continue;
-        }
-
-        Debug{} << "Importing image" << textureData->image() << importer->image2DName(textureData->image());
-    
-        const std::string imageName = "textures/viewer.png";
-        Debug{} << Utility::Directory::fileExists(imageName);
-        //importer->openFile(imageName);
-
-        std::optional<Trade::ImageData2D> imageData = importer->image2D(textureData->image());
-
-        if(!imageData || (imageData->format() != PixelFormat::RGB
-#ifndef MAGNUM_TARGET_GLES
-                          && imageData->format() != PixelFormat::BGR
-#endif
-                          ))
-        {
-            Warning{} << "Cannot load texture image, skipping";
-            continue;
-        }
-
-        /* Configure texture */
-        auto texture = new Texture2D;
-        texture->setMagnificationFilter(textureData->magnificationFilter())
-            .setMinificationFilter(textureData->minificationFilter(), textureData->mipmapFilter())
-            .setWrapping(textureData->wrapping().xy())
-            .setStorage(1, TextureFormat::RGB8, imageData->size())
-            .setSubImage(0, {}, *imageData)
-            .generateMipmap();
-
-        /* Save it */
-        _resourceManager.set(ResourceKey{i}, texture, ResourceDataState::Final, ResourcePolicy::Manual);
-    }
-
-    /* Load all meshes */
-    for(UnsignedInt i = 0; i != importer->mesh3DCount(); ++i) {
-        Debug{} << "Importing mesh" << i << importer->mesh3DName(i);
-
-        std::optional<Trade::MeshData3D> meshData = importer->mesh3D(i);
-        if(!meshData || !meshData->hasNormals() || meshData->primitive() != MeshPrimitive::Triangles) {
-            Warning{} << "Cannot load mesh, skipping";
-            continue;
-        }
-
-        /* Compile the mesh */
-        Mesh mesh{NoCreate};
-        std::unique_ptr<Buffer> buffer, indexBuffer;
-        std::tie(mesh, buffer, indexBuffer) = MeshTools::compile(*meshData, BufferUsage::StaticDraw);
-
-        /* Save things */
-        _resourceManager.set(ResourceKey{i}, new Mesh{std::move(mesh)}, ResourceDataState::Final, ResourcePolicy::Manual);
-        _resourceManager.set(std::to_string(i) + "-vertices", buffer.release(), ResourceDataState::Final, ResourcePolicy::Manual);
-        if(indexBuffer)
-            _resourceManager.set(std::to_string(i) + "-indices", indexBuffer.release(), ResourceDataState::Final, ResourcePolicy::Manual);
-    }
-
-
     Renderer::enable(Renderer::Feature::DepthTest);
     Renderer::enable(Renderer::Feature::FaceCulling);
 
@@ -149,10 +205,27 @@ _shadows{&_scene}
 
 
 
-    Object3D* ground = createSceneObject(_models[0], false, true);
-    ground->setTransformation(Matrix4::scaling({100,1,100}));
+    /* A streamed world replaces the fixed ground and objects, its chunks
+       come in around the camera once it moves */
+    if(!args.value("world").empty()) {
+        const Float chunkSize = args.value<Float>("chunk-size");
+        const std::size_t generated = WorldStreamer::generate(args.value("world"), args.value<Int>("world-size"),
+            chunkSize, args.value<UnsignedInt>("chunk-objects"), UnsignedInt(_models.size()), 0);
+        if(generated) Debug{} << "Generated" << generated << "world chunks in" << args.value("world");
+
+        _worldStreamer.reset(new WorldStreamer{_scene, _shadows, _models});
+        _worldStreamer->setDirectory(args.value("world"));
+        _worldStreamer->setChunkSize(chunkSize);
+        _worldStreamer->setLoadRadius(args.value<Float>("load-radius"));
+        _worldStreamer->setUnloadHysteresis(args.value<Float>("unload-hysteresis"));
+        _worldStreamer->setCreationBudget(args.value<Float>("chunk-budget"));
+        _worldStreamer->start();
+    } else {
+        Object3D* ground = createSceneObject(_models[0], false, true);
+        ground->setTransformation(Matrix4::scaling({100,1,100}));
+    }
 
-    for(std::size_t i = 0; i != 200; ++i) {
+    if(!_worldStreamer) for(std::size_t i = 0; i != 200; ++i) {
         Model& model = _models[std::rand()%_models.size()];
         Object3D* object = createSceneObject(model, true, true);
         object->setTransformation(Matrix4::translation({
@@ -169,6 +242,9 @@ _shadows{&_scene}
 */
     }
 
+    addPointLights(args.value<UnsignedInt>("point-lights"));
+    _shadows.setLights(&_lights);
+
     /* Default object, parent of all (for manipulation) */
     //_root = new Object3D{&_scene};
     _root = new CachingObject{&_scene};
@@ -180,7 +256,10 @@ _shadows{&_scene}
     auto comp = e.get_component<CachingObject*>();
     comp->setTransformation(Matrix4::scaling({2,2,2}) + Matrix4::translation({0,10,0}));
     /* Load the scene */
-    if(importer->defaultScene() != -1) {
+    if(compiledScene) {
+        addCompiledScene(compiledScene);
+
+    } else if(importer->defaultScene() != -1) {
         Debug{} << "Adding default scene" << importer->sceneName(importer->defaultScene());
 
         std::optional<Trade::SceneData> sceneData = importer->scene(importer->defaultScene());
@@ -195,25 +274,52 @@ _shadows{&_scene}
 
         /* The format has no scene support, display just the first loaded mesh with
            default material and be done with it */
-    } else if(_resourceManager.state<Mesh>(ResourceKey{0}) == ResourceState::Final)
-        new ColoredObject{ResourceKey{(size_t)0}, ResourceKey((size_t)-1), _root, &_drawables};
+    } else if(importer->mesh3DCount()) {
+        auto object = new ColoredObject{ResourceKey{(size_t)0}, ResourceKey((size_t)-1), _root, &_drawables, _resourceBudget, _shadows.receiverShader()};
+        _shadows.addCaster(object, ResourceKey{(size_t)0},
+            _resourceManager.get<Mesh>(ResourceKey{std::string{"0-shadow"}}),
+            _resourceManager.get<ShadowCasterLods>(ResourceKey{std::string{"0-shadow-lods"}}));
+    }
 
-    /* Materials were consumed by objects and they are not needed anymore. Also
-       free all texture/mesh data that weren't referenced by any object. */
+    /* Materials were consumed by objects and they are not needed anymore */
     _resourceManager.setFallback<Trade::PhongMaterialData>(nullptr)
-        .clear<Trade::PhongMaterialData>()
-        .free<Texture2D>()
-        .free<Mesh>();
+        .clear<Trade::PhongMaterialData>();
+
+    /* Textures and meshes are decoded in the background and uploaded a bit
+       every frame, the objects use the fallbacks until then */
+    if(compiledScene)
+        _sceneLoader.reset(new AsyncSceneLoader{_resourceManager, std::move(compiledScene), *_textureCache, _backgroundPool});
+    else
+        _sceneLoader.reset(new AsyncSceneLoader{_resourceManager, std::move(importer), fileName, *_textureCache, _backgroundPool, _meshOptimizer});
+    _sceneLoader->setResourceBudget(&_resourceBudget);
+    _sceneLoader->start();
+
+    /* Evicted textures and meshes come back through the scene loader */
+    _resourceManager
+        .setLoader(new SceneResourceLoader<Texture2D>{_resourceBudget, *_sceneLoader, ResidentType::Texture})
+        .setLoader(new SceneResourceLoader<Mesh>{_resourceBudget, *_sceneLoader, ResidentType::Mesh});
+
+    /* Offline cooking, run the loader to the end and exit */
+    if(args.isSet("cook-textures")) {
+        while(!_sceneLoader->isFinished()) {
+            if(!_sceneLoader->processUploads())
+                std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        }
+        Debug{} << "Cooked" << _sceneLoader->uploadedTextureCount() << "textures into" << args.value("texture-cache") << "in" << std::chrono::duration<Float, std::milli>{std::chrono::steady_clock::now() - _startTime}.count() << "ms";
+        std::exit(0);
+    }
 
 
     _mainCamera.setProjectionMatrix(Matrix4::perspectiveProjection(35.0_degf,
                                                                    Vector2{defaultFramebuffer.viewport().size()}.aspectRatio(),
-                                                                   MainCameraNear, MainCameraFar));
+                                                                   MainCameraNear, MainCameraFar))
+        .setViewport(defaultFramebuffer.viewport().size());
     _mainCameraObject.setTransformation(Matrix4::translation(Vector3::yAxis(3.0f)));
 
     _debugCamera.setProjectionMatrix(Matrix4::perspectiveProjection(35.0_degf,
                                                                     Vector2{defaultFramebuffer.viewport().size()}.aspectRatio(),
-                                                                    MainCameraNear/4.0f, MainCameraFar*4.0f));
+                                                                    MainCameraNear/4.0f, MainCameraFar*4.0f))
+        .setViewport(defaultFramebuffer.viewport().size());
     _debugCameraObject.setTransformation(Matrix4::lookAt(
                                              {100.0f, 50.0f, 0.0f}, Vector3::zAxis(-30.0f), Vector3::yAxis()));
 
@@ -221,9 +327,24 @@ _shadows{&_scene}
     _activeCameraObject = &_mainCameraObject;
 
     _shadows.setShadowLightTarget(_activeCamera, _activeCameraObject->transformation()[2].xyz());
+
+    /* Hand all entities over to the simulation thread */
+    {
+        PROFILE_ZONE("entity for_each");
+        _entityManager.for_each<CachingObject*>([this] (auto ent_, auto &object) {
+                _simulation.addBody(object->transformation());
+                _simulatedObjects.push_back(object);
+            });
+    }
+    _simulatedTransformations.reserve(_simulatedObjects.size());
+    _simulation.start();
+
+    /* Added after the hand-off, so they stay out of the simulation */
+    addSoundEmitters(args.value<UnsignedInt>("sound-emitters"), args.value<UnsignedInt>("voices"), args.value<Float>("audio-max-distance"));
 }
 
 void ShadowsExample::addObject(Trade::AbstractImporter& importer, Object3D* parent, UnsignedInt i) {
+    PROFILE_ZONE("ShadowsExample::addObject");
     Debug{} << "Importing object" << i << importer.object3DName(i);
 
     Object3D* object = nullptr;
@@ -234,54 +355,99 @@ void ShadowsExample::addObject(Trade::AbstractImporter& importer, Object3D* pare
     }
 
     /* Only meshes for now */
-    if(objectData->instanceType() == Trade::ObjectInstanceType3D::Mesh) {
-        Int materialId = static_cast<Trade::MeshObjectData3D*>(objectData.get())->material();
-
-        /* Decide what object to add based on material type */
-        auto materialData = _resourceManager.get<Trade::PhongMaterialData>(ResourceKey(materialId));
+    if(objectData->instanceType() == Trade::ObjectInstanceType3D::Mesh)
+        object = addMeshObject(parent, objectData->instance(),
+                               static_cast<Trade::MeshObjectData3D*>(objectData.get())->material());
 
-        /* Color-only material */
-        if(!materialData->flags()) {
-            object = new ColoredObject(ResourceKey(objectData->instance()),
-                                       ResourceKey(materialId),
-                                       parent, &_drawables);
+    /* Create parent object for children, if it doesn't already exist */
+    if(!object && !objectData->children().empty()) object = new Object3D(parent);
+    if(object) object->setTransformation(objectData->transformation());
 
-            object->setTransformation(objectData->transformation());
+    /* Recursively add children */
+    for(std::size_t id: objectData->children()) {
+        addObject(importer, object, id);
+    }
+}
 
+Object3D* ShadowsExample::addMeshObject(Object3D* parent, const UnsignedInt meshId, const Int materialId) {
+    /* Decide what object to add based on material type */
+    auto materialData = _resourceManager.get<Trade::PhongMaterialData>(ResourceKey(materialId));
+
+    Object3D* object;
+    /* Color-only material */
+    if(!materialData->flags())
+        object = new ColoredObject(ResourceKey(meshId),
+                                   ResourceKey(materialId),
+                                   parent, &_drawables, _resourceBudget,
+                                   _shadows.receiverShader());
+
+    /* Diffuse texture material */
+    else if(materialData->flags() == Trade::PhongMaterialData::Flag::DiffuseTexture)
+        object = new TexturedObject(ResourceKey(meshId),
+                                    ResourceKey(materialId),
+                                    ResourceKey(materialData->diffuseTexture()),
+                                    parent, &_drawables, _resourceBudget,
+                                    _shadows.receiverShader(ShadowReceiverShader::Flag::DiffuseTexture));
+
+    /* No other material types are supported yet */
+    else {
+        Warning() << "Texture combination of material" << materialId
+                  << "is not supported, using default material instead";
+        object = new ColoredObject(ResourceKey(meshId),
+                                   ResourceKey((size_t)-1),
+                                   parent, &_drawables, _resourceBudget,
+                                   _shadows.receiverShader());
+    }
 
-            /* Diffuse texture material */
-        } else if(materialData->flags() == Trade::PhongMaterialData::Flag::DiffuseTexture) {
-            object = new TexturedObject(ResourceKey(objectData->instance()),
-                                        ResourceKey(materialId),
-                                        ResourceKey(materialData->diffuseTexture()),
-                                        parent, &_drawables);
-            object->setTransformation(objectData->transformation());
+    /* Every imported mesh casts shadows too. The loader uploads a
+       position-only copy and the bounding sphere comes with its levels. */
+    const std::string prefix = std::to_string(meshId);
+    _shadows.addCaster(object, ResourceKey(meshId),
+        _resourceManager.get<Mesh>(ResourceKey{prefix + "-shadow"}),
+        _resourceManager.get<ShadowCasterLods>(ResourceKey{prefix + "-shadow-lods"}));
+    return object;
+}
 
-            /* No other material types are supported yet */
+void ShadowsExample::addCompiledScene(const CompiledScene& scene) {
+    PROFILE_ZONE("ShadowsExample::addCompiledScene");
+    const auto materials = scene.materials();
+    for(UnsignedInt i = 0; i != materials.size(); ++i) {
+        const CompiledSceneMaterial& record = materials[i];
+        if(!(record.flags & CompiledSceneMaterial::Valid)) continue;
+
+        /* Unsupported combinations get the default material, same as
+           addMeshObject() does */
+        if(record.flags & CompiledSceneMaterial::Unsupported) continue;
+
+        Trade::PhongMaterialData* material;
+        if(record.flags & CompiledSceneMaterial::DiffuseTexture) {
+            material = new Trade::PhongMaterialData{Trade::PhongMaterialData::Flag::DiffuseTexture, record.shininess};
+            material->diffuseTexture() = record.diffuseTexture;
         } else {
-            Warning() << "Texture combination of material"
-                      << materialId << importer.materialName(materialId)
-                      << "is not supported, using default material instead";
-
-            object = new ColoredObject(ResourceKey(objectData->instance()),
-                                       ResourceKey((size_t)-1),
-                                       parent, &_drawables);
-            object->setTransformation(objectData->transformation());
+            material = new Trade::PhongMaterialData{{}, record.shininess};
+            material->diffuseColor() = record.diffuseColor.rgb();
         }
+        material->ambientColor() = record.ambientColor.rgb();
+        material->specularColor() = record.specularColor.rgb();
+        _resourceManager.set(ResourceKey{i}, material);
     }
 
-    /* Create parent object for children, if it doesn't already exist */
-    if(!object && !objectData->children().empty()) object = new Object3D(parent);
-
-    /* Recursively add children */
-    for(std::size_t id: objectData->children()) {
-        addObject(importer, object, id);
+    /* Parents always come before their children, so the hierarchy is built
+       in a single pass */
+    const auto nodes = scene.nodes();
+    std::vector<Object3D*> objects(nodes.size());
+    for(std::size_t i = 0; i != nodes.size(); ++i) {
+        const CompiledSceneNode& node = nodes[i];
+        Object3D* parent = node.parent == -1 ? _root : objects[node.parent];
+        objects[i] = node.mesh == -1 ? new Object3D(parent) :
+            addMeshObject(parent, node.mesh, node.material);
+        objects[i]->setTransformation(node.transformation);
     }
 }
 
-ColoredObject::ColoredObject(ResourceKey meshId, ResourceKey materialId, Object3D* parent, SceneGraph::DrawableGroup3D* group):
-        Object3D{parent}, SceneGraph::Drawable3D{*this, group},
-_mesh{ViewerResourceManager::instance().get<Mesh>(meshId)}, _shader{ViewerResourceManager::instance().get<Shaders::Phong>("color")}
+ColoredObject::ColoredObject(ResourceKey meshId, ResourceKey materialId, Object3D* parent, SceneGraph::DrawableGroup3D* group, ResourceBudget& budget, ShadowReceiverShader& shader):
+        Object3D{parent}, SceneGraph::Drawable3D{*this, group}, _budget(budget),
+_mesh{ViewerResourceManager::instance().get<Mesh>(meshId)}, _shader(shader)
         {
             auto material = ViewerResourceManager::instance().get<Trade::PhongMaterialData>(materialId);
             _ambientColor = material->ambientColor();
@@ -290,9 +456,9 @@ _mesh{ViewerResourceManager::instance().get<Mesh>(meshId)}, _shader{ViewerResour
             _shininess = material->shininess();
         }
 
-TexturedObject::TexturedObject(ResourceKey meshId, ResourceKey materialId, ResourceKey diffuseTextureId, Object3D* parent, SceneGraph::DrawableGroup3D* group):
-        Object3D{parent}, SceneGraph::Drawable3D{*this, group},
-                                _mesh{ViewerResourceManager::instance().get<Mesh>(meshId)}, _diffuseTexture{ViewerResourceManager::instance().get<Texture2D>(diffuseTextureId)}, _shader{ViewerResourceManager::instance().get<Shaders::Phong>("texture")}
+TexturedObject::TexturedObject(ResourceKey meshId, ResourceKey materialId, ResourceKey diffuseTextureId, Object3D* parent, SceneGraph::DrawableGroup3D* group, ResourceBudget& budget, ShadowReceiverShader& shader):
+        Object3D{parent}, SceneGraph::Drawable3D{*this, group}, _budget(budget),
+                                _mesh{ViewerResourceManager::instance().get<Mesh>(meshId)}, _diffuseTexture{ViewerResourceManager::instance().get<Texture2D>(diffuseTextureId)}, _shader(shader)
         {
             auto material = ViewerResourceManager::instance().get<Trade::PhongMaterialData>(materialId);
             _ambientColor = material->ambientColor();
@@ -300,30 +466,36 @@ TexturedObject::TexturedObject(ResourceKey meshId, ResourceKey materialId, Resou
             _shininess = material->shininess();
         }
 
-void ColoredObject::draw(const Matrix4& transformationMatrix, SceneGraph::Camera3D& camera) {
-    _shader->setAmbientColor(_ambientColor)
+void ColoredObject::draw(const Matrix4&, SceneGraph::Camera3D& camera) {
+    /* Shadow maps, light direction and point lights were set by
+       Shadows::draw(). The transformation is multiplied the same way as in
+       its depth pre-pass, the one from the scene graph is associated
+       differently and could be off by a bit. */
+    const Matrix4 transformation = absoluteTransformationMatrix();
+    _shader.setAmbientColor(_ambientColor)
         .setDiffuseColor(_diffuseColor)
         .setSpecularColor(_specularColor)
         .setShininess(_shininess)
-        .setLightPosition(camera.cameraMatrix().transformPoint({-3.0f, 10.0f, 10.0f}))
-        .setTransformationMatrix(transformationMatrix)
-        .setNormalMatrix(transformationMatrix.rotation())
-        .setProjectionMatrix(camera.projectionMatrix());
+        .setTransformationProjectionMatrix(camera.projectionMatrix()*(camera.cameraMatrix()*transformation))
+        .setModelMatrix(transformation);
 
-    _mesh->draw(*_shader);
+    _budget.use(ResidentType::Mesh, _mesh.key());
+    _mesh->draw(_shader);
 }
 
-void TexturedObject::draw(const Matrix4& transformationMatrix, SceneGraph::Camera3D& camera) {
-    _shader->setAmbientColor(_ambientColor)
+void TexturedObject::draw(const Matrix4&, SceneGraph::Camera3D& camera) {
+    /* Same as ColoredObject::draw() */
+    const Matrix4 transformation = absoluteTransformationMatrix();
+    _shader.setAmbientColor(_ambientColor)
         .setDiffuseTexture(*_diffuseTexture)
         .setSpecularColor(_specularColor)
         .setShininess(_shininess)
-        .setLightPosition(camera.cameraMatrix().transformPoint({-3.0f, 10.0f, 10.0f}))
-        .setTransformationMatrix(transformationMatrix)
-        .setNormalMatrix(transformationMatrix.rotation())
-        .setProjectionMatrix(camera.projectionMatrix());
+        .setTransformationProjectionMatrix(camera.projectionMatrix()*(camera.cameraMatrix()*transformation))
+        .setModelMatrix(transformation);
 
-    _mesh->draw(*_shader);
+    _budget.use(ResidentType::Texture, _diffuseTexture.key());
+    _budget.use(ResidentType::Mesh, _mesh.key());
+    _mesh->draw(_shader);
 }
 
 
@@ -344,44 +516,48 @@ entity_t ShadowsExample::createEnemy(CachingObject* object) {
     return _entityManager.create_entity(object);
 }
 
-void ShadowsExample::addModel(const Trade::MeshData3D& meshData3D) {
+void ShadowsExample::addModel(Trade::MeshData3D meshData3D) {
+    _meshOptimizer.optimize(meshData3D, "primitive " + std::to_string(_models.size()));
+
     _models.emplace_back();
-    Model& model = _models.back();
+    setupModel(_models.back(), meshData3D);
+}
 
-    model.vertexBuffer.setData(MeshTools::interleave(meshData3D.positions(0), meshData3D.normals(0)),
-                               BufferUsage::StaticDraw);
+void ShadowsExample::processSceneLoading() {
+    if(!_sceneLoader) return;
 
-    Float maxMagnitudeSquared = 0.0f;
-    for(Vector3 position: meshData3D.positions(0)) {
-        Float magnitudeSquared = position.dot();
+    /* The loader stays around after the initial load to bring back
+       evicted data */
+    _sceneLoader->processUploads();
+    if(_sceneLoaded || !_sceneLoader->isFinished()) return;
 
-        if(magnitudeSquared > maxMagnitudeSquared) {
-            maxMagnitudeSquared = magnitudeSquared;
-        }
-    }
-    model.radius = std::sqrt(maxMagnitudeSquared);
-
-    Containers::Array<char> indexData;
-    Mesh::IndexType indexType;
-    UnsignedInt indexStart, indexEnd;
-    std::tie(indexData, indexType, indexStart, indexEnd) = MeshTools::compressIndices(meshData3D.indices());
-    model.indexBuffer.setData(indexData, BufferUsage::StaticDraw);
-
-    model.mesh.setPrimitive(meshData3D.primitive())
-        .setCount(meshData3D.indices().size())
-        .addVertexBuffer(model.vertexBuffer, 0, Shaders::Phong::Position{}, Shaders::Phong::Normal{})
-        .setIndexBuffer(model.indexBuffer, 0, indexType, indexStart, indexEnd);
+    _sceneLoaded = true;
+    Debug{} << "Scene loaded in" << std::chrono::duration<Float, std::milli>{std::chrono::steady_clock::now() - _startTime}.count() << "ms," << _sceneLoader->uploadedTextureCount() << "textures and" << _sceneLoader->uploadedMeshCount() << "meshes";
+
+    /* Free all texture/mesh data that weren't referenced by any object */
+    _resourceManager.free<Texture2D>()
+        .free<Mesh>();
+    _resourceBudget.refresh();
 }
 
 void ShadowsExample::drawEvent() {
+    PROFILE_FRAME();
+    PROFILE_ZONE("drawEvent");
+    _profiler.beginFrame();
+
+    _profiler.begin(_loadingSection);
+    processSceneLoading();
+    if(_worldStreamer) _worldStreamer->update(_mainCameraObject.absoluteTransformation().translation());
+    _resourceBudget.update();
+    _profiler.end(_loadingSection);
+
+    _profiler.begin(_updateSection);
+
     if(!_mainCameraVelocity.isZero()) {
         Matrix4 transform = _activeCameraObject->transformation();
         transform.translation() += transform.rotation()*_mainCameraVelocity*0.3f;
 
-        _entityManager.for_each<CachingObject*>([transform] (auto ent_, auto &object) {
-                Matrix4 objtrans = object->transformation();
-                object->setTransformation(Matrix4::lookAt(objtrans.translation(), transform.translation(), Vector3::zAxis()));
-            });
+        _simulation.push({SimulationCommand::Type::Target, transform.translation()});
 
         _activeCameraObject->setTransformation(transform);
         _shadows.setShadowLightTarget(_activeCamera, transform[2].xyz());
@@ -394,28 +570,157 @@ void ShadowsExample::drawEvent() {
         redraw();
     }
 
-_entityManager.for_each<CachingObject*>([] (auto ent_, auto &object) {
-                Matrix4 objtrans = object->transformation();
-                objtrans.translation() += objtrans.rotation()*Vector3::zAxis(-0.2f)*0.3f;
-                object->setTransformation(objtrans);
-                object->setClean();
-    });
+    applySimulation();
+    animatePointLights();
+    updateSoundEmitters();
+    _profiler.end(_updateSection);
 
     Renderer::setClearColor({0.1f, 0.1f, 0.4f, 1.0f});
-    defaultFramebuffer.clear(FramebufferClear::Color|FramebufferClear::Depth);
+    if(_dynamicResolution.isEnabled()) {
+        _dynamicResolution.update(_profiler);
+        _activeCamera->setViewport(_dynamicResolution.renderSize());
+        _dynamicResolution.framebuffer().clear(FramebufferClear::Color|FramebufferClear::Depth);
+    } else defaultFramebuffer.clear(FramebufferClear::Color|FramebufferClear::Depth);
+
+    /* Binned for the camera that draws the receivers, so only after its
+       viewport is the render size of this frame */
+    _profiler.begin(_lightBinningSection);
+    _lights.update(*_activeCamera, &_threadPool);
+    _profiler.end(_lightBinningSection);
+
+    {
+        PROFILE_ZONE("Shadows::draw");
+        _shadows.draw(_activeCamera, _activeCameraObject->transformation()[2].xyz());
+    }
 
-    _shadows.draw(_activeCamera, _activeCameraObject->transformation()[2].xyz()); 
-    _activeCamera->draw(_drawables);
+    _profiler.begin(_mainPassSection);
+    {
+        PROFILE_ZONE("main pass");
+        _activeCamera->draw(_drawables);
+        _shadows.endDepthPrePass();
+    }
+    _profiler.end(_mainPassSection, _drawables.size());
 
+    _profiler.begin(_debugLinesSection);
     renderDebugLines();
+    _profiler.end(_debugLinesSection, _activeCamera == &_debugCamera || _shadows.lodDebug() ? 1 : 0);
+
+    if(_dynamicResolution.isEnabled()) {
+        _profiler.begin(_upscaleSection);
+        _dynamicResolution.upscale();
+        _profiler.end(_upscaleSection, 1);
+    }
+
+    /* Without the overlay, it's not part of the frame */
+    if(_capturing) _capture.capture(defaultFramebuffer, defaultFramebuffer.viewport(), _captureFrame++);
+    else _capture.update();
+
+    if(_overlay) _overlay->draw(_profiler);
 
     swapBuffers();
+    _profiler.endFrame();
+
+    if(!_firstFrameDrawn) {
+        _firstFrameDrawn = true;
+        Debug{} << "First frame after" << std::chrono::duration<Float, std::milli>{std::chrono::steady_clock::now() - _startTime}.count() << "ms";
+    }
+
+    /* The simulation keeps running on its own and the scene may still be
+       loading, keep showing both */
+    if(!_simulatedObjects.empty() || !_pointLightOrigins.empty() || (_sceneLoader && !_sceneLoader->isFinished()) || (_overlay && _overlay->isVisible())) redraw();
+}
+
+void ShadowsExample::applySimulation() {
+    PROFILE_ZONE("ShadowsExample::applySimulation");
+    if(!_simulation.interpolate(Simulation::Clock::now(), _simulatedTransformations))
+        return;
+
+    for(std::size_t i = 0; i != _simulatedObjects.size(); ++i) {
+        _simulatedObjects[i]->setTransformation(_simulatedTransformations[i]);
+        _simulatedObjects[i]->setClean();
+    }
 }
 
+void ShadowsExample::addPointLights(const UnsignedInt count) {
+    /* Scattered over the ground of the default scene, low enough to light
+       it */
+    _lights.lights().reserve(count);
+    _pointLightOrigins.reserve(count);
+    for(UnsignedInt i = 0; i != count; ++i) {
+        const Vector3 origin{std::rand()*100.0f/RAND_MAX - 50.0f,
+                             0.5f + std::rand()*2.5f/RAND_MAX,
+                             std::rand()*100.0f/RAND_MAX - 50.0f};
+        const Float radius = 3.0f + std::rand()*5.0f/RAND_MAX;
+        const Color3 color = Color3::fromHsv(Deg(std::rand()*360.0f/RAND_MAX), 0.75f, 1.0f)*4.0f;
+        _pointLightOrigins.push_back(origin);
+        _lights.lights().push_back({origin, radius, color});
+    }
+}
+
+void ShadowsExample::addSoundEmitters(const UnsignedInt count, const UnsignedInt voiceCount, const Float maxDistance) {
+    if(!count) return;
+
+    _audioContext.reset(new Audio::Context);
+    _voiceManager.reset(new VoiceManager{voiceCount});
+    VoiceRanking::DistanceModel distanceModel;
+    distanceModel.maxDistance = maxDistance;
+    _voiceManager->setDistanceModel(distanceModel);
+
+    /* A few tones, so emitters taking over a voice can be told apart */
+    constexpr const UnsignedInt SampleRate = 22050;
+    const Float frequencies[]{220.0f, 277.2f, 329.6f, 440.0f};
+    UnsignedInt sounds[4];
+    for(std::size_t i = 0; i != 4; ++i) {
+        const std::vector<Short> samples = VoiceManager::tone(frequencies[i], 1.0f, SampleRate);
+        sounds[i] = _voiceManager->addSound({samples.data(), samples.size()}, SampleRate);
+    }
+
+    /* Scattered over the ground of the default scene like the point
+       lights, with a random priority */
+    for(UnsignedInt i = 0; i != count; ++i) {
+        auto* object = new CachingObject{&_scene};
+        object->setTransformation(Matrix4::translation({std::rand()*100.0f/RAND_MAX - 50.0f,
+                                                        std::rand()*5.0f/RAND_MAX,
+                                                        std::rand()*100.0f/RAND_MAX - 50.0f}));
+        const UnsignedInt emitter = _voiceManager->addEmitter(sounds[i % 4], object->transformation().translation(),
+            1.0f, 0.5f + std::rand()*1.5f/RAND_MAX);
+        _entityManager.create_entity(object, SoundEmitter{emitter});
+    }
+}
+
+void ShadowsExample::updateSoundEmitters() {
+    if(!_voiceManager) return;
+
+    PROFILE_ZONE("ShadowsExample::updateSoundEmitters");
+    _entityManager.for_each<CachingObject*, SoundEmitter>([this] (auto ent_, auto& object, auto& emitter) {
+            _voiceManager->setPosition(emitter.id, object->transformation().translation());
+        });
+    _voiceManager->update(_mainCameraObject.absoluteTransformation());
+}
+
+void ShadowsExample::animatePointLights() {
+    PROFILE_ZONE("ShadowsExample::animatePointLights");
+    const Float time = std::chrono::duration<Float>{std::chrono::steady_clock::now() - _startTime}.count();
+    std::vector<PointLight>& lights = _lights.lights();
+    for(std::size_t i = 0; i != lights.size(); ++i) {
+        /* Every light has its own phase and direction */
+        const Float angle = time*(i % 2 ? 0.5f : -0.5f) + i*0.7f;
+        lights[i].position = _pointLightOrigins[i] + Vector3{2.0f*std::cos(angle), 0.0f, 2.0f*std::sin(angle)};
+    }
+}
 
 void ShadowsExample::renderDebugLines() {
-    if(_activeCamera != &_debugCamera)
+    const bool showCascades = _activeCamera == &_debugCamera;
+    if(!showCascades && !_shadows.lodDebug())
         return;
+
+    _debugLines.reset();
+    if(_shadows.lodDebug())
+        _shadows.addLodDebugLines(_debugLines);
+    if(!showCascades) {
+        _debugLines.draw(_activeCamera->projectionMatrix()*_activeCamera->cameraMatrix());
+        return;
+    }
 #if 1
     constexpr const Matrix4 unbiasMatrix{{ 2.0f,  0.0f,  0.0f, 0.0f},
         { 0.0f,  2.0f,  0.0f, 0.0f},
@@ -423,7 +728,6 @@ void ShadowsExample::renderDebugLines() {
         {-1.0f, -1.0f, -1.0f, 1.0f}};
 
     auto shadowLight = _shadows.getShadowLight();
-    _debugLines.reset();
     const Matrix4 imvp = (_mainCamera.projectionMatrix()*_mainCamera.cameraMatrix()).inverted();
     for(std::size_t layerIndex = 0; layerIndex != shadowLight->layerCount(); ++layerIndex) {
         const Matrix4 layerMatrix = shadowLight->layerMatrix(layerIndex);
@@ -485,6 +789,7 @@ void ShadowsExample::mouseMoveEvent(MouseMoveEvent& event) {
           }
         */
         rotateCamera(_activeCameraObject, delta);
+        _simulation.push({SimulationCommand::Type::Target, _activeCameraObject->transformation().translation()});
 
         _previousMousePosition = event.position();
         event.setAccepted();
@@ -503,13 +808,7 @@ void ShadowsExample::keyPressEvent(KeyEvent& event) {
     } else if(event.key() == Keys::Down) {
         _mainCameraVelocity.z() = CAMERA_VELOCITY;
     } else if(event.key() == KeyEvent::Key::Space) {
-        _entityManager.for_each<CachingObject*>([this]( auto ent, auto &object) {
-                //UNUSED_ENTITY(ent);
-                UNREFERENCED_PARAMETER(ent);
-                Matrix4 transform = object->transformation();
-        transform.translation() += Vector3::yAxis(3.0f);
-        object->setTransformation(transform);
-            });
+        _simulation.push({SimulationCommand::Type::Jump, Vector3::yAxis(3.0f)});
     } else if(event.key() == Keys::Q) {
         _mainCameraVelocity.y() = -CAMERA_VELOCITY;
 
@@ -530,6 +829,8 @@ void ShadowsExample::keyPressEvent(KeyEvent& event) {
     } else if(event.key() == Keys::K) {
         _mainCameraRotation.y() = -CAMERA_ROTATION;
     } else if(event.key() == KeyEvent::Key::Esc) {
+        _simulation.stop();
+        _simulatedObjects.clear();
         delete _root;
         _resourceManager.clear();
         exit();
@@ -552,6 +853,42 @@ void ShadowsExample::keyPressEvent(KeyEvent& event) {
         _shadows.increaseShadowRecieverBias(1.125f);
     } else if(event.key() == KeyEvent::Key::F8) {
         _shadows.decreaseShadowRecieverBias(1.125f);
+    } else if(event.key() == KeyEvent::Key::L) {
+        _shadows.toggleLodDebug();
+    } else if(event.key() == KeyEvent::Key::B) {
+        _shadows.cycleShadowFiltering();
+    } else if(event.key() == KeyEvent::Key::G) {
+        _shadows.cycleShadowDepthFormat();
+    } else if(event.key() == KeyEvent::Key::Y) {
+        if(_shadows.shadowSoftness()) _shadows.setShadowSoftness(_shadows.shadowSoftness() - 1);
+    } else if(event.key() == KeyEvent::Key::U) {
+        _shadows.setShadowSoftness(_shadows.shadowSoftness() + 1);
+    } else if(event.key() == KeyEvent::Key::Z) {
+        _shadows.setDepthPrePass(!_shadows.depthPrePass());
+    } else if(event.key() == KeyEvent::Key::R) {
+        _dynamicResolution.setEnabled(!_dynamicResolution.isEnabled());
+        if(_dynamicResolution.isEnabled()) _shadows.setFramebuffer(_dynamicResolution.framebuffer());
+        else _shadows.setFramebuffer(defaultFramebuffer);
+        _mainCamera.setViewport(_dynamicResolution.renderSize());
+        _debugCamera.setViewport(_dynamicResolution.renderSize());
+        Debug() << "Dynamic resolution:" << (_dynamicResolution.isEnabled() ? "on" : "off");
+    } else if(event.key() == KeyEvent::Key::K) {
+        _shadows.setStableCascades(!_shadows.stableCascades());
+        _shadows.setShadowLightTarget(_activeCamera, _activeCameraObject->transformation()[2].xyz());
+    } else if(event.key() == KeyEvent::Key::M) {
+        _resourceBudget.printReport();
+        _shadows.printShadowMapReport();
+        if(_worldStreamer) _worldStreamer->printReport();
+        if(_voiceManager) _voiceManager->printReport();
+    } else if(event.key() == KeyEvent::Key::T) {
+        TraceRecorder::captureNext(_traceFrameCount, _traceFile);
+    } else if(event.key() == KeyEvent::Key::F) {
+        _capturing = !_capturing;
+        Debug() << "Frame capture:" << (_capturing ? "on" : "off") << Debug::nospace << "," << _capture.writtenCount()
+                << "frames written to" << _capture.prefix() << Debug::nospace << "*," << _capture.droppedCount() << "dropped";
+    } else if(event.key() == KeyEvent::Key::O) {
+        if(!_overlay) _overlay.reset(new PerformanceOverlay{defaultFramebuffer.viewport().size()});
+        _overlay->toggle();
 #if 0
 
     } else if(event.key() == KeyEvent::Key::F9) {
@@ -11,7 +11,9 @@
 #include <Corrade/Utility/Directory.h>
 
 #include <Magnum/Buffer.h>
+#include <Magnum/Context.h>
 #include <Magnum/DefaultFramebuffer.h>
+#include <Magnum/Extensions.h>
 #include <Magnum/Mesh.h>
 #include <Magnum/PixelFormat.h>
 #include <Magnum/ResourceManager.h>
@@ -42,6 +44,7 @@
 #include <Magnum/SceneGraph/Drawable.h>
 #include <Magnum/SceneGraph/Camera.h>
 
+#include <Magnum/Audio/Context.h>
 #include <Magnum/Trade/AbstractImporter.h>
 #include <Magnum/Trade/ImageData.h>
 #include <Magnum/Trade/MeshData3D.h>
@@ -55,8 +58,21 @@
 using namespace Corrade;
 
 #include "configure.h"
+#include "AsyncSceneLoader.h"
+#include "ClusteredLights.h"
+#include "CompiledScene.h"
+#include "DynamicResolution.h"
+#include "FrameCapture.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "PerformanceOverlay.h"
+#include "ResourceBudget.h"
 #include "Types.h"
 #include "Shadows.h"
+#include "Simulation.h"
+#include "TraceRecorder.h"
+#include "VoiceManager.h"
+#include "WorldStreamer.h"
 
 
 #include <entityplus/entity.h>
@@ -65,8 +81,6 @@ using namespace entityplus;
 
 using namespace Magnum;
 
-typedef ResourceManager<Buffer, Mesh, Texture2D, Shaders::Phong, Trade::PhongMaterialData> ViewerResourceManager;
-
 using namespace Math::Literals;
 
 class CachingObject: public Object3D, SceneGraph::AbstractFeature3D {
@@ -85,9 +99,11 @@ public:
         Vector3 _absolutePosition;
 };
 
+/* Imported objects draw themselves in the main pass with the shadow
+   receiver shader, one draw for material, shadows and lights */
 class ColoredObject: public Object3D,  SceneGraph::Drawable3D {
 public:
-    explicit ColoredObject(ResourceKey meshId, ResourceKey materialId, Object3D* parent, SceneGraph::DrawableGroup3D* group);
+    explicit ColoredObject(ResourceKey meshId, ResourceKey materialId, Object3D* parent, SceneGraph::DrawableGroup3D* group, ResourceBudget& budget, ShadowReceiverShader& shader);
 
 private:
     void draw(const Matrix4& transformationMatrix, SceneGraph::Camera3D& camera) override;
@@ -95,8 +111,9 @@ protected:
     void clean(const Matrix4& absoluteTransformation) override;
 private:
 
+    ResourceBudget& _budget;
     Resource<Mesh> _mesh;
-    Resource<Shaders::Phong> _shader;
+    ShadowReceiverShader& _shader;
     Vector3 _ambientColor,
     _diffuseColor,
     _specularColor;
@@ -111,7 +128,7 @@ void ColoredObject::clean(const Matrix4& absoluteTransformation) {
 
 class TexturedObject: public Object3D, SceneGraph::Drawable3D {
 public:
-    explicit TexturedObject(ResourceKey meshId, ResourceKey materialId, ResourceKey diffuseTextureId, Object3D* parent, SceneGraph::DrawableGroup3D* group);
+    explicit TexturedObject(ResourceKey meshId, ResourceKey materialId, ResourceKey diffuseTextureId, Object3D* parent, SceneGraph::DrawableGroup3D* group, ResourceBudget& budget, ShadowReceiverShader& shader);
 
 private:
     void draw(const Matrix4& transformationMatrix, SceneGraph::Camera3D& camera) override;
@@ -119,9 +136,10 @@ protected:
     void clean(const Matrix4& absoluteTransformation) override;
 private:
 
+    ResourceBudget& _budget;
     Resource<Mesh> _mesh;
     Resource<Texture2D> _diffuseTexture;
-    Resource<Shaders::Phong> _shader;
+    ShadowReceiverShader& _shader;
     Vector3 _ambientColor,
     _specularColor;
     Float _shininess;
@@ -133,7 +151,7 @@ void TexturedObject::clean(const Matrix4& absoluteTransformation) {
     _absolutePosition = absoluteTransformation.translation();
 };
 
-using CompList = component_list<CachingObject*>;
+using CompList = component_list<CachingObject*, SoundEmitter>;
 using TagList = tag_list<struct TSuzanne, struct TCube>;
 
 using entity_manager_t = entity_manager<CompList, TagList>;
@@ -170,11 +188,19 @@ private:
     void mouseMoveEvent(MouseMoveEvent& event) override;
     void keyPressEvent(KeyEvent &event) override;
     void keyReleaseEvent(KeyEvent &event) override;
+    void viewportEvent(const Vector2i& size) override { globalViewportEvent(size); }
+
+    void applySimulation();
+    void addPointLights(UnsignedInt count);
+    void animatePointLights();
+    void addSoundEmitters(UnsignedInt count, UnsignedInt voiceCount, Float maxDistance);
+    void updateSoundEmitters();
+    void processSceneLoading();
 
     void rotateCamera(Object3D* cameraObject, const Vector2 delta, float deltaZ=1.0f);
     void globalViewportEvent(const Vector2i& size);
 
-    void addModel(const Trade::MeshData3D& meshData3D);
+    void addModel(Trade::MeshData3D meshData3D);
     void renderDebugLines();
     Object3D* createSceneObject(Model& model, bool makeCaster, bool makeReceiver);
     Object3D* createSceneObjectComp(Model& model, bool makeCaster, bool makeReceiver);
@@ -184,9 +210,20 @@ private:
     Shadows _shadows;
     
     ViewerResourceManager _resourceManager;
+    ResourceBudget _resourceBudget;
+    std::unique_ptr<PluginManager::Manager<Trade::AbstractImporter>> _importerManager;
+    ThreadPool _threadPool;
+    /* Scene loading, texture cooking and frame capture writes, nothing in
+       a frame waits for it */
+    ThreadPool _backgroundPool;
+    std::unique_ptr<TextureCache> _textureCache;
+    MeshOptimizer _meshOptimizer;
+    std::unique_ptr<AsyncSceneLoader> _sceneLoader;
     SceneGraph::DrawableGroup3D _drawables;
     CachingObject* _root;
     void addObject(Trade::AbstractImporter& importer, Object3D* parent, UnsignedInt i);
+    void addCompiledScene(const CompiledScene& scene);
+    Object3D* addMeshObject(Object3D* parent, UnsignedInt meshId, Int materialId);
 
     DebugLines _debugLines;
 
@@ -199,13 +236,53 @@ private:
     SceneGraph::Camera3D* _activeCamera;
 
     std::vector<Model> _models;
+    /* Chunks around the main camera when streaming a world, after the
+       models so it's destroyed before them */
+    std::unique_ptr<WorldStreamer> _worldStreamer;
     Utility::Resource _resource;
 
+    std::chrono::steady_clock::time_point _startTime;
+    bool _firstFrameDrawn{false};
+    bool _sceneLoaded{false};
+
     Vector3 _mainCameraVelocity;
     Vector3 _mainCameraRotation{0.0f, 0.0f, 1.0f};
     Vector2i _previousMousePosition{0,0};
 
     entity_manager_t _entityManager;
+
+    /* Entity movement runs on its own thread, the objects here get the
+       interpolated transformations every frame */
+    Simulation _simulation;
+    std::vector<CachingObject*> _simulatedObjects;
+    std::vector<Matrix4> _simulatedTransformations;
+
+    /* Point lights circle around their origins, binned for the active
+       camera every frame */
+    ClusteredLights _lights;
+    std::vector<Vector3> _pointLightOrigins;
+
+    /* Emitter entities played on the loudest few sources, heard from the
+       main camera. Only with --sound-emitters, the context outlives the
+       sources. */
+    std::unique_ptr<Audio::Context> _audioContext;
+    std::unique_ptr<VoiceManager> _voiceManager;
+
+    FrameProfiler _profiler;
+    UnsignedInt _loadingSection, _updateSection, _lightBinningSection, _mainPassSection, _debugLinesSection, _upscaleSection;
+    /* Scene drawn offscreen at a GPU time driven scale when enabled */
+    DynamicResolution _dynamicResolution;
+    /* Created on first use, it loads a font */
+    std::unique_ptr<PerformanceOverlay> _overlay;
+
+    /* Frames recorded by the trace key and where to */
+    UnsignedInt _traceFrameCount;
+    std::string _traceFile;
+
+    /* Every frame is saved while capturing, numbered across toggles */
+    FrameCapture _capture;
+    bool _capturing{false};
+    UnsignedLong _captureFrame{0};
 };
 
 
@@ -0,0 +1,148 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "Simulation.h"
+#include "TraceRecorder.h"
+
+#include <Corrade/Utility/Assert.h>
+#include <Magnum/Math/Functions.h>
+
+namespace {
+    /* Same distance per tick as was moved per frame before the simulation
+       got its own thread, so the speed matches the old behavior at 60 Hz */
+    constexpr const Float BodySpeed = 0.2f*0.3f*60.0f;
+
+    /* Don't try to catch up with more than this many ticks after a stall,
+       drop the time instead */
+    constexpr const Int MaxCatchUpTicks = 5;
+}
+
+Simulation::Simulation(const Float timestep):
+_timestep{timestep},
+_tick{0},
+_running{false}
+{}
+
+Simulation::~Simulation() {
+    stop();
+}
+
+std::size_t Simulation::addBody(const Matrix4& transformation) {
+    CORRADE_ASSERT(!_running, "Simulation::addBody(): can't add bodies while running", {});
+
+    SimulationBody body;
+    body.position = transformation.translation();
+    body.rotation = Quaternion::fromMatrix(transformation.rotation());
+    body.scaling = transformation.scaling();
+    _bodies.push_back(body);
+    return _bodies.size() - 1;
+}
+
+void Simulation::start() {
+    if(_running) return;
+
+    /* Allocate everything up front, the thread only copies into existing
+       storage afterwards */
+    _previousBodies = _bodies;
+    const Clock::time_point now = Clock::now();
+    for(SimulationSnapshot* snapshot = _snapshots.slots(); snapshot != _snapshots.slots() + 3; ++snapshot) {
+        snapshot->previous = _bodies;
+        snapshot->current = _bodies;
+        snapshot->time = now;
+        snapshot->tick = 0;
+    }
+
+    _running = true;
+    _thread = std::thread{&Simulation::run, this};
+}
+
+void Simulation::stop() {
+    if(!_running) return;
+
+    _running = false;
+    _thread.join();
+}
+
+bool Simulation::push(const SimulationCommand& command) {
+    return _commands.push(command);
+}
+
+void Simulation::run() {
+    const Clock::duration tick = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<Float>{_timestep});
+    Clock::time_point next = Clock::now();
+    PROFILE_THREAD_NAME("simulation");
+
+    while(_running.load(std::memory_order_acquire)) {
+        {
+            PROFILE_ZONE("Simulation step");
+            SimulationCommand command;
+            while(_commands.pop(command))
+                apply(command);
+
+            _previousBodies = _bodies;
+            step();
+            publish(Clock::now());
+        }
+
+        next += tick;
+        const Clock::time_point now = Clock::now();
+        if(now - next > tick*MaxCatchUpTicks)
+            next = now;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void Simulation::apply(const SimulationCommand& command) {
+    switch(command.type) {
+        case SimulationCommand::Type::Target:
+            for(SimulationBody& body: _bodies)
+                body.rotation = Quaternion::fromMatrix(Matrix4::lookAt(body.position, command.position, Vector3::zAxis()).rotation());
+            break;
+
+        case SimulationCommand::Type::Jump:
+            for(SimulationBody& body: _bodies)
+                body.position.y() += command.position.y();
+            break;
+    }
+}
+
+void Simulation::step() {
+    for(SimulationBody& body: _bodies)
+        body.position += body.rotation.transformVectorNormalized(Vector3::zAxis(-BodySpeed*_timestep));
+    ++_tick;
+}
+
+void Simulation::publish(const Clock::time_point time) {
+    SimulationSnapshot& snapshot = _snapshots.writeBuffer();
+    snapshot.previous = _previousBodies;
+    snapshot.current = _bodies;
+    snapshot.time = time;
+    snapshot.tick = _tick;
+    _snapshots.publish();
+}
+
+bool Simulation::interpolate(const Clock::time_point now, std::vector<Matrix4>& transformations) {
+    _snapshots.update();
+    const SimulationSnapshot& snapshot = _snapshots.readBuffer();
+
+    /* The current tick is shown in full one timestep after it got
+       published, which keeps the render one tick behind but never has to
+       extrapolate */
+    const Float alpha = Math::clamp(std::chrono::duration<Float>{now - snapshot.time}.count()/_timestep, 0.0f, 1.0f);
+
+    transformations.resize(snapshot.current.size());
+    for(std::size_t i = 0; i != snapshot.current.size(); ++i) {
+        const SimulationBody& a = snapshot.previous[i];
+        const SimulationBody& b = snapshot.current[i];
+        /* Rotations change very little per tick, normalized lerp is enough */
+        const Quaternion rotation = Math::lerp(a.rotation, b.rotation, alpha);
+        transformations[i] = Matrix4::from(rotation.toMatrix(), Math::lerp(a.position, b.position, alpha))*
+            Matrix4::scaling(b.scaling);
+    }
+
+    return snapshot.tick != 0;
+}
@@ -0,0 +1,105 @@
+#if !defined(SIMULATION_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define SIMULATION_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Matrix4.h>
+#include <Magnum/Math/Quaternion.h>
+
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+
+using namespace Magnum;
+
+struct SimulationBody {
+    Vector3 position;
+    Quaternion rotation;
+    Vector3 scaling{1.0f};
+};
+
+/* Input forwarded from the event handlers to the simulation thread */
+struct SimulationCommand {
+    enum class Type: UnsignedByte {
+        /* Turn all bodies to face position */
+        Target,
+        /* Lift all bodies by position.y() */
+        Jump
+    };
+
+    Type type;
+    Vector3 position;
+};
+
+/* State of two consecutive ticks, so the render thread can interpolate
+   between them without having to remember anything */
+struct SimulationSnapshot {
+    std::vector<SimulationBody> previous, current;
+    std::chrono::steady_clock::time_point time;
+    UnsignedLong tick;
+};
+
+/**
+Fixed-timestep simulation running on its own thread. Owns the body state,
+publishes a snapshot after every tick through a triple buffer and receives
+input through a lock-free queue, so neither the simulation nor the renderer
+waits for the other.
+*/
+class Simulation {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    explicit Simulation(Float timestep = 1.0f/60.0f);
+    ~Simulation();
+
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    /* Add a body, has to be called before start(). Returns body index. */
+    std::size_t addBody(const Matrix4& transformation);
+
+    std::size_t bodyCount() const { return _bodies.size(); }
+
+    Float timestep() const { return _timestep; }
+
+    void start();
+    void stop();
+
+    /* Called from the render thread. Returns false if the queue is full. */
+    bool push(const SimulationCommand& command);
+
+    /**
+     * Called from the render thread. Fills @p transformations with body
+     * transformations interpolated between the two latest ticks for given
+     * time. Returns false if no tick was published yet.
+     */
+    bool interpolate(Clock::time_point now, std::vector<Matrix4>& transformations);
+
+private:
+    void run();
+    void apply(const SimulationCommand& command);
+    void step();
+    void publish(Clock::time_point time);
+
+    Float _timestep;
+    UnsignedLong _tick;
+    std::vector<SimulationBody> _bodies, _previousBodies;
+
+    TripleBuffer<SimulationSnapshot> _snapshots;
+    SpscQueue<SimulationCommand, 256> _commands;
+
+    std::atomic<bool> _running;
+    std::thread _thread;
+};
+
+#endif
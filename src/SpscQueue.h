@@ -0,0 +1,50 @@
+#if !defined(SPSCQUEUE_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+/* Bounded lock-free single-producer single-consumer ring. push() fails
+   instead of blocking when the ring is full. */
+template<class T, std::size_t Capacity> class SpscQueue {
+    static_assert(Capacity && !(Capacity & (Capacity - 1)), "capacity has to be a power of two");
+
+public:
+    explicit SpscQueue(): _head{0}, _tail{0} {}
+
+    bool push(const T& value) {
+        const std::size_t head = _head.load(std::memory_order_relaxed);
+        if(head - _tail.load(std::memory_order_acquire) == Capacity)
+            return false;
+
+        _items[head & (Capacity - 1)] = value;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        const std::size_t tail = _tail.load(std::memory_order_relaxed);
+        if(tail == _head.load(std::memory_order_acquire))
+            return false;
+
+        value = _items[tail & (Capacity - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T _items[Capacity];
+    /* Keep the two indices on separate cache lines so the producer and
+       consumer don't fight over the same line */
+    alignas(64) std::atomic<std::size_t> _head;
+    alignas(64) std::atomic<std::size_t> _tail;
+};
+
+#endif
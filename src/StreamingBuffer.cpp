@@ -0,0 +1,92 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "StreamingBuffer.h"
+
+#include <Magnum/Context.h>
+#include <Magnum/Extensions.h>
+
+StreamingBuffer::StreamingBuffer(const std::size_t regionSize):
+_persistent{Context::current().isExtensionSupported<Extensions::GL::ARB::buffer_storage>() &&
+            Context::current().isExtensionSupported<Extensions::GL::ARB::base_instance>()},
+_regionSize{regionSize},
+_buffer{NoCreate},
+_mapped{nullptr},
+_fences{},
+_region{RegionCount - 1}
+{
+    create();
+}
+
+StreamingBuffer::~StreamingBuffer() {
+    for(GLsync& fence: _fences)
+        if(fence) glDeleteSync(fence);
+}
+
+void StreamingBuffer::create() {
+    _buffer = Buffer{};
+
+    if(_persistent) {
+        /* Immutable storage, mapped once for the whole lifetime */
+        const std::size_t size = RegionCount*_regionSize;
+        _buffer.setStorage({nullptr, size}, Buffer::StorageFlag::MapWrite|Buffer::StorageFlag::MapPersistent|Buffer::StorageFlag::MapCoherent);
+        _mapped = _buffer.map<char>(0, size, Buffer::MapFlag::Write|Buffer::MapFlag::Persistent|Buffer::MapFlag::Coherent);
+        CORRADE_INTERNAL_ASSERT(_mapped);
+    } else {
+        _staging = Containers::Array<char>(_regionSize);
+        _buffer.setData({nullptr, _regionSize}, BufferUsage::StreamDraw);
+    }
+}
+
+bool StreamingBuffer::reserve(const std::size_t regionSize) {
+    if(regionSize <= _regionSize) return false;
+
+    for(UnsignedInt region = 0; region != RegionCount; ++region) wait(region);
+    _regionSize = regionSize;
+    create();
+    return true;
+}
+
+void StreamingBuffer::wait(const UnsignedInt region) {
+    GLsync& fence = _fences[region];
+    if(!fence) return;
+
+    /* Flush on the first try so the fence is guaranteed to signal */
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    for(;;) {
+        const GLenum status = glClientWaitSync(fence, flags, 1000000);
+        if(status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED || status == GL_WAIT_FAILED) break;
+        flags = 0;
+    }
+
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+Containers::ArrayView<char> StreamingBuffer::map() {
+    if(!_persistent) return {_staging.data(), _staging.size()};
+
+    _region = (_region + 1) % RegionCount;
+    wait(_region);
+    return {_mapped + _region*_regionSize, _regionSize};
+}
+
+void StreamingBuffer::unmap(const std::size_t size) {
+    CORRADE_ASSERT(size <= _regionSize, "StreamingBuffer::unmap(): wrote" << size << "bytes into a region of" << _regionSize, );
+    if(_persistent || !size) return;
+
+    /* Orphan the old storage, the GPU may still be reading it */
+    _buffer.setData({nullptr, _regionSize}, BufferUsage::StreamDraw);
+    _buffer.setSubData(0, Containers::ArrayView<const char>{_staging.data(), size});
+}
+
+void StreamingBuffer::fence() {
+    if(!_persistent) return;
+
+    if(_fences[_region]) glDeleteSync(_fences[_region]);
+    _fences[_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
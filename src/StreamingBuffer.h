@@ -0,0 +1,79 @@
+#if !defined(STREAMINGBUFFER_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define STREAMINGBUFFER_H
+
+#include <cstddef>
+
+#include <Corrade/Containers/Array.h>
+#include <Corrade/Containers/ArrayView.h>
+#include <Magnum/Buffer.h>
+#include <Magnum/Magnum.h>
+#include <Magnum/OpenGL.h>
+
+using namespace Magnum;
+
+/**
+Ring of @ref StreamingBuffer::RegionCount regions for geometry written anew
+every frame. With ARB_buffer_storage and ARB_base_instance the buffer is
+mapped persistently and written directly, a fence after the draws keeps the
+CPU from overwriting a region the GPU still reads. Otherwise writes go to a
+CPU copy that's uploaded into an orphaned buffer and @ref offset() is always
+zero.
+
+Per frame: @ref map(), write, @ref unmap(), draw from @ref offset(),
+@ref fence().
+*/
+class StreamingBuffer {
+public:
+    enum: UnsignedInt { RegionCount = 3 };
+
+    explicit StreamingBuffer(std::size_t regionSize);
+    ~StreamingBuffer();
+
+    StreamingBuffer(const StreamingBuffer&) = delete;
+    StreamingBuffer& operator=(const StreamingBuffer&) = delete;
+
+    bool isPersistent() const { return _persistent; }
+    std::size_t regionSize() const { return _regionSize; }
+    Buffer& buffer() { return _buffer; }
+
+    /**
+     * Grow every region to at least @p regionSize bytes. Waits for the GPU
+     * and creates a new buffer, meshes using the old one have to be set up
+     * again, which is when this returns true. Anything written to the
+     * current region is lost.
+     */
+    bool reserve(std::size_t regionSize);
+
+    /* Next region for writing, waits until the GPU is done reading it */
+    Containers::ArrayView<char> map();
+
+    /* The first @p size bytes of the region were written */
+    void unmap(std::size_t size);
+
+    /* Byte offset of the current region in buffer() */
+    std::size_t offset() const { return _persistent ? _region*_regionSize : 0; }
+
+    /* Call after the last draw that reads the current region */
+    void fence();
+
+private:
+    void create();
+    void wait(UnsignedInt region);
+
+    bool _persistent;
+    std::size_t _regionSize;
+    Buffer _buffer;
+    char* _mapped;
+    Containers::Array<char> _staging;
+    GLsync _fences[RegionCount];
+    UnsignedInt _region;
+};
+
+#endif
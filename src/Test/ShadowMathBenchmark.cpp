@@ -0,0 +1,291 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Corrade/TestSuite/Tester.h>
+#include <Magnum/Math/Angle.h>
+
+#include "ShadowMath.h"
+
+namespace {
+    /* Every heap allocation made by the process, for the allocation count
+       benchmarks. The benchmarks are single-threaded. */
+    std::size_t allocationCount = 0;
+}
+
+void* operator new(std::size_t size) {
+    ++allocationCount;
+    if(void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace Magnum { namespace Test {
+
+struct ShadowMathBenchmark: TestSuite::Tester {
+    explicit ShadowMathBenchmark();
+
+    void setTarget();
+    void setTargetStable();
+    void frustumCorners();
+    void cameraFrustumCorners();
+    void clipPlanes();
+    void setupSplitDistances();
+    void cullCasters();
+
+    void allocationBegin();
+    std::uint64_t allocationEnd();
+
+    std::vector<Matrix4> _matrices;
+    std::vector<Matrix4> _casterTransformations;
+    std::vector<Float> _casterRadii;
+    std::size_t _allocationCount;
+};
+
+namespace {
+    enum: std::size_t { BatchCount = 25 };
+
+    constexpr const struct {
+        const char* name;
+        std::size_t count;
+    } LayerData[]{
+        {"1 layer", 1},
+        {"2 layers", 2},
+        {"4 layers", 4},
+        {"8 layers", 8}
+    };
+
+    constexpr const struct {
+        const char* name;
+        std::size_t count;
+    } MatrixData[]{
+        {"16 cameras", 16},
+        {"256 cameras", 256},
+        {"4096 cameras", 4096}
+    };
+
+    constexpr const struct {
+        const char* name;
+        std::size_t count;
+    } CasterData[]{
+        {"100 casters", 100},
+        {"1000 casters", 1000},
+        {"10000 casters", 10000},
+        {"100000 casters", 100000}
+    };
+
+    constexpr const Float CameraNear = 0.01f;
+    constexpr const Float CameraFar = 200.0f;
+
+    template<class T, std::size_t size> constexpr std::size_t arraySize(const T(&)[size]) { return size; }
+}
+
+ShadowMathBenchmark::ShadowMathBenchmark() {
+    /* Every benchmark in wall time, CPU cycles and heap allocations per
+       iteration */
+    for(const BenchmarkType type: {BenchmarkType::WallTime, BenchmarkType::CpuCycles}) {
+        addInstancedBenchmarks({&ShadowMathBenchmark::setTarget,
+                                &ShadowMathBenchmark::setTargetStable,
+                                &ShadowMathBenchmark::setupSplitDistances}, BatchCount, arraySize(LayerData), type);
+        addInstancedBenchmarks({&ShadowMathBenchmark::frustumCorners,
+                                &ShadowMathBenchmark::cameraFrustumCorners,
+                                &ShadowMathBenchmark::clipPlanes}, BatchCount, arraySize(MatrixData), type);
+        addInstancedBenchmarks({&ShadowMathBenchmark::cullCasters}, BatchCount, arraySize(CasterData), type);
+    }
+
+    addCustomInstancedBenchmarks({&ShadowMathBenchmark::setTarget,
+                                  &ShadowMathBenchmark::setTargetStable,
+                                  &ShadowMathBenchmark::setupSplitDistances}, 1, arraySize(LayerData),
+        &ShadowMathBenchmark::allocationBegin, &ShadowMathBenchmark::allocationEnd, BenchmarkUnits::Count);
+    addCustomInstancedBenchmarks({&ShadowMathBenchmark::frustumCorners,
+                                  &ShadowMathBenchmark::cameraFrustumCorners,
+                                  &ShadowMathBenchmark::clipPlanes}, 1, arraySize(MatrixData),
+        &ShadowMathBenchmark::allocationBegin, &ShadowMathBenchmark::allocationEnd, BenchmarkUnits::Count);
+    addCustomInstancedBenchmarks({&ShadowMathBenchmark::cullCasters}, 1, arraySize(CasterData),
+        &ShadowMathBenchmark::allocationBegin, &ShadowMathBenchmark::allocationEnd, BenchmarkUnits::Count);
+
+    /* Fixed seed, every run measures the same input */
+    std::mt19937 random{5489u};
+    std::uniform_real_distribution<Float> position{-100.0f, 100.0f};
+    std::uniform_real_distribution<Float> height{0.0f, 10.0f};
+    std::uniform_real_distribution<Float> radius{0.5f, 2.0f};
+    std::uniform_real_distribution<Float> angle{0.0f, 360.0f};
+
+    /* Main camera view-projections looking in random directions */
+    _matrices.reserve(MatrixData[arraySize(MatrixData) - 1].count);
+    for(std::size_t i = 0; i != _matrices.capacity(); ++i) {
+        const Matrix4 camera = (Matrix4::translation({position(random), height(random), position(random)})*
+            Matrix4::rotationY(Deg(angle(random)))).inverted();
+        _matrices.push_back(Matrix4::perspectiveProjection(Deg(35.0f), 16.0f/9.0f, CameraNear, CameraFar)*camera);
+    }
+
+    /* Casters relative to a shadow camera above the scene center */
+    const Matrix4 shadowCamera = Matrix4::lookAt({0.0f, 50.0f, 0.0f}, {}, Vector3::zAxis()).inverted();
+    _casterTransformations.reserve(CasterData[arraySize(CasterData) - 1].count);
+    _casterRadii.reserve(_casterTransformations.capacity());
+    for(std::size_t i = 0; i != _casterTransformations.capacity(); ++i) {
+        _casterTransformations.push_back(shadowCamera*Matrix4::translation({position(random), height(random), position(random)}));
+        _casterRadii.push_back(radius(random));
+    }
+}
+
+void ShadowMathBenchmark::setTarget() {
+    const std::size_t layerCount = LayerData[testCaseInstanceId()].count;
+    setTestCaseDescription(LayerData[testCaseInstanceId()].name);
+
+    const std::vector<Float> cutPlanes = ShadowMath::splitCutPlanes(layerCount, CameraNear, CameraFar, 3.0f);
+    const Matrix4 lightCameraMatrix = Matrix4::lookAt({}, -Vector3{3.0f, 2.0f, 3.0f}, Vector3::zAxis());
+
+    std::vector<ShadowMath::LayerVolume> volumes(layerCount);
+    Float size = 0.0f;
+    std::size_t i = 0;
+    CORRADE_BENCHMARK(1000) {
+        const Matrix4 imvp = _matrices[i++ % _matrices.size()].inverted();
+        ShadowMath::fitLayers(lightCameraMatrix, imvp, {cutPlanes.data(), cutPlanes.size()}, {volumes.data(), volumes.size()});
+        size += volumes.back().orthographicSize.x();
+    }
+
+    CORRADE_VERIFY(size > 0.0f);
+}
+
+void ShadowMathBenchmark::setTargetStable() {
+    const std::size_t layerCount = LayerData[testCaseInstanceId()].count;
+    setTestCaseDescription(LayerData[testCaseInstanceId()].name);
+
+    const std::vector<Float> cutPlanes = ShadowMath::splitCutPlanes(layerCount, CameraNear, CameraFar, 3.0f);
+    const Matrix4 lightCameraMatrix = Matrix4::lookAt({}, -Vector3{3.0f, 2.0f, 3.0f}, Vector3::zAxis());
+
+    std::vector<ShadowMath::LayerVolume> volumes(layerCount);
+    Float size = 0.0f;
+    std::size_t i = 0;
+    CORRADE_BENCHMARK(1000) {
+        const Matrix4 imvp = _matrices[i++ % _matrices.size()].inverted();
+        ShadowMath::fitStableLayers(lightCameraMatrix, imvp, {cutPlanes.data(), cutPlanes.size()}, Vector2i{2048}, {volumes.data(), volumes.size()});
+        size += volumes.back().orthographicSize.x();
+    }
+
+    CORRADE_VERIFY(size > 0.0f);
+}
+
+void ShadowMathBenchmark::frustumCorners() {
+    const std::size_t count = MatrixData[testCaseInstanceId()].count;
+    setTestCaseDescription(MatrixData[testCaseInstanceId()].name);
+
+    Vector3 sum;
+    CORRADE_BENCHMARK(10) {
+        for(std::size_t i = 0; i != count; ++i)
+            sum += ShadowMath::frustumCorners(_matrices[i], 0.0f, 1.0f)[7];
+    }
+
+    CORRADE_VERIFY(sum != Vector3{});
+}
+
+void ShadowMathBenchmark::cameraFrustumCorners() {
+    const std::size_t count = MatrixData[testCaseInstanceId()].count;
+    setTestCaseDescription(MatrixData[testCaseInstanceId()].name);
+
+    /* The view-projections stand in for camera matrices, only the work
+       matters */
+    const Matrix4 projection = Matrix4::perspectiveProjection(Deg(35.0f), 16.0f/9.0f, CameraNear, CameraFar);
+    Vector3 sum;
+    CORRADE_BENCHMARK(10) {
+        for(std::size_t i = 0; i != count; ++i)
+            sum += ShadowMath::cameraFrustumCorners(projection, _matrices[i])[7];
+    }
+
+    CORRADE_VERIFY(sum != Vector3{});
+}
+
+void ShadowMathBenchmark::clipPlanes() {
+    const std::size_t count = MatrixData[testCaseInstanceId()].count;
+    setTestCaseDescription(MatrixData[testCaseInstanceId()].name);
+
+    Vector4 sum;
+    CORRADE_BENCHMARK(10) {
+        for(std::size_t i = 0; i != count; ++i)
+            sum += ShadowMath::clipPlanes(_matrices[i])[5];
+    }
+
+    CORRADE_VERIFY(sum != Vector4{});
+}
+
+void ShadowMathBenchmark::setupSplitDistances() {
+    const std::size_t layerCount = LayerData[testCaseInstanceId()].count;
+    setTestCaseDescription(LayerData[testCaseInstanceId()].name);
+
+    Float sum = 0.0f;
+    Float power = 1.0f;
+    CORRADE_BENCHMARK(1000) {
+        sum += ShadowMath::splitCutPlanes(layerCount, CameraNear, CameraFar, power).back();
+        power = power > 4.0f ? 1.0f : power + 0.01f;
+    }
+
+    CORRADE_VERIFY(sum > 0.0f);
+}
+
+void ShadowMathBenchmark::cullCasters() {
+    const std::size_t count = CasterData[testCaseInstanceId()].count;
+    setTestCaseDescription(CasterData[testCaseInstanceId()].name);
+
+    const std::vector<Matrix4> transformations{_casterTransformations.begin(), _casterTransformations.begin() + count};
+    const std::vector<Float> radii{_casterRadii.begin(), _casterRadii.begin() + count};
+    /* A cascade covering a quarter of the scene */
+    const std::array<Vector4, 6> planes = ShadowMath::clipPlanes(Matrix4::orthographicProjection({100.0f, 100.0f}, -50.0f, 50.0f));
+
+    std::vector<UnsignedInt> visible(count);
+    std::size_t visibleCount = 0;
+    CORRADE_BENCHMARK(1) {
+        Float orthographicNear = -50.0f;
+        visibleCount = ShadowMath::cullSpheres(planes, {transformations.data(), count}, {radii.data(), count}, {visible.data(), count}, orthographicNear);
+    }
+
+    CORRADE_VERIFY(visibleCount > 0);
+    CORRADE_VERIFY(visibleCount < count);
+}
+
+void ShadowMathBenchmark::allocationBegin() {
+    _allocationCount = allocationCount;
+}
+
+std::uint64_t ShadowMathBenchmark::allocationEnd() {
+    return allocationCount - _allocationCount;
+}
+
+}}
+
+CORRADE_TEST_MAIN(Magnum::Test::ShadowMathBenchmark)
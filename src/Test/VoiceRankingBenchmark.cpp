@@ -0,0 +1,156 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <Corrade/TestSuite/Tester.h>
+
+#include "VoiceRanking.h"
+
+namespace Magnum { namespace Test {
+
+struct VoiceRankingBenchmark: TestSuite::Tester {
+    explicit VoiceRankingBenchmark();
+
+    void audibilityMatchesScalar();
+    void selectLoudest();
+
+    void audibility();
+    void audibilityScalar();
+    void selectLoudestBenchmark();
+
+    std::vector<Float> _x, _y, _z, _gain, _priority;
+};
+
+namespace {
+    enum: std::size_t { BatchCount = 25, VoiceCount = 32 };
+
+    constexpr const struct {
+        const char* name;
+        std::size_t count;
+    } EmitterData[]{
+        {"1000 emitters", 1000},
+        {"10000 emitters", 10000},
+        {"100000 emitters", 100000}
+    };
+
+    const Vector3 Listener{3.0f, 2.0f, -5.0f};
+
+    template<class T, std::size_t size> constexpr std::size_t arraySize(const T(&)[size]) { return size; }
+}
+
+VoiceRankingBenchmark::VoiceRankingBenchmark() {
+    addTests({&VoiceRankingBenchmark::audibilityMatchesScalar,
+              &VoiceRankingBenchmark::selectLoudest});
+
+    for(const BenchmarkType type: {BenchmarkType::WallTime, BenchmarkType::CpuCycles})
+        addInstancedBenchmarks({&VoiceRankingBenchmark::audibility,
+                                &VoiceRankingBenchmark::audibilityScalar,
+                                &VoiceRankingBenchmark::selectLoudestBenchmark}, BatchCount, arraySize(EmitterData), type);
+
+    /* Fixed seed, every run measures the same input. Most emitters are
+       beyond the default max distance, like in a big level. */
+    std::mt19937 random{5489u};
+    std::uniform_real_distribution<Float> position{-150.0f, 150.0f};
+    std::uniform_real_distribution<Float> height{0.0f, 10.0f};
+    std::uniform_real_distribution<Float> gain{0.0f, 1.0f};
+    std::uniform_real_distribution<Float> priority{0.5f, 2.0f};
+
+    const std::size_t count = EmitterData[arraySize(EmitterData) - 1].count;
+    for(std::size_t i = 0; i != count; ++i) {
+        _x.push_back(position(random));
+        _y.push_back(height(random));
+        _z.push_back(position(random));
+        _gain.push_back(gain(random));
+        _priority.push_back(priority(random));
+    }
+}
+
+void VoiceRankingBenchmark::audibilityMatchesScalar() {
+    /* Not a multiple of four, so the tail is covered too */
+    const std::size_t count = 1001;
+    const VoiceRanking::DistanceModel model;
+
+    std::vector<Float> simd(count), scalar(count);
+    VoiceRanking::audibility(Listener, model, {_x.data(), count}, {_y.data(), count}, {_z.data(), count},
+        {_gain.data(), count}, {_priority.data(), count}, {simd.data(), count});
+    VoiceRanking::audibilityScalar(Listener, model, {_x.data(), count}, {_y.data(), count}, {_z.data(), count},
+        {_gain.data(), count}, {_priority.data(), count}, {scalar.data(), count});
+
+    std::size_t audible = 0;
+    for(std::size_t i = 0; i != count; ++i) {
+        CORRADE_ITERATION(i);
+        CORRADE_COMPARE(simd[i], scalar[i]);
+        if(scalar[i] > 0.0f) ++audible;
+    }
+
+    CORRADE_VERIFY(audible > VoiceCount);
+    CORRADE_VERIFY(audible < count);
+}
+
+void VoiceRankingBenchmark::selectLoudest() {
+    const Float audibility[]{0.5f, 0.0f, 0.9f, 0.1f, 0.0f, 0.7f, 0.3f};
+    UnsignedInt indices[arraySize(audibility)];
+
+    CORRADE_COMPARE(VoiceRanking::selectLoudest(audibility, indices, 3), 5);
+    std::sort(indices, indices + 3);
+    CORRADE_COMPARE(indices[0], 0);
+    CORRADE_COMPARE(indices[1], 2);
+    CORRADE_COMPARE(indices[2], 5);
+
+    /* Fewer audible than asked for, all of them */
+    CORRADE_COMPARE(VoiceRanking::selectLoudest(audibility, indices, 8), 5);
+}
+
+void VoiceRankingBenchmark::audibility() {
+    const std::size_t count = EmitterData[testCaseInstanceId()].count;
+    setTestCaseDescription(EmitterData[testCaseInstanceId()].name);
+
+    std::vector<Float> out(count);
+    CORRADE_BENCHMARK(10) {
+        VoiceRanking::audibility(Listener, {}, {_x.data(), count}, {_y.data(), count}, {_z.data(), count},
+            {_gain.data(), count}, {_priority.data(), count}, {out.data(), count});
+    }
+
+    CORRADE_VERIFY(*std::max_element(out.begin(), out.end()) > 0.0f);
+}
+
+void VoiceRankingBenchmark::audibilityScalar() {
+    const std::size_t count = EmitterData[testCaseInstanceId()].count;
+    setTestCaseDescription(EmitterData[testCaseInstanceId()].name);
+
+    std::vector<Float> out(count);
+    CORRADE_BENCHMARK(10) {
+        VoiceRanking::audibilityScalar(Listener, {}, {_x.data(), count}, {_y.data(), count}, {_z.data(), count},
+            {_gain.data(), count}, {_priority.data(), count}, {out.data(), count});
+    }
+
+    CORRADE_VERIFY(*std::max_element(out.begin(), out.end()) > 0.0f);
+}
+
+void VoiceRankingBenchmark::selectLoudestBenchmark() {
+    const std::size_t count = EmitterData[testCaseInstanceId()].count;
+    setTestCaseDescription(EmitterData[testCaseInstanceId()].name);
+
+    std::vector<Float> audibility(count);
+    VoiceRanking::audibility(Listener, {}, {_x.data(), count}, {_y.data(), count}, {_z.data(), count},
+        {_gain.data(), count}, {_priority.data(), count}, {audibility.data(), count});
+
+    std::vector<UnsignedInt> indices(count);
+    std::size_t audible = 0;
+    CORRADE_BENCHMARK(10) {
+        audible = VoiceRanking::selectLoudest({audibility.data(), count}, {indices.data(), count}, VoiceCount);
+    }
+
+    CORRADE_VERIFY(audible > VoiceCount);
+}
+
+}}
+
+CORRADE_TEST_MAIN(Magnum::Test::VoiceRankingBenchmark)
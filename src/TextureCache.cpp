@@ -0,0 +1,376 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+#include <Corrade/Utility/Assert.h>
+#include <Corrade/Utility/Debug.h>
+#include <Magnum/PixelFormat.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/Trade/ImageData.h>
+
+#include "ThreadPool.h"
+
+namespace {
+
+struct CookedTextureHeader {
+    char magic[4];
+    UnsignedInt version;
+    UnsignedLong key;
+    UnsignedInt compression;
+    UnsignedInt levelCount;
+    UnsignedInt reserved[2];
+};
+
+struct CookedTextureLevelHeader {
+    Int width, height;
+    UnsignedInt offset, dataSize;
+};
+
+static_assert(sizeof(CookedTextureHeader) == 32, "unexpected header padding");
+static_assert(sizeof(CookedTextureLevelHeader) == 16, "unexpected header padding");
+
+constexpr const char CookedTextureMagic[4]{'M', 'T', 'E', 'X'};
+constexpr const UnsignedInt CookedTextureVersion = 1;
+
+/* Level data are aligned so they can be handed to the driver straight from
+   the mapped file */
+constexpr const std::size_t CookedTextureAlignment = 16;
+
+std::size_t alignUp(const std::size_t value, const std::size_t alignment) {
+    return (value + alignment - 1)/alignment*alignment;
+}
+
+std::size_t levelDataSize(const Vector2i& size, const TextureCompression compression) {
+    if(compression == TextureCompression::Bc1)
+        return std::size_t((size.x() + 3)/4)*((size.y() + 3)/4)*8;
+    return std::size_t(size.x())*size.y()*3;
+}
+
+/* 2x2 box filter, odd sizes clamp the last row/column */
+void downsample(const UnsignedByte* const src, const Vector2i& srcSize, UnsignedByte* const dst, const Vector2i& dstSize, const std::size_t rowBegin, const std::size_t rowEnd) {
+    for(std::size_t y = rowBegin; y != rowEnd; ++y) {
+        const Int y0 = Math::min(Int(y*2), srcSize.y() - 1);
+        const Int y1 = Math::min(Int(y*2 + 1), srcSize.y() - 1);
+        for(Int x = 0; x != dstSize.x(); ++x) {
+            const Int x0 = Math::min(x*2, srcSize.x() - 1);
+            const Int x1 = Math::min(x*2 + 1, srcSize.x() - 1);
+            for(Int c = 0; c != 3; ++c) {
+                const UnsignedInt sum =
+                    src[(y0*srcSize.x() + x0)*3 + c] +
+                    src[(y0*srcSize.x() + x1)*3 + c] +
+                    src[(y1*srcSize.x() + x0)*3 + c] +
+                    src[(y1*srcSize.x() + x1)*3 + c];
+                dst[(y*dstSize.x() + x)*3 + c] = UnsignedByte((sum + 2)/4);
+            }
+        }
+    }
+}
+
+UnsignedShort packRgb565(const Int r, const Int g, const Int b) {
+    return UnsignedShort(((r >> 3) << 11)|((g >> 2) << 5)|(b >> 3));
+}
+
+void unpackRgb565(const UnsignedShort color, Int* const out) {
+    const Int r = (color >> 11) & 0x1f;
+    const Int g = (color >> 5) & 0x3f;
+    const Int b = color & 0x1f;
+    out[0] = (r << 3)|(r >> 2);
+    out[1] = (g << 2)|(g >> 4);
+    out[2] = (b << 3)|(b >> 2);
+}
+
+/* Bounding-box BC1 encoder with inset endpoints. Not the best quality out
+   there but fast enough to cook a scene at startup. */
+void encodeBc1Block(const UnsignedByte (&pixels)[16][3], char* const out) {
+    Int min[3]{255, 255, 255}, max[3]{0, 0, 0};
+    for(const auto& pixel: pixels) for(Int c = 0; c != 3; ++c) {
+        min[c] = Math::min(min[c], Int(pixel[c]));
+        max[c] = Math::max(max[c], Int(pixel[c]));
+    }
+    for(Int c = 0; c != 3; ++c) {
+        const Int inset = (max[c] - min[c]) >> 4;
+        min[c] = Math::min(min[c] + inset, 255);
+        max[c] = Math::max(max[c] - inset, 0);
+    }
+
+    UnsignedShort color0 = packRgb565(max[0], max[1], max[2]);
+    UnsignedShort color1 = packRgb565(min[0], min[1], min[2]);
+    /* color0 > color1 selects the four-color mode */
+    if(color0 < color1) std::swap(color0, color1);
+
+    UnsignedInt indices = 0;
+    if(color0 != color1) {
+        Int palette[4][3];
+        unpackRgb565(color0, palette[0]);
+        unpackRgb565(color1, palette[1]);
+        for(Int c = 0; c != 3; ++c) {
+            palette[2][c] = (2*palette[0][c] + palette[1][c])/3;
+            palette[3][c] = (palette[0][c] + 2*palette[1][c])/3;
+        }
+
+        for(std::size_t i = 0; i != 16; ++i) {
+            Int best = 0, bestDistance = 0x7fffffff;
+            for(Int p = 0; p != 4; ++p) {
+                Int distance = 0;
+                for(Int c = 0; c != 3; ++c) {
+                    const Int d = Int(pixels[i][c]) - palette[p][c];
+                    distance += d*d;
+                }
+                if(distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= UnsignedInt(best) << (i*2);
+        }
+    }
+
+    /* Little-endian as the format wants */
+    out[0] = char(color0 & 0xff);
+    out[1] = char(color0 >> 8);
+    out[2] = char(color1 & 0xff);
+    out[3] = char(color1 >> 8);
+    for(Int i = 0; i != 4; ++i)
+        out[4 + i] = char((indices >> (i*8)) & 0xff);
+}
+
+void encodeBc1(const UnsignedByte* const src, const Vector2i& size, char* const dst, const std::size_t blockRowBegin, const std::size_t blockRowEnd) {
+    const Int blocksX = (size.x() + 3)/4;
+    for(std::size_t by = blockRowBegin; by != blockRowEnd; ++by) {
+        for(Int bx = 0; bx != blocksX; ++bx) {
+            UnsignedByte pixels[16][3];
+            for(Int y = 0; y != 4; ++y) for(Int x = 0; x != 4; ++x) {
+                const Int sx = Math::min(bx*4 + x, size.x() - 1);
+                const Int sy = Math::min(Int(by*4) + y, size.y() - 1);
+                std::memcpy(pixels[y*4 + x], src + (sy*size.x() + sx)*3, 3);
+            }
+            encodeBc1Block(pixels, dst + (by*blocksX + bx)*8);
+        }
+    }
+}
+
+}
+
+Containers::ArrayView<const char> CookedTexture::file() const {
+    if(_mapped) return {_mapped.data(), _mapped.size()};
+    return {_owned.data(), _owned.size()};
+}
+
+bool CookedTexture::parse() {
+    const Containers::ArrayView<const char> data = file();
+    if(data.size() < sizeof(CookedTextureHeader)) return false;
+
+    CookedTextureHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if(std::memcmp(header.magic, CookedTextureMagic, 4) != 0 || header.version != CookedTextureVersion)
+        return false;
+    if(data.size() < sizeof(CookedTextureHeader) + header.levelCount*sizeof(CookedTextureLevelHeader))
+        return false;
+
+    _compression = TextureCompression(header.compression);
+    if(_compression != TextureCompression::None && _compression != TextureCompression::Bc1)
+        return false;
+
+    /* The sizes are 32-bit, sum them in 64 so a damaged file can't wrap
+       around the check */
+    _levels.clear();
+    for(UnsignedInt i = 0; i != header.levelCount; ++i) {
+        CookedTextureLevelHeader level;
+        std::memcpy(&level, data.data() + sizeof(CookedTextureHeader) + i*sizeof(CookedTextureLevelHeader), sizeof(level));
+        if(level.width <= 0 || level.height <= 0 ||
+           level.dataSize != levelDataSize({level.width, level.height}, _compression) ||
+           std::size_t(level.offset) + level.dataSize > data.size()) {
+            _levels.clear();
+            return false;
+        }
+        _levels.push_back({{level.width, level.height}, level.offset, level.dataSize});
+    }
+
+    return !_levels.empty();
+}
+
+Containers::ArrayView<const char> CookedTexture::data(const std::size_t level) const {
+    return file().slice(_levels[level].offset, _levels[level].offset + _levels[level].dataSize);
+}
+
+std::size_t CookedTexture::dataSize() const {
+    std::size_t size = 0;
+    for(const Level& level: _levels) size += level.dataSize;
+    return size;
+}
+
+TextureCache::TextureCache(std::string directory, const TextureCompression compression, ThreadPool& pool): _directory{std::move(directory)}, _compression{compression}, _pool(pool) {
+    if(!Utility::Directory::mkpath(_directory))
+        Warning{} << "Cannot create texture cache directory" << _directory << Debug::nospace << ", cooked textures will be kept in memory only";
+}
+
+UnsignedLong TextureCache::hash(const Containers::ArrayView<const char> data, UnsignedLong seed) {
+    for(const char c: data) {
+        seed ^= UnsignedByte(c);
+        seed *= 1099511628211ull;
+    }
+    return seed;
+}
+
+std::string TextureCache::imageFile(const std::string& directory, const std::string& name) {
+    if(name.empty()) return {};
+    const std::string file = Utility::Directory::join(directory, name);
+    return Utility::Directory::fileExists(file) ? file : std::string{};
+}
+
+UnsignedLong TextureCache::imageKey(const UnsignedLong sceneHash, const UnsignedInt image, const std::string& name, const std::string& file) {
+    /* Reading the file is still a lot cheaper than decoding it */
+    UnsignedLong seed = hash({reinterpret_cast<const char*>(&image), sizeof(image)}, sceneHash);
+    if(!file.empty()) seed = hash(Utility::Directory::read(file), seed);
+    return hash({name.data(), name.size()}, seed);
+}
+
+bool TextureCache::isSupported(const Trade::ImageData2D& image) {
+    return image.type() == PixelType::UnsignedByte && (image.format() == PixelFormat::RGB
+#ifndef MAGNUM_TARGET_GLES
+        || image.format() == PixelFormat::BGR
+#endif
+        );
+}
+
+std::string TextureCache::path(const UnsignedLong key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.mtex", static_cast<unsigned long long>(key));
+    return Utility::Directory::join(_directory, name);
+}
+
+std::string TextureCache::temporaryPath(const UnsignedLong key) const {
+    static std::atomic<UnsignedInt> counter{0};
+    return path(key) + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + "-" +
+        std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "-" + std::to_string(counter++) + ".tmp";
+}
+
+CookedTexture TextureCache::open(const UnsignedLong key) const {
+    CookedTexture texture;
+
+    const std::string filename = path(key);
+    if(!Utility::Directory::fileExists(filename)) return texture;
+
+    texture._mapped = Utility::Directory::mapRead(filename);
+    if(!texture.parse()) {
+        Warning{} << "Ignoring corrupted cooked texture" << filename;
+        return CookedTexture{};
+    }
+
+    /* Cooked with different settings, cook again */
+    CookedTextureHeader header;
+    std::memcpy(&header, texture._mapped.data(), sizeof(header));
+    if(header.key != key || texture._compression != _compression)
+        return CookedTexture{};
+
+    return texture;
+}
+
+CookedTexture TextureCache::cook(const UnsignedLong key, const Vector2i& size, const Containers::ArrayView<const char> pixels, const std::size_t rowStride, const bool bgr) {
+    /* Full chain down to 1x1 */
+    const Int levelCount = Math::log2(UnsignedInt(size.max())) + 1;
+    std::vector<Vector2i> levelSizes;
+    for(Int i = 0; i != levelCount; ++i)
+        levelSizes.push_back(Math::max(size >> i, Vector2i{1}));
+
+    /* Uncompressed chain first, tightly packed RGB */
+    std::vector<Containers::Array<UnsignedByte>> chain;
+    chain.emplace_back(Containers::NoInit, std::size_t(size.product())*3);
+    _pool.parallelFor(size.y(), [&](std::size_t begin, std::size_t end) {
+        for(std::size_t y = begin; y != end; ++y) {
+            const UnsignedByte* src = reinterpret_cast<const UnsignedByte*>(pixels.data()) + y*rowStride;
+            UnsignedByte* dst = chain[0] + y*size.x()*3;
+            for(Int x = 0; x != size.x(); ++x, src += 3, dst += 3) {
+                dst[0] = src[bgr ? 2 : 0];
+                dst[1] = src[1];
+                dst[2] = src[bgr ? 0 : 2];
+            }
+        }
+    });
+    for(Int i = 1; i != levelCount; ++i) {
+        chain.emplace_back(Containers::NoInit, std::size_t(levelSizes[i].product())*3);
+        const Vector2i srcSize = levelSizes[i - 1], dstSize = levelSizes[i];
+        const UnsignedByte* src = chain[i - 1];
+        UnsignedByte* dst = chain[i];
+        _pool.parallelFor(dstSize.y(), [&](std::size_t begin, std::size_t end) {
+            downsample(src, srcSize, dst, dstSize, begin, end);
+        });
+    }
+
+    /* Lay out the file */
+    std::size_t offset = alignUp(sizeof(CookedTextureHeader) + levelCount*sizeof(CookedTextureLevelHeader), CookedTextureAlignment);
+    std::vector<CookedTextureLevelHeader> levelHeaders;
+    for(Int i = 0; i != levelCount; ++i) {
+        const std::size_t dataSize = levelDataSize(levelSizes[i], _compression);
+        levelHeaders.push_back({levelSizes[i].x(), levelSizes[i].y(), UnsignedInt(offset), UnsignedInt(dataSize)});
+        offset = alignUp(offset + dataSize, CookedTextureAlignment);
+    }
+
+    Containers::Array<char> file{Containers::ValueInit, offset};
+    CookedTextureHeader header{};
+    std::memcpy(header.magic, CookedTextureMagic, 4);
+    header.version = CookedTextureVersion;
+    header.key = key;
+    header.compression = UnsignedInt(_compression);
+    header.levelCount = UnsignedInt(levelCount);
+    std::memcpy(file.data(), &header, sizeof(header));
+    std::memcpy(file.data() + sizeof(header), levelHeaders.data(), levelHeaders.size()*sizeof(CookedTextureLevelHeader));
+
+    for(Int i = 0; i != levelCount; ++i) {
+        char* const dst = file.data() + levelHeaders[i].offset;
+        if(_compression == TextureCompression::Bc1) {
+            const UnsignedByte* src = chain[i];
+            const Vector2i levelSize = levelSizes[i];
+            _pool.parallelFor((levelSize.y() + 3)/4, [&](std::size_t begin, std::size_t end) {
+                encodeBc1(src, levelSize, dst, begin, end);
+            });
+        } else std::memcpy(dst, chain[i].data(), chain[i].size());
+    }
+
+    /* Write it and use it from the mapped file, same as a cache hit would.
+       Another thread or process may be cooking or mapping the same key, so
+       the file is written aside and moved over in one step, nobody ever
+       sees it half-written. If the move fails because the other one got
+       there first, its file is just as good. */
+    CookedTexture texture;
+    const std::string filename = path(key);
+    const std::string temporary = temporaryPath(key);
+    if(Utility::Directory::write(temporary, file)) {
+        if(std::rename(temporary.data(), filename.data()) != 0)
+            Utility::Directory::rm(temporary);
+        if((texture._mapped = Utility::Directory::mapRead(filename)) && texture.parse())
+            return texture;
+    }
+
+    Warning{} << "Cannot write cooked texture" << filename << Debug::nospace << ", keeping it in memory";
+    texture._mapped = nullptr;
+    texture._owned = std::move(file);
+    texture.parse();
+    return texture;
+}
+
+CookedTexture TextureCache::cook(const UnsignedLong key, const Trade::ImageData2D& image) {
+    CORRADE_INTERNAL_ASSERT(isSupported(image));
+
+    const std::size_t alignment = image.storage().alignment();
+    const std::size_t rowStride = (image.size().x()*3 + alignment - 1)/alignment*alignment;
+#ifndef MAGNUM_TARGET_GLES
+    const bool bgr = image.format() == PixelFormat::BGR;
+#else
+    const bool bgr = false;
+#endif
+    return cook(key, image.size(), image.data(), rowStride, bgr);
+}
@@ -0,0 +1,119 @@
+#if !defined(TEXTURECACHE_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define TEXTURECACHE_H
+
+#include <string>
+#include <vector>
+
+#include <Corrade/Containers/Array.h>
+#include <Corrade/Utility/Directory.h>
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Vector2.h>
+#include <Magnum/Trade/Trade.h>
+
+using namespace Magnum;
+
+class ThreadPool;
+
+enum class TextureCompression: UnsignedInt {
+    None = 0,   /**< RGB8, tightly packed rows */
+    Bc1 = 1     /**< BC1 / S3TC DXT1 */
+};
+
+/**
+Texture with its whole mip chain, cooked into the layout the GPU wants. Data
+are either memory-mapped from the cache file or, if the cache couldn't be
+written, owned in memory.
+*/
+class CookedTexture {
+public:
+    struct Level {
+        Vector2i size;
+        std::size_t offset, dataSize;
+    };
+
+    explicit CookedTexture() = default;
+
+    explicit operator bool() const { return !_levels.empty(); }
+
+    TextureCompression compression() const { return _compression; }
+    const std::vector<Level>& levels() const { return _levels; }
+    Vector2i size() const { return _levels.empty() ? Vector2i{} : _levels[0].size; }
+
+    /* Data of given level */
+    Containers::ArrayView<const char> data(std::size_t level) const;
+
+    /* Size of all levels together */
+    std::size_t dataSize() const;
+
+private:
+    friend class TextureCache;
+
+    bool parse();
+    Containers::ArrayView<const char> file() const;
+
+    Containers::Array<const char, Utility::Directory::MapDeleter> _mapped;
+    Containers::Array<char> _owned;
+    TextureCompression _compression{};
+    std::vector<Level> _levels;
+};
+
+/**
+Cache of cooked textures on disk. A cooked texture is looked up by a key
+that identifies the source data, on a miss the source is cooked (full mip
+chain generated on the CPU in parallel, optionally compressed), written to
+the cache directory and returned mapped from there.
+*/
+class TextureCache {
+public:
+    explicit TextureCache(std::string directory, TextureCompression compression, ThreadPool& pool);
+
+    /* 64-bit FNV-1a, chain calls through @p seed */
+    static UnsignedLong hash(Containers::ArrayView<const char> data, UnsignedLong seed = 14695981039346656037ull);
+
+    /* File of the image named @p name in a scene from @p directory, empty
+       if there's no such file, e.g. because the image is embedded */
+    static std::string imageFile(const std::string& directory, const std::string& name);
+
+    /* Key of an image identified by the scene file it comes from and its
+       index and name in there. Contents of the external image @p file, if
+       any, are hashed in too, so editing just the texture doesn't serve the
+       stale cooked one. */
+    static UnsignedLong imageKey(UnsignedLong sceneHash, UnsignedInt image, const std::string& name, const std::string& file);
+
+    /* Whether given image can be cooked. Only 8-bit RGB and BGR is. */
+    static bool isSupported(const Trade::ImageData2D& image);
+
+    TextureCompression compression() const { return _compression; }
+
+    std::string path(UnsignedLong key) const;
+
+    /* Returns empty texture if there's no valid cache entry for the key */
+    CookedTexture open(UnsignedLong key) const;
+
+    /**
+     * Cook tightly packed RGB8 pixels. @p bgr swaps the channels on the
+     * way. Returns the texture mapped from the cache file, or kept in
+     * memory if the file couldn't be written.
+     */
+    CookedTexture cook(UnsignedLong key, const Vector2i& size, Containers::ArrayView<const char> pixels, std::size_t rowStride, bool bgr);
+
+    /* Cook an imported image, has to be supported */
+    CookedTexture cook(UnsignedLong key, const Trade::ImageData2D& image);
+
+private:
+    /* Unique name next to path(), cooked files are written there first */
+    std::string temporaryPath(UnsignedLong key) const;
+
+    std::string _directory;
+    TextureCompression _compression;
+    ThreadPool& _pool;
+};
+
+#endif
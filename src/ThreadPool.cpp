@@ -0,0 +1,161 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "ThreadPool.h"
+#include "AllocationCounter.h"
+#include "TraceRecorder.h"
+
+#include <algorithm>
+
+namespace {
+    /* Pool the calling thread is a worker of and how many jobs deep it is,
+       a job waiting for other jobs runs them nested */
+    thread_local const ThreadPool* workerOf = nullptr;
+    thread_local std::size_t jobDepth = 0;
+}
+
+ThreadPool::ThreadPool(std::size_t threadCount): _firstJob{0}, _jobCount{0}, _runningJobs{0}, _stopping{false}, _allocationCount{0} {
+    if(!threadCount)
+        threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+    _threads.reserve(threadCount);
+    for(std::size_t i = 0; i != threadCount; ++i)
+        _threads.emplace_back(&ThreadPool::run, this);
+}
+
+std::size_t ThreadPool::backgroundThreadCount() {
+    return std::max(std::thread::hardware_concurrency()/2, 1u);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        _stopping = true;
+    }
+    _jobAvailable.notify_all();
+    for(std::thread& thread: _threads)
+        thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        push(std::move(job), nullptr);
+    }
+    _jobAvailable.notify_one();
+}
+
+void ThreadPool::submit(std::atomic<std::size_t>& counter, std::function<void()> job) {
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        ++counter;
+        push(std::move(job), &counter);
+    }
+    _jobAvailable.notify_one();
+    /* A thread waiting for the counter may be asleep */
+    _jobDone.notify_all();
+}
+
+void ThreadPool::push(std::function<void()> job, std::atomic<std::size_t>* const counter) {
+    if(_jobCount == _jobs.size()) {
+        std::vector<Job> jobs(std::max(_jobs.size()*2, std::size_t{16}));
+        for(std::size_t i = 0; i != _jobCount; ++i)
+            jobs[i] = std::move(_jobs[(_firstJob + i) % _jobs.size()]);
+        _jobs = std::move(jobs);
+        _firstJob = 0;
+    }
+    Job& slot = _jobs[(_firstJob + _jobCount) % _jobs.size()];
+    slot.function = std::move(job);
+    slot.counter = counter;
+    ++_jobCount;
+}
+
+bool ThreadPool::runOne(std::unique_lock<std::mutex>& lock, const std::atomic<std::size_t>* const counter) {
+    std::size_t i = 0;
+    if(counter) while(i != _jobCount && _jobs[(_firstJob + i) % _jobs.size()].counter != counter) ++i;
+    if(i == _jobCount) return false;
+
+    Job& slot = _jobs[(_firstJob + i) % _jobs.size()];
+    std::function<void()> job = std::move(slot.function);
+    std::atomic<std::size_t>* const jobCounter = slot.counter;
+    slot.function = nullptr;
+    slot.counter = nullptr;
+
+    /* Drop the job and any holes it uncovered at the front */
+    while(_jobCount && !_jobs[_firstJob].function) {
+        _firstJob = (_firstJob + 1) % _jobs.size();
+        --_jobCount;
+    }
+    ++_runningJobs;
+
+    lock.unlock();
+    /* Only the outermost job of a worker is counted, nested ones are part
+       of it. Counted before the counter goes down, so the waiter sees it. */
+    const bool counted = AllocationCounter::isEnabled() && workerOf == this && !jobDepth;
+    const std::size_t allocationsBefore = counted ? AllocationCounter::count() : 0;
+    ++jobDepth;
+    {
+        PROFILE_ZONE("ThreadPool job");
+        job();
+    }
+    --jobDepth;
+    if(counted) _allocationCount += AllocationCounter::count() - allocationsBefore;
+    lock.lock();
+
+    /* Counted down with the lock held, so a waiter can't miss it */
+    if(jobCounter) --*jobCounter;
+    --_runningJobs;
+    _jobDone.notify_all();
+    return true;
+}
+
+void ThreadPool::run() {
+    PROFILE_THREAD_NAME("pool");
+    workerOf = this;
+
+    std::unique_lock<std::mutex> lock{_mutex};
+    for(;;) {
+        _jobAvailable.wait(lock, [this]{ return _stopping || _jobCount; });
+        if(_stopping && !_jobCount) return;
+        runOne(lock);
+    }
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock{_mutex};
+    while(_jobCount || _runningJobs) {
+        if(!runOne(lock))
+            _jobDone.wait(lock);
+    }
+}
+
+void ThreadPool::wait(const std::atomic<std::size_t>& counter) {
+    std::unique_lock<std::mutex> lock{_mutex};
+    while(counter) {
+        if(!runOne(lock, &counter))
+            _jobDone.wait(lock);
+    }
+}
+
+void ThreadPool::parallelFor(const std::size_t count, const std::function<void(std::size_t, std::size_t)>& function) {
+    if(!count) return;
+
+    const std::size_t chunkCount = std::min(count, _threads.size() + 1);
+    const std::size_t chunkSize = (count + chunkCount - 1)/chunkCount;
+    std::atomic<std::size_t> remaining{0};
+
+    /* The calling thread takes the first chunk itself */
+    for(std::size_t begin = chunkSize; begin < count; begin += chunkSize) {
+        const std::size_t end = std::min(begin + chunkSize, count);
+        submit(remaining, [&function, begin, end]{
+            function(begin, end);
+        });
+    }
+    function(0, std::min(chunkSize, count));
+
+    wait(remaining);
+}
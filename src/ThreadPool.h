@@ -0,0 +1,98 @@
+#if !defined(THREADPOOL_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+Fixed set of worker threads pulling jobs from a shared queue. Jobs can be
+submitted with a counter, a thread waiting for the counter or in
+@ref parallelFor() helps with the queued jobs of that counter instead of
+blocking. It never picks up anything else, so the frame waiting for its own
+jobs doesn't end up running a long loading job that happened to be queued
+first. Both can be called from inside a job without deadlocking. The plain
+@ref wait() also waits for the job calling it and never returns there, only
+call it from outside the pool.
+
+The queue is a ring buffer that only grows, so once it's big enough
+submitting jobs small enough for std::function to store inline doesn't
+touch the heap.
+*/
+class ThreadPool {
+public:
+    /* Zero threads means one less than the hardware concurrency, leaving a
+       core for the GL thread */
+    explicit ThreadPool(std::size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::size_t threadCount() const { return _threads.size(); }
+
+    /* Heap allocations the workers made in jobs so far. Jobs a waiting
+       thread helps with are in that thread's AllocationCounter::count()
+       instead. Always zero without SHADOWS_COUNT_ALLOCATIONS. */
+    std::size_t allocationCount() const { return _allocationCount; }
+
+    /* Half the hardware concurrency, for a second pool with background
+       work the frame never waits for */
+    static std::size_t backgroundThreadCount();
+
+    void submit(std::function<void()> job);
+
+    /* Count @p counter up and queue a job counting it down once done */
+    void submit(std::atomic<std::size_t>& counter, std::function<void()> job);
+
+    /* Wait until the queue is empty and no job is running, not from
+       inside a job */
+    void wait();
+
+    /* Help with queued jobs of @p counter until it's zero */
+    void wait(const std::atomic<std::size_t>& counter);
+
+    /**
+     * Split [0, count) into roughly equal ranges and call
+     * @p function(begin, end) for each of them in parallel. Returns once
+     * all ranges are done.
+     */
+    void parallelFor(std::size_t count, const std::function<void(std::size_t, std::size_t)>& function);
+
+private:
+    struct Job {
+        /* Empty for jobs taken out of the middle of the queue */
+        std::function<void()> function;
+        std::atomic<std::size_t>* counter;
+    };
+
+    void push(std::function<void()> job, std::atomic<std::size_t>* counter);
+    /* Run the first queued job, with @p counter the first one of that
+       counter. False if there's none. */
+    bool runOne(std::unique_lock<std::mutex>& lock, const std::atomic<std::size_t>* counter = nullptr);
+    void run();
+
+    std::vector<std::thread> _threads;
+    /* Ring buffer of _jobCount jobs starting at _firstJob. The first one is
+       never empty. */
+    std::vector<Job> _jobs;
+    std::size_t _firstJob, _jobCount;
+    std::mutex _mutex;
+    std::condition_variable _jobAvailable, _jobDone;
+    std::size_t _runningJobs;
+    bool _stopping;
+    std::atomic<std::size_t> _allocationCount;
+};
+
+#endif
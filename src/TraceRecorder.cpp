@@ -0,0 +1,200 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "TraceRecorder.h"
+
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include <Corrade/Utility/Debug.h>
+#include <Corrade/Utility/Directory.h>
+
+#include "SpscQueue.h"
+
+std::atomic<bool> TraceRecorder::_recording{false};
+const std::chrono::steady_clock::time_point TraceRecorder::_epoch = std::chrono::steady_clock::now();
+
+#ifdef SHADOWS_PROFILING
+namespace {
+    struct TraceEvent {
+        const char* name;
+        UnsignedLong begin, end;
+    };
+
+    struct ThreadEvents {
+        UnsignedInt id;
+        std::string name;
+        SpscQueue<TraceEvent, 16384> events;
+        std::atomic<std::size_t> dropped{0};
+    };
+
+    struct RecordedEvent {
+        TraceEvent event;
+        UnsignedInt thread;
+    };
+
+    /* Threads only ever get added, so a thread that exits doesn't leave a
+       dangling pointer behind */
+    struct State {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadEvents>> threads;
+
+        /* Everything before the first frame() call is frame zero */
+        UnsignedLong frame{0};
+        bool started{false};
+        UnsignedLong firstFrame{~UnsignedLong{}}, endFrame{0};
+        std::string file;
+        std::vector<RecordedEvent> recorded;
+    };
+
+    State& state() {
+        static State s;
+        return s;
+    }
+
+    ThreadEvents& threadEvents() {
+        thread_local ThreadEvents* events = nullptr;
+        if(!events) {
+            State& s = state();
+            std::unique_lock<std::mutex> lock{s.mutex};
+            s.threads.emplace_back(new ThreadEvents);
+            events = s.threads.back().get();
+            events->id = s.threads.size();
+            events->name = "thread " + std::to_string(events->id);
+        }
+        return *events;
+    }
+
+    void drain(State& s) {
+        std::unique_lock<std::mutex> lock{s.mutex};
+        for(const auto& thread: s.threads) {
+            TraceEvent event;
+            while(thread->events.pop(event))
+                s.recorded.push_back({event, thread->id});
+        }
+    }
+
+    void appendEscaped(std::ostringstream& out, const std::string& string) {
+        for(const char c: string) {
+            if(c == '"' || c == '\\') out << '\\';
+            out << c;
+        }
+    }
+
+    void write(State& s) {
+        std::ostringstream out;
+        out << "{\"traceEvents\":[\n";
+
+        std::size_t dropped = 0;
+        bool first = true;
+        {
+            std::unique_lock<std::mutex> lock{s.mutex};
+            for(const auto& thread: s.threads) {
+                if(!first) out << ",\n";
+                first = false;
+                out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->id << ",\"args\":{\"name\":\"";
+                appendEscaped(out, thread->name);
+                out << "\"}}";
+                dropped += thread->dropped.exchange(0);
+            }
+        }
+
+        /* Complete events, times in microseconds */
+        out.precision(3);
+        out << std::fixed;
+        for(const RecordedEvent& recorded: s.recorded) {
+            if(!first) out << ",\n";
+            first = false;
+            out << "{\"name\":\"";
+            appendEscaped(out, recorded.event.name);
+            out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << recorded.thread
+                << ",\"ts\":" << recorded.event.begin/1000.0
+                << ",\"dur\":" << (recorded.event.end - recorded.event.begin)/1000.0 << "}";
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+        if(!Utility::Directory::writeString(s.file, out.str()))
+            Error{} << "Cannot write trace" << s.file;
+        else {
+            Debug d;
+            d << "Trace of frames" << s.firstFrame << "to" << s.endFrame - 1 << "with" << s.recorded.size() << "zones written to" << s.file;
+            if(dropped) d << Debug::nospace << "," << dropped << "zones dropped";
+        }
+
+        s.recorded.clear();
+        s.recorded.shrink_to_fit();
+    }
+}
+
+void TraceRecorder::capture(const UnsignedLong firstFrame, const UnsignedLong frameCount, std::string file) {
+    State& s = state();
+    if(_recording) {
+        Warning{} << "A trace is being recorded already, ignoring";
+        return;
+    }
+
+    s.firstFrame = firstFrame;
+    s.endFrame = firstFrame + frameCount;
+    s.file = std::move(file);
+
+    /* Frame zero has to record from the very start */
+    if(firstFrame == 0 && !s.started) _recording = true;
+}
+
+void TraceRecorder::captureNext(const UnsignedLong frameCount, std::string file) {
+    capture(state().frame + 1, frameCount, std::move(file));
+}
+
+void TraceRecorder::frame() {
+    State& s = state();
+    if(s.started) ++s.frame;
+    else s.started = true;
+
+    if(!_recording) {
+        if(s.frame == s.firstFrame) _recording = true;
+        return;
+    }
+
+    /* Zones that ended in the previous frame are all in the rings by now,
+       ones still running on other threads are cut off */
+    if(s.frame >= s.endFrame) {
+        _recording = false;
+        drain(s);
+        write(s);
+        s.firstFrame = ~UnsignedLong{};
+        return;
+    }
+
+    drain(s);
+}
+
+void TraceRecorder::setThreadName(const char* name) {
+    ThreadEvents& events = threadEvents();
+    std::unique_lock<std::mutex> lock{state().mutex};
+    events.name = name;
+}
+
+void TraceRecorder::record(const char* name, const UnsignedLong begin, const UnsignedLong end) {
+    ThreadEvents& events = threadEvents();
+    if(!events.events.push({name, begin, end}))
+        events.dropped.fetch_add(1, std::memory_order_relaxed);
+}
+#else
+void TraceRecorder::capture(UnsignedLong, UnsignedLong, std::string) {
+    Warning{} << "Built without SHADOWS_PROFILING, no trace will be recorded";
+}
+
+void TraceRecorder::captureNext(UnsignedLong, std::string) {
+    Warning{} << "Built without SHADOWS_PROFILING, no trace will be recorded";
+}
+
+void TraceRecorder::frame() {}
+void TraceRecorder::setThreadName(const char*) {}
+void TraceRecorder::record(const char*, UnsignedLong, UnsignedLong) {}
+#endif
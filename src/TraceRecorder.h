@@ -0,0 +1,94 @@
+#if !defined(TRACERECORDER_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define TRACERECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include <Magnum/Magnum.h>
+
+#include "configure.h"
+
+using namespace Magnum;
+
+/**
+Records scoped CPU zones from any thread and writes them out as a Chrome
+trace (JSON object format, also opened by Perfetto) for a range of frames.
+
+Every thread pushes finished zones into its own lock-free ring, the GL
+thread drains them in @ref frame(). Zones are only recorded while a capture
+is running, otherwise a zone costs one relaxed atomic load. Without
+SHADOWS_PROFILING the PROFILE_* macros compile to nothing and captures only
+print a warning.
+*/
+class TraceRecorder {
+public:
+    /**
+     * Record frames [@p firstFrame, @p firstFrame + @p frameCount) and write
+     * them to @p file. Frame zero also includes everything before the first
+     * @ref frame() call, such as scene loading. Replaces a capture that
+     * didn't start yet.
+     */
+    static void capture(UnsignedLong firstFrame, UnsignedLong frameCount, std::string file);
+
+    /* Record the next @p frameCount frames */
+    static void captureNext(UnsignedLong frameCount, std::string file);
+
+    /* Mark the start of a frame, call from the GL thread */
+    static void frame();
+
+    /* Name shown for the calling thread */
+    static void setThreadName(const char* name);
+
+    static bool isRecording() { return _recording.load(std::memory_order_relaxed); }
+
+    /* Nanoseconds since the recorder started, never zero */
+    static UnsignedLong now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _epoch).count() + 1;
+    }
+
+    static void record(const char* name, UnsignedLong begin, UnsignedLong end);
+
+private:
+    static std::atomic<bool> _recording;
+    static const std::chrono::steady_clock::time_point _epoch;
+};
+
+class TraceZone {
+public:
+    /* @p name has to outlive the capture, usually a string literal */
+    explicit TraceZone(const char* name): _name{name}, _begin{TraceRecorder::isRecording() ? TraceRecorder::now() : 0} {}
+
+    ~TraceZone() {
+        if(_begin) TraceRecorder::record(_name, _begin, TraceRecorder::now());
+    }
+
+    TraceZone(const TraceZone&) = delete;
+    TraceZone& operator=(const TraceZone&) = delete;
+
+private:
+    const char* _name;
+    UnsignedLong _begin;
+};
+
+#define PROFILE_CONCATENATE_IMPLEMENTATION(a, b) a ## b
+#define PROFILE_CONCATENATE(a, b) PROFILE_CONCATENATE_IMPLEMENTATION(a, b)
+
+#ifdef SHADOWS_PROFILING
+#define PROFILE_ZONE(name) TraceZone PROFILE_CONCATENATE(_profileZone, __LINE__){name}
+#define PROFILE_THREAD_NAME(name) TraceRecorder::setThreadName(name)
+#define PROFILE_FRAME() TraceRecorder::frame()
+#else
+#define PROFILE_ZONE(name) do {} while(false)
+#define PROFILE_THREAD_NAME(name) do {} while(false)
+#define PROFILE_FRAME() do {} while(false)
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+#if !defined(TRIPLEBUFFER_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+/* Lock-free single-producer single-consumer triple buffer. The producer
+   always has a slot of its own to write to, the consumer always has a slot
+   of its own to read from and the third slot is swapped between them
+   atomically, so neither side ever waits for the other. */
+template<class T> class TripleBuffer {
+public:
+    explicit TripleBuffer(): _middle{1}, _back{2}, _front{0} {}
+
+    /* All three slots, for preallocating storage before any thread starts */
+    T* slots() { return _buffers; }
+
+    /* Producer side */
+    T& writeBuffer() { return _buffers[_back]; }
+
+    void publish() {
+        _back = _middle.exchange(_back | DirtyBit, std::memory_order_acq_rel) & IndexMask;
+    }
+
+    /* Consumer side. Returns true if a newer slot was published since the
+       last call. */
+    bool update() {
+        if(!(_middle.load(std::memory_order_relaxed) & DirtyBit))
+            return false;
+        _front = _middle.exchange(_front, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+
+    const T& readBuffer() const { return _buffers[_front]; }
+
+private:
+    enum: std::uint8_t {
+        IndexMask = 0x03,
+        DirtyBit = 0x04
+    };
+
+    T _buffers[3];
+    std::atomic<std::uint8_t> _middle;
+    std::uint8_t _back, _front;
+};
+
+#endif
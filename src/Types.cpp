@@ -4,3 +4,49 @@
    $Revision: $
    $Creator: Joaqim $
    ======================================================================== */
+
+#include "Types.h"
+
+#include <cmath>
+#include <tuple>
+
+#include <Corrade/Containers/Array.h>
+#include <Magnum/MeshTools/CompressIndices.h>
+#include <Magnum/MeshTools/Interleave.h>
+#include <Magnum/Trade/MeshData3D.h>
+
+#include "MeshSimplifier.h"
+
+void setupModel(Model& model, const Trade::MeshData3D& meshData3D) {
+    model.vertexBuffer.setData(MeshTools::interleave(meshData3D.positions(0), meshData3D.normals(0)),
+                               BufferUsage::StaticDraw);
+    model.positionBuffer.setData(meshData3D.positions(0), BufferUsage::StaticDraw);
+
+    Float maxMagnitudeSquared = 0.0f;
+    for(Vector3 position: meshData3D.positions(0)) {
+        Float magnitudeSquared = position.dot();
+
+        if(magnitudeSquared > maxMagnitudeSquared) {
+            maxMagnitudeSquared = magnitudeSquared;
+        }
+    }
+    model.radius = std::sqrt(maxMagnitudeSquared);
+    model.shadowLods.radius = model.radius;
+    model.shadowLods.setData(model.positionBuffer, MeshSimplifier::lodChain(meshData3D.indices(), meshData3D.positions(0), model.radius));
+
+    Containers::Array<char> indexData;
+    Mesh::IndexType indexType;
+    UnsignedInt indexStart, indexEnd;
+    std::tie(indexData, indexType, indexStart, indexEnd) = MeshTools::compressIndices(meshData3D.indices());
+    model.indexBuffer.setData(indexData, BufferUsage::StaticDraw);
+
+    model.mesh.setPrimitive(meshData3D.primitive())
+        .setCount(meshData3D.indices().size())
+        .addVertexBuffer(model.vertexBuffer, 0, Shaders::Phong::Position{}, Shaders::Phong::Normal{})
+        .setIndexBuffer(model.indexBuffer, 0, indexType, indexStart, indexEnd);
+
+    model.shadowMesh.setPrimitive(meshData3D.primitive())
+        .setCount(meshData3D.indices().size())
+        .addVertexBuffer(model.positionBuffer, 0, ShadowCasterShader::Position{})
+        .setIndexBuffer(model.indexBuffer, 0, indexType, indexStart, indexEnd);
+}
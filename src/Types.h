@@ -4,17 +4,34 @@
 #include <Magnum/SceneGraph/SceneGraph.h>
 #include <Magnum/Buffer.h>
 #include <Magnum/Mesh.h>
+#include <Magnum/ResourceManager.h>
+#include <Magnum/Texture.h>
+#include <Magnum/Shaders/Phong.h>
+#include <Magnum/Trade/PhongMaterialData.h>
+
+#include "ShadowCasterDrawable.h"
 
 using namespace Magnum;
 
 typedef SceneGraph::Object<SceneGraph::MatrixTransformation3D> Object3D;
 typedef SceneGraph::Scene<SceneGraph::MatrixTransformation3D> Scene3D;
 
+typedef ResourceManager<Buffer, Mesh, Texture2D, Shaders::Phong, Trade::PhongMaterialData, ShadowCasterLods> ViewerResourceManager;
+
 
 struct Model {
     Buffer indexBuffer, vertexBuffer;
     Mesh mesh;
+    /* Tightly packed positions and a mesh using just those with the same
+       index buffer, for the shadow caster passes */
+    Buffer positionBuffer;
+    Mesh shadowMesh;
+    ShadowCasterLods shadowLods;
     Float radius;
 };
 
+/* Upload an indexed mesh with positions and normals into @p model, with the
+   shadow caster mesh and its LODs */
+void setupModel(Model& model, const Trade::MeshData3D& meshData);
+
 #endif
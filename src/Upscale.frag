@@ -0,0 +1,60 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+uniform sampler2D sourceTexture;
+
+/* Rendered part of the source texture and one texel of it, in texture
+   coordinates */
+uniform vec2 sourceScale;
+uniform vec2 sourceTexelSize;
+uniform vec2 outputSize;
+uniform float sharpness;
+
+out vec4 color;
+
+void main() {
+    /* Clamped half a texel inside the rendered part, so the bilinear taps
+       never reach the unused rest of the texture */
+    vec2 uv = gl_FragCoord.xy/outputSize*sourceScale;
+    vec2 lo = 0.5*sourceTexelSize;
+    vec2 hi = sourceScale - 0.5*sourceTexelSize;
+
+    vec3 center = texture(sourceTexture, clamp(uv, lo, hi)).rgb;
+    vec3 left = texture(sourceTexture, clamp(uv - vec2(sourceTexelSize.x, 0.0), lo, hi)).rgb;
+    vec3 right = texture(sourceTexture, clamp(uv + vec2(sourceTexelSize.x, 0.0), lo, hi)).rgb;
+    vec3 down = texture(sourceTexture, clamp(uv - vec2(0.0, sourceTexelSize.y), lo, hi)).rgb;
+    vec3 up = texture(sourceTexture, clamp(uv + vec2(0.0, sourceTexelSize.y), lo, hi)).rgb;
+
+    /* Unsharp mask against the cross, limited to the neighborhood range */
+    vec3 minimum = min(center, min(min(left, right), min(down, up)));
+    vec3 maximum = max(center, max(max(left, right), max(down, up)));
+    vec3 sharpened = center + sharpness*(4.0*center - left - right - down - up);
+    color = vec4(clamp(sharpened, minimum, maximum), 1.0);
+}
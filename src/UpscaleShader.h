@@ -0,0 +1,78 @@
+#ifndef Magnum_Examples_UpscaleShader_h
+#define Magnum_Examples_UpscaleShader_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Magnum/AbstractShaderProgram.h>
+#include <Magnum/Magnum.h>
+
+namespace Magnum {
+
+/**
+@brief Sharpening upscale of a lower resolution render
+
+Draws a fullscreen triangle with no vertex data. Every output pixel takes a
+bilinear sample of the source and sharpens it against its four neighbors
+one source texel away, clamped to their range so edges don't ring.
+*/
+class UpscaleShader: public AbstractShaderProgram {
+    public:
+        explicit UpscaleShader();
+
+        /**
+         * @brief Set the source texture and the part of it to upscale
+         *
+         * @p size is the rendered area at the origin of the texture, the
+         * texture may be bigger.
+         */
+        UpscaleShader& setSourceTexture(Texture2D& texture, const Vector2i& size, const Vector2i& textureSize);
+
+        /** @brief Set the output size in pixels */
+        UpscaleShader& setOutputSize(const Vector2i& size);
+
+        /**
+         * @brief Set sharpening strength
+         *
+         * Zero is plain bilinear filtering, one is the strongest.
+         */
+        UpscaleShader& setSharpness(Float sharpness);
+
+    private:
+        enum: Int { SourceTextureLayer = 0 };
+
+        Int _sourceScaleUniform,
+            _sourceTexelSizeUniform,
+            _outputSizeUniform,
+            _sharpnessUniform;
+};
+
+}
+
+#endif
@@ -0,0 +1,201 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "VoiceManager.h"
+
+#include <cmath>
+
+#include <al.h>
+#include <Corrade/Utility/Assert.h>
+#include <Corrade/Utility/Debug.h>
+#include <Magnum/Audio/Renderer.h>
+#include <Magnum/Math/Constants.h>
+#include <Magnum/Math/Functions.h>
+
+#include "TraceRecorder.h"
+
+namespace {
+    /* How much louder than a playing emitter another one has to be to take
+       its source */
+    constexpr const Float StealMargin = 0.25f;
+    constexpr const Float ToneAmplitude = 0.25f;
+}
+
+VoiceManager::VoiceManager(const UnsignedInt voiceCount):
+_voices{new Voice[voiceCount]},
+_voiceCount{voiceCount},
+_epoch{Clock::now()},
+_emitterCount{0},
+_frame{0},
+_realCount{0},
+_audibleCount{0},
+_realizedCount{0},
+_virtualizedCount{0}
+{
+    Audio::Renderer::setDistanceModel(Audio::Renderer::DistanceModel::InverseClamped);
+
+    /* Popped from the back, voice 0 goes first */
+    _freeVoices.reserve(voiceCount);
+    for(UnsignedInt i = voiceCount; i != 0; --i) _freeVoices.push_back(i - 1);
+
+    setDistanceModel(_distanceModel);
+}
+
+void VoiceManager::setDistanceModel(const VoiceRanking::DistanceModel& model) {
+    _distanceModel = model;
+    for(std::size_t i = 0; i != _voiceCount; ++i)
+        _voices[i].source.setReferenceDistance(model.referenceDistance)
+            .setMaxDistance(model.maxDistance)
+            .setRolloffFactor(model.rolloffFactor);
+}
+
+UnsignedInt VoiceManager::addSound(const Containers::ArrayView<const Short> samples, const UnsignedInt sampleRate) {
+    _sounds.emplace_back();
+    Sound& sound = _sounds.back();
+    sound.buffer.setData(Audio::BufferFormat::Mono16, samples, sampleRate);
+    sound.duration = Float(samples.size())/sampleRate;
+    return UnsignedInt(_sounds.size() - 1);
+}
+
+UnsignedInt VoiceManager::addEmitter(const UnsignedInt sound, const Vector3& position, const Float gain, const Float priority, const bool looping) {
+    CORRADE_ASSERT(sound < _sounds.size(), "VoiceManager::addEmitter(): sound" << sound << "out of range for" << _sounds.size() << "sounds", NoVoice);
+
+    UnsignedInt emitter;
+    if(!_freeEmitters.empty()) {
+        emitter = _freeEmitters.back();
+        _freeEmitters.pop_back();
+    } else {
+        emitter = UnsignedInt(_x.size());
+        for(std::vector<Float>* array: {&_x, &_y, &_z, &_gain, &_priority, &_audibility})
+            array->push_back(0.0f);
+        _sound.push_back(0);
+        _voice.push_back(NoVoice);
+        _order.push_back(0);
+        _selectedFrame.push_back(0);
+        _startTime.push_back(0.0);
+        _flags.push_back(0);
+    }
+
+    setPosition(emitter, position);
+    _gain[emitter] = gain;
+    _priority[emitter] = priority;
+    _sound[emitter] = sound;
+    _startTime[emitter] = std::chrono::duration<Double>{Clock::now() - _epoch}.count();
+    _flags[emitter] = Alive|(looping ? Looping : 0);
+    ++_emitterCount;
+    return emitter;
+}
+
+void VoiceManager::removeEmitter(const UnsignedInt emitter) {
+    CORRADE_ASSERT(emitter < _flags.size() && (_flags[emitter] & Alive), "VoiceManager::removeEmitter(): no emitter" << emitter, );
+
+    if(_voice[emitter] != NoVoice) release(_voice[emitter]);
+
+    /* Zero gain is never audible, so it's skipped without a check */
+    _gain[emitter] = 0.0f;
+    _flags[emitter] = 0;
+    _freeEmitters.push_back(emitter);
+    --_emitterCount;
+}
+
+void VoiceManager::update(const Matrix4& listenerTransformation) {
+    PROFILE_ZONE("VoiceManager::update");
+
+    ++_frame;
+    const Double time = std::chrono::duration<Double>{Clock::now() - _epoch}.count();
+    const Vector3 listener = listenerTransformation.translation();
+    Audio::Renderer::setListenerPosition(listener);
+    Audio::Renderer::setListenerOrientation(-listenerTransformation.backward(), listenerTransformation.up());
+
+    const std::size_t count = _x.size();
+    VoiceRanking::audibility(listener, _distanceModel,
+        {_x.data(), count}, {_y.data(), count}, {_z.data(), count},
+        {_gain.data(), count}, {_priority.data(), count}, {_audibility.data(), count});
+
+    for(std::size_t i = 0; i != _voiceCount; ++i)
+        if(_voices[i].emitter != NoVoice) _audibility[_voices[i].emitter] *= 1.0f + StealMargin;
+
+    _audibleCount = VoiceRanking::selectLoudest({_audibility.data(), count}, {_order.data(), count}, _voiceCount);
+    const std::size_t selected = Math::min(_audibleCount, _voiceCount);
+    for(std::size_t i = 0; i != selected; ++i) _selectedFrame[_order[i]] = _frame;
+
+    /* Virtualize first, so their sources are free for the new ones */
+    for(UnsignedInt i = 0; i != _voiceCount; ++i) {
+        const UnsignedInt emitter = _voices[i].emitter;
+        if(emitter == NoVoice || _selectedFrame[emitter] == _frame) continue;
+        release(i);
+        ++_virtualizedCount;
+    }
+
+    for(std::size_t i = 0; i != selected; ++i) {
+        const UnsignedInt emitter = _order[i];
+
+        /* A finished one-shot emitter goes silent for good */
+        if(!(_flags[emitter] & Looping) && time - _startTime[emitter] >= _sounds[_sound[emitter]].duration) {
+            if(_voice[emitter] != NoVoice) release(_voice[emitter]);
+            _gain[emitter] = 0.0f;
+            continue;
+        }
+
+        const Vector3 position{_x[emitter], _y[emitter], _z[emitter]};
+        if(_voice[emitter] != NoVoice) {
+            _voices[_voice[emitter]].source.setPosition(position)
+                .setGain(_gain[emitter]);
+            continue;
+        }
+
+        const UnsignedInt voice = _freeVoices.back();
+        _freeVoices.pop_back();
+        _voices[voice].emitter = emitter;
+        _voice[emitter] = voice;
+
+        /* Start where it would be if it had been playing all along. OpenAL
+           keeps the offset of a stopped source for the next play. */
+        Audio::Source& source = _voices[voice].source;
+        source.setBuffer(&_sounds[_sound[emitter]].buffer)
+            .setLooping(_flags[emitter] & Looping)
+            .setPosition(position)
+            .setGain(_gain[emitter]);
+        alSourcef(source.id(), AL_SEC_OFFSET, playbackPosition(emitter, time));
+        source.play();
+        ++_realizedCount;
+    }
+
+    _realCount = _voiceCount - _freeVoices.size();
+}
+
+Float VoiceManager::playbackPosition(const UnsignedInt emitter, const Double time) const {
+    const Double elapsed = time - _startTime[emitter];
+    const Double duration = _sounds[_sound[emitter]].duration;
+    if(_flags[emitter] & Looping) return Float(std::fmod(elapsed, duration));
+    return Float(Math::min(elapsed, duration));
+}
+
+void VoiceManager::release(const UnsignedInt voice) {
+    Voice& v = _voices[voice];
+    v.source.stop();
+    v.source.setBuffer(nullptr);
+    _voice[v.emitter] = NoVoice;
+    v.emitter = NoVoice;
+    _freeVoices.push_back(voice);
+}
+
+void VoiceManager::printReport() const {
+    Debug{} << "Audio:" << _emitterCount << "emitters," << _audibleCount << "audible and" << _realCount
+            << "of" << _voiceCount << "voices playing," << _realizedCount << "emitters got a voice and"
+            << _virtualizedCount << "lost it so far";
+}
+
+std::vector<Short> VoiceManager::tone(const Float frequency, const Float duration, const UnsignedInt sampleRate) {
+    const std::size_t periods = Math::max(std::size_t(std::round(frequency*duration)), std::size_t{1});
+    const std::size_t sampleCount = std::size_t(std::round(periods*sampleRate/frequency));
+
+    std::vector<Short> samples(sampleCount);
+    for(std::size_t i = 0; i != sampleCount; ++i)
+        samples[i] = Short(std::sin(2.0f*Constants::pi()*periods*i/sampleCount)*ToneAmplitude*32767.0f);
+    return samples;
+}
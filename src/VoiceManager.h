@@ -0,0 +1,138 @@
+#if !defined(VOICEMANAGER_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define VOICEMANAGER_H
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <Corrade/Containers/ArrayView.h>
+#include <Magnum/Magnum.h>
+#include <Magnum/Audio/Buffer.h>
+#include <Magnum/Audio/Source.h>
+#include <Magnum/Math/Matrix4.h>
+
+#include "VoiceRanking.h"
+
+using namespace Magnum;
+
+/* Entity component of sound emitters, the id is from
+   VoiceManager::addEmitter() */
+struct SoundEmitter {
+    UnsignedInt id;
+};
+
+/**
+Plays any number of positional sound emitters on a fixed number of OpenAL
+sources. Every @ref update() ranks the emitters by their audibility at the
+listener, see @ref VoiceRanking::audibility(), and only the loudest get a
+source. The rest are virtual, they keep playing on a clock and pick up
+where they'd be once they get a source again. A playing emitter keeps its
+source unless another one is louder by a margin, so emitters at about the
+same distance don't trade sources every frame.
+
+Needs a current Audio::Context. Without audio hardware OpenAL Soft can
+mix into nothing with ALSOFT_DRIVERS=null.
+*/
+class VoiceManager {
+public:
+    enum: UnsignedInt {
+        DefaultVoiceCount = 32,
+        NoVoice = ~UnsignedInt{}
+    };
+
+    explicit VoiceManager(UnsignedInt voiceCount = DefaultVoiceCount);
+
+    VoiceManager(const VoiceManager&) = delete;
+    VoiceManager& operator=(const VoiceManager&) = delete;
+
+    void setDistanceModel(const VoiceRanking::DistanceModel& model);
+    const VoiceRanking::DistanceModel& distanceModel() const { return _distanceModel; }
+
+    /* Mono only, OpenAL doesn't position stereo sounds. Returns the sound
+       id. */
+    UnsignedInt addSound(Containers::ArrayView<const Short> samples, UnsignedInt sampleRate);
+
+    /* Returns the emitter id, ids of removed emitters are reused */
+    UnsignedInt addEmitter(UnsignedInt sound, const Vector3& position, Float gain = 1.0f, Float priority = 1.0f, bool looping = true);
+    void removeEmitter(UnsignedInt emitter);
+
+    void setPosition(UnsignedInt emitter, const Vector3& position) {
+        _x[emitter] = position.x();
+        _y[emitter] = position.y();
+        _z[emitter] = position.z();
+    }
+    void setGain(UnsignedInt emitter, Float gain) { _gain[emitter] = gain; }
+    /* Scales the audibility for ranking only, not the volume */
+    void setPriority(UnsignedInt emitter, Float priority) { _priority[emitter] = priority; }
+
+    /* Rank the emitters heard from @p listenerTransformation and move the
+       sources over to the loudest ones */
+    void update(const Matrix4& listenerTransformation);
+
+    std::size_t voiceCount() const { return _voiceCount; }
+    std::size_t emitterCount() const { return _emitterCount; }
+    /* As of the last update() */
+    std::size_t realCount() const { return _realCount; }
+    std::size_t audibleCount() const { return _audibleCount; }
+    /* Emitters that got or lost a source so far */
+    UnsignedLong realizedCount() const { return _realizedCount; }
+    UnsignedLong virtualizedCount() const { return _virtualizedCount; }
+
+    void printReport() const;
+
+    /* Sine with a whole number of periods, so it loops without a click */
+    static std::vector<Short> tone(Float frequency, Float duration, UnsignedInt sampleRate);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum: UnsignedByte {
+        Alive = 1 << 0,
+        Looping = 1 << 1
+    };
+
+    struct Sound {
+        Audio::Buffer buffer;
+        Float duration;
+    };
+
+    struct Voice {
+        Audio::Source source;
+        UnsignedInt emitter{NoVoice};
+    };
+
+    /* Seconds since the emitter started playing, wrapped for loops */
+    Float playbackPosition(UnsignedInt emitter, Double time) const;
+    void release(UnsignedInt voice);
+
+    std::unique_ptr<Voice[]> _voices;
+    std::size_t _voiceCount;
+    /* Voices without an emitter */
+    std::vector<UnsignedInt> _freeVoices;
+    std::deque<Sound> _sounds;
+    VoiceRanking::DistanceModel _distanceModel;
+    Clock::time_point _epoch;
+
+    /* One entry per emitter in each */
+    std::vector<Float> _x, _y, _z, _gain, _priority, _audibility;
+    std::vector<UnsignedInt> _sound, _voice, _order, _selectedFrame;
+    std::vector<Double> _startTime;
+    std::vector<UnsignedByte> _flags;
+    std::vector<UnsignedInt> _freeEmitters;
+    std::size_t _emitterCount;
+
+    UnsignedInt _frame;
+    std::size_t _realCount, _audibleCount;
+    UnsignedLong _realizedCount, _virtualizedCount;
+};
+
+#endif
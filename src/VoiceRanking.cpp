@@ -0,0 +1,106 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "VoiceRanking.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <Corrade/Utility/Assert.h>
+#include <Magnum/Math/Functions.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VOICERANKING_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace VoiceRanking {
+
+namespace {
+
+/* Emitters from @p i on, one at a time. Same operations in the same order
+   as the SIMD loop. */
+void audibilityTail(const Vector3& listener, const DistanceModel& model,
+    const Float* x, const Float* y, const Float* z, const Float* gain, const Float* priority,
+    Float* out, std::size_t i, const std::size_t count)
+{
+    for(; i != count; ++i) {
+        const Float dx = x[i] - listener.x();
+        const Float dy = y[i] - listener.y();
+        const Float dz = z[i] - listener.z();
+        const Float distance = std::sqrt(dx*dx + dy*dy + dz*dz);
+        const Float clamped = Math::min(Math::max(distance, model.referenceDistance), model.maxDistance);
+        const Float attenuation = model.referenceDistance/(model.referenceDistance + model.rolloffFactor*(clamped - model.referenceDistance));
+        out[i] = distance <= model.maxDistance ? gain[i]*attenuation*priority[i] : 0.0f;
+    }
+}
+
+}
+
+void audibility(const Vector3& listener, const DistanceModel& model,
+    const Containers::ArrayView<const Float> x, const Containers::ArrayView<const Float> y, const Containers::ArrayView<const Float> z,
+    const Containers::ArrayView<const Float> gain, const Containers::ArrayView<const Float> priority,
+    const Containers::ArrayView<Float> out)
+{
+    const std::size_t count = out.size();
+    CORRADE_ASSERT(x.size() == count && y.size() == count && z.size() == count && gain.size() == count && priority.size() == count,
+        "VoiceRanking::audibility(): expected" << count << "emitters in every array", );
+
+    std::size_t i = 0;
+    #ifdef VOICERANKING_SSE2
+    const __m128 lx = _mm_set1_ps(listener.x());
+    const __m128 ly = _mm_set1_ps(listener.y());
+    const __m128 lz = _mm_set1_ps(listener.z());
+    const __m128 reference = _mm_set1_ps(model.referenceDistance);
+    const __m128 maxDistance = _mm_set1_ps(model.maxDistance);
+    const __m128 rolloff = _mm_set1_ps(model.rolloffFactor);
+    for(; i + 4 <= count; i += 4) {
+        const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), lx);
+        const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), ly);
+        const __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + i), lz);
+        const __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        const __m128 clamped = _mm_min_ps(_mm_max_ps(distance, reference), maxDistance);
+        const __m128 attenuation = _mm_div_ps(reference, _mm_add_ps(reference, _mm_mul_ps(rolloff, _mm_sub_ps(clamped, reference))));
+        const __m128 audible = _mm_cmple_ps(distance, maxDistance);
+        const __m128 result = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(gain + i), attenuation), _mm_loadu_ps(priority + i));
+        _mm_storeu_ps(out + i, _mm_and_ps(result, audible));
+    }
+    #endif
+
+    audibilityTail(listener, model, x, y, z, gain, priority, out, i, count);
+}
+
+void audibilityScalar(const Vector3& listener, const DistanceModel& model,
+    const Containers::ArrayView<const Float> x, const Containers::ArrayView<const Float> y, const Containers::ArrayView<const Float> z,
+    const Containers::ArrayView<const Float> gain, const Containers::ArrayView<const Float> priority,
+    const Containers::ArrayView<Float> out)
+{
+    const std::size_t count = out.size();
+    CORRADE_ASSERT(x.size() == count && y.size() == count && z.size() == count && gain.size() == count && priority.size() == count,
+        "VoiceRanking::audibilityScalar(): expected" << count << "emitters in every array", );
+
+    audibilityTail(listener, model, x, y, z, gain, priority, out, 0, count);
+}
+
+std::size_t selectLoudest(const Containers::ArrayView<const Float> audibility, const Containers::ArrayView<UnsignedInt> indices, const std::size_t count) {
+    CORRADE_ASSERT(indices.size() >= audibility.size(),
+        "VoiceRanking::selectLoudest(): expected space for" << audibility.size() << "indices but got" << indices.size(), 0);
+
+    std::size_t audible = 0;
+    for(std::size_t i = 0; i != audibility.size(); ++i)
+        if(audibility[i] > 0.0f) indices[audible++] = UnsignedInt(i);
+
+    /* Only the split matters, not the order on either side of it */
+    if(audible > count)
+        std::nth_element(indices.begin(), indices.begin() + count, indices.begin() + audible, [&audibility](UnsignedInt a, UnsignedInt b) {
+            return audibility[a] > audibility[b];
+        });
+
+    return audible;
+}
+
+}
@@ -0,0 +1,55 @@
+#if !defined(VOICERANKING_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define VOICERANKING_H
+
+#include <cstddef>
+
+#include <Corrade/Containers/ArrayView.h>
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Vector3.h>
+
+using namespace Magnum;
+
+/* Sound emitter ranking without any audio state, so it can be benchmarked
+   without a device. The emitters are in separate arrays per component. */
+namespace VoiceRanking {
+
+/* OpenAL's inverse clamped distance model */
+struct DistanceModel {
+    Float referenceDistance{1.0f};
+    Float maxDistance{50.0f};
+    Float rolloffFactor{1.0f};
+};
+
+/**
+ * Audibility of every emitter heard from @p listener, the gain after the
+ * distance attenuation times the priority. Emitters beyond the max distance
+ * are 0. Four emitters at a time with SSE2, where it's available.
+ */
+void audibility(const Vector3& listener, const DistanceModel& model,
+    Containers::ArrayView<const Float> x, Containers::ArrayView<const Float> y, Containers::ArrayView<const Float> z,
+    Containers::ArrayView<const Float> gain, Containers::ArrayView<const Float> priority,
+    Containers::ArrayView<Float> out);
+
+/* The same one at a time, what the SIMD version is checked against */
+void audibilityScalar(const Vector3& listener, const DistanceModel& model,
+    Containers::ArrayView<const Float> x, Containers::ArrayView<const Float> y, Containers::ArrayView<const Float> z,
+    Containers::ArrayView<const Float> gain, Containers::ArrayView<const Float> priority,
+    Containers::ArrayView<Float> out);
+
+/**
+ * Put the indices of the audible emitters into @p indices, one per emitter,
+ * with the @p count loudest first in no particular order. Returns how many
+ * are audible.
+ */
+std::size_t selectLoudest(Containers::ArrayView<const Float> audibility, Containers::ArrayView<UnsignedInt> indices, std::size_t count);
+
+}
+
+#endif
@@ -0,0 +1,317 @@
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim $
+   ======================================================================== */
+
+#include "WorldStreamer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+#include <Corrade/Utility/Debug.h>
+#include <Corrade/Utility/Directory.h>
+#include <Magnum/Math/Functions.h>
+
+#include "Shadows.h"
+#include "TraceRecorder.h"
+
+namespace {
+    constexpr const char ChunkMagic[4]{'W', 'C', 'H', 'K'};
+    constexpr const UnsignedInt ChunkVersion = 1;
+    /* Objects created between looks at the clock */
+    constexpr const std::size_t CreationBatch = 8;
+    constexpr const Float ObjectHeight = 5.0f;
+
+    struct ChunkHeader {
+        char magic[4];
+        UnsignedInt version;
+        UnsignedInt objectCount;
+    };
+
+    static_assert(sizeof(WorldStreamer::ChunkObject) == 72, "chunk objects are written as they are");
+}
+
+WorldStreamer::WorldStreamer(Scene3D& scene, Shadows& shadows, std::vector<Model>& models):
+_scene(scene),
+_shadows(shadows),
+_models(models),
+_chunkSize{32.0f},
+_loadRadius{96.0f},
+_unloadHysteresis{16.0f},
+_creationBudget{1.0f},
+_residentChunkCount{0},
+_peakResidentChunkCount{0},
+_residentObjectCount{0},
+_pendingObjectCount{0},
+_loadedChunkCount{0},
+_unloadedChunkCount{0},
+_reading{false},
+_quit{false}
+{}
+
+WorldStreamer::~WorldStreamer() {
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _quit = true;
+    }
+    _condition.notify_all();
+    if(_thread.joinable()) _thread.join();
+
+    for(auto& chunk: _chunks) delete chunk.second.root;
+}
+
+void WorldStreamer::start() {
+    _thread = std::thread{&WorldStreamer::run, this};
+}
+
+UnsignedLong WorldStreamer::key(const Vector2i& chunk) {
+    return UnsignedLong(UnsignedInt(chunk.x())) << 32 | UnsignedInt(chunk.y());
+}
+
+Float WorldStreamer::distance(const Vector2i& chunk, const Vector3& position) const {
+    const Vector2 center = (Vector2{chunk} + Vector2{0.5f})*_chunkSize;
+    return (center - Vector2{position.x(), position.z()}).length();
+}
+
+void WorldStreamer::update(const Vector3& cameraPosition) {
+    PROFILE_ZONE("WorldStreamer::update");
+
+    /* Take what the loading thread has read, the vectors trade storage */
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        std::swap(_arrived, _loaded);
+    }
+    for(auto& arrived: _arrived) {
+        /* Unloaded again while it was read, or read twice */
+        auto found = _chunks.find(key(arrived.first));
+        if(found == _chunks.end() || found->second.state != State::Loading) continue;
+
+        /* Models the world knows but this run doesn't are left out */
+        Chunk& chunk = found->second;
+        chunk.objects = std::move(arrived.second);
+        chunk.objects.erase(std::remove_if(chunk.objects.begin(), chunk.objects.end(), [this](const ChunkObject& object) {
+            return object.model >= _models.size();
+        }), chunk.objects.end());
+        chunk.state = State::Creating;
+        _pendingObjectCount += chunk.objects.size();
+        _creationQueue.push_back(found->first);
+        ++_loadedChunkCount;
+    }
+    _arrived.clear();
+
+    /* Unload what got out of range, including chunks not read yet */
+    const Float unloadRadius = _loadRadius + _unloadHysteresis;
+    bool changed = false;
+    for(auto it = _chunks.begin(); it != _chunks.end(); ) {
+        if(distance(it->second.coordinates, cameraPosition) <= unloadRadius) {
+            ++it;
+            continue;
+        }
+        unload(it->second);
+        it = _chunks.erase(it);
+        changed = true;
+    }
+
+    /* Request what came into range */
+    const Vector2 position{cameraPosition.x(), cameraPosition.z()};
+    const Vector2i first{Math::floor((position - Vector2{_loadRadius})/_chunkSize)};
+    const Vector2i last{Math::floor((position + Vector2{_loadRadius})/_chunkSize)};
+    for(Int z = first.y(); z <= last.y(); ++z) for(Int x = first.x(); x <= last.x(); ++x) {
+        const Vector2i coordinates{x, z};
+        if(distance(coordinates, cameraPosition) > _loadRadius || _chunks.count(key(coordinates))) continue;
+        _chunks.emplace(key(coordinates), Chunk{coordinates, State::Loading, nullptr, {}, 0});
+        changed = true;
+    }
+
+    /* Replace the requests, nearest first. The chunk being read is skipped
+       so it isn't read twice. */
+    if(changed) {
+        _requestOrder.clear();
+        for(const auto& chunk: _chunks)
+            if(chunk.second.state == State::Loading)
+                _requestOrder.emplace_back(distance(chunk.second.coordinates, cameraPosition), chunk.second.coordinates);
+        std::sort(_requestOrder.begin(), _requestOrder.end(), [](const std::pair<Float, Vector2i>& a, const std::pair<Float, Vector2i>& b) {
+            return a.first < b.first;
+        });
+
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _requests.clear();
+            for(const auto& request: _requestOrder)
+                if(!_reading || request.second != _readingChunk)
+                    _requests.push_back(request.second);
+        }
+        _condition.notify_one();
+    }
+
+    createObjects();
+}
+
+void WorldStreamer::unload(Chunk& chunk) {
+    if(chunk.state == State::Loading) return;
+
+    if(chunk.state == State::Creating)
+        _pendingObjectCount -= chunk.objects.size() - chunk.createdCount;
+    else --_residentChunkCount;
+    _residentObjectCount -= chunk.createdCount;
+    ++_unloadedChunkCount;
+
+    /* Its key stays in the creation queue and is skipped there */
+    delete chunk.root;
+    chunk.root = nullptr;
+}
+
+void WorldStreamer::createObjects() {
+    PROFILE_ZONE("WorldStreamer::createObjects");
+
+    const auto start = std::chrono::steady_clock::now();
+    const std::chrono::duration<Float, std::milli> budget{_creationBudget};
+    std::size_t created = 0;
+
+    while(!_creationQueue.empty()) {
+        auto found = _chunks.find(_creationQueue.front());
+        if(found == _chunks.end() || found->second.state != State::Creating) {
+            _creationQueue.pop_front();
+            continue;
+        }
+
+        Chunk& chunk = found->second;
+        if(!chunk.root && !chunk.objects.empty()) chunk.root = new Object3D{&_scene};
+        while(chunk.createdCount != chunk.objects.size()) {
+            /* At least one batch every frame, so a tiny budget still gets
+               the world loaded eventually */
+            if(created && created % CreationBatch == 0 && std::chrono::steady_clock::now() - start > budget)
+                return;
+
+            const ChunkObject& object = chunk.objects[chunk.createdCount++];
+            auto* child = new Object3D{chunk.root};
+            child->setTransformation(object.transformation);
+            _shadows.addDrawable(child, _models[object.model], object.flags & Caster, object.flags & Receiver);
+            --_pendingObjectCount;
+            ++_residentObjectCount;
+            ++created;
+        }
+
+        /* The records aren't needed once the objects exist */
+        chunk.objects = {};
+        chunk.state = State::Resident;
+        _peakResidentChunkCount = Math::max(_peakResidentChunkCount, ++_residentChunkCount);
+        _creationQueue.pop_front();
+    }
+}
+
+void WorldStreamer::run() {
+    std::vector<ChunkObject> objects;
+    for(;;) {
+        Vector2i coordinates;
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _reading = false;
+            _condition.wait(lock, [this]{ return _quit || !_requests.empty(); });
+            if(_quit) return;
+
+            coordinates = _requests.front();
+            _requests.pop_front();
+            _readingChunk = coordinates;
+            _reading = true;
+        }
+
+        /* Outside of the world is an empty chunk, so it isn't asked for
+           again */
+        PROFILE_ZONE("WorldStreamer::read");
+        if(!readChunk(chunkFilename(_directory, coordinates), objects))
+            objects.clear();
+
+        std::lock_guard<std::mutex> lock{_mutex};
+        _loaded.emplace_back(coordinates, std::move(objects));
+        objects = {};
+    }
+}
+
+void WorldStreamer::printReport() const {
+    Debug{} << "World:" << _residentChunkCount << "chunks and" << _residentObjectCount
+            << "objects resident," << _peakResidentChunkCount << "chunks at most," << _pendingObjectCount
+            << "objects waiting," << _loadedChunkCount << "chunks loaded and" << _unloadedChunkCount << "unloaded so far";
+}
+
+std::string WorldStreamer::chunkFilename(const std::string& directory, const Vector2i& chunk) {
+    return Utility::Directory::join(directory, "chunk_" + std::to_string(chunk.x()) + "_" + std::to_string(chunk.y()) + ".bin");
+}
+
+bool WorldStreamer::writeChunk(const std::string& filename, const std::vector<ChunkObject>& objects) {
+    ChunkHeader header;
+    std::memcpy(header.magic, ChunkMagic, sizeof(ChunkMagic));
+    header.version = ChunkVersion;
+    header.objectCount = UnsignedInt(objects.size());
+
+    std::ofstream file{filename, std::ios::binary};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(objects.data()), objects.size()*sizeof(ChunkObject));
+    return bool(file);
+}
+
+bool WorldStreamer::readChunk(const std::string& filename, std::vector<ChunkObject>& objects) {
+    std::ifstream file{filename, std::ios::binary};
+    ChunkHeader header;
+    if(!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+       std::memcmp(header.magic, ChunkMagic, sizeof(ChunkMagic)) != 0 ||
+       header.version != ChunkVersion)
+        return false;
+
+    /* The count comes from disk, so a truncated or corrupt file must not
+       turn into a huge allocation on the loader thread */
+    const std::streamoff dataBegin = file.tellg();
+    if(!file.seekg(0, std::ios::end)) return false;
+    const std::streamoff dataSize = file.tellg() - dataBegin;
+    if(dataBegin < 0 || dataSize < 0 ||
+       UnsignedLong(dataSize) != UnsignedLong(header.objectCount)*sizeof(ChunkObject) ||
+       !file.seekg(dataBegin))
+        return false;
+
+    objects.resize(header.objectCount);
+    return bool(file.read(reinterpret_cast<char*>(objects.data()), objects.size()*sizeof(ChunkObject)));
+}
+
+std::size_t WorldStreamer::generate(const std::string& directory, const Int size, const Float chunkSize, const UnsignedInt objectsPerChunk, const UnsignedInt modelCount, const UnsignedInt seed) {
+    PROFILE_ZONE("WorldStreamer::generate");
+
+    if(!Utility::Directory::mkpath(directory)) {
+        Error{} << "Cannot create world directory" << directory;
+        return 0;
+    }
+
+    std::size_t written = 0;
+    std::vector<ChunkObject> objects;
+    for(Int z = -size/2; z != size - size/2; ++z) for(Int x = -size/2; x != size - size/2; ++x) {
+        const std::string filename = chunkFilename(directory, {x, z});
+        if(Utility::Directory::fileExists(filename)) continue;
+
+        /* Every chunk has its own sequence, so it doesn't depend on which
+           chunks were generated before */
+        std::mt19937 engine{seed ^ (UnsignedInt(x)*73856093u) ^ (UnsignedInt(z)*19349663u)};
+        std::uniform_real_distribution<Float> unit{0.0f, 1.0f};
+        const Vector2 corner = Vector2{Vector2i{x, z}}*chunkSize;
+
+        objects.clear();
+        objects.push_back({Matrix4::translation({corner.x() + chunkSize*0.5f, 0.0f, corner.y() + chunkSize*0.5f})*
+            Matrix4::scaling({chunkSize*0.5f, 1.0f, chunkSize*0.5f}), 0, Receiver});
+        for(UnsignedInt i = 0; i != objectsPerChunk; ++i)
+            objects.push_back({Matrix4::translation({
+                corner.x() + unit(engine)*chunkSize,
+                unit(engine)*ObjectHeight,
+                corner.y() + unit(engine)*chunkSize}), UnsignedInt(engine() % Math::max(modelCount, 1u)), Caster|Receiver});
+
+        if(!writeChunk(filename, objects)) {
+            Error{} << "Cannot write" << filename;
+            return written;
+        }
+        ++written;
+    }
+
+    return written;
+}
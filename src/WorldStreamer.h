@@ -0,0 +1,168 @@
+#if !defined(WORLDSTREAMER_H)
+/* ========================================================================
+   $File: $
+   $Date: $
+   $Revision: $
+   $Creator: Joaqim Planstedt $
+   ======================================================================== */
+
+#define WORLDSTREAMER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Matrix4.h>
+#include <Magnum/Math/Vector2.h>
+
+#include "Types.h"
+
+using namespace Magnum;
+
+class Shadows;
+
+/**
+Streams a world cut into square chunks on a grid in the XZ plane, one file
+per chunk in a directory. A loading thread reads the chunks within the load
+radius of the camera, @ref update() on the main thread creates their objects
+a few at a time under a time budget and deletes the chunks that got further
+than the load radius plus the hysteresis. The band keeps a camera moving
+along a chunk border from loading and unloading the same chunks over and
+over.
+
+Only the chunks in range are resident, so the memory depends on the radius
+and not on the size of the world. Reads that were overtaken by the camera
+are dropped as they come in.
+*/
+class WorldStreamer {
+public:
+    enum: UnsignedInt {
+        Caster = 1 << 0,
+        Receiver = 1 << 1
+    };
+
+    /* One object of a chunk file, the transformation is in world space */
+    struct ChunkObject {
+        Matrix4 transformation;
+        UnsignedInt model;
+        UnsignedInt flags;
+    };
+
+    /* Objects are created from @p models and registered with @p shadows */
+    explicit WorldStreamer(Scene3D& scene, Shadows& shadows, std::vector<Model>& models);
+    /* Stops the loading thread and deletes every resident chunk */
+    ~WorldStreamer();
+
+    WorldStreamer(const WorldStreamer&) = delete;
+    WorldStreamer& operator=(const WorldStreamer&) = delete;
+
+    /* Where the chunk files are, call before start() */
+    void setDirectory(const std::string& directory) { _directory = directory; }
+    const std::string& directory() const { return _directory; }
+
+    /* Edge of a chunk, has to match the one the world was generated with */
+    void setChunkSize(Float size) { _chunkSize = size; }
+    Float chunkSize() const { return _chunkSize; }
+
+    void setLoadRadius(Float radius) { _loadRadius = radius; }
+    Float loadRadius() const { return _loadRadius; }
+
+    /* Chunks are unloaded this much further than they're loaded */
+    void setUnloadHysteresis(Float distance) { _unloadHysteresis = distance; }
+    Float unloadHysteresis() const { return _unloadHysteresis; }
+
+    /* Milliseconds update() spends creating objects every frame */
+    void setCreationBudget(Float milliseconds) { _creationBudget = milliseconds; }
+    Float creationBudget() const { return _creationBudget; }
+
+    void start();
+
+    /* Pick up loaded chunks, create their objects within the budget and
+       load and unload chunks around @p cameraPosition. Never waits for the
+       loading thread. */
+    void update(const Vector3& cameraPosition);
+
+    std::size_t residentChunkCount() const { return _residentChunkCount; }
+    std::size_t peakResidentChunkCount() const { return _peakResidentChunkCount; }
+    std::size_t residentObjectCount() const { return _residentObjectCount; }
+    /* Objects of loaded chunks still waiting to be created */
+    std::size_t pendingObjectCount() const { return _pendingObjectCount; }
+    UnsignedLong loadedChunkCount() const { return _loadedChunkCount; }
+    UnsignedLong unloadedChunkCount() const { return _unloadedChunkCount; }
+
+    void printReport() const;
+
+    static std::string chunkFilename(const std::string& directory, const Vector2i& chunk);
+    static bool writeChunk(const std::string& filename, const std::vector<ChunkObject>& objects);
+    /* False if the file doesn't exist or isn't a chunk */
+    static bool readChunk(const std::string& filename, std::vector<ChunkObject>& objects);
+
+    /**
+     * Write the chunks of a world of @p size × @p size chunks around the
+     * origin that aren't in @p directory yet. Every chunk gets a ground tile
+     * using model 0 and @p objectsPerChunk random ones out of the first
+     * @p modelCount models, the same ones for the same @p seed. Returns the
+     * number of chunks written.
+     */
+    static std::size_t generate(const std::string& directory, Int size, Float chunkSize, UnsignedInt objectsPerChunk, UnsignedInt modelCount, UnsignedInt seed);
+
+private:
+    enum class State: UnsignedByte {
+        /* Requested from the loading thread */
+        Loading,
+        /* Objects being created */
+        Creating,
+        Resident
+    };
+
+    struct Chunk {
+        Vector2i coordinates;
+        State state;
+        /* Parent of the objects, deleting it deletes the drawables too */
+        Object3D* root;
+        /* Dropped once all objects are created */
+        std::vector<ChunkObject> objects;
+        std::size_t createdCount;
+    };
+
+    static UnsignedLong key(const Vector2i& chunk);
+
+    Float distance(const Vector2i& chunk, const Vector3& position) const;
+    void unload(Chunk& chunk);
+    void createObjects();
+    void run();
+
+    Scene3D& _scene;
+    Shadows& _shadows;
+    std::vector<Model>& _models;
+    std::string _directory;
+    Float _chunkSize, _loadRadius, _unloadHysteresis, _creationBudget;
+
+    /* Main thread only */
+    std::unordered_map<UnsignedLong, Chunk> _chunks;
+    /* Chunks being created, oldest first */
+    std::deque<UnsignedLong> _creationQueue;
+    std::vector<std::pair<Float, Vector2i>> _requestOrder;
+    std::vector<std::pair<Vector2i, std::vector<ChunkObject>>> _arrived;
+    std::size_t _residentChunkCount, _peakResidentChunkCount, _residentObjectCount, _pendingObjectCount;
+    UnsignedLong _loadedChunkCount, _unloadedChunkCount;
+
+    /* Shared with the loading thread. The requests are replaced whenever
+       the wanted chunks change, nearest first. */
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<Vector2i> _requests;
+    std::vector<std::pair<Vector2i, std::vector<ChunkObject>>> _loaded;
+    bool _reading, _quit;
+    Vector2i _readingChunk;
+    std::thread _thread;
+};
+
+#endif
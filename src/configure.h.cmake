@@ -34,3 +34,6 @@
 #define MAGNUM_PLUGINS_AUDIOIMPORTER_DIR "${MAGNUM_PLUGINS_AUDIOIMPORTER_DIR}"
 #define MAGNUM_PLUGINS_IMPORTER_DIR "${MAGNUM_PLUGINS_IMPORTER_DIR}"
 #endif
+
+#cmakedefine SHADOWS_PROFILING
+#cmakedefine SHADOWS_COUNT_ALLOCATIONS